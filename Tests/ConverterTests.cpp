@@ -0,0 +1,118 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "deadbeef.h"
+#include "../common.h"
+#include "playlist.h"
+#include "../plugins/converter/converter.h"
+
+extern DB_functions_t *deadbeef;
+
+#define NUM_TRACKS 8
+#define WAV_SIZE (176400 + 44) // 1 second of 16 bit stereo at 44100 Hz, and the header
+
+static int
+_get_output_path (ddb_converter_batch_t *batch, int idx, DB_playItem_t *it, char *out, int sz, void *user_data) {
+    snprintf (out, sz, "%s/ddb_converter_test_%d.wav", P_tmpdir, idx);
+    return 0;
+}
+
+static int
+_read_output (int idx, char *buffer, int size) {
+    char out[PATH_MAX];
+    _get_output_path (NULL, idx, NULL, out, sizeof (out), NULL);
+    FILE *fp = fopen (out, "rb");
+    if (!fp) {
+        return -1;
+    }
+    int res = (int)fread (buffer, 1, size, fp);
+    fclose (fp);
+    unlink (out);
+    return res;
+}
+
+// Converts the same track multiple times with the built-in wave writer,
+// which streams the decoded blocks straight to the output files.
+// Every output must be the same, whatever the number of threads.
+TEST(ConverterTests, test_BatchConvertToWav_1To4Threads_WritesSameOutputForEachTrack) {
+    ddb_converter_t *converter = (ddb_converter_t *)deadbeef->plug_get_for_id ("converter");
+    if (!converter || !PLUG_TEST_COMPAT(&converter->misc.plugin, 1, 6)) {
+        GTEST_SKIP() << "converter plugin is not available";
+    }
+
+    char path[PATH_MAX];
+    snprintf (path, sizeof (path), "%s/TestData/chirp-1sec.mp3", dbplugindir);
+
+    playlist_t *plt = plt_alloc ("testplt");
+    DB_playItem_t *items[NUM_TRACKS];
+    for (int i = 0; i < NUM_TRACKS; i++) {
+        items[i] = deadbeef->plt_insert_file2 (0, (ddb_playlist_t *)plt, NULL, path, NULL, NULL, NULL);
+        ASSERT_TRUE(items[i] != NULL);
+    }
+
+    ddb_encoder_preset_t *preset = converter->encoder_preset_alloc ();
+    preset->title = strdup ("wav");
+    preset->ext = strdup ("wav");
+    preset->encoder = strdup ("");
+    preset->method = DDB_ENCODER_METHOD_FILE;
+
+    ddb_converter_settings_t settings = {};
+    settings.output_bps = -1;
+    settings.encoder_preset = preset;
+
+    char *reference_data = (char *)malloc (WAV_SIZE + 1);
+    char *data = (char *)malloc (WAV_SIZE + 1);
+    char *reference = NULL;
+    for (int threads = 1; threads <= 4; threads *= 2) {
+        ddb_converter_batch_settings_t batch_settings = {};
+        batch_settings.num_threads = threads;
+        batch_settings.get_output_path = _get_output_path;
+
+        ddb_converter_batch_t *batch = converter->batch_start (&settings, &batch_settings, items, NUM_TRACKS);
+        ASSERT_TRUE(batch != NULL);
+        EXPECT_EQ(converter->batch_wait (batch), 0);
+
+        for (int i = 0; i < NUM_TRACKS; i++) {
+            char *buffer = reference ? data : reference_data;
+            // one extra byte, to catch anything written past the end of the track
+            EXPECT_EQ(_read_output (i, buffer, WAV_SIZE + 1), WAV_SIZE);
+            if (!reference) {
+                reference = reference_data;
+            }
+            else {
+                EXPECT_TRUE(!memcmp (data, reference, WAV_SIZE));
+            }
+        }
+    }
+    EXPECT_TRUE(reference && !memcmp (reference, "RIFF", 4));
+
+    free (reference_data);
+    free (data);
+    converter->encoder_preset_free (preset);
+    deadbeef->plt_unref ((ddb_playlist_t *)plt);
+}
@@ -140,3 +140,133 @@ TEST(CuesheetTests, test_CueWithTrackGain_SetsCueTrackGainForOneTrack) {
     pl_item_unref(cueItem);
     plt_free (plt);
 }
+
+TEST(CuesheetTests, test_EmbeddedCue_TracksShareImageTags) {
+    const char cue[] =
+        "FILE \"file.wav\" WAVE\n"
+        "TRACK 01 AUDIO\n"
+        "TITLE \"Track 1\"\n"
+        "INDEX 01 00:00:00\n"
+        "TRACK 02 AUDIO\n"
+        "TITLE \"Track 2\"\n"
+        "INDEX 01 05:50:65\n";
+
+    playlist_t *plt = plt_alloc("test");
+
+    playItem_t *it = pl_item_alloc_init ("testfile.flac", "stdflac");
+    pl_add_meta (it, "cuesheet", cue);
+    pl_add_meta (it, "title", "Image Title");
+    pl_add_meta (it, "genre", "Rock");
+    pl_add_meta (it, ":BPS", "16");
+    pl_add_meta (it, ":CHANNELS", "2");
+    plt_process_cue(plt, NULL, it, 60*10*44100, 44100);
+
+    EXPECT_EQ(plt_get_item_count(plt, PL_MAIN), 2);
+    playItem_t *first = plt->head[PL_MAIN];
+    playItem_t *second = first->next[PL_MAIN];
+
+    EXPECT_NE(first->meta_base, nullptr);
+    EXPECT_EQ(first->meta_base, second->meta_base);
+    EXPECT_EQ(strcmp (pl_find_meta (first, "title"), "Track 1"), 0);
+    EXPECT_EQ(strcmp (pl_find_meta (second, "title"), "Track 2"), 0);
+    EXPECT_EQ(strcmp (pl_find_meta (second, "genre"), "Rock"), 0);
+    EXPECT_EQ(strcmp (pl_find_meta (second, ":BPS"), "16"), 0);
+
+    // the own regular fields still come before the own properties
+    int props = 0;
+    for (DB_metaInfo_t *m = first->meta; m != first->meta_base->head; m = m->next) {
+        int is_prop = m->key[0] == ':' || m->key[0] == '_' || m->key[0] == '!';
+        EXPECT_FALSE(props && !is_prop);
+        props |= is_prop;
+    }
+
+    // changing a shared field must not affect the other track
+    pl_replace_meta (first, ":BPS", "24");
+    EXPECT_EQ(first->meta_base, nullptr);
+    EXPECT_EQ(strcmp (pl_find_meta (first, ":BPS"), "24"), 0);
+    EXPECT_EQ(strcmp (pl_find_meta (second, ":BPS"), "16"), 0);
+
+    plt_free (plt);
+}
+
+TEST(CuesheetTests, test_EmbeddedCue_TracksShareImageRegularTagNodes) {
+    const char cue[] =
+        "FILE \"file.wav\" WAVE\n"
+        "TRACK 01 AUDIO\n"
+        "TITLE \"Track 1\"\n"
+        "INDEX 01 00:00:00\n"
+        "TRACK 02 AUDIO\n"
+        "TITLE \"Track 2\"\n"
+        "INDEX 01 05:50:65\n";
+
+    playlist_t *plt = plt_alloc("test");
+
+    playItem_t *it = pl_item_alloc_init ("testfile.flac", "stdflac");
+    pl_add_meta (it, "cuesheet", cue);
+    pl_add_meta (it, "album", "Album");
+    pl_add_meta (it, "artist", "Artist");
+    pl_add_meta (it, "year", "1999");
+    pl_add_meta (it, "comment", "Comment");
+    pl_add_meta (it, ":BPS", "16");
+    plt_process_cue(plt, NULL, it, 60*10*44100, 44100);
+
+    playItem_t *first = plt->head[PL_MAIN];
+    playItem_t *second = first->next[PL_MAIN];
+
+    // each track has its own :URI and :TRACKNUM, the image tags are still stored once
+    pl_lock ();
+    static const char *keys[] = { "album", "artist", "year", "comment", ":BPS" };
+    for (size_t i = 0; i < sizeof (keys) / sizeof (keys[0]); i++) {
+        DB_metaInfo_t *m = pl_meta_for_key (first, keys[i]);
+        EXPECT_NE(m, nullptr);
+        EXPECT_EQ(m, pl_meta_for_key (second, keys[i]));
+    }
+    EXPECT_NE(pl_meta_for_key (first, ":TRACKNUM"), pl_meta_for_key (second, ":TRACKNUM"));
+    pl_unlock ();
+
+    plt_free (plt);
+}
+
+TEST(CuesheetTests, test_EmbeddedCue_DeletePropertiesWhileIterating_AllDeleted) {
+    const char cue[] =
+        "FILE \"file.wav\" WAVE\n"
+        "TRACK 01 AUDIO\n"
+        "TITLE \"Track 1\"\n"
+        "INDEX 01 00:00:00\n"
+        "TRACK 02 AUDIO\n"
+        "TITLE \"Track 2\"\n"
+        "INDEX 01 05:50:65\n";
+
+    playlist_t *plt = plt_alloc("test");
+
+    playItem_t *it = pl_item_alloc_init ("testfile.flac", "stdflac");
+    pl_add_meta (it, "cuesheet", cue);
+    pl_add_meta (it, ":BPS", "16");
+    pl_add_meta (it, ":CHANNELS", "2");
+    pl_add_meta (it, "!TITLE", "Override");
+    plt_process_cue(plt, NULL, it, 60*10*44100, 44100);
+
+    playItem_t *first = plt->head[PL_MAIN];
+    playItem_t *second = first->next[PL_MAIN];
+    EXPECT_NE(first->meta_base, nullptr);
+
+    // the same loop as the converter uses to strip the properties
+    DB_metaInfo_t *m = pl_get_metadata_head (first);
+    while (m) {
+        DB_metaInfo_t *next = m->next;
+        if (m->key[0] == ':' || m->key[0] == '!') {
+            pl_delete_metadata (first, m);
+        }
+        m = next;
+    }
+
+    for (m = first->meta; m; m = m->next) {
+        EXPECT_NE(m->key[0], ':');
+        EXPECT_NE(m->key[0], '!');
+    }
+    EXPECT_EQ(strcmp (pl_find_meta (first, "title"), "Track 1"), 0);
+    EXPECT_EQ(strcmp (pl_find_meta (second, ":BPS"), "16"), 0);
+    EXPECT_EQ(strcmp (pl_find_meta_raw (second, "!TITLE"), "Override"), 0);
+
+    plt_free (plt);
+}
@@ -0,0 +1,124 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "decodeinfo.h"
+
+class DecodeInfoTests: public ::testing::Test {
+protected:
+    void SetUp() override {
+        snprintf (_path, sizeof (_path), "%s/decodeinfo_test.bin", P_tmpdir);
+        FILE *fp = fopen (_path, "wb");
+        fwrite ("data", 1, 4, fp);
+        fclose (fp);
+
+        snprintf (_cachePath, sizeof (_cachePath), "%s/decodeinfo_test.cache", P_tmpdir);
+
+        decode_info_cache_clear ();
+    }
+
+    void TearDown() override {
+        decode_info_cache_clear ();
+        unlink (_path);
+        unlink (_cachePath);
+    }
+
+    void setInfo() {
+        ddb_decode_info_t info = {0};
+        info.totalsamples = 88200;
+        info.duration = 2;
+        info.delay = 529;
+        info.padding = 1080;
+        info.fmt.samplerate = 44100;
+        info.fmt.channels = 2;
+        info.seekpoints = _seekpoints;
+        info.num_seekpoints = 2;
+        info.extra = "extra";
+        info.extra_size = 6;
+        EXPECT_EQ(decode_info_set (_path, "test", &info), 0);
+    }
+
+    char _path[PATH_MAX];
+    char _cachePath[PATH_MAX];
+    ddb_seekpoint_t _seekpoints[2] = { { 1152, 417 }, { 2304, 835 } };
+};
+
+TEST_F(DecodeInfoTests, test_GetAfterSet_ReturnsStoredInfo) {
+    setInfo ();
+
+    ddb_decode_info_t *info = decode_info_get (_path, "test");
+    ASSERT_TRUE(info != NULL);
+    EXPECT_EQ(info->totalsamples, 88200);
+    EXPECT_EQ(info->duration, 2);
+    EXPECT_EQ(info->delay, 529);
+    EXPECT_EQ(info->padding, 1080);
+    EXPECT_EQ(info->fmt.samplerate, 44100);
+    EXPECT_EQ(info->fmt.channels, 2);
+    ASSERT_EQ(info->num_seekpoints, 2);
+    EXPECT_EQ(info->seekpoints[1].sample, 2304);
+    EXPECT_EQ(info->seekpoints[1].offset, 835);
+    ASSERT_EQ(info->extra_size, 6);
+    EXPECT_STREQ((const char *)info->extra, "extra");
+    decode_info_free (info);
+}
+
+TEST_F(DecodeInfoTests, test_GetWithAnotherDecoder_ReturnsNull) {
+    setInfo ();
+
+    EXPECT_TRUE(decode_info_get (_path, "other") == NULL);
+}
+
+TEST_F(DecodeInfoTests, test_GetAfterFileModified_ReturnsNull) {
+    setInfo ();
+
+    struct timeval tv[2] = { { 1000, 0 }, { 1000, 0 } };
+    utimes (_path, tv);
+
+    EXPECT_TRUE(decode_info_get (_path, "test") == NULL);
+}
+
+TEST_F(DecodeInfoTests, test_SetForRemoteFile_Fails) {
+    ddb_decode_info_t info = {0};
+    EXPECT_EQ(decode_info_set ("http://example.com/test.mp3", "test", &info), -1);
+}
+
+TEST_F(DecodeInfoTests, test_SaveAndLoad_RestoresEntries) {
+    setInfo ();
+
+    EXPECT_EQ(decode_info_cache_save (_cachePath), 0);
+    decode_info_cache_clear ();
+    EXPECT_TRUE(decode_info_get (_path, "test") == NULL);
+
+    EXPECT_EQ(decode_info_cache_load (_cachePath), 0);
+
+    ddb_decode_info_t *info = decode_info_get (_path, "test");
+    ASSERT_TRUE(info != NULL);
+    EXPECT_EQ(info->totalsamples, 88200);
+    ASSERT_EQ(info->num_seekpoints, 2);
+    EXPECT_EQ(info->seekpoints[0].offset, 417);
+    EXPECT_STREQ((const char *)info->extra, "extra");
+    decode_info_free (info);
+}
@@ -23,6 +23,13 @@
 
 #include "ConvertUTF.h"
 #include "junklib.h"
+#include "playlist.h"
+#include "plmeta.h"
+#include "vfs.h"
+#include "../common.h"
+#include <dirent.h>
+#include <unistd.h>
+#include <string>
 #include <gtest/gtest.h>
 
 extern "C" {
@@ -288,3 +295,148 @@ TEST(JunklibTests, test_junkMakeTdrcString_bufferTooSmallForDate_outputEmpty) {
 
     EXPECT_TRUE(!strcmp(buffer, ""));
 }
+
+static void
+_write_id3v23_frame (FILE *fp, const char *id, const void *data, uint32_t size) {
+    uint8_t header[10] = {
+        (uint8_t)id[0], (uint8_t)id[1], (uint8_t)id[2], (uint8_t)id[3],
+        (uint8_t)(size >> 24), (uint8_t)(size >> 16), (uint8_t)(size >> 8), (uint8_t)size,
+        0, 0
+    };
+    fwrite (header, 1, sizeof (header), fp);
+    fwrite (data, 1, size, fp);
+}
+
+// Writes an id3v2.3 tag with a title, a picture of the given size, and an artist
+static void
+_write_tag_with_picture (const char *path, uint32_t picture_size) {
+    FILE *fp = fopen (path, "w+b");
+    const char title[] = "\0Title";
+    const char artist[] = "\0Artist";
+    uint32_t apic_size = 14 + picture_size;
+    uint8_t *apic = (uint8_t *)calloc (1, apic_size);
+    memcpy (apic, "\0image/jpeg\0\3\0", 14);
+
+    uint32_t size = 10 + sizeof (title) - 1 + 10 + apic_size + 10 + sizeof (artist) - 1;
+    uint8_t header[10] = {
+        'I', 'D', '3', 3, 0, 0,
+        (uint8_t)((size >> 21) & 0x7f), (uint8_t)((size >> 14) & 0x7f), (uint8_t)((size >> 7) & 0x7f), (uint8_t)(size & 0x7f)
+    };
+    fwrite (header, 1, sizeof (header), fp);
+    _write_id3v23_frame (fp, "TIT2", title, sizeof (title) - 1);
+    _write_id3v23_frame (fp, "APIC", apic, apic_size);
+    _write_id3v23_frame (fp, "TPE1", artist, sizeof (artist) - 1);
+    fclose (fp);
+    free (apic);
+}
+
+TEST(JunklibTests, test_Id3v2ReadWithLargePicture_ReadsTextFramesAroundPicture) {
+    char path[PATH_MAX];
+    snprintf (path, sizeof (path), "%s/junklib_picture_test.mp3", P_tmpdir);
+    _write_tag_with_picture (path, 5*1024*1024);
+
+    DB_FILE *fp = vfs_fopen (path);
+    ASSERT_TRUE(fp != NULL);
+
+    playItem_t *it = pl_item_alloc ();
+    EXPECT_EQ(junk_id3v2_read (it, fp), 0);
+    EXPECT_STREQ(pl_find_meta (it, "title"), "Title");
+    EXPECT_STREQ(pl_find_meta (it, "artist"), "Artist");
+    EXPECT_TRUE(pl_get_item_flags (it) & DDB_TAG_ID3V23);
+    pl_item_unref (it);
+
+    vfs_fclose (fp);
+    unlink (path);
+}
+
+TEST(JunklibTests, test_Id3v2ReadFullWithPicture_KeepsPictureFrame) {
+    char path[PATH_MAX];
+    snprintf (path, sizeof (path), "%s/junklib_picture_full_test.mp3", P_tmpdir);
+    _write_tag_with_picture (path, 1000);
+
+    DB_FILE *fp = vfs_fopen (path);
+    ASSERT_TRUE(fp != NULL);
+
+    DB_id3v2_tag_t tag = {0};
+    EXPECT_EQ(junk_id3v2_read_full (NULL, &tag, fp), 0);
+
+    const char *ids[] = { "TIT2", "APIC", "TPE1" };
+    int count = 0;
+    for (DB_id3v2_frame_t *f = tag.frames; f; f = f->next, count++) {
+        ASSERT_TRUE(count < 3);
+        EXPECT_STREQ(f->id, ids[count]);
+    }
+    EXPECT_EQ(count, 3);
+    EXPECT_EQ(tag.frames->next->size, 1014);
+
+    junk_id3v2_free (&tag);
+    vfs_fclose (fp);
+    unlink (path);
+}
+
+#define NUM_IMPORT_PASSES 3
+
+static std::string
+_import_tags (DB_FILE *fp) {
+    playItem_t *it = pl_item_alloc ();
+    junk_apev2_read (it, fp);
+    junk_id3v2_read (it, fp);
+    junk_id3v1_read (it, fp);
+
+    std::string res;
+    for (DB_metaInfo_t *m = it->meta; m; m = m->next) {
+        res += m->key;
+        res += '=';
+        res.append (m->value, m->valuesize);
+        res += '\n';
+    }
+    pl_item_unref (it);
+    return res;
+}
+
+// Reads the tags of all TestData files, the same way as the decoder plugins do on import.
+// Each import must give the same metadata, whatever was read before it.
+TEST(JunklibTests, test_ImportTagsFromTestData_RepeatedImportsGiveSameMetadata) {
+    char dir[PATH_MAX];
+    snprintf (dir, sizeof (dir), "%s/TestData", dbplugindir);
+
+    DB_FILE *files[100];
+    std::string tags[100];
+    int count = 0;
+    DIR *d = opendir (dir);
+    ASSERT_TRUE(d != NULL);
+    struct dirent *e;
+    while (count < 100 && (e = readdir (d)) != NULL) {
+        const char *ext = strrchr (e->d_name, '.');
+        if (!ext || strcasecmp (ext, ".mp3")) {
+            continue;
+        }
+        char path[PATH_MAX];
+        snprintf (path, sizeof (path), "%s/%s", dir, e->d_name);
+        DB_FILE *fp = vfs_fopen (path);
+        if (fp) {
+            files[count++] = fp;
+        }
+    }
+    closedir (d);
+    ASSERT_TRUE(count > 0);
+
+    int tagged = 0;
+    for (int i = 0; i < count; i++) {
+        tags[i] = _import_tags (files[i]);
+        if (tags[i].find ("title=") != std::string::npos) {
+            tagged++;
+        }
+    }
+    EXPECT_GT(tagged, 0);
+
+    for (int pass = 0; pass < NUM_IMPORT_PASSES; pass++) {
+        for (int i = count - 1; i >= 0; i--) {
+            EXPECT_EQ(_import_tags (files[i]), tags[i]);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        vfs_fclose (files[i]);
+    }
+}
@@ -0,0 +1,162 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2024 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <gtest/gtest.h>
+#include "../plugins/gtkui/playlist/listviewregroup.h"
+
+// three albums of three items each
+static const listview_group_key_t albums[] = {
+    { 0, "A" },
+    { 3, "B" },
+    { 6, "C" },
+};
+
+TEST(ListviewRegroupTests, test_AppendNewAlbum_KeepsAllGroups) {
+    listview_regroup_range_t range;
+    listview_regroup_find_range (albums, 3, 9, 11, 9, 0, "D", "D", &range);
+    EXPECT_EQ(range.first_group, 3);
+    EXPECT_EQ(range.last_group, 2);
+    EXPECT_EQ(range.first_item, 9);
+    EXPECT_EQ(range.item_count, 2);
+}
+
+TEST(ListviewRegroupTests, test_AppendTracksOfLastAlbum_RegroupsLastGroup) {
+    listview_regroup_range_t range;
+    listview_regroup_find_range (albums, 3, 9, 11, 9, 0, "C", "C", &range);
+    EXPECT_EQ(range.first_group, 2);
+    EXPECT_EQ(range.last_group, 2);
+    EXPECT_EQ(range.first_item, 6);
+    EXPECT_EQ(range.item_count, 5);
+}
+
+TEST(ListviewRegroupTests, test_InsertAlbumBetweenGroups_KeepsNeighbours) {
+    listview_regroup_range_t range;
+    listview_regroup_find_range (albums, 3, 9, 11, 3, 6, "X", "X", &range);
+    EXPECT_EQ(range.first_group, 1);
+    EXPECT_EQ(range.last_group, 0);
+    EXPECT_EQ(range.first_item, 3);
+    EXPECT_EQ(range.item_count, 2);
+}
+
+TEST(ListviewRegroupTests, test_InsertAlbumBetweenGroupsWithSameTitle_MergesWithBoth) {
+    listview_regroup_range_t range;
+    listview_regroup_find_range (albums, 3, 9, 11, 3, 6, "A", "B", &range);
+    EXPECT_EQ(range.first_group, 0);
+    EXPECT_EQ(range.last_group, 1);
+    EXPECT_EQ(range.first_item, 0);
+    EXPECT_EQ(range.item_count, 8);
+}
+
+TEST(ListviewRegroupTests, test_InsertIntoGroup_RegroupsOnlyThatGroup) {
+    listview_regroup_range_t range;
+    listview_regroup_find_range (albums, 3, 9, 10, 4, 5, "B", "B", &range);
+    EXPECT_EQ(range.first_group, 1);
+    EXPECT_EQ(range.last_group, 1);
+    EXPECT_EQ(range.first_item, 3);
+    EXPECT_EQ(range.item_count, 4);
+}
+
+TEST(ListviewRegroupTests, test_RemoveGroup_RemovesOnlyThatGroup) {
+    listview_regroup_range_t range;
+    listview_regroup_find_range (albums, 3, 9, 6, 3, 3, NULL, NULL, &range);
+    EXPECT_EQ(range.first_group, 1);
+    EXPECT_EQ(range.last_group, 1);
+    EXPECT_EQ(range.first_item, 3);
+    EXPECT_EQ(range.item_count, 0);
+}
+
+TEST(ListviewRegroupTests, test_RemoveGroupBetweenSameTitles_MergesNeighbours) {
+    const listview_group_key_t groups[] = {
+        { 0, "A" },
+        { 3, "B" },
+        { 6, "A" },
+    };
+    listview_regroup_range_t range;
+    listview_regroup_find_range (groups, 3, 9, 6, 3, 3, NULL, NULL, &range);
+    EXPECT_EQ(range.first_group, 0);
+    EXPECT_EQ(range.last_group, 2);
+    EXPECT_EQ(range.first_item, 0);
+    EXPECT_EQ(range.item_count, 6);
+}
+
+TEST(ListviewRegroupTests, test_RemoveEndOfGroup_RegroupsOnlyThatGroup) {
+    listview_regroup_range_t range;
+    listview_regroup_find_range (albums, 3, 9, 8, 5, 3, NULL, NULL, &range);
+    EXPECT_EQ(range.first_group, 1);
+    EXPECT_EQ(range.last_group, 1);
+    EXPECT_EQ(range.first_item, 3);
+    EXPECT_EQ(range.item_count, 2);
+}
+
+TEST(ListviewRegroupTests, test_ChangeItemInGroup_RegroupsOnlyThatGroup) {
+    listview_regroup_range_t range;
+    listview_regroup_find_range (albums, 3, 9, 9, 4, 4, "X", "X", &range);
+    EXPECT_EQ(range.first_group, 1);
+    EXPECT_EQ(range.last_group, 1);
+    EXPECT_EQ(range.first_item, 3);
+    EXPECT_EQ(range.item_count, 3);
+}
+
+TEST(ListviewRegroupTests, test_RetitleWholeGroup_MergesWithPreviousGroup) {
+    listview_regroup_range_t range;
+    listview_regroup_find_range (albums, 3, 9, 9, 3, 3, "A", "A", &range);
+    EXPECT_EQ(range.first_group, 0);
+    EXPECT_EQ(range.last_group, 1);
+    EXPECT_EQ(range.first_item, 0);
+    EXPECT_EQ(range.item_count, 6);
+}
+
+TEST(ListviewRegroupTests, test_InsertAtHead_KeepsFirstGroup) {
+    listview_regroup_range_t range;
+    listview_regroup_find_range (albums, 3, 9, 11, 0, 9, "X", "X", &range);
+    EXPECT_EQ(range.first_group, 0);
+    EXPECT_EQ(range.last_group, -1);
+    EXPECT_EQ(range.first_item, 0);
+    EXPECT_EQ(range.item_count, 2);
+}
+
+TEST(ListviewRegroupTests, test_InsertBeforeUntitledFirstGroup_RegroupsFirstGroup) {
+    const listview_group_key_t groups[] = {
+        { 0, "" },
+        { 3, "B" },
+    };
+    listview_regroup_range_t range;
+    listview_regroup_find_range (groups, 2, 6, 8, 0, 6, "X", "X", &range);
+    EXPECT_EQ(range.first_group, 0);
+    EXPECT_EQ(range.last_group, 0);
+    EXPECT_EQ(range.first_item, 0);
+    EXPECT_EQ(range.item_count, 5);
+}
+
+TEST(ListviewRegroupTests, test_RemoveFirstGroupBeforeUntitledGroup_RegroupsNewFirstGroup) {
+    const listview_group_key_t groups[] = {
+        { 0, "A" },
+        { 3, "" },
+    };
+    listview_regroup_range_t range;
+    listview_regroup_find_range (groups, 2, 6, 3, 0, 3, NULL, NULL, &range);
+    EXPECT_EQ(range.first_group, 0);
+    EXPECT_EQ(range.last_group, 1);
+    EXPECT_EQ(range.first_item, 0);
+    EXPECT_EQ(range.item_count, 3);
+}
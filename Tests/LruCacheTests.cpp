@@ -0,0 +1,150 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include "lrucache.h"
+
+static int freed_count;
+
+static void
+_free_value (void *value) {
+    freed_count++;
+    free (value);
+}
+
+static void *
+_value (int v) {
+    int *p = (int *)malloc (sizeof (int));
+    *p = v;
+    return p;
+}
+
+class LruCacheTests: public ::testing::Test {
+protected:
+    void SetUp() override {
+        freed_count = 0;
+        _cache = lru_cache_new (100, _free_value);
+    }
+    void TearDown() override {
+        if (_cache) {
+            lru_cache_free (_cache);
+        }
+    }
+    lru_cache_t *_cache;
+};
+
+TEST_F(LruCacheTests, test_SetGet_ReturnsValue) {
+    lru_cache_set (_cache, "a", _value (1), 10);
+    lru_cache_set (_cache, "b", _value (2), 10);
+    int *a = (int *)lru_cache_get (_cache, "a");
+    int *b = (int *)lru_cache_get (_cache, "b");
+    ASSERT_TRUE (a != NULL);
+    ASSERT_TRUE (b != NULL);
+    EXPECT_EQ (*a, 1);
+    EXPECT_EQ (*b, 2);
+    EXPECT_TRUE (lru_cache_get (_cache, "c") == NULL);
+
+    lru_cache_stats_t stats;
+    lru_cache_get_stats (_cache, &stats);
+    EXPECT_EQ (stats.hits, 2);
+    EXPECT_EQ (stats.misses, 1);
+    EXPECT_EQ (stats.count, 2);
+    EXPECT_EQ (stats.size, 20);
+}
+
+TEST_F(LruCacheTests, test_SetExisting_ReplacesAndFreesOldValue) {
+    lru_cache_set (_cache, "a", _value (1), 10);
+    lru_cache_set (_cache, "a", _value (2), 30);
+    EXPECT_EQ (freed_count, 1);
+    EXPECT_EQ (*(int *)lru_cache_peek (_cache, "a"), 2);
+
+    lru_cache_stats_t stats;
+    lru_cache_get_stats (_cache, &stats);
+    EXPECT_EQ (stats.count, 1);
+    EXPECT_EQ (stats.size, 30);
+}
+
+TEST_F(LruCacheTests, test_OverCapacity_EvictsLeastRecentlyUsed) {
+    lru_cache_set (_cache, "a", _value (1), 40);
+    lru_cache_set (_cache, "b", _value (2), 40);
+    // make "a" the most recently used
+    lru_cache_get (_cache, "a");
+    lru_cache_set (_cache, "c", _value (3), 40);
+
+    EXPECT_TRUE (lru_cache_contains (_cache, "a"));
+    EXPECT_FALSE (lru_cache_contains (_cache, "b"));
+    EXPECT_TRUE (lru_cache_contains (_cache, "c"));
+    EXPECT_EQ (freed_count, 1);
+
+    lru_cache_stats_t stats;
+    lru_cache_get_stats (_cache, &stats);
+    EXPECT_EQ (stats.evictions, 1);
+    EXPECT_EQ (stats.size, 80);
+}
+
+TEST_F(LruCacheTests, test_ValueLargerThanCapacity_IsKept) {
+    lru_cache_set (_cache, "a", _value (1), 10);
+    lru_cache_set (_cache, "big", _value (2), 1000);
+    EXPECT_FALSE (lru_cache_contains (_cache, "a"));
+    EXPECT_TRUE (lru_cache_contains (_cache, "big"));
+}
+
+TEST_F(LruCacheTests, test_SetCapacity_Evicts) {
+    lru_cache_set (_cache, "a", _value (1), 30);
+    lru_cache_set (_cache, "b", _value (2), 30);
+    lru_cache_set (_cache, "c", _value (3), 30);
+    lru_cache_set_capacity (_cache, 50);
+    EXPECT_FALSE (lru_cache_contains (_cache, "a"));
+    EXPECT_FALSE (lru_cache_contains (_cache, "b"));
+    EXPECT_TRUE (lru_cache_contains (_cache, "c"));
+    EXPECT_EQ (freed_count, 2);
+}
+
+TEST_F(LruCacheTests, test_Remove_FreesValue) {
+    lru_cache_set (_cache, "a", _value (1), 10);
+    lru_cache_set (_cache, "b", _value (2), 10);
+    lru_cache_remove (_cache, "a");
+    EXPECT_EQ (freed_count, 1);
+    EXPECT_FALSE (lru_cache_contains (_cache, "a"));
+    EXPECT_TRUE (lru_cache_contains (_cache, "b"));
+
+    lru_cache_remove_all (_cache);
+    EXPECT_EQ (freed_count, 2);
+    EXPECT_FALSE (lru_cache_contains (_cache, "b"));
+}
+
+TEST_F(LruCacheTests, test_ManyKeys_AllFound) {
+    lru_cache_set_capacity (_cache, 100000);
+    char key[20];
+    for (int i = 0; i < 5000; i++) {
+        snprintf (key, sizeof (key), "key%d", i);
+        lru_cache_set (_cache, key, _value (i), 1);
+    }
+    for (int i = 0; i < 5000; i++) {
+        snprintf (key, sizeof (key), "key%d", i);
+        int *v = (int *)lru_cache_get (_cache, key);
+        ASSERT_TRUE (v != NULL);
+        EXPECT_EQ (*v, i);
+    }
+}
@@ -110,6 +110,44 @@ TEST(MP3ParserTests, test_2secSquareNoXHSeekTo1sec_SeeksTo1SecMinus10Packets) {
     EXPECT_EQ(info.pcmsample, 32256);
 }
 
+TEST(MP3ParserTests, test_2secSquareNoXHSeekTo1secWithSeektable_SeeksFromSeekpoint) {
+    mp3info_t info;
+    char path[PATH_MAX];
+    snprintf (path, sizeof (path), "%s/TestData/mp3parser/2sec-square-nolamehdr.mp3", dbplugindir);
+    DB_FILE *fp = vfs_fopen (path);
+    int64_t fsize = vfs_fgetlength(fp);
+    mp3seektable_t seektable = {};
+    seektable.interval = 1152*4;
+    int res = mp3_parse_file_with_seektable (&info, 0, fp, fsize, 0, 0, -1, &seektable);
+    EXPECT_TRUE(!res);
+    EXPECT_GT(seektable.count, 0);
+
+    res = mp3_parse_file_with_seektable (&info, 0, fp, fsize, 0, 0, 576+44100, &seektable);
+    EXPECT_TRUE(!res);
+    EXPECT_EQ(info.packet_offs, 5851);
+    EXPECT_EQ(info.pcmsample, 32256);
+    EXPECT_LT(info.num_reads, 5);
+}
+
+TEST(MP3ParserTests, test_2secSquareSeekTo1secWithSeektable_SeeksFromSeekpoint) {
+    mp3info_t info;
+    char path[PATH_MAX];
+    snprintf (path, sizeof (path), "%s/TestData/mp3parser/2sec-square-lamehdr.mp3", dbplugindir);
+    DB_FILE *fp = vfs_fopen (path);
+    int64_t fsize = vfs_fgetlength(fp);
+    mp3seektable_t seektable = {};
+    seektable.interval = 1152*4;
+    int res = mp3_parse_file_with_seektable (&info, 0, fp, fsize, 0, 0, -1, &seektable);
+    EXPECT_TRUE(!res);
+    EXPECT_GT(seektable.count, 0);
+
+    res = mp3_parse_file_with_seektable (&info, 0, fp, fsize, 0, 0, 576+44100, &seektable);
+    EXPECT_TRUE(!res);
+    EXPECT_EQ(info.packet_offs, 6059);
+    EXPECT_EQ(info.pcmsample, 32256);
+    EXPECT_LT(info.num_reads, 5);
+}
+
 // the file contains garbage/invalid data around the middle of the file, with packet markers.
 // we still expect the parser to deal with it
 TEST(MP3ParserTests, test_2secSquareWithGarbage_Reports88200SamplesLength) {
@@ -188,3 +226,36 @@ TEST(MP3ParserTests, test_FiniteVBRLameHdrNetworkStream_ReportsAccurateDuration)
     EXPECT_EQ_WITH_ACCURACY(info.npackets, 890, 10);
     EXPECT_LT(info.valid_packets, info.npackets);
 }
+
+// the whole file is read in a few large windows, and no byte is read twice
+TEST(MP3ParserTests, test_FullScanOfTestFiles_ReadsEachFileOnceInFewWindows) {
+    static const char *files[] = {
+        "mp3parser/2sec-square-lamehdr.mp3",
+        "mp3parser/2sec-square-nolamehdr.mp3",
+        "mp3parser/2sec-square-nolamehdr-garbage.mp3",
+        "mp3parser/cbr_rhytm_30sec.mp3",
+        "mp3parser/cbr_rhytm_30sec_lamehdr.mp3",
+        "mp3parser/vbr_rhytm_30sec.mp3",
+        "mp3parser/vbr_rhytm_30sec_lamehdr.mp3",
+        "chirp-1sec.mp3",
+        "tone1sec_id3v1.mp3",
+        "tpe1_multiline.mp3",
+        NULL
+    };
+
+    for (int i = 0; files[i]; i++) {
+        mp3info_t info;
+        char path[PATH_MAX];
+        snprintf (path, sizeof (path), "%s/TestData/%s", dbplugindir, files[i]);
+        DB_FILE *fp = vfs_fopen (path);
+        ASSERT_TRUE(fp != NULL);
+        int64_t fsize = vfs_fgetlength(fp);
+        int res = mp3_parse_file (&info, MP3_PARSE_FULLSCAN, fp, fsize, 0, 0, -1);
+        vfs_fclose (fp);
+        EXPECT_TRUE(!res) << files[i];
+        EXPECT_LE(info.num_seeks, 2) << files[i];
+        EXPECT_LT(info.num_reads, 10) << files[i];
+        EXPECT_GT(info.bytes_read, 0) << files[i];
+        EXPECT_LE(info.bytes_read, (uint64_t)fsize) << files[i];
+    }
+}
@@ -0,0 +1,167 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "deadbeef.h"
+#include "playlist.h"
+#include "plugins.h"
+#include "conf.h"
+#include "pcmcache.h"
+#include "fakein.h"
+#include <gtest/gtest.h>
+
+extern "C" DB_plugin_t * fakein_load (DB_functions_t *api);
+
+// fakein produces 2 float channels, 44100 Hz
+#define SAMPLESIZE 8
+
+class PcmCacheTests: public ::testing::Test {
+protected:
+    void SetUp() override {
+        conf_set_int ("streamer.pcm_cache_size_mb", 16);
+        pcmcache_init ();
+        _fakein = (DB_decoder_t *)fakein_load (plug_get_api ());
+        _plt = plt_alloc ("test");
+        _it = (playItem_t *)_fakein->insert ((ddb_playlist_t *)_plt, NULL, "ramp.fake");
+    }
+
+    void TearDown() override {
+        pcmcache_free ();
+        conf_set_int ("streamer.pcm_cache_size_mb", 0);
+        plt_free (_plt);
+    }
+
+    DB_fileinfo_t *openDecoder () {
+        DB_fileinfo_t *fileinfo = _fakein->open (0);
+        _fakein->init (fileinfo, DB_PLAYITEM (_it));
+        return pcmcache_wrap (_fakein, 0, _it, fileinfo);
+    }
+
+    // reads the samples, and checks that the values match the ramp at the given position
+    bool readAndVerify (DB_fileinfo_t *fileinfo, int64_t position, int count) {
+        float *buffer = (float *)malloc (count * SAMPLESIZE);
+        int rb = fileinfo->plugin->read (fileinfo, (char *)buffer, count * SAMPLESIZE);
+        bool res = rb == count * SAMPLESIZE;
+        for (int i = 0; res && i < count * 2; i++) {
+            res = buffer[i] == (float)(position * 2 + i);
+        }
+        free (buffer);
+        return res;
+    }
+
+    int64_t readToEnd (DB_fileinfo_t *fileinfo) {
+        char buffer[16384];
+        int64_t total = 0;
+        for (;;) {
+            int rb = fileinfo->plugin->read (fileinfo, buffer, sizeof (buffer));
+            total += rb;
+            if (rb != sizeof (buffer)) {
+                break;
+            }
+        }
+        return total / SAMPLESIZE;
+    }
+
+    DB_decoder_t *_fakein;
+    playlist_t *_plt;
+    playItem_t *_it;
+};
+
+TEST_F(PcmCacheTests, test_CacheDisabled_ReturnsDecoderFileinfo) {
+    conf_set_int ("streamer.pcm_cache_size_mb", 0);
+    pcmcache_configchanged ();
+
+    DB_fileinfo_t *fileinfo = _fakein->open (0);
+    _fakein->init (fileinfo, DB_PLAYITEM (_it));
+    EXPECT_EQ(pcmcache_wrap (_fakein, 0, _it, fileinfo), fileinfo);
+    _fakein->free (fileinfo);
+}
+
+TEST_F(PcmCacheTests, test_ReplayCachedTrack_DoesNotOpenDecoder) {
+    DB_fileinfo_t *fileinfo = openDecoder ();
+    int64_t samples = readToEnd (fileinfo);
+    fileinfo->plugin->free (fileinfo);
+
+    EXPECT_EQ(pcmcache_get_cached_samples (_it), samples);
+
+    int opened = fakein_get_open_count ();
+    fileinfo = pcmcache_open_cached (_fakein, 0, _it);
+    EXPECT_NE(fileinfo, nullptr);
+    EXPECT_TRUE(readAndVerify (fileinfo, 0, 1000));
+    EXPECT_EQ(readToEnd (fileinfo), samples - 1000);
+    fileinfo->plugin->free (fileinfo);
+
+    EXPECT_EQ(fakein_get_open_count (), opened);
+}
+
+TEST_F(PcmCacheTests, test_SeekWithinCachedRange_ReturnsSamplesAtSeekPosition) {
+    DB_fileinfo_t *fileinfo = openDecoder ();
+    EXPECT_TRUE(readAndVerify (fileinfo, 0, 44100));
+    fileinfo->plugin->free (fileinfo);
+
+    int opened = fakein_get_open_count ();
+    fileinfo = pcmcache_open_cached (_fakein, 0, _it);
+    fileinfo->plugin->seek_sample (fileinfo, 1234);
+    EXPECT_TRUE(readAndVerify (fileinfo, 1234, 4000));
+    fileinfo->plugin->seek (fileinfo, 0.5f);
+    EXPECT_TRUE(readAndVerify (fileinfo, 22050, 100));
+    EXPECT_EQ(fakein_get_open_count (), opened);
+    fileinfo->plugin->free (fileinfo);
+}
+
+TEST_F(PcmCacheTests, test_ReadPastCachedRange_DecodesAndJoinsRanges) {
+    DB_fileinfo_t *fileinfo = openDecoder ();
+    fileinfo->plugin->seek_sample (fileinfo, 100000);
+    EXPECT_TRUE(readAndVerify (fileinfo, 100000, 10000));
+    fileinfo->plugin->free (fileinfo);
+
+    fileinfo = openDecoder ();
+    // crosses the beginning of the cached range, and continues decoding after its end
+    EXPECT_TRUE(readAndVerify (fileinfo, 0, 150000));
+    fileinfo->plugin->free (fileinfo);
+
+    EXPECT_EQ(pcmcache_get_cached_samples (_it), 150000);
+
+    int opened = fakein_get_open_count ();
+    fileinfo = pcmcache_open_cached (_fakein, 0, _it);
+    fileinfo->plugin->seek_sample (fileinfo, 99990);
+    EXPECT_TRUE(readAndVerify (fileinfo, 99990, 50000));
+    EXPECT_EQ(fakein_get_open_count (), opened);
+    fileinfo->plugin->free (fileinfo);
+}
+
+TEST_F(PcmCacheTests, test_TrackLargerThanCache_PlaysCompletelyAndStaysWithinCapacity) {
+    conf_set_int ("streamer.pcm_cache_size_mb", 1);
+    pcmcache_configchanged ();
+
+    DB_fileinfo_t *fileinfo = openDecoder ();
+    EXPECT_TRUE(readAndVerify (fileinfo, 0, 44100 * 4));
+    fileinfo->plugin->free (fileinfo);
+
+    EXPECT_TRUE(pcmcache_get_cached_samples (_it) <= 1024 * 1024 / SAMPLESIZE);
+
+    // the beginning is served from the cache, the rest is decoded again
+    fileinfo = pcmcache_open_cached (_fakein, 0, _it);
+    EXPECT_NE(fileinfo, nullptr);
+    EXPECT_TRUE(readAndVerify (fileinfo, 0, 44100 * 4));
+    fileinfo->plugin->free (fileinfo);
+}
@@ -9,6 +9,8 @@
 #include "deadbeef.h"
 #include "../common.h"
 #include "plmeta.h"
+#include "pltmeta.h"
+#include "plshuffle.h"
 #include "plugins.h"
 #include <gtest/gtest.h>
 
@@ -46,6 +48,407 @@ TEST(PlaylistTests, test_SearchFor2ndValueInMultiValueItems_FindsTheItem) {
     plt_unref (plt);
 }
 
+TEST(PlaylistTests, test_SearchForLowercaseNonAsciiValue_FindsUppercaseItem) {
+    playlist_t *plt = plt_alloc("test");
+    playItem_t *it = pl_item_alloc();
+
+    plt_insert_item(plt, NULL, it);
+
+    pl_add_meta(it, "title", "L'ÉTÉ ИНДЕЙСКОЕ");
+
+    plt_search_process(plt, "été индейское");
+
+    EXPECT_TRUE(plt->head[PL_SEARCH] != NULL);
+
+    plt_unref (plt);
+}
+
+TEST(PlaylistTests, test_SearchForCharacterWithLongerLowercase_FindsTheItem) {
+    playlist_t *plt = plt_alloc("test");
+    playItem_t *it = pl_item_alloc();
+
+    plt_insert_item(plt, NULL, it);
+
+    // U+023A is 2 bytes long, its lowercase form U+2C65 is 3 bytes long
+    pl_add_meta(it, "title", "\xc8\xba\xc8\xbaBC");
+
+    plt_search_process(plt, "\xe2\xb1\xa5\xe2\xb1\xa5bc");
+
+    EXPECT_TRUE(plt->head[PL_SEARCH] != NULL);
+
+    plt_unref (plt);
+}
+
+TEST(PlaylistTests, test_SearchAcrossMultiValueParts_DoesNotFindTheItem) {
+    playlist_t *plt = plt_alloc("test");
+    playItem_t *it = pl_item_alloc();
+
+    plt_insert_item(plt, NULL, it);
+
+    const char values[] = "value1\0value2\0";
+    pl_add_meta_full(it, "title", values, sizeof(values));
+
+    plt_search_process(plt, "1value");
+
+    EXPECT_TRUE(plt->head[PL_SEARCH] == NULL);
+
+    plt_unref (plt);
+}
+
+TEST(PlaylistTests, test_SearchForDirectoryName_DoesNotMatchUri) {
+    playlist_t *plt = plt_alloc("test");
+    playItem_t *it = pl_item_alloc_init("/music/Folder/Track.mp3", "stdmpg");
+
+    plt_insert_item(plt, NULL, it);
+    pl_item_unref(it);
+
+    plt_search_process(plt, "folder");
+    EXPECT_TRUE(plt->head[PL_SEARCH] == NULL);
+
+    plt_search_process(plt, "track.mp3");
+    EXPECT_TRUE(plt->head[PL_SEARCH] != NULL);
+
+    plt_unref (plt);
+}
+
+#pragma mark - DBPL
+
+TEST(PlaylistTests, test_SaveLoad_DBPL_RoundTripsItemsAndMetadata) {
+    playlist_t *plt = plt_alloc("test");
+
+    for (int i = 0; i < 3; i++) {
+        char uri[100];
+        snprintf (uri, sizeof (uri), "/music/track%d.mp3", i);
+        playItem_t *it = pl_item_alloc_init(uri, "stdmpg");
+        pl_add_meta(it, "title", uri);
+        pl_add_meta(it, "album", "Album");
+        const char artists[] = "Artist1\0Artist2\0";
+        pl_add_meta_full(it, "artist", artists, sizeof(artists));
+        pl_item_set_startsample(it, 0x100000000LL + i);
+        pl_item_set_endsample(it, 0x200000000LL + i);
+        plt_set_item_duration(plt, it, 10.5f + i);
+        it->_flags = DDB_IS_SUBTRACK;
+        plt_insert_item(plt, plt->tail[PL_MAIN], it);
+        pl_item_unref(it);
+    }
+    plt_add_meta(plt, "plt_key", "plt_value");
+
+    char path[PATH_MAX];
+    snprintf (path, sizeof (path), "%s/roundtrip_test.dbpl", P_tmpdir);
+    EXPECT_EQ(plt_save(plt, NULL, NULL, path, NULL, NULL, NULL), 0);
+
+    playlist_t *loaded = plt_alloc("loaded");
+    playItem_t *last = plt_load(loaded, NULL, path, NULL, NULL, NULL);
+    unlink (path);
+
+    EXPECT_TRUE(last != NULL);
+    EXPECT_EQ(loaded->count[PL_MAIN], 3);
+
+    playItem_t *orig = plt->head[PL_MAIN];
+    playItem_t *it = loaded->head[PL_MAIN];
+    for (int i = 0; i < 3 && it && orig; i++) {
+        EXPECT_EQ(pl_item_get_startsample(it), 0x100000000LL + i);
+        EXPECT_EQ(pl_item_get_endsample(it), 0x200000000LL + i);
+        EXPECT_EQ(it->_duration, orig->_duration);
+        EXPECT_EQ(it->_flags, (uint32_t)DDB_IS_SUBTRACK);
+        EXPECT_STREQ(pl_find_meta(it, ":URI"), pl_find_meta(orig, ":URI"));
+        EXPECT_STREQ(pl_find_meta(it, ":DECODER"), "stdmpg");
+        EXPECT_STREQ(pl_find_meta(it, "title"), pl_find_meta(orig, "title"));
+        EXPECT_STREQ(pl_find_meta(it, "album"), "Album");
+
+        // interned strings must be shared with the original items
+        EXPECT_EQ(pl_find_meta(it, "album"), pl_find_meta(orig, "album"));
+
+        DB_metaInfo_t *artist = pl_meta_for_key(it, "artist");
+        EXPECT_TRUE(artist != NULL);
+        if (artist) {
+            // the trailing empty part is stripped when adding
+            EXPECT_EQ(artist->valuesize, (int)sizeof("Artist1\0Artist2"));
+            EXPECT_TRUE(!memcmp(artist->value, "Artist1\0Artist2", artist->valuesize));
+        }
+
+        it = it->next[PL_MAIN];
+        orig = orig->next[PL_MAIN];
+    }
+
+    EXPECT_STREQ(plt_find_meta(loaded, "plt_key"), "plt_value");
+
+    plt_unref (loaded);
+    plt_unref (plt);
+}
+
+TEST(PlaylistTests, test_Load_TruncatedDBPL_LoadsNothing) {
+    char path[PATH_MAX];
+    snprintf (path, sizeof (path), "%s/truncated_test.dbpl", P_tmpdir);
+    FILE *fp = fopen (path, "wb");
+    const uint8_t data[] = { 'D', 'B', 'P', 'L', 1, 4, 0, 0, 100, 0, 0, 0 };
+    fwrite (data, 1, sizeof (data), fp);
+    fclose (fp);
+
+    playlist_t *plt = plt_alloc("test");
+    playItem_t *last = plt_load(plt, NULL, path, NULL, NULL, NULL);
+    unlink (path);
+
+    EXPECT_TRUE(last == NULL);
+    EXPECT_EQ(plt->count[PL_MAIN], 0);
+
+    plt_unref (plt);
+}
+
+static int
+_dbpl_count_cb (playItem_t *it, void *data) {
+    int *count = (int *)data;
+    return ++(*count) == 2 ? -1 : 0;
+}
+
+TEST(PlaylistTests, test_Load_DBPL_InsertsAfterItemAndStopsOnCallback) {
+    playlist_t *plt = plt_alloc("test");
+    for (int i = 0; i < 3; i++) {
+        char uri[100];
+        snprintf (uri, sizeof (uri), "/music/track%d.mp3", i);
+        playItem_t *it = pl_item_alloc_init(uri, "stdmpg");
+        plt_insert_item(plt, plt->tail[PL_MAIN], it);
+        pl_item_unref(it);
+    }
+
+    char path[PATH_MAX];
+    snprintf (path, sizeof (path), "%s/insert_test.dbpl", P_tmpdir);
+    EXPECT_EQ(plt_save(plt, NULL, NULL, path, NULL, NULL, NULL), 0);
+
+    playlist_t *loaded = plt_alloc("loaded");
+    playItem_t *first = pl_item_alloc_init("/music/first.mp3", "stdmpg");
+    playItem_t *second = pl_item_alloc_init("/music/second.mp3", "stdmpg");
+    plt_insert_item(loaded, NULL, first);
+    plt_insert_item(loaded, first, second);
+
+    int count = 0;
+    int abort = 0;
+    playItem_t *last = plt_load(loaded, first, path, &abort, _dbpl_count_cb, &count);
+    unlink (path);
+
+    EXPECT_EQ(count, 2);
+    EXPECT_EQ(abort, 1);
+    EXPECT_EQ(loaded->count[PL_MAIN], 4);
+    EXPECT_TRUE(first->next[PL_MAIN] != NULL);
+    if (first->next[PL_MAIN] && last) {
+        EXPECT_STREQ(pl_find_meta(first->next[PL_MAIN], ":URI"), "/music/track0.mp3");
+        EXPECT_STREQ(pl_find_meta(last, ":URI"), "/music/track1.mp3");
+        EXPECT_TRUE(last->next[PL_MAIN] == second);
+    }
+
+    pl_item_unref(first);
+    pl_item_unref(second);
+    plt_unref (loaded);
+    plt_unref (plt);
+}
+
+TEST(PlaylistTests, test_Load_NewerMinorVersionDBPL_LoadsNothing) {
+    char path[PATH_MAX];
+    snprintf (path, sizeof (path), "%s/newer_test.dbpl", P_tmpdir);
+    FILE *fp = fopen (path, "wb");
+    uint8_t data[8 + 24] = { 'D', 'B', 'P', 'L', 1, 5 };
+    fwrite (data, 1, sizeof (data), fp);
+    fclose (fp);
+
+    playlist_t *plt = plt_alloc("test");
+    playItem_t *last = plt_load(plt, NULL, path, NULL, NULL, NULL);
+    unlink (path);
+
+    EXPECT_TRUE(last == NULL);
+    EXPECT_EQ(plt->count[PL_MAIN], 0);
+
+    plt_unref (plt);
+}
+
+#pragma mark - Shuffle
+
+TEST(PlaylistTests, test_ShuffleOrder_VisitsAllItemsInRatingOrder) {
+    playlist_t *plt = plt_alloc("test");
+    for (int i = 0; i < 100; i++) {
+        playItem_t *it = pl_item_alloc();
+        plt_insert_item(plt, plt->tail[PL_MAIN], it);
+        pl_item_unref(it);
+    }
+
+    int visited = 0;
+    playItem_t *prev = NULL;
+    playItem_t *it;
+    while ((it = plt_shuffle_first(plt, INT32_MIN, 0)) != NULL) {
+        if (prev) {
+            EXPECT_TRUE(it->shufflerating >= prev->shufflerating);
+        }
+        // the previous track is the last played one
+        EXPECT_TRUE(plt_shuffle_last(plt, INT32_MAX, 1) == prev);
+        pl_set_played(it, 1);
+        prev = it;
+        visited++;
+    }
+
+    EXPECT_EQ(visited, 100);
+    EXPECT_TRUE(plt_shuffle_first(plt, INT32_MIN, 1) != NULL);
+
+    plt_unref (plt);
+}
+
+TEST(PlaylistTests, test_ShuffleOrder_RemovedItem_IsNotReturned) {
+    playlist_t *plt = plt_alloc("test");
+    for (int i = 0; i < 10; i++) {
+        playItem_t *it = pl_item_alloc();
+        plt_insert_item(plt, plt->tail[PL_MAIN], it);
+        pl_item_unref(it);
+    }
+
+    playItem_t *first = plt_shuffle_first(plt, INT32_MIN, 0);
+    plt_remove_item(plt, first);
+
+    playItem_t *next = plt_shuffle_first(plt, INT32_MIN, 0);
+    EXPECT_TRUE(next != NULL);
+    EXPECT_TRUE(next != first);
+    EXPECT_EQ(first->shuffle_count, 0);
+    EXPECT_EQ(plt->shuffle_root->shuffle_count, 9);
+
+    plt_unref (plt);
+}
+
+TEST(PlaylistTests, test_SetItemShufflerating_Negative_MovesItemFirst) {
+    playlist_t *plt = plt_alloc("test");
+    for (int i = 0; i < 10; i++) {
+        playItem_t *it = pl_item_alloc();
+        plt_insert_item(plt, plt->tail[PL_MAIN], it);
+        pl_item_unref(it);
+    }
+
+    playItem_t *last = plt_shuffle_last(plt, INT32_MAX, 0);
+    plt_set_item_shufflerating(plt, last, -1);
+
+    EXPECT_TRUE(plt_shuffle_first(plt, INT32_MIN, 0) == last);
+
+    pl_set_played(last, 1);
+    EXPECT_TRUE(plt_shuffle_last(plt, 0, 1) == last);
+    EXPECT_TRUE(plt_shuffle_first(plt, INT32_MIN, 0) != last);
+
+    plt_unref (plt);
+}
+
+TEST(PlaylistTests, test_ItemCopyShared_ModifySharedField_DoesNotAffectOriginal) {
+    playItem_t *it = pl_item_alloc_init ("file.mp3", "stdmpg");
+    pl_add_meta (it, "title", "Title");
+    pl_add_meta (it, "artist", "Artist");
+
+    playItem_t *copy = pl_item_alloc ();
+    pl_item_copy_shared (copy, it);
+
+    EXPECT_NE(copy->meta_base, nullptr);
+    EXPECT_EQ(copy->meta_base, it->meta_base);
+
+    pl_replace_meta (copy, "title", "New Title");
+    pl_delete_meta (copy, "artist");
+    pl_add_meta (it, "album", "Album");
+
+    EXPECT_EQ(copy->meta_base, nullptr);
+    EXPECT_STREQ(pl_find_meta (copy, "title"), "New Title");
+    EXPECT_EQ(pl_find_meta (copy, "artist"), nullptr);
+    EXPECT_EQ(pl_find_meta (copy, "album"), nullptr);
+    EXPECT_STREQ(pl_find_meta (it, "title"), "Title");
+    EXPECT_STREQ(pl_find_meta (it, "artist"), "Artist");
+    EXPECT_STREQ(pl_find_meta (it, "album"), "Album");
+
+    pl_item_unref (copy);
+    pl_item_unref (it);
+}
+
+static void
+_delete_properties_while_iterating (playItem_t *it) {
+    // the same loop as the converter uses to strip the properties
+    DB_metaInfo_t *m = pl_get_metadata_head (it);
+    while (m) {
+        DB_metaInfo_t *next = m->next;
+        if (m->key[0] == ':' || m->key[0] == '!' || !strcasecmp (m->key, "cuesheet")) {
+            pl_delete_metadata (it, m);
+        }
+        m = next;
+    }
+}
+
+TEST(PlaylistTests, test_ItemCopy_DeleteWhileIterating_DeletesFromCopyOnly) {
+    playItem_t *it = pl_item_alloc_init ("file.flac", "stdflac");
+    pl_add_meta (it, "title", "Title");
+    pl_add_meta (it, "cuesheet", "FILE");
+    pl_add_meta (it, "!TITLE", "Override");
+
+    playItem_t *copy = pl_item_alloc ();
+    pl_item_copy (copy, it);
+    EXPECT_EQ(copy->meta_base, nullptr);
+
+    _delete_properties_while_iterating (copy);
+
+    EXPECT_STREQ(pl_find_meta (copy, "title"), "Title");
+    EXPECT_EQ(pl_find_meta (copy, "cuesheet"), nullptr);
+    EXPECT_EQ(pl_find_meta (copy, ":URI"), nullptr);
+    EXPECT_EQ(pl_find_meta (copy, ":DECODER"), nullptr);
+    EXPECT_EQ(pl_find_meta_raw (copy, "!TITLE"), nullptr);
+    EXPECT_STREQ(pl_find_meta (it, ":URI"), "file.flac");
+    EXPECT_STREQ(pl_find_meta (it, "cuesheet"), "FILE");
+
+    pl_item_unref (copy);
+    pl_item_unref (it);
+}
+
+TEST(PlaylistTests, test_ItemCopyShared_DeleteWhileIterating_DeletesFromCopyOnly) {
+    playItem_t *it = pl_item_alloc_init ("file.flac", "stdflac");
+    pl_add_meta (it, "title", "Title");
+    pl_add_meta (it, "cuesheet", "FILE");
+    pl_add_meta (it, "!TITLE", "Override");
+
+    playItem_t *copy = pl_item_alloc ();
+    pl_item_copy_shared (copy, it);
+    EXPECT_NE(copy->meta_base, nullptr);
+
+    _delete_properties_while_iterating (copy);
+
+    EXPECT_STREQ(pl_find_meta (copy, "title"), "Title");
+    EXPECT_EQ(pl_find_meta (copy, "cuesheet"), nullptr);
+    EXPECT_EQ(pl_find_meta (copy, ":URI"), nullptr);
+    EXPECT_EQ(pl_find_meta (copy, ":DECODER"), nullptr);
+    EXPECT_EQ(pl_find_meta_raw (copy, "!TITLE"), nullptr);
+    EXPECT_STREQ(pl_find_meta (it, ":URI"), "file.flac");
+    EXPECT_STREQ(pl_find_meta (it, "cuesheet"), "FILE");
+    EXPECT_STREQ(pl_find_meta_raw (it, "!TITLE"), "Override");
+
+    pl_item_unref (copy);
+    pl_item_unref (it);
+}
+
+TEST(PlaylistTests, test_ShareCommonMeta_SubsongsKeepTheirOwnFields) {
+    playItem_t *items[3];
+    for (int i = 0; i < 3; i++) {
+        items[i] = pl_item_alloc_init ("file.nsf", "gme");
+        pl_set_meta_int (items[i], ":TRACKNUM", i);
+        pl_add_meta (items[i], "album", "Game");
+        pl_add_meta (items[i], "artist", i == 2 ? "Composer 2" : "Composer 1");
+    }
+
+    pl_items_share_common_meta (items, 3);
+
+    EXPECT_NE(items[0]->meta_base, nullptr);
+    EXPECT_EQ(items[0]->meta_base, items[2]->meta_base);
+    EXPECT_STREQ(pl_find_meta (items[1], "album"), "Game");
+    EXPECT_STREQ(pl_find_meta (items[1], ":URI"), "file.nsf");
+    EXPECT_STREQ(pl_find_meta (items[1], "artist"), "Composer 1");
+    EXPECT_STREQ(pl_find_meta (items[2], "artist"), "Composer 2");
+    EXPECT_EQ(pl_find_meta_int (items[2], ":TRACKNUM", -1), 2);
+
+    // the common regular fields are shared, even though each item has its own properties
+    pl_lock ();
+    EXPECT_EQ(pl_meta_for_key (items[0], "album"), pl_meta_for_key (items[2], "album"));
+    EXPECT_NE(pl_meta_for_key (items[0], "artist"), pl_meta_for_key (items[2], "artist"));
+    pl_unlock ();
+
+    for (int i = 0; i < 3; i++) {
+        pl_item_unref (items[i]);
+    }
+}
+
 #pragma mark - IsRelativePathPosix
 
 TEST(PlaylistTests, test_IsRelativePathPosix_AbsolutePath_False) {
@@ -0,0 +1,213 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "deadbeef.h"
+#include "replaygain.h"
+#include <math.h>
+#include <gtest/gtest.h>
+
+// The vectorized gain must produce exactly the same samples as the scalar formula.
+// Odd sample counts are used to cover the scalar tails.
+
+static const float _gains[] = { 0.25f, 0.5f, 0.891f, 1.337f, 2.f, 7.5f };
+
+class ReplayGainTests: public ::testing::Test {
+protected:
+    void SetUp() override {
+        memset (&_settings, 0, sizeof (_settings));
+        _settings._size = sizeof (_settings);
+        _settings.source_mode = DDB_RG_SOURCE_MODE_TRACK;
+        _settings.processing_flags = DDB_RG_PROCESSING_GAIN;
+        _settings.has_track_gain = 1;
+        _settings.preamp_with_rg = 1;
+        _settings.trackpeak = 1;
+        srand (1);
+    }
+
+    // same as the volume calculation in replaygain.c
+    int64_t setGain (float gain) {
+        _settings.trackgain = gain;
+        return (int)(_settings.preamp_with_rg * _settings.trackgain * 1000);
+    }
+
+    static int64_t scaleAndClip (int64_t sample, int64_t vol, int64_t min, int64_t max) {
+        sample = sample * vol / 1000;
+        return sample > max ? max : sample < min ? min : sample;
+    }
+
+    static int32_t randomInt32 (void) {
+        return (int32_t)(((uint32_t)rand () << 16) ^ (uint32_t)rand ());
+    }
+
+    ddb_replaygain_settings_t _settings;
+};
+
+TEST_F(ReplayGainTests, test_Int16AllValues_MatchesScalar) {
+    int count = 65536 + 3;
+    int16_t *samples = (int16_t *)malloc (count * sizeof (int16_t));
+    for (float gain : _gains) {
+        int64_t vol = setGain (gain);
+        for (int i = 0; i < count; i++) {
+            samples[i] = (int16_t)(i - 0x8000);
+        }
+
+        apply_replay_gain_int16 (&_settings, (char *)samples, count * sizeof (int16_t));
+
+        int mismatches = 0;
+        for (int i = 0; i < count; i++) {
+            mismatches += samples[i] != scaleAndClip ((int16_t)(i - 0x8000), vol, -0x8000, 0x7fff);
+        }
+        EXPECT_EQ(mismatches, 0);
+    }
+    free (samples);
+}
+
+TEST_F(ReplayGainTests, test_Int24_MatchesScalar) {
+    int count = 100003;
+    uint8_t *bytes = (uint8_t *)malloc (count * 3);
+    int32_t *input = (int32_t *)malloc (count * sizeof (int32_t));
+    for (float gain : _gains) {
+        int64_t vol = setGain (gain);
+        for (int i = 0; i < count; i++) {
+            input[i] = randomInt32 () >> 8;
+            bytes[i*3] = input[i] & 0xff;
+            bytes[i*3+1] = (input[i] >> 8) & 0xff;
+            bytes[i*3+2] = (input[i] >> 16) & 0xff;
+        }
+
+        apply_replay_gain_int24 (&_settings, (char *)bytes, count * 3);
+
+        int mismatches = 0;
+        for (int i = 0; i < count; i++) {
+            int32_t sample = bytes[i*3] | (bytes[i*3+1] << 8) | ((int8_t)bytes[i*3+2] << 16);
+            mismatches += sample != scaleAndClip (input[i], vol, -0x800000, 0x7fffff);
+        }
+        EXPECT_EQ(mismatches, 0);
+    }
+    free (input);
+    free (bytes);
+}
+
+TEST_F(ReplayGainTests, test_Int32_MatchesScalarAndClips) {
+    int count = 100003;
+    int32_t *samples = (int32_t *)malloc (count * sizeof (int32_t));
+    int32_t *input = (int32_t *)malloc (count * sizeof (int32_t));
+    for (float gain : _gains) {
+        int64_t vol = setGain (gain);
+        for (int i = 0; i < count; i++) {
+            input[i] = samples[i] = randomInt32 ();
+        }
+        input[0] = samples[0] = INT32_MIN;
+        input[1] = samples[1] = INT32_MAX;
+
+        apply_replay_gain_int32 (&_settings, (char *)samples, count * sizeof (int32_t));
+
+        int mismatches = 0;
+        for (int i = 0; i < count; i++) {
+            mismatches += samples[i] != scaleAndClip (input[i], vol, INT32_MIN, INT32_MAX);
+        }
+        EXPECT_EQ(mismatches, 0);
+    }
+    free (input);
+    free (samples);
+}
+
+TEST_F(ReplayGainTests, test_Float32_MatchesScalar) {
+    int count = 100003;
+    float *samples = (float *)malloc (count * sizeof (float));
+    float *input = (float *)malloc (count * sizeof (float));
+    for (float gain : _gains) {
+        setGain (gain);
+        for (int i = 0; i < count; i++) {
+            input[i] = samples[i] = (float)rand () / RAND_MAX * 2.5f - 1.25f;
+        }
+        input[0] = samples[0] = NAN;
+        input[1] = samples[1] = -0.f;
+
+        apply_replay_gain_float32 (&_settings, (char *)samples, count * sizeof (float));
+
+        int mismatches = 0;
+        for (int i = 0; i < count; i++) {
+            float sample = input[i] * gain;
+            if (sample > 1.f) {
+                sample = 1.f;
+            }
+            else if (sample < -1.f) {
+                sample = -1.f;
+            }
+            mismatches += memcmp (&samples[i], &sample, sizeof (float)) != 0;
+        }
+        EXPECT_EQ(mismatches, 0);
+    }
+    free (input);
+    free (samples);
+}
+
+// Applying the gain in blocks of odd sizes, which start at unaligned addresses,
+// must give the same result as applying it to the whole buffer at once.
+TEST_F(ReplayGainTests, test_OddBlocks_AllFormats_SameAsOneBlock) {
+    const int size = 44100 * 2 * 4; // 1 sec of 32 bit stereo
+    static const int blocksizes[] = { 1, 3, 7, 13, 257, 1001 };
+    char *whole = (char *)malloc (size);
+    char *blocks = (char *)malloc (size);
+    setGain (0.891f);
+
+    struct {
+        int samplesize;
+        void (*apply) (ddb_replaygain_settings_t *settings, char *bytes, int numbytes);
+    } formats[] = {
+        { 2, apply_replay_gain_int16 },
+        { 3, apply_replay_gain_int24 },
+        { 4, apply_replay_gain_int32 },
+        { 4, apply_replay_gain_float32 },
+    };
+
+    for (auto &f : formats) {
+        int numbytes = size / f.samplesize * f.samplesize;
+        for (int i = 0; i < size; i++) {
+            whole[i] = (char)rand ();
+        }
+        if (f.apply == apply_replay_gain_float32) {
+            for (int i = 0; i < numbytes / 4; i++) {
+                ((float *)whole)[i] = (float)rand () / RAND_MAX * 2.5f - 1.25f;
+            }
+        }
+        memcpy (blocks, whole, size);
+
+        f.apply (&_settings, whole, numbytes);
+
+        int offs = 0;
+        for (int n = 0; offs < numbytes; n++) {
+            int blocksize = blocksizes[n % (sizeof (blocksizes) / sizeof (blocksizes[0]))] * f.samplesize;
+            if (blocksize > numbytes - offs) {
+                blocksize = numbytes - offs;
+            }
+            f.apply (&_settings, blocks + offs, blocksize);
+            offs += blocksize;
+        }
+
+        EXPECT_TRUE(!memcmp (whole, blocks, size));
+    }
+    free (whole);
+    free (blocks);
+}
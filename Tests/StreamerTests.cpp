@@ -32,6 +32,7 @@
 #include "fakein.h"
 #include "fakeout.h"
 #include "playmodes.h"
+#include <unistd.h>
 #include <gtest/gtest.h>
 
 extern "C" DB_plugin_t * fakein_load (DB_functions_t *api);
@@ -321,3 +322,38 @@ TEST_F(StreamerTests, test_nextTrack_currentWasDeleted_picksNextTrack) {
     deadbeef->plt_unref(plt);
 }
 
+
+TEST_F(StreamerTests, test_PlayTrack_OpensNextTrackBeforeTheEnd) {
+    streamer_set_repeat(DDB_REPEAT_OFF);
+    streamer_set_shuffle(DDB_SHUFFLE_OFF);
+    ddb_playlist_t *plt = deadbeef->plt_alloc ("testplt");
+
+    ddb_playItem_t *first = deadbeef->plt_insert_file2 (0, (ddb_playlist_t *)plt, NULL, "/sine.fake", NULL, NULL, NULL);
+    deadbeef->plt_insert_file2 (0, (ddb_playlist_t *)plt, first, "/square.fake", NULL, NULL, NULL);
+
+    fakein_set_sleep (0);
+    fakeout_set_manual (1);
+    fakeout_set_realtime (0);
+
+    deadbeef->plt_set_curr (plt);
+
+    int opened = fakein_get_open_count ();
+
+    // the fake tracks are 5 sec long, so the prefetch starts right away
+    streamer_set_nextsong (0, 0);
+    streamer_yield ();
+    fakeout_consume (44100 * 4 * 2);
+
+    for (int i = 0; i < 100 && fakein_get_open_count () - opened < 2; i++) {
+        usleep (10000);
+    }
+
+    ddb_playItem_t *curr = deadbeef->streamer_get_streaming_track();
+    EXPECT_EQ(curr, first);
+    EXPECT_EQ(fakein_get_open_count () - opened, 2);
+
+    deadbeef->pl_item_unref(curr);
+
+    plt_set_curr (NULL);
+    deadbeef->plt_unref(plt);
+}
@@ -0,0 +1,202 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "../plugins/supereq/Equ.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gtest/gtest.h>
+
+#define WB 10 // same as in supereq.c
+#define PARTBITS 7
+#define WINLEN ((1 << (WB-1)) - 1)
+#define PARTSIZE (1 << PARTBITS)
+#define NUM_SAMPLES 16384
+
+// The filter is linear phase, its peak is delayed by half of its length.
+// On top of that, the normal mode outputs a block of WINLEN samples later, the partitioned mode a block of PARTSIZE samples.
+#define FILTER_LATENCY (WINLEN/2)
+
+class SuperEqTests: public ::testing::Test {
+protected:
+    void SetUp() override {
+        memset (&_state, 0, sizeof (_state));
+        _params = paramlist_alloc ();
+        _samples = (float *)calloc (NUM_SAMPLES, sizeof (float));
+    }
+
+    void TearDown() override {
+        equ_quit (&_state);
+        paramlist_free (_params);
+        free (_samples);
+    }
+
+    SuperEqKernel *makeKernel (int partbits, const float *bands) {
+        return equ_makeKernel (WB, partbits, (float *)bands, _params, 44100);
+    }
+
+    SuperEqKernel *makeFlatKernel (int partbits, float gain) {
+        float bands[18];
+        for (int i = 0; i < 18; i++) {
+            bands[i] = gain;
+        }
+        return makeKernel (partbits, bands);
+    }
+
+    void init (int partbits, SuperEqKernel *kernel) {
+        equ_init (&_state, WB, 1, partbits);
+        equ_setKernel (&_state, kernel);
+    }
+
+    // Processes the samples [from, to) in blocks of an unrelated size
+    void process (int from, int to) {
+        for (int i = from; i < to; i += 100) {
+            equ_modifySamples_float (&_state, (char *)(_samples + i), i + 100 > to ? to - i : 100, 1);
+        }
+    }
+
+    // Sample of the largest magnitude
+    int peak () {
+        int pos = 0;
+        for (int i = 0; i < NUM_SAMPLES; i++) {
+            if (fabsf (_samples[i]) > fabsf (_samples[pos])) {
+                pos = i;
+            }
+        }
+        return pos;
+    }
+
+    // Energy of everything but the peak
+    double energyAround (int pos) {
+        double energy = 0;
+        for (int i = 0; i < NUM_SAMPLES; i++) {
+            if (i != pos) {
+                energy += _samples[i] * _samples[i];
+            }
+        }
+        return energy;
+    }
+
+    // Switches from the unity gain to half gain while processing a constant signal,
+    // and checks that the output fades from one to the other over `fade` samples, without steps.
+    void checkCrossfade (int partbits, int fade) {
+        init (partbits, makeFlatKernel (partbits, 1));
+        for (int i = 0; i < NUM_SAMPLES; i++) {
+            _samples[i] = 0.5f;
+        }
+        process (0, NUM_SAMPLES / 2);
+        EXPECT_TRUE(equ_setKernel (&_state, makeFlatKernel (partbits, 0.5f)) == NULL);
+        process (NUM_SAMPLES / 2, NUM_SAMPLES);
+
+        // skip the start, where the output goes from silence to the signal
+        int first = -1, last = -1;
+        float maxstep = 0;
+        for (int i = NUM_SAMPLES / 4; i < NUM_SAMPLES; i++) {
+            EXPECT_GE(_samples[i], 0.25f - 1e-5f);
+            EXPECT_LE(_samples[i], 0.5f + 1e-5f);
+            maxstep = fmaxf (maxstep, fabsf (_samples[i] - _samples[i-1]));
+            if (first < 0 && fabsf (_samples[i] - 0.5f) > 1e-4f) {
+                first = i;
+            }
+            if (fabsf (_samples[i] - 0.25f) > 1e-4f) {
+                last = i;
+            }
+        }
+        EXPECT_GE(first, NUM_SAMPLES / 2);
+        EXPECT_LE(last - first + 1, fade);
+        EXPECT_GE(last - first + 1, fade - 2);
+        // a linear fade, rather than a jump
+        EXPECT_LT(maxstep, 0.25f / fade * 1.5f);
+        EXPECT_FLOAT_EQ(_samples[NUM_SAMPLES-1], 0.25f);
+        EXPECT_TRUE(_state.next_kernel == NULL);
+    }
+
+    SuperEqState _state;
+    void *_params;
+    float *_samples;
+};
+
+TEST_F(SuperEqTests, test_ImpulseResponseFlat_NormalMode_DelayedImpulse) {
+    init (0, makeFlatKernel (0, 1));
+    _samples[0] = 0.5f;
+    process (0, NUM_SAMPLES);
+    int pos = peak ();
+    EXPECT_EQ(pos, WINLEN + FILTER_LATENCY);
+    EXPECT_NEAR(_samples[pos], 0.5f, 1e-5f);
+    EXPECT_LT(energyAround (pos), 1e-8);
+}
+
+TEST_F(SuperEqTests, test_ImpulseResponseFlat_PartitionedMode_DelayedImpulse) {
+    init (PARTBITS, makeFlatKernel (PARTBITS, 1));
+    _samples[0] = 0.5f;
+    process (0, NUM_SAMPLES);
+    int pos = peak ();
+    EXPECT_EQ(pos, PARTSIZE + FILTER_LATENCY);
+    EXPECT_NEAR(_samples[pos], 0.5f, 1e-5f);
+    EXPECT_LT(energyAround (pos), 1e-8);
+}
+
+TEST_F(SuperEqTests, test_ImpulseResponseHalfGain_BothModes_HalfImpulse) {
+    for (int partbits : { 0, PARTBITS }) {
+        init (partbits, makeFlatKernel (partbits, 0.5f));
+        memset (_samples, 0, NUM_SAMPLES * sizeof (float));
+        _samples[0] = 0.5f;
+        process (0, NUM_SAMPLES);
+        int pos = peak ();
+        EXPECT_EQ(pos, (partbits ? PARTSIZE : WINLEN) + FILTER_LATENCY);
+        EXPECT_NEAR(_samples[pos], 0.25f, 1e-5f);
+    }
+}
+
+TEST_F(SuperEqTests, test_ImpulseResponse_PartitionedMode_SameAsNormalModeShiftedByBlockLatency) {
+    static const float bands[18] = { 2, 1.5f, 1, 0.5f, 0.25f, 0.5f, 1, 1.5f, 2, 1.5f, 1, 0.5f, 0.25f, 0.5f, 1, 1.5f, 2, 1 };
+
+    init (0, makeKernel (0, bands));
+    _samples[0] = 0.25f;
+    process (0, NUM_SAMPLES);
+    float *normal = (float *)malloc (NUM_SAMPLES * sizeof (float));
+    memcpy (normal, _samples, NUM_SAMPLES * sizeof (float));
+
+    init (PARTBITS, makeKernel (PARTBITS, bands));
+    memset (_samples, 0, NUM_SAMPLES * sizeof (float));
+    _samples[0] = 0.25f;
+    process (0, NUM_SAMPLES);
+
+    // the filter is not flat
+    EXPECT_GT(energyAround (peak ()), 1e-4);
+
+    float maxdiff = 0;
+    for (int i = 0; i + WINLEN - PARTSIZE < NUM_SAMPLES; i++) {
+        maxdiff = fmaxf (maxdiff, fabsf (normal[i + WINLEN - PARTSIZE] - _samples[i]));
+    }
+    EXPECT_LT(maxdiff, 1e-5f);
+    free (normal);
+}
+
+TEST_F(SuperEqTests, test_Crossfade_NormalMode_FadesOverOneBlock) {
+    checkCrossfade (0, WINLEN);
+}
+
+TEST_F(SuperEqTests, test_Crossfade_PartitionedMode_FadesOverOneBlock) {
+    checkCrossfade (PARTBITS, PARTSIZE);
+}
@@ -7,8 +7,21 @@
 //
 
 #include "../plugins/vfs_curl/vfs_curl.h"
+#include "common.h"
 #include "messagepump.h"
 #include "plmeta.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include <gtest/gtest.h>
 
 extern "C" DB_functions_t *deadbeef;
@@ -99,3 +112,307 @@ TEST_F(VfsCurlTests, test_HandleIcyHeaders_IcyHeaderAndTitleMetaSeparatePackets_
     EXPECT_NE (title, nullptr);
     EXPECT_EQ (strcmp (title, "Title"), 0);
 }
+
+#pragma mark - Range requests and disk cache
+
+// Serves a blob over HTTP/1.1 on a loopback port, with optional byte range support and ETag.
+class LocalHttpServer {
+public:
+    LocalHttpServer(const std::string &data, bool supportsRanges) : _data(data), _supportsRanges(supportsRanges) {
+        _listenFd = socket (AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt (_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        bind (_listenFd, (struct sockaddr *)&addr, sizeof (addr));
+        listen (_listenFd, 8);
+        socklen_t len = sizeof (addr);
+        getsockname (_listenFd, (struct sockaddr *)&addr, &len);
+        _port = ntohs (addr.sin_port);
+        _acceptThread = std::thread([this] { acceptLoop(); });
+    }
+
+    ~LocalHttpServer() {
+        _stop = true;
+        _acceptThread.join ();
+        for (auto &t : _connections) {
+            t.join ();
+        }
+        close (_listenFd);
+    }
+
+    std::string url(const char *path) const {
+        return "http://127.0.0.1:" + std::to_string (_port) + path;
+    }
+
+    void setData(const std::string &data, const std::string &etag) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _data = data;
+        _etag = etag;
+    }
+
+    std::vector<int64_t> requests() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _requests;
+    }
+
+private:
+    void acceptLoop() {
+        while (!_stop) {
+            struct pollfd pfd = { _listenFd, POLLIN, 0 };
+            if (poll (&pfd, 1, 100) <= 0) {
+                continue;
+            }
+            int fd = accept (_listenFd, NULL, NULL);
+            if (fd >= 0) {
+                _connections.emplace_back ([this, fd] { serve (fd); });
+            }
+        }
+    }
+
+    void serve(int fd) {
+        std::string request;
+        char buf[1024];
+        while (request.find ("\r\n\r\n") == std::string::npos) {
+            ssize_t n = recv (fd, buf, sizeof (buf), 0);
+            if (n <= 0) {
+                close (fd);
+                return;
+            }
+            request.append (buf, n);
+        }
+
+        int64_t start = -1;
+        size_t range = request.find ("Range: bytes=");
+        if (range != std::string::npos) {
+            start = atoll (request.c_str () + range + strlen ("Range: bytes="));
+        }
+        std::string data;
+        std::string etag;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _requests.push_back (start);
+            data = _data;
+            etag = _etag;
+        }
+
+        std::string header;
+        size_t offset = 0;
+        if (start > 0 && _supportsRanges) {
+            offset = (size_t)start;
+            header = "HTTP/1.1 206 Partial Content\r\n"
+                "Content-Range: bytes " + std::to_string (offset) + "-" + std::to_string (data.size () - 1) + "/" + std::to_string (data.size ()) + "\r\n";
+        }
+        else {
+            header = "HTTP/1.1 200 OK\r\n";
+        }
+        header += "Content-Type: audio/x-test\r\n";
+        if (_supportsRanges) {
+            header += "Accept-Ranges: bytes\r\n";
+        }
+        if (!etag.empty ()) {
+            header += "ETag: " + etag + "\r\n";
+        }
+        header += "Content-Length: " + std::to_string (data.size () - offset) + "\r\nConnection: close\r\n\r\n";
+
+        std::string response = header + data.substr (offset);
+        const char *p = response.data ();
+        size_t remaining = response.size ();
+        while (remaining > 0 && !_stop) {
+            ssize_t n = send (fd, p, remaining, SEND_FLAGS);
+            if (n <= 0) {
+                break; // client went away, e.g. after a seek
+            }
+            p += n;
+            remaining -= n;
+        }
+        close (fd);
+    }
+
+#ifdef MSG_NOSIGNAL
+    static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    static const int SEND_FLAGS = 0;
+#endif
+
+    std::string _data;
+    std::string _etag;
+    bool _supportsRanges;
+    int _listenFd;
+    int _port;
+    std::atomic<bool> _stop{false};
+    std::thread _acceptThread;
+    std::vector<std::thread> _connections;
+    std::mutex _mutex;
+    std::vector<int64_t> _requests;
+};
+
+class VfsCurlStreamTests: public ::testing::Test {
+protected:
+    void SetUp() override {
+        _vfs = (DB_vfs_t *)vfs_curl_load (deadbeef);
+        _vfs->plugin.start ();
+
+        strcpy (_prevCacheDir, dbcachedir);
+        snprintf (_cacheDir, sizeof (_cacheDir), "%s/VfsCurlTests.XXXXXX", P_tmpdir);
+        EXPECT_NE (mkdtemp (_cacheDir), nullptr);
+        strcpy (dbcachedir, _cacheDir);
+        deadbeef->conf_set_int ("vfs_curl.cache", 0);
+
+        // 700000 bytes: two full cache segments, and a partial one
+        _data.resize (700000);
+        for (size_t i = 0; i < _data.size (); i++) {
+            _data[i] = (char)((i * 7 + (i >> 8)) & 0xff);
+        }
+    }
+
+    void TearDown() override {
+        _vfs->plugin.stop ();
+        deadbeef->conf_set_int ("vfs_curl.cache", 0);
+        strcpy (dbcachedir, _prevCacheDir);
+        std::string cmd = std::string ("rm -rf '") + _cacheDir + "'";
+        (void)system (cmd.c_str ());
+    }
+
+    bool readAndCompare(DB_FILE *fp, size_t offset, size_t size) {
+        std::vector<char> buffer(size);
+        size_t res = _vfs->read (buffer.data (), 1, size, fp);
+        return res == size && !memcmp (buffer.data (), _data.data () + offset, size);
+    }
+
+    DB_vfs_t *_vfs;
+    std::string _data;
+    char _cacheDir[PATH_MAX];
+    char _prevCacheDir[PATH_MAX];
+};
+
+TEST_F(VfsCurlStreamTests, test_SeekOutsideBuffer_UsesRangeRequest) {
+    LocalHttpServer server(_data, true);
+    DB_FILE *fp = _vfs->open (server.url ("/file").c_str ());
+
+    EXPECT_EQ (_vfs->getlength (fp), (int64_t)_data.size ());
+    EXPECT_TRUE (readAndCompare (fp, 0, 4096));
+    EXPECT_EQ (_vfs->seek (fp, 600000, SEEK_SET), 0);
+    EXPECT_TRUE (readAndCompare (fp, 600000, 4096));
+    EXPECT_EQ (_vfs->tell (fp), 604096);
+    _vfs->close (fp);
+
+    std::vector<int64_t> requests = server.requests ();
+    EXPECT_EQ (requests.size (), 2);
+    EXPECT_EQ (requests.back (), 600000);
+}
+
+TEST_F(VfsCurlStreamTests, test_SeekBackAfterEndOfStream_RestartsRequest) {
+    LocalHttpServer server(_data, true);
+    DB_FILE *fp = _vfs->open (server.url ("/file").c_str ());
+
+    EXPECT_TRUE (readAndCompare (fp, 0, _data.size ()));
+    char byte;
+    EXPECT_EQ (_vfs->read (&byte, 1, 1, fp), 0);
+    EXPECT_EQ (_vfs->seek (fp, 100, SEEK_SET), 0);
+    EXPECT_TRUE (readAndCompare (fp, 100, 1000));
+    _vfs->close (fp);
+
+    EXPECT_EQ (server.requests ().back (), 100);
+}
+
+TEST_F(VfsCurlStreamTests, test_ServerIgnoresRange_SkipsToRequestedOffset) {
+    LocalHttpServer server(_data, false);
+    DB_FILE *fp = _vfs->open (server.url ("/file").c_str ());
+
+    EXPECT_TRUE (readAndCompare (fp, 0, 16));
+    EXPECT_EQ (_vfs->seek (fp, 500000, SEEK_SET), 0);
+    EXPECT_TRUE (readAndCompare (fp, 500000, 4096));
+    _vfs->close (fp);
+}
+
+TEST_F(VfsCurlStreamTests, test_ServerIgnoresRange_NextSeeksDontRequestRanges) {
+    LocalHttpServer server(_data, false);
+    DB_FILE *fp = _vfs->open (server.url ("/file").c_str ());
+
+    EXPECT_TRUE (readAndCompare (fp, 0, 16));
+    EXPECT_EQ (_vfs->seek (fp, 300000, SEEK_SET), 0);
+    EXPECT_TRUE (readAndCompare (fp, 300000, 4096));
+
+    // forward: keeps reading the current response
+    EXPECT_EQ (_vfs->seek (fp, 600000, SEEK_SET), 0);
+    EXPECT_TRUE (readAndCompare (fp, 600000, 4096));
+    EXPECT_EQ (server.requests ().size (), 2);
+
+    // backward: a new request without the range header
+    EXPECT_EQ (_vfs->seek (fp, 100, SEEK_SET), 0);
+    EXPECT_TRUE (readAndCompare (fp, 100, 4096));
+    _vfs->close (fp);
+
+    std::vector<int64_t> requests = server.requests ();
+    EXPECT_EQ (requests.size (), 3);
+    EXPECT_EQ (requests.back (), -1);
+}
+
+TEST_F(VfsCurlStreamTests, test_Replay_SameETag_ReadsFromDiskCache) {
+    deadbeef->conf_set_int ("vfs_curl.cache", 1);
+    LocalHttpServer server(_data, true);
+    server.setData (_data, "\"v1\"");
+    std::string url = server.url ("/file");
+
+    DB_FILE *fp = _vfs->open (url.c_str ());
+    EXPECT_TRUE (readAndCompare (fp, 0, _data.size ()));
+    _vfs->close (fp);
+    size_t requestCount = server.requests ().size ();
+
+    // same length and validator, different bytes: only the disk cache has the original data
+    std::string other(_data.size (), 'x');
+    server.setData (other, "\"v1\"");
+
+    fp = _vfs->open (url.c_str ());
+    EXPECT_EQ (_vfs->getlength (fp), (int64_t)_data.size ());
+    EXPECT_STREQ (_vfs->get_content_type (fp), "audio/x-test");
+    EXPECT_TRUE (readAndCompare (fp, 0, _data.size ()));
+    EXPECT_EQ (_vfs->seek (fp, 12345, SEEK_SET), 0);
+    EXPECT_TRUE (readAndCompare (fp, 12345, 1000));
+    _vfs->close (fp);
+
+    // the resource is still validated with the server
+    EXPECT_GT (server.requests ().size (), requestCount);
+}
+
+TEST_F(VfsCurlStreamTests, test_Replay_ChangedETag_ReadsNewData) {
+    deadbeef->conf_set_int ("vfs_curl.cache", 1);
+    LocalHttpServer server(_data, true);
+    server.setData (_data, "\"v1\"");
+    std::string url = server.url ("/file");
+
+    DB_FILE *fp = _vfs->open (url.c_str ());
+    EXPECT_TRUE (readAndCompare (fp, 0, _data.size ()));
+    _vfs->close (fp);
+
+    for (size_t i = 0; i < _data.size (); i++) {
+        _data[i] = (char)(_data[i] ^ 0x5a);
+    }
+    server.setData (_data, "\"v2\"");
+
+    fp = _vfs->open (url.c_str ());
+    EXPECT_TRUE (readAndCompare (fp, 0, _data.size ()));
+    _vfs->close (fp);
+}
+
+TEST_F(VfsCurlStreamTests, test_Replay_NoValidators_NotCached) {
+    deadbeef->conf_set_int ("vfs_curl.cache", 1);
+    LocalHttpServer server(_data, true);
+    std::string url = server.url ("/file");
+
+    DB_FILE *fp = _vfs->open (url.c_str ());
+    EXPECT_TRUE (readAndCompare (fp, 0, _data.size ()));
+    _vfs->close (fp);
+
+    for (size_t i = 0; i < _data.size (); i++) {
+        _data[i] = (char)(_data[i] ^ 0x5a);
+    }
+    server.setData (_data, "");
+
+    fp = _vfs->open (url.c_str ());
+    EXPECT_TRUE (readAndCompare (fp, 0, _data.size ()));
+    _vfs->close (fp);
+}
@@ -0,0 +1,178 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "vfs.h"
+#include "vfs_stdio.h"
+
+#define TEST_FILE_SIZE (8*1024*1024+123)
+
+class VfsStdioTests: public ::testing::Test {
+protected:
+    void SetUp() override {
+        snprintf (_path, sizeof (_path), "%s/vfs_stdio_test.bin", P_tmpdir);
+        _data = (uint8_t *)malloc (TEST_FILE_SIZE);
+        for (int i = 0; i < TEST_FILE_SIZE; i++) {
+            _data[i] = (uint8_t)(i * 7 + (i >> 12));
+        }
+        FILE *fp = fopen (_path, "wb");
+        fwrite (_data, 1, TEST_FILE_SIZE, fp);
+        fclose (fp);
+    }
+
+    void TearDown() override {
+        unlink (_path);
+        free (_data);
+    }
+
+    // Reads the rest of the file in chunks, starting at offs, and verifies the content
+    void readAll (DB_FILE *fp, size_t chunk, int64_t offs = 0) {
+        uint8_t *buffer = (uint8_t *)malloc (chunk);
+        for (;;) {
+            size_t rb = vfs_fread (buffer, 1, chunk, fp);
+            if (rb == 0) {
+                break;
+            }
+            ASSERT_TRUE(!memcmp (buffer, _data + offs, rb));
+            offs += rb;
+        }
+        EXPECT_EQ(offs, TEST_FILE_SIZE);
+        free (buffer);
+    }
+
+    char _path[PATH_MAX];
+    uint8_t *_data;
+};
+
+TEST_F(VfsStdioTests, test_SequentialRead_AllModes_ReturnsFileContents) {
+    static const uint32_t modes[] = { 0, DDB_VFS_OPEN_SEQUENTIAL, DDB_VFS_OPEN_MMAP, DDB_VFS_OPEN_MMAP|DDB_VFS_OPEN_SEQUENTIAL };
+    for (size_t i = 0; i < sizeof (modes) / sizeof (modes[0]); i++) {
+        DB_FILE *fp = vfs_fopen2 (_path, modes[i]);
+        ASSERT_TRUE(fp != NULL);
+        EXPECT_EQ(vfs_fgetlength (fp), TEST_FILE_SIZE);
+        readAll (fp, 4093);
+        vfs_fclose (fp);
+    }
+}
+
+TEST_F(VfsStdioTests, test_SeekAndRead_AllModes_ReturnsDataAtOffset) {
+    static const uint32_t modes[] = { 0, DDB_VFS_OPEN_SEQUENTIAL, DDB_VFS_OPEN_MMAP };
+    static const int64_t offsets[] = { 100, 50, 0x10000 - 3, 5000000, 4999000, TEST_FILE_SIZE - 10, 1 };
+    for (size_t i = 0; i < sizeof (modes) / sizeof (modes[0]); i++) {
+        DB_FILE *fp = vfs_fopen2 (_path, modes[i]);
+        ASSERT_TRUE(fp != NULL);
+        for (size_t k = 0; k < sizeof (offsets) / sizeof (offsets[0]); k++) {
+            uint8_t buffer[100];
+            EXPECT_EQ(vfs_fseek (fp, offsets[k], SEEK_SET), 0);
+            size_t expected = offsets[k] + sizeof (buffer) > TEST_FILE_SIZE ? TEST_FILE_SIZE - offsets[k] : sizeof (buffer);
+            EXPECT_EQ(vfs_fread (buffer, 1, sizeof (buffer), fp), expected);
+            EXPECT_TRUE(!memcmp (buffer, _data + offsets[k], expected));
+            EXPECT_EQ(vfs_ftell (fp), offsets[k] + (int64_t)expected);
+        }
+        vfs_fclose (fp);
+    }
+}
+
+TEST_F(VfsStdioTests, test_LargeRead_Buffered_ReturnsFileContents) {
+    DB_FILE *fp = vfs_fopen2 (_path, DDB_VFS_OPEN_SEQUENTIAL);
+    ASSERT_TRUE(fp != NULL);
+    uint8_t small[10];
+    EXPECT_EQ(vfs_fread (small, 1, sizeof (small), fp), sizeof (small));
+    EXPECT_TRUE(!memcmp (small, _data, sizeof (small)));
+    readAll (fp, 3*1024*1024, sizeof (small));
+    vfs_fclose (fp);
+}
+
+TEST_F(VfsStdioTests, test_SequentialRead_Buffered_BufferGrows) {
+    DB_FILE *fp = vfs_fopen2 (_path, DDB_VFS_OPEN_SEQUENTIAL);
+    ASSERT_TRUE(fp != NULL);
+    readAll (fp, 0x2800);
+    vfs_stdio_stats_t stats;
+    EXPECT_EQ(vfs_stdio_get_stats (fp, &stats), 0);
+    vfs_fclose (fp);
+
+    // 64K, 128K, ... 1M, then 1M windows, and a final read at the end of file
+    EXPECT_LE(stats.num_reads, 16);
+    EXPECT_EQ(stats.num_seeks, 0);
+    EXPECT_EQ(stats.bytes_read, TEST_FILE_SIZE);
+}
+
+TEST_F(VfsStdioTests, test_SequentialRead_Default_BufferStaysSmall) {
+    DB_FILE *fp = vfs_fopen2 (_path, 0);
+    ASSERT_TRUE(fp != NULL);
+    readAll (fp, 0x2800);
+    vfs_stdio_stats_t stats;
+    EXPECT_EQ(vfs_stdio_get_stats (fp, &stats), 0);
+    vfs_fclose (fp);
+
+    // without the sequential hint, the buffer doesn't grow past 64K
+    EXPECT_GE(stats.num_reads, TEST_FILE_SIZE / 0x10000);
+    EXPECT_EQ(stats.bytes_read, TEST_FILE_SIZE);
+}
+
+// Reads the file in the chunk sizes typically requested by the wavpack, mp3 and flac decoders.
+// The number of syscalls depends on the open mode, not on the size of the requests.
+TEST_F(VfsStdioTests, test_SequentialRead_DecoderChunkSizes_SyscallsDontDependOnChunkSize) {
+    static const uint32_t modes[] = { 0, DDB_VFS_OPEN_SEQUENTIAL, DDB_VFS_OPEN_MMAP|DDB_VFS_OPEN_SEQUENTIAL };
+    static const size_t chunks[] = { 1024, 0x2800, 0x10000 };
+
+    for (size_t m = 0; m < sizeof (modes) / sizeof (modes[0]); m++) {
+        vfs_stdio_stats_t first = {0};
+        for (size_t c = 0; c < sizeof (chunks) / sizeof (chunks[0]); c++) {
+            DB_FILE *fp = vfs_fopen2 (_path, modes[m]);
+            ASSERT_TRUE(fp != NULL);
+            readAll (fp, chunks[c]);
+            vfs_stdio_stats_t stats;
+            EXPECT_EQ(vfs_stdio_get_stats (fp, &stats), 0);
+            vfs_fclose (fp);
+
+            EXPECT_EQ(stats.num_seeks, 0);
+            if (c == 0) {
+                first = stats;
+            }
+            else {
+                EXPECT_EQ(stats.num_reads, first.num_reads);
+                EXPECT_EQ(stats.num_hints, first.num_hints);
+            }
+
+            if (modes[m] & DDB_VFS_OPEN_MMAP) {
+                EXPECT_EQ(stats.num_reads, 0);
+            }
+            else if (modes[m] & DDB_VFS_OPEN_SEQUENTIAL) {
+                EXPECT_LE(stats.num_reads, 16);
+                EXPECT_LE(stats.num_hints, stats.num_reads);
+                EXPECT_EQ(stats.bytes_read, TEST_FILE_SIZE);
+            }
+            else {
+                // never less than 32K per read
+                EXPECT_LE(stats.num_reads, TEST_FILE_SIZE / 0x8000 + 1);
+                EXPECT_EQ(stats.num_hints, 0);
+                EXPECT_EQ(stats.bytes_read, TEST_FILE_SIZE);
+            }
+        }
+    }
+}
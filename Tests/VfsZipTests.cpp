@@ -0,0 +1,295 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "deadbeef.h"
+#include "../common.h"
+
+extern "C" DB_functions_t *deadbeef;
+extern "C" DB_plugin_t *vfs_zip_load (DB_functions_t *api);
+
+// Large enough for several inflate checkpoints, which are 1 MiB apart
+#define MEMBER_SIZE (4*1024*1024+123)
+
+static void
+_put16 (FILE *fp, uint16_t v) {
+    uint8_t b[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+    fwrite (b, 1, 2, fp);
+}
+
+static void
+_put32 (FILE *fp, uint32_t v) {
+    _put16 (fp, (uint16_t)v);
+    _put16 (fp, (uint16_t)(v >> 16));
+}
+
+typedef struct {
+    const char *name;
+    uint16_t method;
+    uint32_t crc;
+    uint32_t comp_size;
+    uint32_t offset;
+} zip_member_t;
+
+static void
+_write_header (FILE *fp, const zip_member_t *m, int central) {
+    _put32 (fp, central ? 0x02014b50 : 0x04034b50);
+    if (central) {
+        _put16 (fp, 20); // version made by
+    }
+    _put16 (fp, 20); // version needed
+    _put16 (fp, 0); // flags
+    _put16 (fp, m->method);
+    _put16 (fp, 0); // time
+    _put16 (fp, 0x21); // date
+    _put32 (fp, m->crc);
+    _put32 (fp, m->comp_size);
+    _put32 (fp, MEMBER_SIZE);
+    _put16 (fp, (uint16_t)strlen (m->name));
+    _put16 (fp, 0); // extra field length
+    if (central) {
+        _put16 (fp, 0); // comment length
+        _put16 (fp, 0); // disk number
+        _put16 (fp, 0); // internal attributes
+        _put32 (fp, 0); // external attributes
+        _put32 (fp, m->offset);
+    }
+    fwrite (m->name, 1, strlen (m->name), fp);
+}
+
+// Writes a zip file with the same data stored as "stored.bin", and deflated as "deflated.bin"
+static int
+_write_zip (const char *path, const uint8_t *data) {
+    uLong bound = compressBound (MEMBER_SIZE);
+    uint8_t *comp = (uint8_t *)malloc (bound);
+    z_stream strm = {};
+    if (deflateInit2 (&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free (comp);
+        return -1;
+    }
+    strm.next_in = (Bytef *)data;
+    strm.avail_in = MEMBER_SIZE;
+    strm.next_out = comp;
+    strm.avail_out = (uInt)bound;
+    int ret = deflate (&strm, Z_FINISH);
+    uint32_t comp_size = (uint32_t)strm.total_out;
+    deflateEnd (&strm);
+    if (ret != Z_STREAM_END) {
+        free (comp);
+        return -1;
+    }
+
+    uint32_t crc = (uint32_t)crc32 (crc32 (0, NULL, 0), data, MEMBER_SIZE);
+    zip_member_t members[] = {
+        { "deflated.bin", 8, crc, comp_size, 0 },
+        { "stored.bin", 0, crc, MEMBER_SIZE, 0 },
+    };
+
+    FILE *fp = fopen (path, "wb");
+    if (!fp) {
+        free (comp);
+        return -1;
+    }
+    for (int i = 0; i < 2; i++) {
+        members[i].offset = (uint32_t)ftell (fp);
+        _write_header (fp, &members[i], 0);
+        fwrite (members[i].method ? comp : data, 1, members[i].comp_size, fp);
+    }
+    uint32_t cd_offset = (uint32_t)ftell (fp);
+    for (int i = 0; i < 2; i++) {
+        _write_header (fp, &members[i], 1);
+    }
+    uint32_t cd_size = (uint32_t)ftell (fp) - cd_offset;
+    _put32 (fp, 0x06054b50);
+    _put16 (fp, 0); // disk number
+    _put16 (fp, 0); // disk with the central directory
+    _put16 (fp, 2);
+    _put16 (fp, 2);
+    _put32 (fp, cd_size);
+    _put32 (fp, cd_offset);
+    _put16 (fp, 0); // comment length
+    fclose (fp);
+    free (comp);
+    return 0;
+}
+
+static const char *_members[] = { "deflated.bin", "stored.bin" };
+
+class VfsZipTests: public ::testing::Test {
+protected:
+    void SetUp() override {
+        _vfs = (DB_vfs_t *)vfs_zip_load (deadbeef);
+        _vfs->plugin.start ();
+
+        // compressible, but not so much that the deflate blocks get huge
+        _data = (uint8_t *)malloc (MEMBER_SIZE);
+        uint32_t r = 1;
+        for (int i = 0; i < MEMBER_SIZE; i++) {
+            r = r * 1103515245 + 12345;
+            _data[i] = "abcdefgh"[(r >> 16) & 7];
+        }
+
+        snprintf (_path, sizeof (_path), "%s/vfs_zip_test.zip", P_tmpdir);
+        ASSERT_EQ(_write_zip (_path, _data), 0);
+    }
+
+    void TearDown() override {
+        _vfs->plugin.stop ();
+        unlink (_path);
+        free (_data);
+    }
+
+    DB_FILE *openMember (const char *name) {
+        char uri[PATH_MAX+100];
+        snprintf (uri, sizeof (uri), "zip://%s:%s", _path, name);
+        DB_FILE *fp = _vfs->open (uri);
+        if (fp) {
+            EXPECT_EQ(_vfs->getlength (fp), MEMBER_SIZE);
+        }
+        return fp;
+    }
+
+    // Seeks to the offset, reads up to 1000 bytes, and verifies them
+    void readAt (DB_FILE *fp, int64_t offset) {
+        uint8_t buffer[1000];
+        ASSERT_EQ(_vfs->seek (fp, offset, SEEK_SET), 0);
+        size_t expected = offset + sizeof (buffer) > MEMBER_SIZE ? MEMBER_SIZE - offset : sizeof (buffer);
+        ASSERT_EQ(_vfs->read (buffer, 1, sizeof (buffer), fp), expected) << "offset " << offset;
+        EXPECT_TRUE(!memcmp (buffer, _data + offset, expected)) << "offset " << offset;
+        EXPECT_EQ(_vfs->tell (fp), offset + (int64_t)expected);
+    }
+
+    DB_vfs_t *_vfs;
+    uint8_t *_data;
+    char _path[PATH_MAX];
+};
+
+TEST_F(VfsZipTests, test_SequentialRead_ReturnsMemberContents) {
+    uint8_t *buffer = (uint8_t *)malloc (MEMBER_SIZE);
+    for (const char *name : _members) {
+        DB_FILE *fp = openMember (name);
+        ASSERT_TRUE(fp != NULL);
+        size_t total = 0;
+        for (;;) {
+            size_t rb = _vfs->read (buffer + total, 1, min (12345, MEMBER_SIZE - total), fp);
+            if (rb == 0) {
+                break;
+            }
+            total += rb;
+        }
+        EXPECT_EQ(total, MEMBER_SIZE);
+        EXPECT_TRUE(!memcmp (buffer, _data, MEMBER_SIZE));
+        _vfs->close (fp);
+    }
+    free (buffer);
+}
+
+TEST_F(VfsZipTests, test_SeekForward_ReturnsDataAtOffset) {
+    // within the window, past the window, and across several checkpoints
+    static const int64_t offsets[] = { 0, 100, 20000, 70000, 1024*1024 + 5, 1024*1024 + 40000, 3*1024*1024 + 17, MEMBER_SIZE - 1000 };
+    for (const char *name : _members) {
+        DB_FILE *fp = openMember (name);
+        ASSERT_TRUE(fp != NULL);
+        for (int64_t offset : offsets) {
+            readAt (fp, offset);
+        }
+        _vfs->close (fp);
+    }
+}
+
+TEST_F(VfsZipTests, test_SeekBack_ReturnsDataAtOffset) {
+    // the end first, so that all the checkpoints are recorded, then back to each of them and into the window
+    static const int64_t offsets[] = { MEMBER_SIZE - 1000, MEMBER_SIZE - 20000, 3*1024*1024 + 17, 2*1024*1024 - 1, 2*1024*1024 - 5000, 1024*1024 + 3, 1000, 0 };
+    for (const char *name : _members) {
+        DB_FILE *fp = openMember (name);
+        ASSERT_TRUE(fp != NULL);
+        for (int64_t offset : offsets) {
+            readAt (fp, offset);
+        }
+        _vfs->close (fp);
+    }
+}
+
+TEST_F(VfsZipTests, test_RandomSeeks_ReturnDataAtOffset) {
+    for (const char *name : _members) {
+        DB_FILE *fp = openMember (name);
+        ASSERT_TRUE(fp != NULL);
+        srand (1);
+        for (int i = 0; i < 50; i++) {
+            readAt (fp, (int64_t)rand () % MEMBER_SIZE);
+        }
+        _vfs->close (fp);
+    }
+}
+
+TEST_F(VfsZipTests, test_SeekPastEOF_Fails) {
+    for (const char *name : _members) {
+        DB_FILE *fp = openMember (name);
+        ASSERT_TRUE(fp != NULL);
+        EXPECT_EQ(_vfs->seek (fp, MEMBER_SIZE + 1, SEEK_SET), -1);
+        EXPECT_EQ(_vfs->seek (fp, 1, SEEK_END), -1);
+        EXPECT_EQ(_vfs->seek (fp, -1, SEEK_SET), -1);
+
+        // the position is unchanged by the failed seeks
+        EXPECT_EQ(_vfs->tell (fp), 0);
+        readAt (fp, 0);
+        _vfs->close (fp);
+    }
+}
+
+TEST_F(VfsZipTests, test_ReadAtEOF_ReturnsTail) {
+    for (const char *name : _members) {
+        DB_FILE *fp = openMember (name);
+        ASSERT_TRUE(fp != NULL);
+        uint8_t buffer[100];
+        EXPECT_EQ(_vfs->seek (fp, 0, SEEK_END), 0);
+        EXPECT_EQ(_vfs->read (buffer, 1, sizeof (buffer), fp), 0);
+        EXPECT_EQ(_vfs->tell (fp), MEMBER_SIZE);
+
+        EXPECT_EQ(_vfs->seek (fp, -10, SEEK_END), 0);
+        EXPECT_EQ(_vfs->read (buffer, 1, sizeof (buffer), fp), 10);
+        EXPECT_TRUE(!memcmp (buffer, _data + MEMBER_SIZE - 10, 10));
+        EXPECT_EQ(_vfs->read (buffer, 1, sizeof (buffer), fp), 0);
+
+        // and back from the end
+        readAt (fp, 12345);
+        _vfs->close (fp);
+    }
+}
+
+TEST_F(VfsZipTests, test_StopWithOpenFile_FileStaysReadable) {
+    DB_FILE *fp = openMember ("stored.bin");
+    ASSERT_TRUE(fp != NULL);
+    readAt (fp, 1000);
+
+    // the archive is still in use, and is closed with the file
+    _vfs->plugin.stop ();
+    readAt (fp, 5000);
+    _vfs->close (fp);
+    _vfs->plugin.start ();
+}
@@ -31,6 +31,7 @@
 
 #define FAKEIN_NUMSAMPLES 44100 * 5 // 5 sec
 static int _sleep;
+static int _open_count;
 
 static DB_decoder_t plugin;
 static DB_functions_t *deadbeef;
@@ -48,6 +49,7 @@ static const char * exts[] = { "fake", NULL };
 
 static DB_fileinfo_t *
 fakein_open (uint32_t hints) {
+    _open_count++;
     DB_fileinfo_t *_info = malloc (sizeof (fakein_info_t));
     fakein_info_t *info = (fakein_info_t *)_info;
     memset (info, 0, sizeof (fakein_info_t));
@@ -81,6 +83,12 @@ fakein_init (DB_fileinfo_t *_info, DB_playItem_t *it) {
             info->samples[i] = sin (t);
         }
     }
+    else if (!strcmp (type, "ramp")) {
+        // each value is the index of the value, for checking the positions
+        for (int i = 0; i < FAKEIN_NUMSAMPLES * 2; i++) {
+            info->samples[i] = i;
+        }
+    }
     else if (!strcmp (type, "square")) {
         // 440Hz square
         for (int i = 0; i < FAKEIN_NUMSAMPLES; i++) {
@@ -191,3 +199,8 @@ void
 fakein_set_sleep (int sleep) {
     _sleep = sleep;
 }
+
+int
+fakein_get_open_count (void) {
+    return _open_count;
+}
@@ -32,6 +32,10 @@ extern "C" {
 void
 fakein_set_sleep (int sleep);
 
+// number of fileinfos opened since the start
+int
+fakein_get_open_count (void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,6 +9,7 @@
 #include "vfs.h"
 #include "plugins.h"
 #include "playmodes.h"
+#include "decodeinfo.h"
 
 int main(int argc, char **argv) {
     char buf[PATH_MAX];
@@ -21,6 +22,7 @@ int main(int argc, char **argv) {
     conf_enable_saving (0);
     streamer_playmodes_init();
     pl_init ();
+    decode_info_cache_init ();
 
     if (plug_load_all ()) { // required to add files to playlist from commandline
         exit (1);
@@ -85,8 +85,7 @@ typedef struct {
     int embedded_samplerate;
     const char *cue_file_dir; // directory containing cue file or parent file (FIXME: looks like a dupe with `dirname`)
     const char *dirname; // directory path being loaded
-    struct dirent **namelist;
-    int n;
+    cue_dir_index_t *dirindex; // files of the directory being loaded
     int ncuefiles; // number of FILEs in cue
     int ncuetracks; // number of TRACKs in cue
     const char *cue_fname; // just the filename of cue file (or parent file)
@@ -114,6 +113,7 @@ typedef struct {
     const char *charset; // detected charset
     int have_track; // wheter track info has been found, before encountering the TRACK field
     playItem_t *cuetracks[MAX_CUE_TRACKS]; // all loaded cue tracks after splitting
+    playItem_t *cuetrack_origins[MAX_CUE_TRACKS]; // unsplit track of each cue track
     int ntracks; // count of cuetracks
 
     int64_t currsample;
@@ -307,7 +307,7 @@ pl_cue_set_track_field_values(playItem_t *it, cueparser_t *cue) {
     // generated "total tracks" field
     pl_add_meta(it, "numtracks", cue->cuefields[CUE_FIELD_TOTALTRACKS]);
 
-    pl_items_copy_junk (cue->origin, it, it);
+    // the tags of the unsplit track are added after all tracks are loaded, see _add_origin_tags
 }
 
 static void
@@ -451,6 +451,121 @@ pl_cue_get_field_value(cueparser_t *cue) {
 
 //========================================================================
 
+typedef struct {
+    char *name;
+    int index; // in namelist
+} cue_dir_entry_t;
+
+struct cue_dir_index_s {
+    struct dirent **namelist;
+    int n;
+    cue_dir_entry_t *entries; // sorted by case-insensitive name, then by index
+};
+
+static int
+_dir_entry_cmp (const void *a, const void *b) {
+    const cue_dir_entry_t *e1 = a;
+    const cue_dir_entry_t *e2 = b;
+    int res = strcasecmp (e1->name, e2->name);
+    if (res) {
+        return res;
+    }
+    return e1->index - e2->index;
+}
+
+cue_dir_index_t *
+cue_dir_index_alloc (struct dirent **namelist, int n) {
+    cue_dir_index_t *dirindex = calloc (1, sizeof (cue_dir_index_t));
+    if (!dirindex) {
+        return NULL;
+    }
+    dirindex->namelist = namelist;
+    dirindex->entries = calloc (n > 0 ? n : 1, sizeof (cue_dir_entry_t));
+    if (!dirindex->entries) {
+        free (dirindex);
+        return NULL;
+    }
+    for (int i = 0; i < n; i++) {
+        // the names get cleared when the files are used, so the index needs a copy
+        dirindex->entries[i].name = strdup (namelist[i]->d_name);
+        if (!dirindex->entries[i].name) {
+            cue_dir_index_free (dirindex);
+            return NULL;
+        }
+        dirindex->entries[i].index = i;
+        dirindex->n = i + 1;
+    }
+    qsort (dirindex->entries, n, sizeof (cue_dir_entry_t), _dir_entry_cmp);
+    return dirindex;
+}
+
+void
+cue_dir_index_free (cue_dir_index_t *dirindex) {
+    for (int i = 0; i < dirindex->n; i++) {
+        free (dirindex->entries[i].name);
+    }
+    free (dirindex->entries);
+    free (dirindex);
+}
+
+// returns the position of the first entry, which starts with the prefix (case-insensitive), or sorts after it
+static int
+_dir_index_lower_bound (cue_dir_index_t *dirindex, const char *prefix, size_t len) {
+    int l = 0;
+    int r = dirindex->n;
+    while (l < r) {
+        int m = l + (r - l) / 2;
+        if (strncasecmp (dirindex->entries[m].name, prefix, len) < 0) {
+            l = m + 1;
+        }
+        else {
+            r = m;
+        }
+    }
+    return l;
+}
+
+static int
+_int_cmp (const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+// returns the number of the not yet used files starting with the prefix (case-insensitive),
+// and their namelist indexes in the original order, the array must be freed by the caller
+static int
+_dir_index_find_prefixed (cue_dir_index_t *dirindex, const char *prefix, size_t len, int **indexes) {
+    int first = _dir_index_lower_bound (dirindex, prefix, len);
+    int count = 0;
+    *indexes = NULL;
+    for (int i = first; i < dirindex->n && !strncasecmp (dirindex->entries[i].name, prefix, len); i++) {
+        int index = dirindex->entries[i].index;
+        if (!dirindex->namelist[index]->d_name[0]) {
+            continue;
+        }
+        if (!*indexes) {
+            *indexes = malloc (sizeof (int) * (dirindex->n - i));
+        }
+        (*indexes)[count++] = index;
+    }
+    if (count > 1) {
+        qsort (*indexes, count, sizeof (int), _int_cmp);
+    }
+    return count;
+}
+
+// returns the namelist index of the not yet used file with the exact name, or -1
+static int
+_dir_index_find (cue_dir_index_t *dirindex, const char *name) {
+    size_t len = strlen (name) + 1;
+    for (int i = _dir_index_lower_bound (dirindex, name, len); i < dirindex->n && !strcasecmp (dirindex->entries[i].name, name); i++) {
+        int index = dirindex->entries[i].index;
+        if (!strcmp (dirindex->namelist[index]->d_name, name)) {
+            return index;
+        }
+    }
+    return -1;
+}
+
 static int
 _file_exists (const char *fname) {
     if (!plug_is_local_file(fname)) {
@@ -475,7 +590,7 @@ _set_last_item_region (playlist_t *plt, playItem_t *it, playItem_t *origin, int6
 }
 
 playItem_t *
-plt_load_cue_file (playlist_t *plt, playItem_t *after, const char *fname, const char *dirname, struct dirent **namelist, int n) {
+plt_load_cue_file (playlist_t *plt, playItem_t *after, const char *fname, const char *dirname, cue_dir_index_t *dirindex) {
     char resolved_fname[PATH_MAX];
 
     uint8_t *membuffer = NULL;
@@ -506,7 +621,7 @@ plt_load_cue_file (playlist_t *plt, playItem_t *after, const char *fname, const
         goto error;
     }
 
-    after = plt_load_cuesheet_from_buffer (plt, after, fname, NULL, 0, 0, buffer, sz, dirname, namelist, n);
+    after = plt_load_cuesheet_from_buffer (plt, after, fname, NULL, 0, 0, buffer, sz, dirname, dirindex);
 error:
     if (fp) {
         vfs_fclose (fp);
@@ -519,27 +634,16 @@ error:
 
 static int
 _file_present_in_namelist (const char *fullpath, cueparser_t *cue) {
-    int i = 0;
-    for (i = 0; i < cue->n; i++) {
-        if (cue->namelist[i]->d_name[0]) {
-            char path[PATH_MAX];
-            snprintf (path, sizeof (path), "%s/%s", cue->dirname, cue->namelist[i]->d_name);
-            if (!strcmp (path, cue->fullpath)) {
-                // file present
-                break;
-            }
-            // poor's man vfs detection -- directory ends with ':'
-            snprintf (path, sizeof (path), "%s%s", cue->dirname, cue->namelist[i]->d_name);
-            if (!strcmp (path, cue->fullpath)) {
-                // file present
-                break;
-            }
-        }
-    }
-    if (i == cue->n) {
+    size_t l = strlen (cue->dirname);
+    if (strncmp (fullpath, cue->dirname, l)) {
         return 0;
     }
-    return 1;
+    const char *name = fullpath + l;
+    if (name[0] == '/' && _dir_index_find (cue->dirindex, name + 1) >= 0) {
+        return 1;
+    }
+    // poor's man vfs detection -- directory ends with ':'
+    return _dir_index_find (cue->dirindex, name) >= 0;
 }
 
 
@@ -574,31 +678,36 @@ _load_nextfile (cueparser_t *cue) {
 
         if (!_file_exists (cue->fullpath)) {
             cue->fullpath[0] = 0;
-            if (cue->namelist) {
+            if (cue->dirindex) {
+                struct dirent **namelist = cue->dirindex->namelist;
+                int *indexes;
+                int count;
+
                 // for image+cue, try guessing the audio filename from cuesheet filename
                 int image_found = 0;
                 if (cue->ncuefiles == 1) {
                     size_t l = strlen (cue->cue_fname);
-                    for (int i = 0; i < cue->n; i++) {
-                        const char *ext = strrchr (cue->namelist[i]->d_name, '.');
+                    count = _dir_index_find_prefixed (cue->dirindex, cue->cue_fname, l-4, &indexes);
+                    for (int c = 0; c < count; c++) {
+                        int i = indexes[c];
+                        const char *ext = strrchr (namelist[i]->d_name, '.');
                         if (!ext || !strcasecmp (ext, ".cue")) {
                             continue;
                         }
 
-                        if (!strncasecmp (cue->cue_fname, cue->namelist[i]->d_name, l-4)) {
-                            // have to try loading each of these files
-                            snprintf (cue->fullpath, sizeof (cue->fullpath), "%s/%s", cue->dirname, cue->namelist[i]->d_name);
-                            int res = cue_addfile_filter(cue);
-                            if (res >= 0) {
-                                cue->origin = plt_insert_file2 (-1, cue->temp_plt, NULL, cue->fullpath, NULL, NULL, NULL);
-                            }
-                            if (cue->origin) {
-                                image_found = 1;
-                                cue->namelist[i]->d_name[0] = 0;
-                                break;
-                            }
+                        // have to try loading each of these files
+                        snprintf (cue->fullpath, sizeof (cue->fullpath), "%s/%s", cue->dirname, namelist[i]->d_name);
+                        int res = cue_addfile_filter(cue);
+                        if (res >= 0) {
+                            cue->origin = plt_insert_file2 (-1, cue->temp_plt, NULL, cue->fullpath, NULL, NULL, NULL);
+                        }
+                        if (cue->origin) {
+                            image_found = 1;
+                            namelist[i]->d_name[0] = 0;
+                            break;
                         }
                     }
+                    free (indexes);
                 }
                 if (!image_found) {
                     // for tracks+cue, try guessing the extension of the FILE value
@@ -606,16 +715,18 @@ _load_nextfile (cueparser_t *cue) {
                     if (ext) {
                         *ext = 0;
                     }
-                    for (int i = 0; i < cue->n; i++) {
-                        const char *cueext = strrchr (cue->namelist[i]->d_name, '.');
+                    size_t l = strlen (audio_file);
+                    count = _dir_index_find_prefixed (cue->dirindex, audio_file, l, &indexes);
+                    for (int c = 0; c < count; c++) {
+                        int i = indexes[c];
+                        const char *cueext = strrchr (namelist[i]->d_name, '.');
                         if (!cueext || !strcasecmp (cueext, ".cue")) {
                             continue;
                         }
 
-                        if (!strncasecmp (audio_file, cue->namelist[i]->d_name, ext-audio_file)
-                            && cue->namelist[i]->d_name[ext-audio_file] == '.') {
+                        if (namelist[i]->d_name[l] == '.') {
                             // have to try loading each of these files
-                            snprintf (cue->fullpath, sizeof (cue->fullpath), "%s/%s", cue->dirname, cue->namelist[i]->d_name);
+                            snprintf (cue->fullpath, sizeof (cue->fullpath), "%s/%s", cue->dirname, namelist[i]->d_name);
 
                             // adding to temp playlist will fail file add filters, so need to call this manually here
                             int res = cue_addfile_filter(cue);
@@ -623,11 +734,12 @@ _load_nextfile (cueparser_t *cue) {
                                 cue->origin = plt_insert_file2 (-1, cue->temp_plt, NULL, cue->fullpath, NULL, NULL, NULL);
                             }
                             if (cue->origin) {
-                                cue->namelist[i]->d_name[0] = 0;
+                                namelist[i]->d_name[0] = 0;
                                 break;
                             }
                         }
                     }
+                    free (indexes);
                 }
             }
         }
@@ -637,7 +749,7 @@ _load_nextfile (cueparser_t *cue) {
         // if we have namelist - means we're loading cue as part of the folder
         // need to check if the fullpath file is present in the list, to avoid double-loading
 
-        if (cue->namelist && !_file_present_in_namelist (cue->fullpath, cue)) {
+        if (cue->dirindex && !_file_present_in_namelist (cue->fullpath, cue)) {
             cue->fullpath[0] = 0;
         }
     }
@@ -650,7 +762,7 @@ _load_nextfile (cueparser_t *cue) {
         }
         if (cue->origin) {
             // mark the file as used
-            if (cue->namelist) {
+            if (cue->dirindex) {
                 const char *fn_vfs = NULL;
                 const char *fn_nonvfs = NULL;
 
@@ -680,18 +792,20 @@ _load_nextfile (cueparser_t *cue) {
                     fn_nonvfs = cue->fullpath;
                 }
 
-                for (int i = 0; i < cue->n; i++) {
-                    if (!strcmp (fn_vfs, cue->namelist[i]->d_name) || !strcmp (fn_nonvfs, cue->namelist[i]->d_name)) {
-                        cue->namelist[i]->d_name[0] = 0;
-                        break;
-                    }
+                int i = _dir_index_find (cue->dirindex, fn_vfs);
+                int i_nonvfs = _dir_index_find (cue->dirindex, fn_nonvfs);
+                if (i < 0 || (i_nonvfs >= 0 && i_nonvfs < i)) {
+                    i = i_nonvfs;
+                }
+                if (i >= 0) {
+                    cue->dirindex->namelist[i]->d_name[0] = 0;
                 }
             }
         }
     }
 
     if (!cue->origin) {
-        if (!cue->namelist) {
+        if (!cue->dirindex) {
             // only display error if adding individual file;
             // this is to prevent bogus errors when auto-scanning for cuesheets in folders.
             trace_err("Invalid FILE entry %s in cuesheet %s, and could not guess any suitable file name.\n", audio_file, cue->fname);
@@ -765,19 +879,35 @@ plt_process_cue_track (playlist_t *plt, cueparser_t *cue) {
     }
     pl_set_item_flags (it, f);
 
+    cue->cuetrack_origins[cue->ntracks] = cue->origin;
     cue->cuetracks[cue->ntracks++] = it;
 
     cue->prev = it;
     return 0;
 }
 
+// The tags of the unsplit track are the same in all of its cue tracks,
+// so they're stored once per FILE, except the ones which some of the tracks override.
+static void
+_add_origin_tags (cueparser_t *cue) {
+    int i = 0;
+    while (i < cue->ntracks) {
+        int count = 1;
+        while (i + count < cue->ntracks && cue->cuetrack_origins[i + count] == cue->cuetrack_origins[i]) {
+            count++;
+        }
+        pl_items_share_junk (cue->cuetrack_origins[i], cue->cuetracks + i, count);
+        i += count;
+    }
+}
+
 static int
 _is_audio_track (const char *track) {
     return !strcmp (track + strlen (track) - 6, " AUDIO");
 }
 
 playItem_t *
-plt_load_cuesheet_from_buffer (playlist_t *plt, playItem_t *after, const char *fname, playItem_t *embedded_origin, int64_t embedded_numsamples, int embedded_samplerate, const uint8_t *buffer, int sz, const char *dirname, struct dirent **namelist, int n) {
+plt_load_cuesheet_from_buffer (playlist_t *plt, playItem_t *after, const char *fname, playItem_t *embedded_origin, int64_t embedded_numsamples, int embedded_samplerate, const uint8_t *buffer, int sz, const char *dirname, cue_dir_index_t *dirindex) {
     playItem_t *result = NULL;
     cueparser_t cue;
     memset (&cue, 0, sizeof (cue));
@@ -801,8 +931,7 @@ plt_load_cuesheet_from_buffer (playlist_t *plt, playItem_t *after, const char *f
 
 
     cue.dirname = dirname;
-    cue.namelist = namelist;
-    cue.n = n;
+    cue.dirindex = dirindex;
 
     cue.target_playlist = plt;
 
@@ -930,6 +1059,7 @@ plt_load_cuesheet_from_buffer (playlist_t *plt, playItem_t *after, const char *f
             cue.p++;
         }
     }
+    _add_origin_tags (&cue);
     for (int i = 0; i < cue.ntracks; i++) {
         after = plt_insert_item (plt, after, cue.cuetracks[i]);
         pl_item_unref (cue.cuetracks[i]);
@@ -23,9 +23,22 @@
 
 #include "deadbeef.h"
 
+// Index of a directory listing, for finding the audio files of all cuesheets in the directory.
+// The file names are looked up by binary search, instead of scanning the whole listing for each cuesheet.
+// The namelist must stay valid while the index is used; the entries marked as used by clearing their names
+// are skipped.
+typedef struct cue_dir_index_s cue_dir_index_t;
+
+// Returns NULL if out of memory, the cuesheets are then loaded as if they were added one by one.
+cue_dir_index_t *
+cue_dir_index_alloc (struct dirent **namelist, int n);
+
+void
+cue_dir_index_free (cue_dir_index_t *dirindex);
+
 // Load cuesheet, find the corresponding audiofiles, and add them as tracks into playlist, if they can be found.
 //
-// If namelist is not NULL (result of scandir), it helps to find the audio files in the cuesheet directory,
+// If dirindex is not NULL (made from the result of scandir), it helps to find the audio files in the cuesheet directory,
 // and allows to mark them as used to avoid adding the same files multiple times.
 //
 // Internally, the function finds and loads the cue file, and passes it to `plt_load_cuesheet_from_buffer`, see below for more information.
@@ -35,10 +48,10 @@
 //  The item `after` which to insert the files. NULL means beginning of playlist.
 //  `fullname` is the fully qualified path to the cuesheet file.
 //  `dirname` is full directory path, in which scandir was performed.
-//  `namelist` and `n` is the scandir output.
-//  The `dirname`, `namelist` and `n` can be either all set to NULL, otherwise they all must be valid values.
+//  `dirindex` is the index of the scandir output.
+//  The `dirname` and `dirindex` can be either both set to NULL, otherwise they both must be valid values.
 playItem_t *
-plt_load_cue_file (playlist_t *playlist, playItem_t *after, const char *fullname, const char *dirname, struct dirent **namelist, int n);
+plt_load_cue_file (playlist_t *playlist, playItem_t *after, const char *fullname, const char *dirname, cue_dir_index_t *dirindex);
 
 // This is a more internal function, to load cuesheet from buffer.
 // Semantics are the same as `plt_load_cue_file`.
@@ -51,5 +64,5 @@ plt_load_cue_file (playlist_t *playlist, playItem_t *after, const char *fullname
 //  `buffer`: pointer to the string containing cuesheet.
 //  `buffersize`: size of the buffer.
 playItem_t *
-plt_load_cuesheet_from_buffer (playlist_t *playlist, playItem_t *after, const char *fname, playItem_t *embedded_origin, int64_t embedded_numsamples, int embedded_samplerate, const uint8_t *buffer, int buffersize, const char *dirname, struct dirent **namelist, int n);
+plt_load_cuesheet_from_buffer (playlist_t *playlist, playItem_t *after, const char *fname, playItem_t *embedded_origin, int64_t embedded_numsamples, int embedded_samplerate, const uint8_t *buffer, int buffersize, const char *dirname, cue_dir_index_t *dirindex);
 
@@ -0,0 +1,566 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef __MINGW32__
+#include <sys/mman.h>
+#endif
+#include "dbpl.h"
+#include "metacache.h"
+#include "pltmeta.h"
+
+//#define trace(...) { fprintf(stderr, __VA_ARGS__); }
+#define trace(fmt,...)
+
+#pragma mark - String table
+
+// Maps interned string pointers to string indexes.
+// All metadata strings come from metacache, so pointer identity is enough for deduplication.
+typedef struct {
+    const char **slots;
+    uint32_t *slot_indexes;
+    uint32_t capacity;
+
+    const char **strings;
+    uint32_t *sizes;
+    uint32_t count;
+    uint32_t reserved;
+
+    uint32_t data_size;
+} dbpl4_strtab_t;
+
+static uint32_t
+_ptr_hash (const char *ptr) {
+    uint64_t v = (uint64_t)(uintptr_t)ptr;
+    v ^= v >> 33;
+    v *= 0xff51afd7ed558ccdULL;
+    v ^= v >> 33;
+    return (uint32_t)v;
+}
+
+static int
+_strtab_grow (dbpl4_strtab_t *tab) {
+    uint32_t capacity = tab->capacity ? tab->capacity * 2 : 1024;
+    const char **slots = calloc (capacity, sizeof (const char *));
+    uint32_t *slot_indexes = calloc (capacity, sizeof (uint32_t));
+    const char **strings = realloc (tab->strings, capacity / 2 * sizeof (const char *));
+    if (!slots || !slot_indexes || !strings) {
+        free (slots);
+        free (slot_indexes);
+        if (strings) {
+            tab->strings = strings;
+        }
+        return -1;
+    }
+    tab->strings = strings;
+    uint32_t *sizes = realloc (tab->sizes, capacity / 2 * sizeof (uint32_t));
+    if (!sizes) {
+        free (slots);
+        free (slot_indexes);
+        return -1;
+    }
+    tab->sizes = sizes;
+
+    for (uint32_t i = 0; i < tab->count; i++) {
+        uint32_t h = _ptr_hash (tab->strings[i]) & (capacity - 1);
+        while (slots[h]) {
+            h = (h + 1) & (capacity - 1);
+        }
+        slots[h] = tab->strings[i];
+        slot_indexes[h] = i;
+    }
+
+    free (tab->slots);
+    free (tab->slot_indexes);
+    tab->slots = slots;
+    tab->slot_indexes = slot_indexes;
+    tab->capacity = capacity;
+    tab->reserved = capacity / 2;
+    return 0;
+}
+
+static int64_t
+_strtab_add (dbpl4_strtab_t *tab, const char *str, uint32_t size) {
+    if (tab->count >= tab->reserved && _strtab_grow (tab) < 0) {
+        return -1;
+    }
+
+    uint32_t h = _ptr_hash (str) & (tab->capacity - 1);
+    while (tab->slots[h]) {
+        if (tab->slots[h] == str) {
+            return tab->slot_indexes[h];
+        }
+        h = (h + 1) & (tab->capacity - 1);
+    }
+
+    uint32_t idx = tab->count++;
+    tab->slots[h] = str;
+    tab->slot_indexes[h] = idx;
+    tab->strings[idx] = str;
+    tab->sizes[idx] = size;
+    tab->data_size += size;
+    return idx;
+}
+
+static void
+_strtab_free (dbpl4_strtab_t *tab) {
+    free (tab->slots);
+    free (tab->slot_indexes);
+    free (tab->strings);
+    free (tab->sizes);
+}
+
+#pragma mark - Saving
+
+struct dbpl4_writer_s {
+    dbpl4_strtab_t tab;
+
+    dbpl4_item_t *items;
+    uint32_t item_count;
+    uint32_t item_reserved;
+
+    dbpl4_meta_t *metas;
+    uint32_t meta_count;
+    uint32_t meta_reserved;
+
+    dbpl4_meta_t *plt_metas;
+    uint32_t plt_meta_count;
+    uint32_t plt_meta_reserved;
+};
+
+// The writer keeps a reference to each string in the table,
+// so that the items can be modified or freed while the data is being written.
+static int64_t
+_writer_add_string (dbpl4_writer_t *w, const char *str, uint32_t size) {
+    uint32_t count = w->tab.count;
+    int64_t idx = _strtab_add (&w->tab, str, size);
+    if (idx >= 0 && w->tab.count != count) {
+        metacache_ref_value (str);
+    }
+    return idx;
+}
+
+static int
+_writer_add_meta_pair (dbpl4_writer_t *w, dbpl4_meta_t **metas, uint32_t *count, uint32_t *reserved, const char *key, const char *value, uint32_t valuesize) {
+    if (*count >= *reserved) {
+        uint32_t newsize = *reserved ? *reserved * 2 : 256;
+        dbpl4_meta_t *newmetas = realloc (*metas, newsize * sizeof (dbpl4_meta_t));
+        if (!newmetas) {
+            return -1;
+        }
+        *metas = newmetas;
+        *reserved = newsize;
+    }
+
+    int64_t k = _writer_add_string (w, key, (uint32_t)strlen (key) + 1);
+    int64_t v = _writer_add_string (w, value, valuesize);
+    if (k < 0 || v < 0) {
+        return -1;
+    }
+    (*metas)[*count].key = (uint32_t)k;
+    (*metas)[*count].value = (uint32_t)v;
+    (*count)++;
+    return 0;
+}
+
+dbpl4_writer_t *
+dbpl4_writer_new (uint32_t item_count_hint) {
+    dbpl4_writer_t *w = calloc (1, sizeof (dbpl4_writer_t));
+    if (!w) {
+        return NULL;
+    }
+    w->item_reserved = item_count_hint ? item_count_hint : 1;
+    w->items = malloc (w->item_reserved * sizeof (dbpl4_item_t));
+    if (!w->items) {
+        free (w);
+        return NULL;
+    }
+    return w;
+}
+
+void
+dbpl4_writer_free (dbpl4_writer_t *w) {
+    pl_lock ();
+    for (uint32_t i = 0; i < w->tab.count; i++) {
+        metacache_remove_value (w->tab.strings[i], w->tab.sizes[i]);
+    }
+    pl_unlock ();
+    _strtab_free (&w->tab);
+    free (w->items);
+    free (w->metas);
+    free (w->plt_metas);
+    free (w);
+}
+
+int
+dbpl4_writer_add_item (dbpl4_writer_t *w, playItem_t *it) {
+    if (w->item_count >= w->item_reserved) {
+        uint32_t newsize = w->item_reserved * 2;
+        dbpl4_item_t *items = realloc (w->items, newsize * sizeof (dbpl4_item_t));
+        if (!items) {
+            return -1;
+        }
+        w->items = items;
+        w->item_reserved = newsize;
+    }
+
+    dbpl4_item_t *rec = &w->items[w->item_count];
+    memset (rec, 0, sizeof (dbpl4_item_t));
+    rec->startsample = it->has_startsample64 ? it->startsample64 : it->startsample;
+    rec->endsample = it->has_endsample64 ? it->endsample64 : it->endsample;
+    rec->duration = it->_duration;
+    rec->flags = it->_flags;
+    if (it->has_startsample64) {
+        rec->attrs |= DBPL4_ITEM_HAS_STARTSAMPLE64;
+    }
+    if (it->has_endsample64) {
+        rec->attrs |= DBPL4_ITEM_HAS_ENDSAMPLE64;
+    }
+    rec->meta_first = w->meta_count;
+    for (DB_metaInfo_t *m = it->meta; m; m = m->next) {
+        if (m->key[0] == '_' || m->key[0] == '!') {
+            continue; // skip reserved names
+        }
+        if (!m->value) {
+            continue;
+        }
+        if (_writer_add_meta_pair (w, &w->metas, &w->meta_count, &w->meta_reserved, m->key, m->value, (uint32_t)m->valuesize) < 0) {
+            return -1;
+        }
+    }
+    rec->meta_count = w->meta_count - rec->meta_first;
+    w->item_count++;
+    return 0;
+}
+
+int
+dbpl4_writer_add_playlist_meta (dbpl4_writer_t *w, playlist_t *plt) {
+    for (DB_metaInfo_t *m = plt->meta; m; m = m->next) {
+        if (_writer_add_meta_pair (w, &w->plt_metas, &w->plt_meta_count, &w->plt_meta_reserved, m->key, m->value, (uint32_t)strlen (m->value) + 1) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int
+dbpl4_writer_write (dbpl4_writer_t *w, buffered_file_writer_t *writer) {
+    uint16_t reserved = 0;
+    if (buffered_file_writer_write (writer, &reserved, 2) < 0) {
+        return -1;
+    }
+
+    dbpl4_header_t header = {
+        .item_count = w->item_count,
+        .meta_count = w->meta_count,
+        .plt_meta_count = w->plt_meta_count,
+        .string_count = w->tab.count,
+        .string_data_size = w->tab.data_size,
+    };
+    if (buffered_file_writer_write (writer, &header, sizeof (header)) < 0) {
+        return -1;
+    }
+
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < w->tab.count; i++) {
+        dbpl4_string_t s = { .offset = offset, .size = w->tab.sizes[i] };
+        if (buffered_file_writer_write (writer, &s, sizeof (s)) < 0) {
+            return -1;
+        }
+        offset += w->tab.sizes[i];
+    }
+
+    if (w->item_count && buffered_file_writer_write (writer, w->items, w->item_count * sizeof (dbpl4_item_t)) < 0) {
+        return -1;
+    }
+
+    if (w->meta_count && buffered_file_writer_write (writer, w->metas, w->meta_count * sizeof (dbpl4_meta_t)) < 0) {
+        return -1;
+    }
+
+    if (w->plt_meta_count && buffered_file_writer_write (writer, w->plt_metas, w->plt_meta_count * sizeof (dbpl4_meta_t)) < 0) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < w->tab.count; i++) {
+        if (buffered_file_writer_write (writer, w->tab.strings[i], w->tab.sizes[i]) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+#pragma mark - Loading
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    int mapped;
+
+    const dbpl4_header_t *header;
+    const dbpl4_string_t *strings;
+    const dbpl4_item_t *items;
+    const dbpl4_meta_t *metas;
+    const char *string_data;
+
+    // strings are interned on first use, so that unreferenced strings never reach metacache
+    const char **interned;
+} dbpl4_reader_t;
+
+static int
+_reader_open (dbpl4_reader_t *rd, FILE *fp) {
+    struct stat st;
+    if (fstat (fileno (fp), &st) != 0 || st.st_size < DBPL4_HEADER_OFFSET + (off_t)sizeof (dbpl4_header_t)) {
+        return -1;
+    }
+    rd->size = (size_t)st.st_size;
+
+#ifndef __MINGW32__
+    void *ptr = mmap (NULL, rd->size, PROT_READ, MAP_PRIVATE, fileno (fp), 0);
+    if (ptr != MAP_FAILED) {
+        madvise (ptr, rd->size, MADV_SEQUENTIAL);
+        rd->data = ptr;
+        rd->mapped = 1;
+    }
+#endif
+    if (!rd->data) {
+        uint8_t *buffer = malloc (rd->size);
+        if (!buffer) {
+            return -1;
+        }
+        if (fseek (fp, 0, SEEK_SET) != 0 || fread (buffer, 1, rd->size, fp) != rd->size) {
+            free (buffer);
+            return -1;
+        }
+        rd->data = buffer;
+    }
+
+    rd->header = (const dbpl4_header_t *)(rd->data + DBPL4_HEADER_OFFSET);
+    const dbpl4_header_t *h = rd->header;
+
+    uint64_t required = DBPL4_HEADER_OFFSET + sizeof (dbpl4_header_t)
+        + (uint64_t)h->string_count * sizeof (dbpl4_string_t)
+        + (uint64_t)h->item_count * sizeof (dbpl4_item_t)
+        + ((uint64_t)h->meta_count + h->plt_meta_count) * sizeof (dbpl4_meta_t)
+        + h->string_data_size;
+    if (required > rd->size) {
+        trace ("dbpl: truncated playlist file\n");
+        return -1;
+    }
+
+    const uint8_t *p = rd->data + DBPL4_HEADER_OFFSET + sizeof (dbpl4_header_t);
+    rd->strings = (const dbpl4_string_t *)p;
+    p += (size_t)h->string_count * sizeof (dbpl4_string_t);
+    rd->items = (const dbpl4_item_t *)p;
+    p += (size_t)h->item_count * sizeof (dbpl4_item_t);
+    rd->metas = (const dbpl4_meta_t *)p;
+    p += ((size_t)h->meta_count + h->plt_meta_count) * sizeof (dbpl4_meta_t);
+    rd->string_data = (const char *)p;
+
+    rd->interned = calloc (h->string_count ? h->string_count : 1, sizeof (const char *));
+    if (!rd->interned) {
+        return -1;
+    }
+    return 0;
+}
+
+static void
+_reader_close (dbpl4_reader_t *rd) {
+    if (rd->interned) {
+        // drop the reference owned by the intern table
+        for (uint32_t i = 0; i < rd->header->string_count; i++) {
+            if (rd->interned[i]) {
+                metacache_remove_value (rd->interned[i], rd->strings[i].size);
+            }
+        }
+        free (rd->interned);
+    }
+    if (rd->data) {
+#ifndef __MINGW32__
+        if (rd->mapped) {
+            munmap ((void *)rd->data, rd->size);
+        }
+        else
+#endif
+        {
+            free ((void *)rd->data);
+        }
+    }
+}
+
+// Returns a metacache string with a new reference, or NULL if the index or the string is invalid
+static const char *
+_reader_string (dbpl4_reader_t *rd, uint32_t idx) {
+    if (idx >= rd->header->string_count) {
+        return NULL;
+    }
+    const char *str = rd->interned[idx];
+    if (str) {
+        metacache_ref_value (str);
+        return str;
+    }
+
+    const dbpl4_string_t *s = &rd->strings[idx];
+    if (s->size == 0
+        || (uint64_t)s->offset + s->size > rd->header->string_data_size
+        || rd->string_data[s->offset + s->size - 1] != 0) {
+        return NULL;
+    }
+    str = metacache_add_value (rd->string_data + s->offset, s->size);
+    rd->interned[idx] = str;
+    metacache_ref_value (str);
+    return str;
+}
+
+static int
+_load_item_meta (dbpl4_reader_t *rd, playItem_t *it, const dbpl4_item_t *rec) {
+    if ((uint64_t)rec->meta_first + rec->meta_count > rd->header->meta_count) {
+        return -1;
+    }
+
+    DB_metaInfo_t *tail = NULL;
+    for (uint32_t i = 0; i < rec->meta_count; i++) {
+        const dbpl4_meta_t *pair = &rd->metas[rec->meta_first + i];
+        const char *key = _reader_string (rd, pair->key);
+        if (!key) {
+            return -1;
+        }
+        if (key[0] != ':' && pair->value < rd->header->string_count && rd->strings[pair->value].size <= 1) {
+            // same as pl_add_meta: empty values are only allowed for properties
+            metacache_remove_string (key);
+            continue;
+        }
+        const char *value = _reader_string (rd, pair->value);
+        if (!value) {
+            metacache_remove_string (key);
+            return -1;
+        }
+
+        DB_metaInfo_t *m = calloc (1, sizeof (DB_metaInfo_t));
+        if (!m) {
+            metacache_remove_string (key);
+            metacache_remove_value (value, rd->strings[pair->value].size);
+            return -1;
+        }
+        m->key = key;
+        m->value = value;
+        m->valuesize = (int)rd->strings[pair->value].size;
+        if (tail) {
+            tail->next = m;
+        }
+        else {
+            it->meta = m;
+        }
+        tail = m;
+    }
+    return 0;
+}
+
+playItem_t *
+dbpl4_load (playlist_t *plt, playItem_t *after, FILE *fp, int *pabort, int (*cb)(playItem_t *it, void *data), void *user_data) {
+    dbpl4_reader_t rd = {0};
+    playItem_t *last_added = NULL;
+
+    if (_reader_open (&rd, fp) < 0) {
+        goto done;
+    }
+
+    for (uint32_t i = 0; i < rd.header->item_count; i++) {
+        const dbpl4_item_t *rec = &rd.items[i];
+        playItem_t *it = pl_item_alloc ();
+        if (!it) {
+            break;
+        }
+
+        it->startsample = rec->startsample >= 0x7fffffff ? 0x7fffffff : (int32_t)rec->startsample;
+        it->endsample = rec->endsample >= 0x7fffffff ? 0x7fffffff : (int32_t)rec->endsample;
+        if (rec->attrs & DBPL4_ITEM_HAS_STARTSAMPLE64) {
+            it->startsample64 = rec->startsample;
+            it->has_startsample64 = 1;
+        }
+        if (rec->attrs & DBPL4_ITEM_HAS_ENDSAMPLE64) {
+            it->endsample64 = rec->endsample;
+            it->has_endsample64 = 1;
+        }
+        it->_duration = rec->duration;
+        // :TAGS and :HAS_EMBEDDED_CUESHEET are stored with the rest of the metadata,
+        // no need to regenerate them via pl_set_item_flags
+        it->_flags = rec->flags;
+
+        // metacache and the playlist are shared with the other threads, so the lock is held
+        // while the strings are referenced, one item at a time to avoid blocking the UI
+        pl_lock ();
+        if (_load_item_meta (&rd, it, rec) < 0) {
+            trace ("dbpl: invalid metadata in item %d\n", (int)i);
+            pl_item_unref (it);
+            pl_unlock ();
+            break;
+        }
+
+        plt_insert_item (plt, after, it);
+        pl_unlock ();
+        after = it;
+        last_added = it;
+
+        int res = cb ? cb (it, user_data) : 0;
+        pl_item_unref (it);
+        if (res < 0 && pabort) {
+            *pabort = 1;
+        }
+        if (pabort && *pabort) {
+            break;
+        }
+    }
+
+    pl_lock ();
+    const dbpl4_meta_t *plt_metas = rd.metas + rd.header->meta_count;
+    for (uint32_t i = 0; i < rd.header->plt_meta_count; i++) {
+        const char *key = _reader_string (&rd, plt_metas[i].key);
+        const char *value = _reader_string (&rd, plt_metas[i].value);
+        if (key && value) {
+            // FIXME: multivalue support
+            plt_add_meta (plt, key, value);
+        }
+        if (key) {
+            metacache_remove_string (key);
+        }
+        if (value) {
+            metacache_remove_value (value, rd.strings[plt_metas[i].value].size);
+        }
+    }
+
+    pl_unlock ();
+
+done:
+    pl_lock ();
+    _reader_close (&rd);
+    pl_unlock ();
+    return last_added;
+}
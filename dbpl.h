@@ -0,0 +1,121 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef dbpl_h
+#define dbpl_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include "buffered_file_writer.h"
+#include "playlist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// DBPL 1.4 layout, all values in native byte order:
+//
+// "DBPL", uint8 major, uint8 minor, uint16 reserved
+// dbpl4_header_t
+// dbpl4_string_t[string_count]      -- string index, offsets into string data
+// dbpl4_item_t[item_count]          -- fixed size item records
+// dbpl4_meta_t[meta_count]          -- item key/value pairs, referenced by the item records
+// dbpl4_meta_t[plt_meta_count]      -- playlist key/value pairs
+// string data, string_data_size bytes
+//
+// Each distinct key and value is stored once in the string data,
+// so that the loader can map the file and intern every string only once.
+
+#define DBPL4_HEADER_OFFSET 8
+
+typedef struct {
+    uint32_t item_count;
+    uint32_t meta_count;
+    uint32_t plt_meta_count;
+    uint32_t string_count;
+    uint32_t string_data_size;
+    uint32_t reserved;
+} dbpl4_header_t;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t size; // including the terminating zero, multivalue parts are zero-separated
+} dbpl4_string_t;
+
+enum {
+    DBPL4_ITEM_HAS_STARTSAMPLE64 = 1<<0,
+    DBPL4_ITEM_HAS_ENDSAMPLE64 = 1<<1,
+};
+
+typedef struct {
+    int64_t startsample;
+    int64_t endsample;
+    float duration;
+    uint32_t flags;
+    uint32_t meta_first;
+    uint32_t meta_count;
+    uint32_t attrs;
+    uint32_t reserved;
+} dbpl4_item_t;
+
+typedef struct {
+    uint32_t key;
+    uint32_t value;
+} dbpl4_meta_t;
+
+typedef struct dbpl4_writer_s dbpl4_writer_t;
+
+// Collects the playlist data for writing.
+// Items and playlist metadata can be added in several steps, each under pl_lock,
+// the writer holds references to all collected strings.
+dbpl4_writer_t *
+dbpl4_writer_new (uint32_t item_count_hint);
+
+void
+dbpl4_writer_free (dbpl4_writer_t *w);
+
+// Must be called with pl_lock held.
+int
+dbpl4_writer_add_item (dbpl4_writer_t *w, playItem_t *it);
+
+// Must be called with pl_lock held.
+int
+dbpl4_writer_add_playlist_meta (dbpl4_writer_t *w, playlist_t *plt);
+
+// Writes everything after the version bytes, doesn't require pl_lock.
+int
+dbpl4_writer_write (dbpl4_writer_t *w, buffered_file_writer_t *writer);
+
+// Loads the items and playlist metadata from an open DBPL 1.4 file,
+// and inserts the items after the given one.
+// The callback is called for each inserted item, and stops the loading by returning a negative value.
+// Takes pl_lock while the items are built and inserted, the file is read without it.
+// Returns the last loaded item (without a reference), or NULL.
+playItem_t *
+dbpl4_load (playlist_t *plt, playItem_t *after, FILE *fp, int *pabort, int (*cb)(playItem_t *it, void *data), void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* dbpl_h */
@@ -71,6 +71,7 @@ extern "C" {
 // that there's a better replacement in the newer deadbeef versions.
 
 // API version history:
+// 1.17 -- deadbeef-1.10.0
 // 1.16 -- deadbeef-1.9.4
 // 1.15 -- deadbeef-1.9.0
 // 1.14 -- deadbeef-1.8.8
@@ -100,7 +101,7 @@ extern "C" {
 // 0.1 -- deadbeef-0.2.0
 
 #define DB_API_VERSION_MAJOR 1
-#define DB_API_VERSION_MINOR 16
+#define DB_API_VERSION_MINOR 17
 
 #if defined(__clang__)
 
@@ -137,6 +138,12 @@ extern "C" {
 #define DDB_API_LEVEL DB_API_VERSION_MINOR
 #endif
 
+#if (DDB_WARN_DEPRECATED && DDB_API_LEVEL >= 17)
+#define DEPRECATED_117 DDB_DEPRECATED("since deadbeef API 1.17")
+#else
+#define DEPRECATED_117
+#endif
+
 #if (DDB_WARN_DEPRECATED && DDB_API_LEVEL >= 16)
 #define DEPRECATED_116 DDB_DEPRECATED("since deadbeef API 1.16")
 #else
@@ -660,6 +667,33 @@ typedef struct {
     int is_dsd;
 } ddb_waveformat_t;
 
+// since 1.17
+#if (DDB_API_LEVEL >= 17)
+/// A stream position which a decoder can start decoding from
+typedef struct {
+    int64_t sample;
+    int64_t offset;
+} ddb_seekpoint_t;
+
+/// Stream information derived by a decoder, which can be stored in the decode info cache,
+/// to avoid scanning the file again on the next insert / playback / seek.
+typedef struct {
+    int64_t totalsamples; // total number of samples in the stream, including encoder delay and padding
+    float duration; // seconds
+    int delay; // encoder delay in samples
+    int padding; // encoder padding in samples
+    ddb_waveformat_t fmt;
+
+    // Sparse seek table, sorted by sample
+    const ddb_seekpoint_t *seekpoints;
+    int num_seekpoints;
+
+    // Decoder-specific data, opaque to the player
+    const void *extra;
+    int extra_size;
+} ddb_decode_info_t;
+#endif
+
 // since 1.5
 #if (DDB_API_LEVEL >= 5)
 
@@ -1681,6 +1715,34 @@ typedef struct {
     /// since this function internally uses streamer_lock, which may cause a deadlock against pl_lock.
     ddb_playItem_t * (*streamer_get_playing_track_safe) (void);
 #endif
+
+#if (DDB_API_LEVEL >= 17)
+    /// Look up the cached decode info of a local file.
+    /// The entry is only returned if it was stored by the same decoder,
+    /// and the file size and modification time haven't changed since.
+    /// @param fname File path
+    /// @param decoder_id ID of the decoder plugin
+    /// @return A copy of the cached info, which must be freed using @c decode_info_free, or NULL.
+    ddb_decode_info_t * (*decode_info_get) (const char *fname, const char *decoder_id);
+
+    /// Store the decode info of a local file, replacing the existing entry.
+    /// The data is copied, and persisted across sessions.
+    /// @return 0 on success, -1 if the file can't be cached (e.g. it's not a local file)
+    int (*decode_info_set) (const char *fname, const char *decoder_id, const ddb_decode_info_t *info);
+
+    /// Free the info returned by @c decode_info_get
+    void (*decode_info_free) (ddb_decode_info_t *info);
+
+    /// Same as @c fopen, with a combination of @c ddb_vfs_open_flags_t,
+    /// which tell the VFS plugin how the file is going to be accessed.
+    /// The VFS plugins which don't support the flags will ignore them.
+    DB_FILE* (*fopen2) (const char *fname, uint32_t flags);
+
+    /// Same as @c pl_save_current and @c pl_save_all, but the playlists are saved in the background.
+    /// Repeated requests are coalesced, and the errors are only logged.
+    void (*pl_save_current_deferred) (void);
+    void (*pl_save_all_deferred) (void);
+#endif
 } DB_functions_t;
 
 // NOTE: an item placement must be selected like this
@@ -2114,6 +2176,18 @@ typedef struct {
     DB_plugin_t plugin;
 } DB_misc_t;
 
+#if (DDB_API_LEVEL >= 17)
+typedef enum {
+    /// The file is going to be read mostly sequentially, e.g. for decoding.
+    /// Allows larger read-ahead, and passing access pattern hints to the OS.
+    DDB_VFS_OPEN_SEQUENTIAL = 1 << 0,
+
+    /// Map the file into memory, if possible.
+    /// Only useful for local files, which are not expected to change while open.
+    DDB_VFS_OPEN_MMAP = 1 << 1,
+} ddb_vfs_open_flags_t;
+#endif
+
 // vfs plugin
 // provides means for reading, seeking, etc
 // api is based on stdio
@@ -2164,6 +2238,11 @@ typedef struct DB_vfs_s {
     // Optional method to abort any file / stream operation on a file with specified identifier
     void (*abort_with_identifier) (uint64_t identifier);
 #endif
+
+#if (DDB_API_LEVEL >= 17)
+    // Optional method, same as open, with a combination of ddb_vfs_open_flags_t
+    DB_FILE* (*open2) (const char *fname, uint32_t flags);
+#endif
 } DB_vfs_t;
 
 // gui plugin
@@ -0,0 +1,605 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "decodeinfo.h"
+#include "threading.h"
+
+//#define trace(...) { fprintf(stderr, __VA_ARGS__); }
+#define trace(fmt,...)
+
+#define DECODE_INFO_MAGIC "DDIC"
+#define DECODE_INFO_VERSION 2
+
+#define DECODE_INFO_MAX_ENTRIES 50000
+#define DECODE_INFO_MAX_SEEKPOINTS 4096
+#define DECODE_INFO_MAX_EXTRA_SIZE 4096
+#define DECODE_INFO_MAX_STRING_SIZE 4096
+#define DECODE_INFO_INITIAL_BUCKETS 1024
+
+typedef struct decode_info_entry_s {
+    char *fname;
+    char *decoder_id;
+    int64_t size;
+    int64_t mtime; // in nanoseconds
+    uint32_t hash;
+
+    int64_t totalsamples;
+    float duration;
+    int delay;
+    int padding;
+    ddb_waveformat_t fmt;
+    ddb_seekpoint_t *seekpoints;
+    int num_seekpoints;
+    void *extra;
+    int extra_size;
+
+    struct decode_info_entry_s *next_in_bucket;
+
+    // least recently used entries are evicted first
+    struct decode_info_entry_s *lru_prev;
+    struct decode_info_entry_s *lru_next;
+} decode_info_entry_t;
+
+// On-disk record, followed by fname, decoder_id, seekpoints and extra data.
+// All values are in native byte order.
+typedef struct {
+    uint32_t fname_size; // including the terminating zero
+    uint32_t decoder_id_size; // including the terminating zero
+    int64_t size;
+    int64_t mtime;
+    int64_t totalsamples;
+    float duration;
+    int32_t delay;
+    int32_t padding;
+    int32_t bps;
+    int32_t channels;
+    int32_t samplerate;
+    uint32_t channelmask;
+    int32_t is_float;
+    int32_t is_bigendian;
+    int32_t is_dsd;
+    uint32_t num_seekpoints;
+    uint32_t extra_size;
+} decode_info_record_t;
+
+static uintptr_t _mutex;
+static decode_info_entry_t **_buckets;
+static uint32_t _num_buckets;
+static uint32_t _count;
+static decode_info_entry_t *_lru_head; // most recently used
+static decode_info_entry_t *_lru_tail;
+static int _modified;
+
+#pragma mark - Hash table
+
+static uint32_t
+_str_hash (const char *str) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (const uint8_t *p = (const uint8_t *)str; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void
+_entry_free (decode_info_entry_t *entry) {
+    free (entry->fname);
+    free (entry->decoder_id);
+    free (entry->seekpoints);
+    free (entry->extra);
+    free (entry);
+}
+
+static void
+_lru_unlink (decode_info_entry_t *entry) {
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    }
+    else {
+        _lru_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    }
+    else {
+        _lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void
+_lru_push_head (decode_info_entry_t *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = _lru_head;
+    if (_lru_head) {
+        _lru_head->lru_prev = entry;
+    }
+    _lru_head = entry;
+    if (!_lru_tail) {
+        _lru_tail = entry;
+    }
+}
+
+static decode_info_entry_t *
+_find (const char *fname, uint32_t hash) {
+    if (!_num_buckets) {
+        return NULL;
+    }
+    for (decode_info_entry_t *entry = _buckets[hash & (_num_buckets-1)]; entry; entry = entry->next_in_bucket) {
+        if (entry->hash == hash && !strcmp (entry->fname, fname)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static int
+_grow (void) {
+    uint32_t num_buckets = _num_buckets ? _num_buckets * 2 : DECODE_INFO_INITIAL_BUCKETS;
+    decode_info_entry_t **buckets = calloc (num_buckets, sizeof (decode_info_entry_t *));
+    if (!buckets) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < _num_buckets; i++) {
+        decode_info_entry_t *entry = _buckets[i];
+        while (entry) {
+            decode_info_entry_t *next = entry->next_in_bucket;
+            uint32_t idx = entry->hash & (num_buckets-1);
+            entry->next_in_bucket = buckets[idx];
+            buckets[idx] = entry;
+            entry = next;
+        }
+    }
+    free (_buckets);
+    _buckets = buckets;
+    _num_buckets = num_buckets;
+    return 0;
+}
+
+static void
+_remove (decode_info_entry_t *entry) {
+    decode_info_entry_t **pentry = &_buckets[entry->hash & (_num_buckets-1)];
+    while (*pentry != entry) {
+        pentry = &(*pentry)->next_in_bucket;
+    }
+    *pentry = entry->next_in_bucket;
+    _lru_unlink (entry);
+    _count--;
+    _entry_free (entry);
+}
+
+// Takes ownership of the entry, replacing an existing entry with the same file name.
+// Returns -1 and frees the entry, if the table could not be allocated.
+static int
+_insert (decode_info_entry_t *entry) {
+    decode_info_entry_t *existing = _find (entry->fname, entry->hash);
+    if (existing) {
+        _remove (existing);
+    }
+
+    // when growing fails, the existing buckets keep working with longer chains
+    if (_count >= _num_buckets && _grow () < 0 && !_num_buckets) {
+        _entry_free (entry);
+        return -1;
+    }
+
+    uint32_t idx = entry->hash & (_num_buckets-1);
+    entry->next_in_bucket = _buckets[idx];
+    _buckets[idx] = entry;
+    _lru_push_head (entry);
+    _count++;
+
+    while (_count > DECODE_INFO_MAX_ENTRIES) {
+        _remove (_lru_tail);
+    }
+    return 0;
+}
+
+#pragma mark - Public API
+
+void
+decode_info_cache_init (void) {
+    _mutex = mutex_create ();
+}
+
+void
+decode_info_cache_free (void) {
+    decode_info_cache_clear ();
+    free (_buckets);
+    _buckets = NULL;
+    _num_buckets = 0;
+    if (_mutex) {
+        mutex_free (_mutex);
+        _mutex = 0;
+    }
+}
+
+void
+decode_info_cache_clear (void) {
+    mutex_lock (_mutex);
+    while (_lru_head) {
+        _remove (_lru_head);
+    }
+    _modified = 1;
+    mutex_unlock (_mutex);
+}
+
+static int
+_stat_local_file (const char *fname, int64_t *size, int64_t *mtime) {
+    if (strstr (fname, "://")) {
+        return -1;
+    }
+    struct stat st;
+    if (stat (fname, &st) != 0 || !S_ISREG (st.st_mode)) {
+        return -1;
+    }
+    *size = (int64_t)st.st_size;
+    // with the nanoseconds, a file rewritten within the same second is detected as modified
+#if defined(__APPLE__)
+    *mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    *mtime = (int64_t)st.st_mtime * 1000000000;
+#else
+    *mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return 0;
+}
+
+ddb_decode_info_t *
+decode_info_get (const char *fname, const char *decoder_id) {
+    int64_t size, mtime;
+    if (_stat_local_file (fname, &size, &mtime) < 0) {
+        return NULL;
+    }
+
+    ddb_decode_info_t *info = NULL;
+    uint32_t hash = _str_hash (fname);
+
+    mutex_lock (_mutex);
+    decode_info_entry_t *entry = _find (fname, hash);
+    if (entry && (entry->size != size || entry->mtime != mtime)) {
+        // the file was modified
+        _remove (entry);
+        _modified = 1;
+        entry = NULL;
+    }
+    if (entry && !strcmp (entry->decoder_id, decoder_id)) {
+        _lru_unlink (entry);
+        _lru_push_head (entry);
+
+        // single allocation, released with decode_info_free
+        size_t seekpoints_size = entry->num_seekpoints * sizeof (ddb_seekpoint_t);
+        info = malloc (sizeof (ddb_decode_info_t) + seekpoints_size + entry->extra_size);
+        if (info) {
+            uint8_t *data = (uint8_t *)(info + 1);
+
+            info->totalsamples = entry->totalsamples;
+            info->duration = entry->duration;
+            info->delay = entry->delay;
+            info->padding = entry->padding;
+            info->fmt = entry->fmt;
+
+            info->num_seekpoints = entry->num_seekpoints;
+            info->seekpoints = entry->num_seekpoints ? (ddb_seekpoint_t *)data : NULL;
+            memcpy (data, entry->seekpoints, seekpoints_size);
+            data += seekpoints_size;
+
+            info->extra_size = entry->extra_size;
+            info->extra = entry->extra_size ? data : NULL;
+            memcpy (data, entry->extra, entry->extra_size);
+        }
+    }
+    mutex_unlock (_mutex);
+
+    return info;
+}
+
+int
+decode_info_set (const char *fname, const char *decoder_id, const ddb_decode_info_t *info) {
+    if (info->num_seekpoints < 0 || info->num_seekpoints > DECODE_INFO_MAX_SEEKPOINTS
+        || info->extra_size < 0 || info->extra_size > DECODE_INFO_MAX_EXTRA_SIZE
+        || strlen (fname) >= DECODE_INFO_MAX_STRING_SIZE || strlen (decoder_id) >= DECODE_INFO_MAX_STRING_SIZE) {
+        return -1;
+    }
+
+    int64_t size, mtime;
+    if (_stat_local_file (fname, &size, &mtime) < 0) {
+        return -1;
+    }
+
+    decode_info_entry_t *entry = calloc (1, sizeof (decode_info_entry_t));
+    if (!entry) {
+        return -1;
+    }
+    entry->fname = strdup (fname);
+    entry->decoder_id = strdup (decoder_id);
+    if (!entry->fname || !entry->decoder_id) {
+        _entry_free (entry);
+        return -1;
+    }
+    entry->size = size;
+    entry->mtime = mtime;
+    entry->hash = _str_hash (fname);
+    entry->totalsamples = info->totalsamples;
+    entry->duration = info->duration;
+    entry->delay = info->delay;
+    entry->padding = info->padding;
+    entry->fmt = info->fmt;
+    if (info->num_seekpoints > 0) {
+        entry->seekpoints = malloc (info->num_seekpoints * sizeof (ddb_seekpoint_t));
+        if (!entry->seekpoints) {
+            _entry_free (entry);
+            return -1;
+        }
+        memcpy (entry->seekpoints, info->seekpoints, info->num_seekpoints * sizeof (ddb_seekpoint_t));
+        entry->num_seekpoints = info->num_seekpoints;
+    }
+    if (info->extra_size > 0) {
+        entry->extra = malloc (info->extra_size);
+        if (!entry->extra) {
+            _entry_free (entry);
+            return -1;
+        }
+        memcpy (entry->extra, info->extra, info->extra_size);
+        entry->extra_size = info->extra_size;
+    }
+
+    mutex_lock (_mutex);
+    int res = _insert (entry);
+    if (!res) {
+        _modified = 1;
+    }
+    mutex_unlock (_mutex);
+    return res;
+}
+
+void
+decode_info_free (ddb_decode_info_t *info) {
+    free (info);
+}
+
+#pragma mark - Persistence
+
+static decode_info_entry_t *
+_read_entry (const uint8_t **pdata, const uint8_t *end) {
+    const uint8_t *data = *pdata;
+    decode_info_record_t rec;
+    if (end - data < (ptrdiff_t)sizeof (rec)) {
+        return NULL;
+    }
+    memcpy (&rec, data, sizeof (rec));
+    data += sizeof (rec);
+
+    if (rec.fname_size < 2 || rec.fname_size > DECODE_INFO_MAX_STRING_SIZE
+        || rec.decoder_id_size < 2 || rec.decoder_id_size > DECODE_INFO_MAX_STRING_SIZE
+        || rec.num_seekpoints > DECODE_INFO_MAX_SEEKPOINTS
+        || rec.extra_size > DECODE_INFO_MAX_EXTRA_SIZE) {
+        return NULL;
+    }
+
+    size_t seekpoints_size = rec.num_seekpoints * sizeof (ddb_seekpoint_t);
+    size_t payload_size = rec.fname_size + rec.decoder_id_size + seekpoints_size + rec.extra_size;
+    if ((size_t)(end - data) < payload_size) {
+        return NULL;
+    }
+
+    const char *fname = (const char *)data;
+    const char *decoder_id = fname + rec.fname_size;
+    if (fname[rec.fname_size-1] || decoder_id[rec.decoder_id_size-1]) {
+        return NULL;
+    }
+
+    decode_info_entry_t *entry = calloc (1, sizeof (decode_info_entry_t));
+    if (!entry) {
+        return NULL;
+    }
+    entry->fname = strdup (fname);
+    entry->decoder_id = strdup (decoder_id);
+    if (!entry->fname || !entry->decoder_id) {
+        _entry_free (entry);
+        return NULL;
+    }
+    entry->hash = _str_hash (entry->fname);
+    entry->size = rec.size;
+    entry->mtime = rec.mtime;
+    entry->totalsamples = rec.totalsamples;
+    entry->duration = rec.duration;
+    entry->delay = rec.delay;
+    entry->padding = rec.padding;
+    entry->fmt.bps = rec.bps;
+    entry->fmt.channels = rec.channels;
+    entry->fmt.samplerate = rec.samplerate;
+    entry->fmt.channelmask = rec.channelmask;
+    entry->fmt.is_float = rec.is_float;
+    entry->fmt.is_bigendian = rec.is_bigendian;
+    entry->fmt.is_dsd = rec.is_dsd;
+
+    data += rec.fname_size + rec.decoder_id_size;
+    if (rec.num_seekpoints) {
+        entry->seekpoints = malloc (seekpoints_size);
+        if (!entry->seekpoints) {
+            _entry_free (entry);
+            return NULL;
+        }
+        memcpy (entry->seekpoints, data, seekpoints_size);
+        entry->num_seekpoints = rec.num_seekpoints;
+        data += seekpoints_size;
+    }
+    if (rec.extra_size) {
+        entry->extra = malloc (rec.extra_size);
+        if (!entry->extra) {
+            _entry_free (entry);
+            return NULL;
+        }
+        memcpy (entry->extra, data, rec.extra_size);
+        entry->extra_size = rec.extra_size;
+        data += rec.extra_size;
+    }
+
+    *pdata = data;
+    return entry;
+}
+
+int
+decode_info_cache_load (const char *fname) {
+    FILE *fp = fopen (fname, "rb");
+    if (!fp) {
+        return -1;
+    }
+
+    uint8_t *buffer = NULL;
+    int res = -1;
+
+    if (fseek (fp, 0, SEEK_END) < 0) {
+        goto error;
+    }
+    long size = ftell (fp);
+    if (size < 12) {
+        goto error;
+    }
+    rewind (fp);
+
+    buffer = malloc (size);
+    if (!buffer || fread (buffer, 1, size, fp) != (size_t)size) {
+        goto error;
+    }
+
+    uint32_t version, count;
+    memcpy (&version, buffer + 4, 4);
+    memcpy (&count, buffer + 8, 4);
+    if (memcmp (buffer, DECODE_INFO_MAGIC, 4) || version != DECODE_INFO_VERSION) {
+        trace ("decodeinfo: %s has unsupported format, ignored\n", fname);
+        goto error;
+    }
+
+    decode_info_cache_clear ();
+
+    const uint8_t *data = buffer + 12;
+    const uint8_t *end = buffer + size;
+
+    mutex_lock (_mutex);
+    // the entries are stored from least to most recently used
+    for (uint32_t i = 0; i < count; i++) {
+        decode_info_entry_t *entry = _read_entry (&data, end);
+        if (!entry) {
+            trace ("decodeinfo: %s is corrupted, loaded %d entries\n", fname, (int)i);
+            break;
+        }
+        if (_insert (entry) < 0) {
+            break;
+        }
+    }
+    _modified = 0;
+    mutex_unlock (_mutex);
+
+    res = 0;
+error:
+    free (buffer);
+    fclose (fp);
+    return res;
+}
+
+int
+decode_info_cache_save (const char *fname) {
+    int res = -1;
+
+    mutex_lock (_mutex);
+    if (!_modified) {
+        mutex_unlock (_mutex);
+        return 0;
+    }
+
+    char tempname[PATH_MAX];
+    if (snprintf (tempname, sizeof (tempname), "%s.tmp", fname) >= (int)sizeof (tempname)) {
+        goto error;
+    }
+
+    FILE *fp = fopen (tempname, "w+b");
+    if (!fp) {
+        goto error;
+    }
+
+    uint32_t version = DECODE_INFO_VERSION;
+    int err = fwrite (DECODE_INFO_MAGIC, 1, 4, fp) != 4
+        || fwrite (&version, 1, 4, fp) != 4
+        || fwrite (&_count, 1, 4, fp) != 4;
+
+    for (decode_info_entry_t *entry = _lru_tail; entry && !err; entry = entry->lru_prev) {
+        decode_info_record_t rec = {
+            .fname_size = (uint32_t)strlen (entry->fname) + 1,
+            .decoder_id_size = (uint32_t)strlen (entry->decoder_id) + 1,
+            .size = entry->size,
+            .mtime = entry->mtime,
+            .totalsamples = entry->totalsamples,
+            .duration = entry->duration,
+            .delay = entry->delay,
+            .padding = entry->padding,
+            .bps = entry->fmt.bps,
+            .channels = entry->fmt.channels,
+            .samplerate = entry->fmt.samplerate,
+            .channelmask = entry->fmt.channelmask,
+            .is_float = entry->fmt.is_float,
+            .is_bigendian = entry->fmt.is_bigendian,
+            .is_dsd = entry->fmt.is_dsd,
+            .num_seekpoints = entry->num_seekpoints,
+            .extra_size = entry->extra_size,
+        };
+
+        size_t seekpoints_size = entry->num_seekpoints * sizeof (ddb_seekpoint_t);
+        err = fwrite (&rec, 1, sizeof (rec), fp) != sizeof (rec)
+            || fwrite (entry->fname, 1, rec.fname_size, fp) != rec.fname_size
+            || fwrite (entry->decoder_id, 1, rec.decoder_id_size, fp) != rec.decoder_id_size
+            || (seekpoints_size && fwrite (entry->seekpoints, 1, seekpoints_size, fp) != seekpoints_size)
+            || (rec.extra_size && fwrite (entry->extra, 1, rec.extra_size, fp) != rec.extra_size);
+    }
+
+    if (fclose (fp) || err) {
+        unlink (tempname);
+        goto error;
+    }
+
+    if (rename (tempname, fname)) {
+        trace ("decodeinfo: failed to move %s to %s\n", tempname, fname);
+        unlink (tempname);
+        goto error;
+    }
+
+    _modified = 0;
+    res = 0;
+error:
+    mutex_unlock (_mutex);
+    return res;
+}
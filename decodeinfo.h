@@ -0,0 +1,67 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef decodeinfo_h
+#define decodeinfo_h
+
+#include "deadbeef.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Cache of stream information derived by decoders (duration, format, encoder delay/padding, seek table),
+// keyed by file path, and validated against file size and modification time.
+
+void
+decode_info_cache_init (void);
+
+void
+decode_info_cache_free (void);
+
+// Remove all entries
+void
+decode_info_cache_clear (void);
+
+// Replaces the cache contents with the contents of the file
+int
+decode_info_cache_load (const char *fname);
+
+// Writes the cache to the file, if it was modified since the last load/save
+int
+decode_info_cache_save (const char *fname);
+
+ddb_decode_info_t *
+decode_info_get (const char *fname, const char *decoder_id);
+
+int
+decode_info_set (const char *fname, const char *decoder_id, const ddb_decode_info_t *info);
+
+void
+decode_info_free (ddb_decode_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* decodeinfo_h */
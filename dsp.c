@@ -33,12 +33,16 @@
 #include "plugins.h"
 #include "conf.h"
 #include "premix.h"
+#include "threading.h"
 
 static ddb_dsp_context_t *_current_dsp_chain;
 static DB_dsp_t *_eqplug;
 static ddb_dsp_context_t *_eq;
 static int _dsp_on = 0;
 
+// protects the chain against changes and resets while a block is being processed
+static uintptr_t _dsp_mutex;
+
 static char *_dsp_input_buffer;
 static int _dsp_input_buffer_size;
 
@@ -60,10 +64,26 @@ dsp_free (void) {
 
     _eqplug = NULL;
     _eq = NULL;
+
+    if (_dsp_mutex) {
+        mutex_free (_dsp_mutex);
+        _dsp_mutex = 0;
+    }
+}
+
+void
+dsp_lock (void) {
+    mutex_lock (_dsp_mutex);
+}
+
+void
+dsp_unlock (void) {
+    mutex_unlock (_dsp_mutex);
 }
 
 void
 dsp_reset (void) {
+    dsp_lock ();
     // reset dsp
     ddb_dsp_context_t *dsp = _current_dsp_chain;
     while (dsp) {
@@ -72,6 +92,7 @@ dsp_reset (void) {
         }
         dsp = dsp->next;
     }
+    dsp_unlock ();
 }
 
 static char *
@@ -137,11 +158,13 @@ dsp_clone (ddb_dsp_context_t *from) {
 void
 streamer_set_dsp_chain_real (ddb_dsp_context_t *chain) {
     streamer_lock ();
+    dsp_lock ();
     dsp_chain_free (_current_dsp_chain);
     _current_dsp_chain = chain;
     _eq = NULL;
 
     streamer_dsp_postinit ();
+    dsp_unlock ();
     streamer_dsp_chain_save();
 
     streamer_unlock ();
@@ -294,6 +317,7 @@ streamer_dsp_postinit (void) {
     // note about EQ hack:
     // we 1st check if there's an EQ in dsp chain, and just use it
     // if not -- we add our own
+    dsp_lock ();
 
     // eq plug
     if (_eqplug) {
@@ -328,11 +352,13 @@ streamer_dsp_postinit (void) {
     else if (!ctx) {
         _dsp_on = 0;
     }
-
+    dsp_unlock ();
 }
 
 void
 streamer_dsp_init (void) {
+    _dsp_mutex = mutex_create ();
+
     // load dsp chain from file
     char fname[PATH_MAX];
     snprintf (fname, sizeof (fname), "%s/dspconfig", plug_get_config_dir ());
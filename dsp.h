@@ -42,6 +42,14 @@ dsp_free (void);
 void
 dsp_reset (void);
 
+// Must be held while calling dsp_apply, and while using its output.
+// Lock order: streamer_lock, then dsp_lock.
+void
+dsp_lock (void);
+
+void
+dsp_unlock (void);
+
 int
 streamer_dsp_chain_save (void);
 
@@ -1024,6 +1024,25 @@ can_be_shift_jis (const unsigned char *str, int size) {
 }
 
 
+// Returns 1 if the text frame data is already valid utf8.
+// That's true for utf8 frames, and for plain ascii in single-byte charsets, except shift-jis,
+// which has different characters at 0x5c and 0x7e.
+static int
+junk_id3v2_text_is_utf8 (const char *enc, uint8_t encoding, const uint8_t *str, int sz) {
+    if (!strcmp (enc, UTF8_STR)) {
+        return u8_valid ((const char *)str, sz, NULL);
+    }
+    if (encoding != 0 || !strcasecmp (enc, "shift-jis")) {
+        return 0;
+    }
+    for (int i = 0; i < sz; i++) {
+        if (str[i] & 0x80) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 static char *
 convstr_id3v2 (const char *sb_charset, int version, uint8_t encoding, const uint8_t *str, int sz, int *out_size) {
     const char *enc = NULL;
@@ -1087,7 +1106,13 @@ convstr_id3v2 (const char *sb_charset, int version, uint8_t encoding, const uint
 
     int outlen = sz*4+1;
     char *out = malloc (outlen);
-    if ((converted_sz = junk_iconv (str, sz, out, outlen, enc, UTF8_STR)) < 0) {
+    if (junk_id3v2_text_is_utf8 (enc, encoding, str, sz)) {
+        // no conversion required, skip iconv setup
+        memcpy (out, str, sz);
+        out[sz] = 0;
+        converted_sz = sz;
+    }
+    else if ((converted_sz = junk_iconv (str, sz, out, outlen, enc, UTF8_STR)) < 0) {
         free (out);
         return NULL;
     }
@@ -1579,6 +1604,66 @@ junk_add_disc_meta (playItem_t *it, const char *disc) {
     return 0;
 }
 
+// Allocator for the data of a single tag parse.
+// Allocations are never freed individually, junk_arena_free releases everything at once.
+#define JUNK_ARENA_BLOCK_SIZE 16384
+
+typedef struct junk_arena_block_s {
+    struct junk_arena_block_s *next;
+    size_t size;
+    size_t used;
+    uint8_t data[0];
+} junk_arena_block_t;
+
+typedef struct {
+    junk_arena_block_t *blocks;
+} junk_arena_t;
+
+static void *
+junk_arena_alloc (junk_arena_t *arena, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    junk_arena_block_t *block = arena->blocks;
+    if (block && block->size - block->used >= size) {
+        void *ptr = block->data + block->used;
+        block->used += size;
+        return ptr;
+    }
+
+    size_t block_size = max (size, JUNK_ARENA_BLOCK_SIZE);
+    block = malloc (sizeof (junk_arena_block_t) + block_size);
+    if (!block) {
+        return NULL;
+    }
+    block->size = block_size;
+    block->used = size;
+    if (arena->blocks && block_size > JUNK_ARENA_BLOCK_SIZE) {
+        // large allocation, keep using the free space of the current block
+        block->next = arena->blocks->next;
+        arena->blocks->next = block;
+    }
+    else {
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+    return block->data;
+}
+
+static void
+junk_arena_free (junk_arena_t *arena) {
+    while (arena->blocks) {
+        junk_arena_block_t *next = arena->blocks->next;
+        free (arena->blocks);
+        arena->blocks = next;
+    }
+}
+
+// Returns 1 for the items which are added to the track metadata
+static int
+junk_apev2_is_metadata_item (uint32_t itemsize, uint32_t itemflags, const char *key) {
+    int valuetype = ((itemflags >> 1) & 3);
+    return valuetype == 0 && (itemsize < MAX_TEXT_FRAME_SIZE || (!strcasecmp (key, "cuesheet") && itemsize < MAX_CUESHEET_FRAME_SIZE));
+}
+
 int
 junk_apev2_add_frame (playItem_t *it, DB_apev2_tag_t *tag_store, DB_apev2_frame_t **tail, uint32_t itemsize, uint32_t itemflags, const char *key, const uint8_t *value) {
     if (tag_store) {
@@ -1599,9 +1684,8 @@ junk_apev2_add_frame (playItem_t *it, DB_apev2_tag_t *tag_store, DB_apev2_frame_
     }
 
     if (it) {
-        int valuetype = ((itemflags >> 1) & 3);
         // add metainfo only if it's textual
-        if (valuetype == 0 && (itemsize < MAX_TEXT_FRAME_SIZE || (!strcasecmp (key, "cuesheet") && itemsize < MAX_CUESHEET_FRAME_SIZE))) {
+        if (junk_apev2_is_metadata_item (itemsize, itemflags, key)) {
             if (!u8_valid (value, itemsize, NULL)) {
                 trace ("junk_read_ape_full: bad encoding in text frame %s\n", key);
                 return -1;
@@ -1653,8 +1737,8 @@ junk_apev2_add_frame (playItem_t *it, DB_apev2_tag_t *tag_store, DB_apev2_frame_
     return 0;
 }
 
-int
-junk_apev2_read_full_mem (playItem_t *it, DB_apev2_tag_t *tag_store, char *mem, int memsize) {
+static int
+junk_apev2_read_items_mem (playItem_t *it, DB_apev2_tag_t *tag_store, char *mem, int memsize, junk_arena_t *arena) {
     char *end = mem+memsize;
 #define STEP(x,y) {mem+=(x);if(mem+(y)>end) {trace ("fail %d\n", (x));return -1;}}
 
@@ -1712,23 +1796,90 @@ junk_apev2_read_full_mem (playItem_t *it, DB_apev2_tag_t *tag_store, char *mem,
         if (itemsize <= MAX_APEV2_FRAME_SIZE) // just a sanity check
         {
             STEP(0,itemsize);
-            uint8_t *value = malloc (itemsize+1);
+            if (tag_store || (it && junk_apev2_is_metadata_item (itemsize, itemflags, key))) {
+                uint8_t *value = junk_arena_alloc (arena, itemsize+1);
+                if (!value) {
+                    trace ("junk_read_ape_full: failed to allocate %d bytes\n", itemsize+1);
+                    return -1;
+                }
+                memcpy (value, mem, itemsize);
+                value[itemsize] = 0;
+
+                junk_apev2_add_frame (it, tag_store, &tail, itemsize, itemflags, key, value);
+            }
+            STEP(itemsize, 8);
+        }
+        else {
+            STEP(itemsize,8);
+        }
+    }
+    return 0;
+#undef STEP
+}
+
+int
+junk_apev2_read_full_mem (playItem_t *it, DB_apev2_tag_t *tag_store, char *mem, int memsize) {
+    junk_arena_t arena = {0};
+    int res = junk_apev2_read_items_mem (it, tag_store, mem, memsize, &arena);
+    junk_arena_free (&arena);
+    return res;
+}
+
+static int
+junk_apev2_read_items (playItem_t *it, DB_apev2_tag_t *tag_store, DB_FILE *fp, uint32_t numitems, junk_arena_t *arena) {
+    DB_apev2_frame_t *tail = NULL;
+
+    for (int i = 0; i < numitems; i++) {
+        uint8_t buffer[8];
+        if (deadbeef->fread (buffer, 1, 8, fp) != 8) {
+            return -1;
+        }
+        uint32_t itemsize = extract_i32_le (&buffer[0]);
+        uint32_t itemflags = extract_i32_le (&buffer[4]);
+
+        // read key until 0 (stupid and slow)
+        char key[256];
+        int keysize = 0;
+        while (keysize <= 255) {
+            if (deadbeef->fread (&key[keysize], 1, 1, fp) != 1) {
+                return -1;
+            }
+            if (key[keysize] == 0) {
+                break;
+            }
+            if (key[keysize] < 0x20) {
+                return -1; // non-ascii chars and chars with codes 0..0x1f not allowed in ape item keys
+            }
+            keysize++;
+        }
+        key[255] = 0;
+        trace ("item %d, size %d, flags %08x, keysize %d, key %s\n", i, itemsize, itemflags, keysize, key);
+        // read value
+        if (itemsize <= MAX_APEV2_FRAME_SIZE // just a sanity check
+            && (tag_store || (it && junk_apev2_is_metadata_item (itemsize, itemflags, key)))) {
+            uint8_t *value = junk_arena_alloc (arena, itemsize+1);
             if (!value) {
                 trace ("junk_read_ape_full: failed to allocate %d bytes\n", itemsize+1);
                 return -1;
             }
-            memcpy (value, mem, itemsize);
+            if (deadbeef->fread (value, 1, itemsize, fp) != itemsize) {
+                trace ("junk_read_ape_full: failed to read %d bytes from file\n", itemsize);
+                return -1;
+            }
             value[itemsize] = 0;
 
             junk_apev2_add_frame (it, tag_store, &tail, itemsize, itemflags, key, value);
-
-            free (value);
-            STEP(itemsize, 8);
         }
         else {
-            STEP(itemsize,8);
+            // try to skip, this is also where binary items end up, unless they were requested
+            int err = deadbeef->fseek (fp, itemsize, SEEK_CUR);
+            if (0 != err) {
+                perror ("junklib: corrupted APEv2 tag\n");
+                return -1;
+            }
         }
     }
+
     return 0;
 }
 
@@ -1737,8 +1888,6 @@ junk_apev2_read_full (playItem_t *it, DB_apev2_tag_t *tag_store, DB_FILE *fp) {
     // try to read footer, position must be already at the EOF right before
     // id3v1 (if present)
 
-    DB_apev2_frame_t *tail = NULL;
-
     uint8_t header[32];
     if (deadbeef->fseek (fp, -32, SEEK_END) == -1) {
         return -1; // something bad happened
@@ -1787,61 +1936,10 @@ junk_apev2_read_full (playItem_t *it, DB_apev2_tag_t *tag_store, DB_FILE *fp) {
         return -1;
     }
 
-    int i;
-    for (i = 0; i < numitems; i++) {
-        uint8_t buffer[8];
-        if (deadbeef->fread (buffer, 1, 8, fp) != 8) {
-            return -1;
-        }
-        uint32_t itemsize = extract_i32_le (&buffer[0]);
-        uint32_t itemflags = extract_i32_le (&buffer[4]);
-
-        // read key until 0 (stupid and slow)
-        char key[256];
-        int keysize = 0;
-        while (keysize <= 255) {
-            if (deadbeef->fread (&key[keysize], 1, 1, fp) != 1) {
-                return -1;
-            }
-            if (key[keysize] == 0) {
-                break;
-            }
-            if (key[keysize] < 0x20) {
-                return -1; // non-ascii chars and chars with codes 0..0x1f not allowed in ape item keys
-            }
-            keysize++;
-        }
-        key[255] = 0;
-        trace ("item %d, size %d, flags %08x, keysize %d, key %s\n", i, itemsize, itemflags, keysize, key);
-        // read value
-        if (itemsize <= MAX_APEV2_FRAME_SIZE) // just a sanity check
-        {
-            uint8_t *value = malloc (itemsize+1);
-            if (!value) {
-                trace ("junk_read_ape_full: failed to allocate %d bytes\n", itemsize+1);
-                return -1;
-            }
-            if (deadbeef->fread (value, 1, itemsize, fp) != itemsize) {
-                trace ("junk_read_ape_full: failed to read %d bytes from file\n", itemsize);
-                free (value);
-                return -1;
-            }
-            value[itemsize] = 0;
-
-            junk_apev2_add_frame (it, tag_store, &tail, itemsize, itemflags, key, value);
-            free (value);
-        }
-        else {
-            // try to skip
-            int err = deadbeef->fseek (fp, itemsize, SEEK_CUR);
-            if (0 != err) {
-                perror ("junklib: corrupted APEv2 tag\n");
-                return -1;
-            }
-        }
-    }
-
-    return 0;
+    junk_arena_t arena = {0};
+    int res = junk_apev2_read_items (it, tag_store, fp, numitems, &arena);
+    junk_arena_free (&arena);
+    return res;
 }
 
 int
@@ -3605,14 +3703,14 @@ junk_apev2_free (DB_apev2_tag_t *tag) {
 }
 
 static int
-junklib_id3v2_sync_frame (const int version_major, uint8_t *data, const int synced_size, int *consumed_size) {
+junklib_id3v2_sync_frame (const int version_major, uint8_t *data, const int synced_size, const int available_size, int *consumed_size) {
     char *writeptr = data;
     int written = 0;
     int consumed = 0;
-    while (written < synced_size) {
+    while (written < synced_size && consumed < available_size) {
         *writeptr++ = *data;
         written++;
-        if (data[0] == 0xff && synced_size-written >= 2 && data[1] == 0) {
+        if (data[0] == 0xff && synced_size-written >= 2 && available_size-consumed >= 2 && data[1] == 0) {
             data++;
             consumed++;
         }
@@ -3962,7 +4060,7 @@ junk_id3v2_load_txx (const char *sb_charset, int version_major, playItem_t *it,
     }
 
     char *val = NULL;
-    for (char *p = txx; synched_size-- > 0; p++) {
+    for (char *p = txx; p < txx + decoded_size; p++) {
         if (*p == 0) {
             val = p+1;
             break;
@@ -4211,6 +4309,8 @@ junk_id3v2_set_metadata_from_frame (playItem_t *it, DB_id3v2_tag_t *id3v2_tag, D
                             }
                             pl_append_meta_full(it, frame_mapping[f+MAP_DDB], text, text_size+1);
                         }
+                    }
+                    if (text) {
                         free (text);
                     }
                     break;
@@ -4250,9 +4350,24 @@ junk_id3v2_set_metadata_from_frame (playItem_t *it, DB_id3v2_tag_t *id3v2_tag, D
 // Detect single-byte charset for the whole tag.
 // Ignore unicode and non-text frames.
 static const char *
-junk_id3v2_detect_charset (DB_id3v2_tag_t *id3v2_tag) {
+junk_id3v2_detect_charset (DB_id3v2_tag_t *id3v2_tag, junk_arena_t *arena) {
     int sz = 1000*200;
-    char *buf = calloc (1, sz);
+    int len = 0;
+
+    for (DB_id3v2_frame_t *frm = id3v2_tag->frames; frm; frm = frm->next) {
+        if (frm->id[0] == 'T' && sz - len >= frm->size && frm->data[0] == 0) {
+            len += frm->size-1;
+        }
+    }
+
+    if (len == 0) {
+        return NULL;
+    }
+
+    char *buf = junk_arena_alloc (arena, len);
+    if (!buf) {
+        return NULL;
+    }
     char *p = buf;
 
     for (DB_id3v2_frame_t *frm = id3v2_tag->frames; frm; frm = frm->next) {
@@ -4263,10 +4378,7 @@ junk_id3v2_detect_charset (DB_id3v2_tag_t *id3v2_tag) {
         }
     }
 
-    const char *cs = junk_detect_charset_len (buf, (int)(p-buf));
-
-    free (buf);
-    return cs;
+    return junk_detect_charset_len (buf, (int)(p-buf));
 }
 
 static int
@@ -4277,12 +4389,88 @@ junk_id3v2_set_metadata (playItem_t *it, DB_id3v2_tag_t *id3v2_tag, const char *
     return 0;
 }
 
-int
-junk_id3v2_read_full (playItem_t *it, DB_id3v2_tag_t *tag_store, DB_FILE *fp) {
-    int err = -1;
-    if (!tag_store) {
+// Sequential access to the frames of an id3v2 tag.
+// The frames are read directly from the file, except for tags with unsynchronisation,
+// where the raw size of a frame is only known after decoding, so such tags are loaded as a whole.
+typedef struct {
+    DB_FILE *fp;
+    uint8_t *mem;
+    uint32_t size; // size of the tag, excluding the header
+    uint32_t pos;
+} junk_id3v2_reader_t;
+
+static int
+junk_id3v2_reader_read (junk_id3v2_reader_t *reader, void *data, uint32_t size) {
+    if (size > reader->size - reader->pos) {
+        return -1;
+    }
+    if (reader->mem) {
+        memcpy (data, reader->mem + reader->pos, size);
+    }
+    else if (deadbeef->fread (data, 1, size, reader->fp) != size) {
         return -1;
     }
+    reader->pos += size;
+    return 0;
+}
+
+static int
+junk_id3v2_reader_skip (junk_id3v2_reader_t *reader, uint32_t size) {
+    if (size > reader->size - reader->pos) {
+        return -1;
+    }
+    if (!reader->mem && deadbeef->fseek (reader->fp, size, SEEK_CUR) != 0) {
+        // not seekable, read through
+        uint8_t buffer[4096];
+        for (uint32_t left = size; left > 0; ) {
+            uint32_t n = min (left, (uint32_t)sizeof (buffer));
+            if (deadbeef->fread (buffer, 1, n, reader->fp) != n) {
+                return -1;
+            }
+            left -= n;
+        }
+    }
+    reader->pos += size;
+    return 0;
+}
+
+// Returns 1 for the frames handled by junk_id3v2_set_metadata_from_frame
+static int
+junk_id3v2_is_metadata_frame (int version_major, const char *frameid) {
+    if (frameid[0] == 'T') {
+        return 1;
+    }
+    if (version_major == 2) {
+        return !strcmp (frameid, "COM") || !strcmp (frameid, "ULT");
+    }
+    return !strcmp (frameid, "COMM")
+        || !strcmp (frameid, "USLT")
+        || !strcmp (frameid, "RVA2")
+        || !strcmp (frameid, "UFID")
+        || !strcmp (frameid, "POPM");
+}
+
+// Returns 0 for compressed, encrypted, and otherwise unsupported frames
+static int
+junk_id3v2_frame_flags_supported (int version_major, uint8_t flags1, uint8_t flags2) {
+    if (version_major == 4) {
+        // unknown status / format flags, compression, encryption
+        return !(flags1 & 0x8f) && !(flags2 & 0xb0) && !(flags2 & 0x08) && !(flags2 & 0x04);
+    }
+    else if (version_major == 3) {
+        // unknown status / format flags, compression, encryption
+        return !(flags1 & 0x1f) && !(flags2 & 0x1f) && !(flags2 & 0x80) && !(flags2 & 0x40);
+    }
+    return 1;
+}
+
+// Reads the tag frames into tag_store.
+// Without an arena, all frames are read, and allocated with malloc, as expected by junk_id3v2_free.
+// With an arena, the frames are allocated from the arena, and only the frames which are used for the track metadata
+// are read, while pictures and other binary frames are skipped in the file.
+static int
+junk_id3v2_read_frames (playItem_t *it, DB_id3v2_tag_t *tag_store, DB_FILE *fp, junk_arena_t *arena) {
+    int err = -1;
     DB_id3v2_frame_t *tail = NULL;
     if (!fp) {
         trace ("bad call to junk_id3v2_read!\n");
@@ -4331,39 +4519,62 @@ junk_id3v2_read_full (playItem_t *it, DB_id3v2_tag_t *tag_store, DB_FILE *fp) {
     // remove unsync flag
     tag_store->flags &= ~ (1<<7);
 
-    uint8_t *tag = malloc (size);
-    if (!tag) {
-        fprintf (stderr, "junklib: out of memory while reading id3v2, tried to alloc %d bytes\n", size);
-        goto error;
-    }
-    if (deadbeef->fread (tag, 1, size, fp) != size) {
-        goto error; // bad size
-    }
-    uint8_t *readptr = tag;
     trace ("version: 2.%d.%d, unsync: %d, extheader: %d, experimental: %d\n", version_major, version_minor, unsync, extheader, expindicator);
-    
+
+    junk_arena_t scratch = {0};
+    junk_id3v2_reader_t reader = {
+        .fp = fp,
+        .size = size,
+    };
+
+    if (unsync) {
+        reader.mem = junk_arena_alloc (&scratch, size);
+        if (!reader.mem) {
+            fprintf (stderr, "junklib: out of memory while reading id3v2, tried to alloc %d bytes\n", size);
+            goto error;
+        }
+        if (deadbeef->fread (reader.mem, 1, size, fp) != size) {
+            goto error; // bad size
+        }
+    }
+
     if (extheader) {
-        uint32_t sz = (readptr[3] << 0) | (readptr[2] << 7) | (readptr[1] << 14) | (readptr[0] << 21);
+        uint8_t extsize[4];
+        if (junk_id3v2_reader_read (&reader, extsize, 4)) {
+            goto error;
+        }
+        uint32_t sz = (extsize[3] << 0) | (extsize[2] << 7) | (extsize[1] << 14) | (extsize[0] << 21);
         if (size < sz) {
             trace ("error: size of ext header (%d) is greater than tag size\n", sz);
             goto error; // bad size
         }
-        readptr += sz;
+        // the size includes the 4 bytes which were just read
+        if (sz > 4 && junk_id3v2_reader_skip (&reader, sz - 4)) {
+            goto error;
+        }
     }
 
     int found_wmp_popm = 0;
+    const uint32_t frame_header_size = version_major == 2 ? 6 : 10;
+
+    while (reader.size - reader.pos >= frame_header_size) {
+        uint8_t frame_header[10];
+        if (junk_id3v2_reader_read (&reader, frame_header, frame_header_size)) {
+            goto error;
+        }
+        if (frame_header[0] == 0) {
+            break; // padding
+        }
+
+        char frameid[5];
+        uint32_t sz;
+        uint8_t flags1 = 0;
+        uint8_t flags2 = 0;
+        uint32_t left = reader.size - reader.pos;
 
-    while (readptr - tag <= size - 4 && *readptr) {
         if (version_major == 3 || version_major == 4) {
-            trace ("pos %d of %d\n", readptr - tag, size);
-            char frameid[5];
-            memcpy (frameid, readptr, 4);
+            memcpy (frameid, frame_header, 4);
             frameid[4] = 0;
-            readptr += 4;
-            if (readptr - tag >= size - 4) {
-                trace ("reached the end of tag\n");
-                break;
-            }
 
             // a hack to support malformed ID3v2.2 frame names in 2.3+ tags
             // find the correct frame names, and rename if possible
@@ -4379,230 +4590,94 @@ junk_id3v2_read_full (playItem_t *it, DB_id3v2_tag_t *tag_store, DB_FILE *fp) {
                 }
             }
 
-            uint32_t sz;
+            const uint8_t *p = frame_header + 4;
             if (version_major == 4) {
-                sz = (readptr[3] << 0) | (readptr[2] << 7) | (readptr[1] << 14) | (readptr[0] << 21);
-            }
-            else if (version_major == 3) {
-                sz = (readptr[3] << 0) | (readptr[2] << 8) | (readptr[1] << 16) | (readptr[0] << 24);
+                sz = (p[3] << 0) | (p[2] << 7) | (p[1] << 14) | (p[0] << 21);
             }
             else {
-                trace ("unknown id3v2 version (2.%d.%d)\n", version_major, version_minor);
-                goto error;
+                sz = (p[3] << 0) | (p[2] << 8) | (p[1] << 16) | (p[0] << 24);
             }
-            readptr += 4;
-            trace ("got frame %s, size %d, pos %d, tagsize %d\n", frameid, sz, readptr-tag, size);
-            if (readptr - tag >= size - sz) {
+            flags1 = frame_header[8];
+            flags2 = frame_header[9];
+            trace ("got frame %s, size %d, pos %d, tagsize %d\n", frameid, sz, reader.pos, size);
+
+            if (sz <= size && sz > left + 1) {
                 trace ("frame is out of tag bounds\n");
-                err = -1;
                 goto error; // size of frame is more than size of tag
             }
-            if (sz < 1) {
-//                err = 1;
-                break; // frame must be at least 1 byte long
-            }
-            uint8_t flags1 = readptr[0];
-            uint8_t flags2 = readptr[1];
-            readptr += 2;
-
-            if (!strcmp (frameid, "APIC")) {
-                // don't attempt to parse APIC when we're not planning to use it
-                if (tag_store == NULL) {
-                    readptr += sz;
-                    continue;
-                }
-            }
-            else if (sz > MAX_ID3V2_FRAME_SIZE) {
-                trace ("junk_id3v2_read_full: frame %s size is too big (%d), discarded\n", frameid, sz);
-                readptr += sz;
-                continue;
-            }
-
-            if (readptr - tag + sz > size) {
-                trace ("junk_id3v2_read_full: frame %s size is crossing beyond the end of tag (%d), discarded\n", frameid, sz);
-                readptr += sz;
-                continue;
-            }
+        }
+        else {
+            memcpy (frameid, frame_header, 3);
+            frameid[3] = 0;
+            const uint8_t *p = frame_header + 3;
+            sz = (p[2] << 0) | (p[1] << 8) | (p[0] << 16);
+        }
 
-            int synched_size = sz;
-            if (unsync) {
-                int consumed = 0;
-                synched_size = junklib_id3v2_sync_frame (version_major, readptr, sz, &consumed);
-                sz = consumed;
+        if (sz < 1) {
+            break; // frame must be at least 1 byte long
+        }
 
-                trace ("size: %d/%d\n", synched_size, sz);
-            }
+        if (sz > left) {
+            trace ("junk_id3v2_read_full: frame %s size is crossing beyond the end of tag (%d), discarded\n", frameid, sz);
+            break;
+        }
 
-            DB_id3v2_frame_t *frm = NULL;
-            frm = malloc (sizeof (DB_id3v2_frame_t) + sz);
-            if (!frm) {
-                fprintf (stderr, "junklib: failed to alloc %d bytes for id3v2 frame %s\n", (int)(sizeof (DB_id3v2_frame_t) + sz), frameid);
+        if (sz > MAX_ID3V2_FRAME_SIZE && strcmp (frameid, version_major == 2 ? "PIC" : "APIC")) {
+            trace ("junk_id3v2_read_full: frame %s size is too big (%d), discarded\n", frameid, sz);
+            if (junk_id3v2_reader_skip (&reader, sz)) {
                 goto error;
             }
-
-            memset (frm, 0, sizeof (DB_id3v2_frame_t));
-            if (tail) {
-                tail->next = frm;
-            }
-            tail = frm;
-            if (!tag_store->frames) {
-                tag_store->frames = frm;
-            }
-            strcpy (frm->id, frameid);
-            memcpy (frm->data, readptr, sz);
-            frm->size = synched_size;
-
-            frm->flags[0] = flags1;
-            frm->flags[1] = flags2;
-
-            if (version_major == 4) {
-                if (flags1 & 0x8f) {
-                    // unknown flags
-                    trace ("unknown status flags: %02x\n", flags1);
-                    readptr += sz;
-                    continue;
-                }
-                if (flags2 & 0xb0) {
-                    // unknown flags
-                    trace ("unknown format flags: %02x\n", flags2);
-                    readptr += sz;
-                    continue;
-                }
-
-                if (flags2 & 0x40) { // group id
-                    trace ("frame has group id\n");
-                    readptr++; // skip id
-                    sz--;
-                }
-                if (flags2 & 0x08) { // compressed frame, ignore
-                    trace ("frame is compressed, skipping\n");
-                    readptr += sz;
-                    continue;
-                }
-                if (flags2 & 0x04) { // encrypted frame, skip
-                    trace ("frame is encrypted, skipping\n");
-                    readptr += sz;
-                    continue;
-                }
-                if (flags2 & 0x02) { // unsync, just do nothing
-                }
-                if (flags2 & 0x01) { // data size
-                    synched_size = (readptr[3] << 0) | (readptr[2] << 7) | (readptr[1] << 14) | (readptr[0] << 21);
-                    trace ("frame has extra size field = %d\n", synched_size);
-                    readptr += 4;
-                    sz -= 4;
-                }
-            }
-            else if (version_major == 3) {
-                if (flags1 & 0x1F) {
-                    trace ("unknown status flags: %02x\n", flags1);
-                    readptr += sz;
-                    continue;
-                }
-                if (flags2 & 0x1F) {
-                    trace ("unknown format flags: %02x\n", flags2);
-                    readptr += sz;
-                    continue;
-                }
-                if (flags2 & 0x80) {
-                    trace ("frame is compressed, skipping\n");
-                    readptr += sz;
-                    continue;
-                }
-                if (flags2 & 0x40) {
-                    trace ("frame is encrypted, skipping\n");
-                    readptr += sz;
-                    continue;
-                }
-                if (flags2 & 0x20) {
-                    trace ("frame has group id\n");
-                    readptr++; // skip id
-                    sz--;
-                }
-            }
-
-            readptr += sz;
-
-            if (it) {
-                junk_id3v2_set_metadata_from_frame(it, tag_store, frm, "cp1252", &found_wmp_popm);
-            }
-            if (!tag_store) {
-                free (frm);
-            }
+            continue;
         }
-        else if (version_major == 2) {
-            char frameid[4];
-            memcpy (frameid, readptr, 3);
-            frameid[3] = 0;
-            readptr += 3;
-            if (readptr - tag >= size - 3) {
-                break;
-            }
-            uint32_t sz = (readptr[2] << 0) | (readptr[1] << 8) | (readptr[0] << 16);
-            readptr += 3;
-            if (readptr - tag >= size - sz) {
-                break; // size of frame is less than size of tag
-            }
-            if (sz < 1) {
-                break; // frame must be at least 1 byte long
-            }
-            if (!strcmp (frameid, "PIC")) {
-                // don't attempt to parse APIC when we're not planning to use it
-                if (tag_store == NULL) {
-                    trace ("junk_id3v2_read_full: frame %s size is too big (%d), discarded\n", frameid, sz);
-                    readptr += sz;
-                    continue;
-                }
-            }
-            else if (sz > MAX_ID3V2_FRAME_SIZE) {
-                trace ("junk_id3v2_read_full: frame %s size is too big, discarded\n", frameid);
-                readptr += sz;
-                continue;
-            }
 
-            if (readptr - tag + sz > size) {
-                trace ("junk_id3v2_read_full: frame %s size is crossing beyond the end of tag (%d), discarded\n", frameid, sz);
-                readptr += sz;
-                continue;
-            }
+        int synched_size = sz;
+        if (reader.mem) {
+            int consumed = 0;
+            synched_size = junklib_id3v2_sync_frame (version_major, reader.mem + reader.pos, sz, left, &consumed);
+            sz = consumed;
+            trace ("size: %d/%d\n", synched_size, sz);
+        }
 
-            int synched_size = sz;
-            if (unsync) {
-                int consumed = 0;
-                synched_size = junklib_id3v2_sync_frame (version_major, readptr, sz, &consumed);
-                sz = consumed;
-            }
+        int supported = junk_id3v2_frame_flags_supported (version_major, flags1, flags2);
 
-            DB_id3v2_frame_t *frm = malloc (sizeof (DB_id3v2_frame_t) + sz);
-            if (!frm) {
-                fprintf (stderr, "junklib: failed to alloc %d bytes for id3v2.2 frame %s\n", (int)(sizeof (DB_id3v2_frame_t) + sz), frameid);
+        if (arena && (!supported || !junk_id3v2_is_metadata_frame (version_major, frameid))) {
+            // not going to be used, e.g. pictures
+            if (junk_id3v2_reader_skip (&reader, sz)) {
                 goto error;
             }
+            continue;
+        }
 
-            memset (frm, 0, sizeof (DB_id3v2_frame_t));
-            if (tail) {
-                tail->next = frm;
-            }
-            tail = frm;
-            if (!tag_store->frames) {
-                tag_store->frames = frm;
-            }
-            strcpy (frm->id, frameid);
-            memcpy (frm->data, readptr, synched_size);
-            frm->size = sz;
-//            trace ("found id3v2.2 frame: %s, size=%d\n", frameid, sz);
+        size_t frame_size = sizeof (DB_id3v2_frame_t) + synched_size;
+        DB_id3v2_frame_t *frm = arena ? junk_arena_alloc (arena, frame_size) : malloc (frame_size);
+        if (!frm) {
+            fprintf (stderr, "junklib: failed to alloc %d bytes for id3v2 frame %s\n", (int)frame_size, frameid);
+            goto error;
+        }
 
-            readptr += sz;
+        memset (frm, 0, sizeof (DB_id3v2_frame_t));
+        if (tail) {
+            tail->next = frm;
+        }
+        tail = frm;
+        if (!tag_store->frames) {
+            tag_store->frames = frm;
+        }
+        strcpy (frm->id, frameid);
+        frm->size = synched_size;
+        frm->flags[0] = flags1;
+        frm->flags[1] = flags2;
 
-            if (it) {
-                junk_id3v2_set_metadata_from_frame(it, tag_store, frm, "cp1252", &found_wmp_popm);
-            }
-            if (!tag_store) {
-                free (frm);
-            }
+        if (reader.mem) {
+            memcpy (frm->data, reader.mem + reader.pos, synched_size);
+            reader.pos += sz;
         }
-        else {
-            trace ("id3v2.%d (unsupported!)\n", version_minor);
+        else if (junk_id3v2_reader_read (&reader, frm->data, sz)) {
+            goto error;
+        }
+
+        if (it && supported) {
+            junk_id3v2_set_metadata_from_frame (it, tag_store, frm, "cp1252", &found_wmp_popm);
         }
     }
     err = 0;
@@ -4611,27 +4686,34 @@ error:
         trace ("error parsing id3v2\n");
     }
 
-    if (tag) {
-        free (tag);
-    }
-    if (tag_store && err != 0) {
-        while (tag_store->frames) {
-            DB_id3v2_frame_t *next = tag_store->frames->next;
-            free (tag_store->frames);
-            tag_store->frames = next;
+    junk_arena_free (&scratch);
+
+    if (err != 0) {
+        if (!arena) {
+            junk_id3v2_free (tag_store);
         }
+        tag_store->frames = NULL;
     }
     return err;
 }
 
+int
+junk_id3v2_read_full (playItem_t *it, DB_id3v2_tag_t *tag_store, DB_FILE *fp) {
+    if (!tag_store) {
+        return -1;
+    }
+    return junk_id3v2_read_frames (it, tag_store, fp, NULL);
+}
+
 int
 junk_id3v2_read (playItem_t *it, DB_FILE *fp) {
     DB_id3v2_tag_t id3v2_tag;
     memset (&id3v2_tag, 0, sizeof (id3v2_tag));
-    int res = junk_id3v2_read_full (NULL, &id3v2_tag, fp);
+    junk_arena_t arena = {0};
+    int res = junk_id3v2_read_frames (NULL, &id3v2_tag, fp, &arena);
     if (!res) {
         // detect charset on all text fields
-        const char *charset = junk_id3v2_detect_charset (&id3v2_tag);
+        const char *charset = junk_id3v2_detect_charset (&id3v2_tag, &arena);
         int found_wmp_popm = 0;
         junk_id3v2_set_metadata (it, &id3v2_tag, charset, &found_wmp_popm);
     }
@@ -4650,7 +4732,7 @@ junk_id3v2_read (playItem_t *it, DB_FILE *fp) {
         f |= DDB_TAG_ID3V24;
         pl_set_item_flags (it, f);
     }
-    deadbeef->junk_id3v2_free (&id3v2_tag);
+    junk_arena_free (&arena);
     return res;
 }
 
@@ -72,6 +72,7 @@
 #include <unistd.h>
 #include "gettext.h"
 #include "playlist.h"
+#include "plshuffle.h"
 #include "threading.h"
 #include "messagepump.h"
 #include "streamer.h"
@@ -87,6 +88,7 @@
 #include "playqueue.h"
 #include "tf.h"
 #include "logger.h"
+#include "decodeinfo.h"
 
 #ifdef OSX_APPBUNDLE
 #include "scriptable/scriptable.h"
@@ -1011,6 +1013,11 @@ _touch(const char *path) {
 }
 #endif
 
+static int
+_decode_info_cache_path (char *path, size_t size) {
+    return snprintf (path, size, "%s/decodeinfo.cache", dbcachedir) < (int)size ? 0 : -1;
+}
+
 void
 main_cleanup_and_quit (void) {
     // stop streaming and playback before unloading plugins
@@ -1040,8 +1047,14 @@ main_cleanup_and_quit (void) {
 
     // save config
     pl_save_all ();
+    pl_save_wait ();
     conf_save ();
 
+    char decode_info_path[PATH_MAX];
+    if (!_decode_info_cache_path (decode_info_path, sizeof (decode_info_path))) {
+        decode_info_cache_save (decode_info_path);
+    }
+
     // delete legacy session file
     {
         char sessfile[1024]; // $HOME/.config/deadbeef/session
@@ -1061,6 +1074,7 @@ main_cleanup_and_quit (void) {
         // at this point we can simply do exit(0), but let's clean up for debugging
         pl_free (); // may access conf_*
         conf_free ();
+        decode_info_cache_free ();
 
         trace ("messagepump_free\n");
         messagepump_free ();
@@ -1173,6 +1187,7 @@ main (int argc, char *argv[]) {
 
     trace ("starting deadbeef " VERSION "%s%s\n", staticlink ? " [static]" : "", portable ? " [portable]" : "");
     srand ((unsigned int)time (NULL));
+    pl_shuffle_seed ((uint64_t)time (NULL));
 #ifdef __linux__
     prctl (PR_SET_NAME, "deadbeef-main", 0, 0, 0, 0);
 #endif
@@ -1470,6 +1485,12 @@ main (int argc, char *argv[]) {
     conf_init ();
     conf_load (); // required by some plugins at startup
 
+    decode_info_cache_init ();
+    char decode_info_path[PATH_MAX];
+    if (!_decode_info_cache_path (decode_info_path, sizeof (decode_info_path))) {
+        decode_info_cache_load (decode_info_path);
+    }
+
     if (use_gui_plugin[0]) {
         conf_set_str ("gui_plugin", use_gui_plugin);
     }
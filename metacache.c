@@ -28,11 +28,15 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include "metacache.h"
+#include "utf8.h"
 
 typedef struct metacache_str_s {
     struct metacache_str_s *next;
     size_t value_length;
+    char *folded; // case-folded copy of the value, created on demand
+    size_t folded_length;
     uint32_t refcount;
     char cmpidx; // positive means "equals", negative means "notequals"
     char str[1];
@@ -125,6 +129,7 @@ metacache_remove_value (const char *value, size_t valuesize) {
                 else {
                     bucket->chain = chain->next;
                 }
+                free (chain->folded);
                 free (chain);
             }
             break;
@@ -153,6 +158,12 @@ metacache_unref (const char *str) {
     (*refc)--;
 }
 
+void
+metacache_ref_value (const char *value) {
+    metacache_str_t *data = (metacache_str_t *)(value - offsetof (metacache_str_t, str));
+    data->refcount++;
+}
+
 const char *
 metacache_get_string (const char *str) {
     return metacache_get_value (str, strlen (str)+1);
@@ -170,3 +181,34 @@ metacache_get_value (const char *value, size_t len) {
 
     return NULL;
 }
+
+const char *
+metacache_get_folded_value (const char *value, size_t *folded_size) {
+    metacache_str_t *data = (metacache_str_t *)(value - offsetof (metacache_str_t, str));
+    if (!data->folded) {
+        // fold each part separately, the invalid ones become empty
+        char *folded = malloc (U8_CASEFOLD_MAX_LEN (data->value_length));
+        if (!folded) {
+            *folded_size = 0;
+            return NULL;
+        }
+        char *out = folded;
+        const char *p = data->str;
+        const char *end = data->str + data->value_length;
+        while (p < end) {
+            const char *part_end = memchr (p, 0, end - p);
+            size_t len = part_end ? (size_t)(part_end - p) : (size_t)(end - p);
+            if (u8_valid (p, (int)len, NULL)) {
+                out += u8_casefold (p, (int)len, out);
+            }
+            if (part_end) {
+                *out++ = 0;
+            }
+            p += len + 1;
+        }
+        data->folded = folded;
+        data->folded_length = out - folded;
+    }
+    *folded_size = data->folded_length;
+    return data->folded;
+}
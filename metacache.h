@@ -55,8 +55,20 @@ metacache_remove_value (const char *value, size_t valuesize);
 void
 metacache_ref (const char *str);
 
+// Increases reference count of a value previously returned by metacache_add_value,
+// without looking it up in the hash table
+void
+metacache_ref_value (const char *value);
+
 // Decreases reference count of the specified value
 void
 metacache_unref (const char *str);
 
+// Returns the case-folded copy of a value previously returned by metacache_add_value,
+// for case-insensitive search. The copy is created on first use, and stays valid while the value exists.
+// Parts of multi-value strings are folded separately, invalid UTF-8 parts are folded to empty strings.
+// Returns NULL if the copy could not be allocated.
+const char *
+metacache_get_folded_value (const char *value, size_t *folded_size);
+
 #endif
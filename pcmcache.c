@@ -0,0 +1,652 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "pcmcache.h"
+#include "conf.h"
+#include "plmeta.h"
+#include "plugins.h"
+#include "threading.h"
+
+#define PCMCACHE_CHUNK_SIZE 65536
+
+// contiguous range of samples, stored in chunks of chunk_samples each
+typedef struct pcmcache_segment_s {
+    int64_t start;
+    int64_t end; // exclusive
+    int eof; // the decoder has reached the end of the track at `end`
+    char **chunks;
+    int num_chunks;
+    int alloc_chunks;
+    struct pcmcache_segment_s *next; // ordered by start, never overlapping
+} pcmcache_segment_t;
+
+typedef struct pcmcache_entry_s {
+    playItem_t *track;
+    DB_decoder_t *dec;
+    ddb_waveformat_t fmt;
+    int samplesize;
+    int chunk_samples;
+    int64_t size; // bytes in all chunks
+    int users; // number of open fileinfos
+    pcmcache_segment_t *segments;
+    struct pcmcache_entry_s *prev;
+    struct pcmcache_entry_s *next;
+} pcmcache_entry_t;
+
+typedef struct {
+    DB_fileinfo_t info;
+    pcmcache_entry_t *entry;
+    DB_decoder_t *dec;
+    uint32_t hints;
+    DB_fileinfo_t *real; // decoder fileinfo, opened when the data is not cached
+    int real_failed;
+    int64_t real_pos; // position of the decoder in samples
+    int64_t pos; // read position in samples
+} pcmcache_info_t;
+
+static uintptr_t _mutex;
+static int64_t _capacity;
+static int64_t _total_size;
+
+// most recently used first
+static pcmcache_entry_t *_head;
+static pcmcache_entry_t *_tail;
+
+static DB_decoder_t _plugin;
+
+static void
+_chunk_free (pcmcache_entry_t *e, char *chunk) {
+    int64_t size = (int64_t)e->chunk_samples * e->samplesize;
+    e->size -= size;
+    _total_size -= size;
+    free (chunk);
+}
+
+static void
+_segment_free (pcmcache_entry_t *e, pcmcache_segment_t *s) {
+    for (int i = 0; i < s->num_chunks; i++) {
+        if (s->chunks[i]) {
+            _chunk_free (e, s->chunks[i]);
+        }
+    }
+    free (s->chunks);
+    free (s);
+}
+
+static void
+_entry_reset (pcmcache_entry_t *e) {
+    while (e->segments) {
+        pcmcache_segment_t *next = e->segments->next;
+        _segment_free (e, e->segments);
+        e->segments = next;
+    }
+}
+
+static void
+_entry_unlink (pcmcache_entry_t *e) {
+    if (e->prev) {
+        e->prev->next = e->next;
+    }
+    else {
+        _head = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    }
+    else {
+        _tail = e->prev;
+    }
+    e->prev = e->next = NULL;
+}
+
+static void
+_entry_touch (pcmcache_entry_t *e) {
+    if (_head == e) {
+        return;
+    }
+    if (e->prev || e->next || _tail == e) {
+        _entry_unlink (e);
+    }
+    e->next = _head;
+    if (_head) {
+        _head->prev = e;
+    }
+    _head = e;
+    if (!_tail) {
+        _tail = e;
+    }
+}
+
+static void
+_entry_free (pcmcache_entry_t *e) {
+    _entry_unlink (e);
+    _entry_reset (e);
+    pl_item_unref (e->track);
+    free (e);
+}
+
+static pcmcache_entry_t *
+_entry_find (playItem_t *it) {
+    for (pcmcache_entry_t *e = _head; e; e = e->next) {
+        if (e->track == it) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// drops the least recently used entries, until the size is within the capacity
+static void
+_trim (int64_t extra, pcmcache_entry_t *keep) {
+    pcmcache_entry_t *e = _tail;
+    while (e && _total_size + extra > _capacity) {
+        pcmcache_entry_t *prev = e->prev;
+        if (!e->users && e != keep) {
+            _entry_free (e);
+        }
+        e = prev;
+    }
+}
+
+static int
+_segment_add_chunk (pcmcache_entry_t *e, pcmcache_segment_t *s, int ignore_capacity) {
+    int64_t size = (int64_t)e->chunk_samples * e->samplesize;
+    if (!ignore_capacity) {
+        _trim (size, e);
+        if (_total_size + size > _capacity) {
+            return -1;
+        }
+    }
+    if (s->num_chunks == s->alloc_chunks) {
+        int alloc = s->alloc_chunks ? s->alloc_chunks * 2 : 16;
+        char **chunks = realloc (s->chunks, alloc * sizeof (char *));
+        if (!chunks) {
+            return -1;
+        }
+        s->chunks = chunks;
+        s->alloc_chunks = alloc;
+    }
+    char *chunk = malloc (size);
+    if (!chunk) {
+        return -1;
+    }
+    s->chunks[s->num_chunks++] = chunk;
+    e->size += size;
+    _total_size += size;
+    return 0;
+}
+
+// returns the number of appended samples
+static int64_t
+_segment_append (pcmcache_entry_t *e, pcmcache_segment_t *s, const char *data, int64_t count, int ignore_capacity) {
+    int64_t done = 0;
+    while (done < count) {
+        int64_t filled = s->end - s->start;
+        int idx = (int)(filled / e->chunk_samples);
+        int64_t offs = filled % e->chunk_samples;
+        if (idx == s->num_chunks && _segment_add_chunk (e, s, ignore_capacity) < 0) {
+            break;
+        }
+        int64_t n = e->chunk_samples - offs;
+        if (n > count - done) {
+            n = count - done;
+        }
+        memcpy (s->chunks[idx] + offs * e->samplesize, data + done * e->samplesize, n * e->samplesize);
+        done += n;
+        s->end += n;
+    }
+    return done;
+}
+
+static void
+_segment_copy (pcmcache_entry_t *e, pcmcache_segment_t *s, int64_t sample, char *data, int64_t count) {
+    while (count > 0) {
+        int idx = (int)((sample - s->start) / e->chunk_samples);
+        int64_t offs = (sample - s->start) % e->chunk_samples;
+        int64_t n = e->chunk_samples - offs;
+        if (n > count) {
+            n = count;
+        }
+        memcpy (data, s->chunks[idx] + offs * e->samplesize, n * e->samplesize);
+        data += n * e->samplesize;
+        sample += n;
+        count -= n;
+    }
+}
+
+// appends the following segment, which must start right at the end of `s`
+static void
+_segment_merge_next (pcmcache_entry_t *e, pcmcache_segment_t *s) {
+    pcmcache_segment_t *next = s->next;
+    int complete = 1;
+    for (int i = 0; i < next->num_chunks; i++) {
+        int64_t start = next->start + (int64_t)i * e->chunk_samples;
+        int64_t n = next->end - start;
+        if (n > e->chunk_samples) {
+            n = e->chunk_samples;
+        }
+        if (_segment_append (e, s, next->chunks[i], n, 1) != n) {
+            complete = 0;
+            break;
+        }
+        // release the copied data right away, to stay close to the capacity
+        _chunk_free (e, next->chunks[i]);
+        next->chunks[i] = NULL;
+    }
+    s->eof = complete && next->eof;
+    s->next = next->next;
+    _segment_free (e, next);
+}
+
+// returns the segment containing the sample, or the last segment if the sample is past the end of the track,
+// otherwise the segment following the sample is returned in `next`
+static pcmcache_segment_t *
+_segment_find (pcmcache_entry_t *e, int64_t sample, pcmcache_segment_t **next) {
+    *next = NULL;
+    for (pcmcache_segment_t *s = e->segments; s; s = s->next) {
+        if (s->start > sample) {
+            *next = s;
+            break;
+        }
+        if (sample < s->end || s->eof) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+static void
+_store (pcmcache_entry_t *e, int64_t sample, const char *data, int64_t count, int eof) {
+    pcmcache_segment_t *prev = NULL;
+    pcmcache_segment_t *s = e->segments;
+    for (; s && s->start <= sample; prev = s, s = s->next) {
+        if (s->end == sample) {
+            break;
+        }
+    }
+    if (!s || s->start > sample) {
+        if (prev && prev->end > sample) {
+            return;
+        }
+        if (!count && !eof) {
+            return;
+        }
+        s = calloc (1, sizeof (pcmcache_segment_t));
+        if (!s) {
+            return;
+        }
+        s->start = s->end = sample;
+        if (prev) {
+            s->next = prev->next;
+            prev->next = s;
+        }
+        else {
+            s->next = e->segments;
+            e->segments = s;
+        }
+    }
+
+    int64_t n = _segment_append (e, s, data, count, 0);
+    if (n == count && eof) {
+        s->eof = 1;
+    }
+
+    if (s->start == s->end && !s->eof) {
+        // nothing fit into the cache
+        if (e->segments == s) {
+            e->segments = s->next;
+        }
+        else {
+            for (prev = e->segments; prev->next != s; prev = prev->next);
+            prev->next = s->next;
+        }
+        _segment_free (e, s);
+        return;
+    }
+
+    if (s->next && s->end == s->next->start) {
+        _segment_merge_next (e, s);
+    }
+}
+
+static int
+_real_seek (pcmcache_info_t *info, int64_t sample) {
+    DB_decoder_t *dec = info->dec;
+#if (DDB_API_LEVEL >= 14)
+    if (dec->plugin.flags & DDB_PLUGIN_FLAG_IMPLEMENTS_DECODER2) {
+        return ((ddb_decoder2_t *)dec)->seek_sample64 (info->real, sample);
+    }
+#endif
+    if (dec->seek_sample) {
+        return dec->seek_sample (info->real, (int)sample);
+    }
+    return dec->seek (info->real, (float)((double)sample / info->info.fmt.samplerate));
+}
+
+// opens the decoder if necessary, and moves it to the read position
+static int
+_real_prepare (pcmcache_info_t *info) {
+    if (info->real_failed) {
+        return -1;
+    }
+    if (!info->real) {
+        DB_decoder_t *dec = info->dec;
+        DB_playItem_t *it = DB_PLAYITEM (info->entry->track);
+        DB_fileinfo_t *fi;
+        if (dec->plugin.api_vminor >= 7 && dec->open2) {
+            fi = dec->open2 (info->hints, it);
+        }
+        else {
+            fi = dec->open (info->hints);
+        }
+        if (!fi) {
+            info->real_failed = 1;
+            return -1;
+        }
+        if (dec->init (fi, it) != 0) {
+            dec->free (fi);
+            info->real_failed = 1;
+            return -1;
+        }
+        if (memcmp (&fi->fmt, &info->info.fmt, sizeof (ddb_waveformat_t))) {
+            // the cached data is no longer valid for this file
+            dec->free (fi);
+            info->real_failed = 1;
+            return -1;
+        }
+        info->real = fi;
+        info->real_pos = 0;
+        info->info.file = fi->file;
+    }
+    if (info->real_pos != info->pos) {
+        if (_real_seek (info, info->pos) < 0) {
+            return -1;
+        }
+        info->real_pos = info->pos;
+    }
+    return 0;
+}
+
+static int
+pcmcache_read (DB_fileinfo_t *_info, char *bytes, int size) {
+    pcmcache_info_t *info = (pcmcache_info_t *)_info;
+    pcmcache_entry_t *e = info->entry;
+    int samplesize = e->samplesize;
+    int64_t samples = size / samplesize;
+    int64_t done = 0;
+
+    while (done < samples) {
+        char *out = bytes + done * samplesize;
+        pcmcache_segment_t *next;
+
+        mutex_lock (_mutex);
+        pcmcache_segment_t *s = _segment_find (e, info->pos, &next);
+        if (s) {
+            int64_t n = s->end - info->pos;
+            if (n <= 0) {
+                mutex_unlock (_mutex);
+                break; // end of track
+            }
+            if (n > samples - done) {
+                n = samples - done;
+            }
+            _segment_copy (e, s, info->pos, out, n);
+            mutex_unlock (_mutex);
+            done += n;
+            info->pos += n;
+            continue;
+        }
+        int64_t n = samples - done;
+        if (next && next->start - info->pos < n) {
+            n = next->start - info->pos;
+        }
+        mutex_unlock (_mutex);
+
+        if (_real_prepare (info) < 0) {
+            break;
+        }
+
+        int rb = info->real->plugin->read (info->real, out, (int)(n * samplesize));
+        int64_t got = rb > 0 ? rb / samplesize : 0;
+        info->pos += got;
+        info->real_pos = info->pos;
+        done += got;
+
+        mutex_lock (_mutex);
+        _store (e, info->pos - got, out, got, got < n);
+        mutex_unlock (_mutex);
+
+        if (got < n) {
+            break;
+        }
+    }
+
+    _info->readpos = (float)((double)info->pos / _info->fmt.samplerate);
+    return (int)(done * samplesize);
+}
+
+static int
+pcmcache_seek_sample64 (DB_fileinfo_t *_info, int64_t sample) {
+    pcmcache_info_t *info = (pcmcache_info_t *)_info;
+    if (sample < 0) {
+        sample = 0;
+    }
+    // the decoder is seeked on the next read, if the data is not cached
+    info->pos = sample;
+    _info->readpos = (float)((double)sample / _info->fmt.samplerate);
+    return 0;
+}
+
+static int
+pcmcache_seek_sample (DB_fileinfo_t *_info, int sample) {
+    return pcmcache_seek_sample64 (_info, sample);
+}
+
+static int
+pcmcache_seek (DB_fileinfo_t *_info, float seconds) {
+    return pcmcache_seek_sample64 (_info, (int64_t)((double)seconds * _info->fmt.samplerate));
+}
+
+static void
+pcmcache_fileinfo_free (DB_fileinfo_t *_info) {
+    pcmcache_info_t *info = (pcmcache_info_t *)_info;
+    if (info->real) {
+        info->dec->free (info->real);
+    }
+    mutex_lock (_mutex);
+    info->entry->users--;
+    _trim (0, NULL);
+    mutex_unlock (_mutex);
+    free (info);
+}
+
+static pcmcache_info_t *
+_info_alloc (pcmcache_entry_t *e, DB_decoder_t *dec, uint32_t hints) {
+    pcmcache_info_t *info = calloc (1, sizeof (pcmcache_info_t));
+    if (!info) {
+        return NULL;
+    }
+    info->entry = e;
+    info->dec = dec;
+    info->hints = hints;
+    info->info.plugin = &_plugin;
+    info->info.fmt = e->fmt;
+    e->users++;
+    _entry_touch (e);
+    return info;
+}
+
+int
+pcmcache_can_cache (DB_decoder_t *dec, playItem_t *it) {
+    mutex_lock (_mutex);
+    int64_t capacity = _capacity;
+    mutex_unlock (_mutex);
+
+    if (capacity <= 0) {
+        return 0;
+    }
+    // replaygain is applied to the cached data by the streamreader,
+    // and muted voices would change the output
+    if ((dec->plugin.flags & DDB_PLUGIN_FLAG_REPLAYGAIN) || dec->numvoices) {
+        return 0;
+    }
+    if (pl_get_item_duration (it) <= 0) {
+        return 0;
+    }
+    pl_lock ();
+    const char *uri = pl_find_meta (it, ":URI");
+    int local = uri && plug_is_local_file (uri);
+    pl_unlock ();
+    return local;
+}
+
+DB_fileinfo_t *
+pcmcache_open_cached (DB_decoder_t *dec, uint32_t hints, playItem_t *it) {
+    if (!pcmcache_can_cache (dec, it)) {
+        return NULL;
+    }
+    pcmcache_info_t *info = NULL;
+    mutex_lock (_mutex);
+    pcmcache_entry_t *e = _entry_find (it);
+    if (e && e->dec == dec && e->segments && e->segments->start == 0
+        && (e->segments->end > 0 || e->segments->eof)) {
+        info = _info_alloc (e, dec, hints);
+    }
+    mutex_unlock (_mutex);
+    return info ? &info->info : NULL;
+}
+
+DB_fileinfo_t *
+pcmcache_wrap (DB_decoder_t *dec, uint32_t hints, playItem_t *it, DB_fileinfo_t *fileinfo) {
+    int samplesize = fileinfo->fmt.channels * (fileinfo->fmt.bps >> 3);
+    if (samplesize <= 0 || fileinfo->fmt.samplerate <= 0 || !pcmcache_can_cache (dec, it)) {
+        return fileinfo;
+    }
+
+    pcmcache_info_t *info = NULL;
+    mutex_lock (_mutex);
+    pcmcache_entry_t *e = _entry_find (it);
+    if (e && (e->dec != dec || memcmp (&e->fmt, &fileinfo->fmt, sizeof (ddb_waveformat_t)))) {
+        if (e->users) {
+            e = NULL;
+            goto done;
+        }
+        _entry_free (e);
+        e = NULL;
+    }
+    if (!e) {
+        e = calloc (1, sizeof (pcmcache_entry_t));
+        if (!e) {
+            goto done;
+        }
+        e->track = it;
+        pl_item_ref (it);
+        e->dec = dec;
+        e->fmt = fileinfo->fmt;
+        e->samplesize = samplesize;
+        e->chunk_samples = PCMCACHE_CHUNK_SIZE / samplesize;
+        if (e->chunk_samples < 1) {
+            e->chunk_samples = 1;
+        }
+    }
+    info = _info_alloc (e, dec, hints);
+    if (info) {
+        info->real = fileinfo;
+        info->info.file = fileinfo->file;
+        info->info.readpos = fileinfo->readpos;
+    }
+done:
+    mutex_unlock (_mutex);
+    return info ? &info->info : fileinfo;
+}
+
+int64_t
+pcmcache_get_cached_samples (playItem_t *it) {
+    int64_t samples = 0;
+    mutex_lock (_mutex);
+    pcmcache_entry_t *e = _entry_find (it);
+    if (e) {
+        for (pcmcache_segment_t *s = e->segments; s; s = s->next) {
+            samples += s->end - s->start;
+        }
+    }
+    mutex_unlock (_mutex);
+    return samples;
+}
+
+void
+pcmcache_clear (void) {
+    mutex_lock (_mutex);
+    pcmcache_entry_t *e = _head;
+    while (e) {
+        pcmcache_entry_t *next = e->next;
+        if (!e->users) {
+            _entry_free (e);
+        }
+        e = next;
+    }
+    mutex_unlock (_mutex);
+}
+
+void
+pcmcache_configchanged (void) {
+    int size_mb = conf_get_int ("streamer.pcm_cache_size_mb", 0);
+    if (size_mb < 0) {
+        size_mb = 0;
+    }
+    mutex_lock (_mutex);
+    _capacity = (int64_t)size_mb * 1024 * 1024;
+    _trim (0, NULL);
+    mutex_unlock (_mutex);
+}
+
+void
+pcmcache_init (void) {
+    _mutex = mutex_create ();
+    pcmcache_configchanged ();
+}
+
+void
+pcmcache_free (void) {
+    mutex_lock (_mutex);
+    while (_head) {
+        _entry_free (_head);
+    }
+    _capacity = 0;
+    mutex_unlock (_mutex);
+    mutex_free (_mutex);
+    _mutex = 0;
+}
+
+static DB_decoder_t _plugin = {
+    DB_PLUGIN_SET_API_VERSION
+    .plugin.type = DB_PLUGIN_DECODER,
+    .plugin.id = "pcmcache",
+    .plugin.name = "Decoded PCM cache",
+    .read = pcmcache_read,
+    .seek = pcmcache_seek,
+    .seek_sample = pcmcache_seek_sample,
+    .free = pcmcache_fileinfo_free,
+};
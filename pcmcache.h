@@ -0,0 +1,82 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef pcmcache_h
+#define pcmcache_h
+
+#include <stdint.h>
+#include "deadbeef.h"
+#include "playlist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Cache of decoded PCM data of the recently played tracks.
+//
+// The data is kept per track as a list of non-overlapping sample ranges, exactly as returned by the decoder,
+// before replaygain is applied.
+// Playing a track through the cache stores everything that gets decoded,
+// and serves seeks and replays of the cached ranges without calling the decoder.
+// The decoder is opened, and seeked to the read position, only when the data is not in the cache.
+//
+// The size is set by the "streamer.pcm_cache_size_mb" config option, 0 (default) disables the cache.
+// When the cache is full, the least recently used tracks are dropped, except the ones which are being played.
+
+void
+pcmcache_init (void);
+
+void
+pcmcache_free (void);
+
+void
+pcmcache_configchanged (void);
+
+// Drops all unused tracks from the cache.
+void
+pcmcache_clear (void);
+
+// Returns 1 if the track can be played through the cache with the given decoder.
+int
+pcmcache_can_cache (DB_decoder_t *dec, playItem_t *it);
+
+// Returns a cache fileinfo for the track, if the beginning of the track is cached,
+// otherwise NULL.
+// The decoder will be opened using `hints` on the first read past the cached data.
+DB_fileinfo_t *
+pcmcache_open_cached (DB_decoder_t *dec, uint32_t hints, playItem_t *it);
+
+// Returns a cache fileinfo, which takes ownership of the initialized decoder fileinfo,
+// or the passed fileinfo, if the track can't be cached.
+DB_fileinfo_t *
+pcmcache_wrap (DB_decoder_t *dec, uint32_t hints, playItem_t *it, DB_fileinfo_t *fileinfo);
+
+// Returns the number of samples of the track in the cache.
+int64_t
+pcmcache_get_cached_samples (playItem_t *it);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* pcmcache_h */
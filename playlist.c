@@ -48,10 +48,13 @@
 #include <limits.h>
 #include <errno.h>
 #include <math.h>
+#include <dispatch/dispatch.h>
 #include "buffered_file_writer.h"
+#include "dbpl.h"
 #include "gettext.h"
 #include "playlist.h"
 #include "plmeta.h"
+#include "plshuffle.h"
 #include "streamer.h"
 #include "messagepump.h"
 #include "plugins.h"
@@ -94,8 +97,11 @@
 //    removed legacy data used for compat with 0.4.4
 //    note: ddb-0.5.0 should keep using 1.2 playlist format
 //    1.3 support is designed for transition to ddb-0.6.0
+// 1.3->1.4 changelog:
+//    new layout: deduplicated string table, fixed size item records and index,
+//    which can be loaded via mmap (see dbpl.h)
 #define PLAYLIST_MAJOR_VER 1
-#define PLAYLIST_MINOR_VER 2
+#define PLAYLIST_MINOR_VER 4
 
 #if (PLAYLIST_MINOR_VER<2)
 #error writing playlists in format <1.2 is not supported
@@ -103,6 +109,9 @@
 
 #define min(x,y) ((x)<(y)?(x):(y))
 
+// number of items serialized per pl_lock when saving
+#define PLT_SAVE_CHUNK_SIZE 256
+
 static int _playlists_count = 0;
 static playlist_t *_playlists_head = NULL;
 static playlist_t *_current_playlist = NULL; // current playlist
@@ -112,6 +121,14 @@ static int _plt_loading = 0; // disable sending event about playlist switch, con
 static uintptr_t _playlist_mutex;
 #endif
 
+// serial queue for background playlist saving
+static dispatch_queue_t _save_queue;
+
+// The playlist being saved on the save queue, reset by plt_free, so that the save can tell whether
+// the playlist is still alive, without holding a reference to it.
+// Protected by pl_lock.
+static playlist_t *_plt_saving;
+
 #define LOCK {pl_lock();}
 #define UNLOCK {pl_unlock();}
 
@@ -172,11 +189,17 @@ pl_init (void) {
 #if !DISABLE_LOCKING
     _playlist_mutex = mutex_create ();
 #endif
+    _save_queue = dispatch_queue_create ("PlaylistSaveQueue", NULL);
     return 0;
 }
 
 void
 pl_free (void) {
+    if (_save_queue) {
+        pl_save_wait ();
+        dispatch_release (_save_queue);
+        _save_queue = NULL;
+    }
     LOCK;
     playqueue_clear ();
     _plt_loading = 1;
@@ -707,6 +730,10 @@ void
 plt_free (playlist_t *plt) {
     LOCK;
 
+    if (_plt_saving == plt) {
+        _plt_saving = NULL;
+    }
+
     plt_clear (plt);
 
     if (plt->title) {
@@ -931,6 +958,40 @@ fileadd_filter_test (ddb_file_found_data_t *data) {
     return 0;
 }
 
+// The subsongs of a file have most of the fields in common,
+// so after a decoder has added them, these fields are moved to a shared block.
+static void
+_plt_share_inserted_meta (playlist_t *plt, playItem_t *after, playItem_t *last) {
+    LOCK;
+    playItem_t *first = after ? after->next[PL_MAIN] : plt->head[PL_MAIN];
+    int count = 0;
+    playItem_t *it;
+    for (it = first; it; it = it->next[PL_MAIN]) {
+        count++;
+        if (it == last) {
+            break;
+        }
+    }
+    if (!it || count < 2) {
+        UNLOCK;
+        return;
+    }
+
+    playItem_t **items = malloc (sizeof (playItem_t *) * count);
+    if (!items) {
+        // the items just keep their own copies
+        UNLOCK;
+        return;
+    }
+    it = first;
+    for (int i = 0; i < count; i++, it = it->next[PL_MAIN]) {
+        items[i] = it;
+    }
+    pl_items_share_common_meta (items, count);
+    free (items);
+    UNLOCK;
+}
+
 static playItem_t *
 plt_insert_file_int (
                      int visibility,
@@ -1089,7 +1150,7 @@ plt_insert_file_int (
 
     // handle cue files
     if (!strcasecmp (eol, "cue")) {
-        playItem_t *inserted = plt_load_cue_file(plt, after, fname, NULL, NULL, 0);
+        playItem_t *inserted = plt_load_cue_file(plt, after, fname, NULL, NULL);
         if (callback_with_result) {
             callback_with_result(inserted ? DDB_INSERT_FILE_RESULT_SUCCESS : DDB_INSERT_FILE_RESULT_CUESHEET_ERROR, fname, user_data);
         }
@@ -1121,6 +1182,7 @@ plt_insert_file_int (
 
                     playItem_t *inserted = (playItem_t *)decoders[i]->insert ((ddb_playlist_t *)plt, DB_PLAYITEM (after), fname);
                     if (inserted != NULL) {
+                        _plt_share_inserted_meta (plt, after, inserted);
                         if (callback && callback (inserted, user_data) < 0) {
                             *pabort = 1;
                         }
@@ -1163,6 +1225,7 @@ plt_insert_file_int (
                     file_recognized = 1;
                     playItem_t *inserted = (playItem_t *)decoders[i]->insert ((ddb_playlist_t *)plt, DB_PLAYITEM (after), fname);
                     if (inserted != NULL) {
+                        _plt_share_inserted_meta (plt, after, inserted);
                         if (callback && callback (inserted, user_data) < 0) {
                             *pabort = 1;
                         }
@@ -1396,11 +1459,12 @@ plt_insert_dir_int (
     char fulldir[PATH_MAX];
 
     // try loading cuesheets first
+    cue_dir_index_t *dirindex = ncuefiles ? cue_dir_index_alloc (namelist, n) : NULL;
     for (int c = 0; c < ncuefiles; c++) {
         int i = cuefiles[c];
         _get_fullname_and_dir (fullname, sizeof (fullname), fulldir, sizeof(fulldir), vfs, dirname, namelist[i]->d_name);
 
-        playItem_t *inserted = plt_load_cue_file (plt, after, fullname, fulldir, namelist, n);
+        playItem_t *inserted = plt_load_cue_file (plt, after, fullname, fulldir, dirindex);
         namelist[i]->d_name[0] = 0;
 
         if (inserted) {
@@ -1410,6 +1474,9 @@ plt_insert_dir_int (
             break;
         }
     }
+    if (dirindex) {
+        cue_dir_index_free (dirindex);
+    }
 
     // load the rest of the files
     if (!pabort || !*pabort) {
@@ -1503,6 +1570,9 @@ plt_remove_item (playlist_t *playlist, playItem_t *it) {
 
     // remove from both lists
     LOCK;
+    if (it->prev[PL_MAIN] || it->next[PL_MAIN] || playlist->head[PL_MAIN] == it) {
+        plt_shuffle_remove (playlist, it);
+    }
     for (int iter = PL_MAIN; iter <= PL_SEARCH; iter++) {
         if (it->prev[iter] || it->next[iter] || playlist->head[iter] == it || playlist->tail[iter] == it) {
             playlist->count[iter]--;
@@ -1700,13 +1770,15 @@ plt_insert_item (playlist_t *playlist, playItem_t *after, playItem_t *it) {
             prev_aa = pl_find_meta_raw (prev, "albumartist");
         }
     }
+    it->played = 0;
     if (streamer_get_shuffle () == DDB_SHUFFLE_ALBUMS && prev && pl_find_meta_raw (prev, "album") == pl_find_meta_raw (it, "album") && ((aa && prev_aa && aa == prev_aa) || pl_find_meta_raw (prev, "artist") == pl_find_meta_raw (it, "artist"))) {
         it->shufflerating = prev->shufflerating;
+        plt_shuffle_insert (playlist, it, prev);
     }
     else {
-        it->shufflerating = rand ();
+        it->shufflerating = pl_shuffle_random ();
+        plt_shuffle_insert (playlist, it, NULL);
     }
-    it->played = 0;
 
     // totaltime
     float dur = pl_get_item_duration (it);
@@ -1725,9 +1797,8 @@ pl_insert_item (playItem_t *after, playItem_t *it) {
     return plt_insert_item (addfiles_playlist ? addfiles_playlist : _current_playlist, after, it);
 }
 
-void
-pl_item_copy (playItem_t *out, playItem_t *it) {
-    LOCK;
+static void
+_pl_item_copy_fields (playItem_t *out, playItem_t *it) {
     out->startsample = it->startsample;
     out->endsample = it->endsample;
     out->startsample64 = it->startsample64;
@@ -1738,6 +1809,12 @@ pl_item_copy (playItem_t *out, playItem_t *it) {
     out->prev[PL_MAIN] = it->prev[PL_MAIN];
     out->next[PL_SEARCH] = it->next[PL_SEARCH];
     out->prev[PL_SEARCH] = it->prev[PL_SEARCH];
+}
+
+void
+pl_item_copy (playItem_t *out, playItem_t *it) {
+    LOCK;
+    _pl_item_copy_fields (out, it);
 
     for (DB_metaInfo_t *meta = it->meta; meta; meta = meta->next) {
         pl_add_meta_copy (out, meta);
@@ -1745,6 +1822,30 @@ pl_item_copy (playItem_t *out, playItem_t *it) {
     UNLOCK;
 }
 
+void
+pl_item_copy_shared (playItem_t *out, playItem_t *it) {
+    LOCK;
+    if (out->meta) {
+        pl_item_copy (out, it);
+        UNLOCK;
+        return;
+    }
+
+    // share the fields, the items get private copies when they're modified
+    pl_meta_base_t *base = pl_item_freeze_meta (it);
+    if (!base && it->meta) {
+        pl_item_copy (out, it);
+        UNLOCK;
+        return;
+    }
+
+    _pl_item_copy_fields (out, it);
+    if (base) {
+        pl_item_set_meta_base (out, base);
+    }
+    UNLOCK;
+}
+
 playItem_t *
 pl_item_alloc (void) {
     playItem_t *it = malloc (sizeof (playItem_t));
@@ -1774,12 +1875,16 @@ static void
 pl_item_free (playItem_t *it) {
     LOCK;
     if (it) {
-        while (it->meta) {
+        DB_metaInfo_t *shared = it->meta_base ? it->meta_base->head : NULL;
+        while (it->meta != shared) {
             pl_meta_free_values (it->meta);
             DB_metaInfo_t *m = it->meta;
             it->meta = m->next;
             free (m);
         }
+        if (it->meta_base) {
+            pl_meta_base_unref (it->meta_base);
+        }
 
         free (it);
     }
@@ -1883,49 +1988,80 @@ pl_crop_selected (void) {
     plt_crop_selected (_current_playlist);
 }
 
-static uint16_t
-length_to_uint16 (size_t len) {
-    return (uint16_t)min(0xffff, len);
-}
+typedef struct {
+    playItem_t **items;
+    int count;
+    dbpl4_writer_t *dbpl;
+    int modification_idx;
+} plt_save_snapshot_t;
 
-static uint8_t
-length_to_uint8 (size_t len) {
-    return (uint8_t)min(0xff, len);
+// Must be called with pl_lock held.
+// Takes a reference to each item, and collects the playlist metadata.
+static int
+_plt_save_snapshot (playlist_t *plt, plt_save_snapshot_t *snapshot) {
+    int count = plt->count[PL_MAIN];
+    playItem_t **items = malloc ((count ? count : 1) * sizeof (playItem_t *));
+    if (!items) {
+        return -1;
+    }
+    int n = 0;
+    for (playItem_t *it = plt->head[PL_MAIN]; it && n < count; it = it->next[PL_MAIN]) {
+        it->_refc++;
+        items[n++] = it;
+    }
+    snapshot->items = items;
+    snapshot->count = n;
+    snapshot->modification_idx = plt->modification_idx;
+    snapshot->dbpl = dbpl4_writer_new (n);
+    return snapshot->dbpl ? dbpl4_writer_add_playlist_meta (snapshot->dbpl, plt) : -1;
 }
 
-int
-plt_save (playlist_t *plt, playItem_t *first, playItem_t *last, const char *fname, int *pabort, int (*cb)(playItem_t *it, void *data), void *user_data) {
-    LOCK;
-    plt->last_save_modification_idx = plt->modification_idx;
-    const char *ext = strrchr (fname, '.');
-    if (ext) {
-        DB_playlist_t **plug = deadbeef->plug_get_playlist_list ();
-        for (int i = 0; plug[i]; i++) {
-            if (plug[i]->extensions && plug[i]->load) {
-                const char **exts = plug[i]->extensions;
-                if (exts && plug[i]->save) {
-                    for (int e = 0; exts[e]; e++) {
-                        if (!strcasecmp (exts[e], ext+1)) {
-                            int res = plug[i]->save ((ddb_playlist_t *)plt, fname, (DB_playItem_t *)_current_playlist->head[PL_MAIN], NULL);
-                            UNLOCK;
-                            return res;
-                        }
-                    }
-                }
+// Must be called without pl_lock held.
+// Collects the item data in chunks, each under a short lock, and writes the file with the lock released.
+// Releases the snapshot.
+static int
+_plt_save_snapshot_write (plt_save_snapshot_t *snapshot, int res, const char *fname, int (*cb)(playItem_t *it, void *data), void *user_data) {
+    playItem_t **items = snapshot->items;
+    int n = snapshot->count;
+    dbpl4_writer_t *dbpl = snapshot->dbpl;
+
+    for (int i = 0; i < n && res >= 0; i += PLT_SAVE_CHUNK_SIZE) {
+        int end = min (n, i + PLT_SAVE_CHUNK_SIZE);
+        LOCK;
+        for (int j = i; j < end; j++) {
+            if (cb) {
+                cb (items[j], user_data);
+            }
+            if (dbpl4_writer_add_item (dbpl, items[j]) < 0) {
+                res = -1;
+                break;
             }
         }
+        UNLOCK;
+    }
+
+    for (int i = 0; i < n; i += PLT_SAVE_CHUNK_SIZE) {
+        int end = min (n, i + PLT_SAVE_CHUNK_SIZE);
+        LOCK;
+        for (int j = i; j < end; j++) {
+            pl_item_unref (items[j]);
+        }
+        UNLOCK;
+    }
+    free (items);
+
+    FILE *fp = NULL;
+    buffered_file_writer_t *writer = NULL;
+    if (res < 0) {
+        goto save_fail;
     }
 
-    char tempfile[PATH_MAX];
-    snprintf (tempfile, sizeof (tempfile), "%s.tmp", fname);
     const char magic[] = "DBPL";
     uint8_t majorver = PLAYLIST_MAJOR_VER;
     uint8_t minorver = PLAYLIST_MINOR_VER;
-    buffered_file_writer_t *writer = NULL;
-    FILE *fp = fopen (tempfile, "w+b");
+    fp = fopen (fname, "w+b");
     if (!fp) {
-        UNLOCK;
-        return -1;
+        goto save_fail;
     }
 
     writer = buffered_file_writer_new(fp, 64*1024);
@@ -1939,190 +2075,79 @@ plt_save (playlist_t *plt, playItem_t *first, playItem_t *last, const char *fnam
     if (buffered_file_writer_write(writer, &minorver, 1) < 0) {
         goto save_fail;
     }
-    uint32_t cnt = plt->count[PL_MAIN];
-    if (buffered_file_writer_write(writer, &cnt, 4) < 0) {
-        goto save_fail;
-    }
-    for (playItem_t *it = plt->head[PL_MAIN]; it; it = it->next[PL_MAIN]) {
-        uint16_t l;
-        uint8_t ll;
-        if (cb) {
-            cb(it, user_data);
-        }
-#if (PLAYLIST_MINOR_VER==2)
-        const char *item_uri = pl_find_meta_raw (it, ":URI");
-        l = length_to_uint16(strlen (item_uri));
-        if (buffered_file_writer_write(writer, &l, 2) < 0) {
-            goto save_fail;
-        }
-        if (buffered_file_writer_write(writer, item_uri, l) < 0) {
-            goto save_fail;
-        }
-        const char *decoder_id = pl_find_meta_raw (it, ":DECODER");
-        if (decoder_id) {
-            ll = length_to_uint8(strlen (decoder_id));
-            if (buffered_file_writer_write(writer, &ll, 1) < 0) {
-                goto save_fail;
-            }
-            if (buffered_file_writer_write(writer, decoder_id, ll) < 0) {
-                goto save_fail;
-            }
-        }
-        else
-        {
-            ll = 0;
-            if (buffered_file_writer_write(writer, &ll, 1) < 0) {
-                goto save_fail;
-            }
-        }
-        l = length_to_uint8(pl_find_meta_int (it, ":TRACKNUM", 0));
-        if (buffered_file_writer_write(writer, &l, 2) < 0) {
-            goto save_fail;
-        }
-#endif
-        if (buffered_file_writer_write(writer, &it->startsample, 4) < 0) {
-            goto save_fail;
-        }
-        if (buffered_file_writer_write(writer, &it->endsample, 4) < 0) {
-            goto save_fail;
-        }
-        if (buffered_file_writer_write(writer, &it->_duration, 4) < 0) {
-            goto save_fail;
-        }
-#if (PLAYLIST_MINOR_VER==2)
-        const char *filetype = pl_find_meta_raw (it, ":FILETYPE");
-        if (!filetype) {
-            filetype = "";
-        }
-        uint8_t ft = length_to_uint8(strlen (filetype));
-        if (buffered_file_writer_write(writer, &ft, 1) < 0) {
-            goto save_fail;
-        }
-        if (ft) {
-            if (buffered_file_writer_write(writer, filetype, ft) < 0) {
-                goto save_fail;
-            }
-        }
-        float rg_albumgain = pl_get_item_replaygain (it, DDB_REPLAYGAIN_ALBUMGAIN);
-        float rg_albumpeak = pl_get_item_replaygain (it, DDB_REPLAYGAIN_ALBUMPEAK);
-        float rg_trackgain = pl_get_item_replaygain (it, DDB_REPLAYGAIN_TRACKGAIN);
-        float rg_trackpeak = pl_get_item_replaygain (it, DDB_REPLAYGAIN_TRACKPEAK);
-        if (buffered_file_writer_write(writer, &rg_albumgain, 4) < 0) {
-            goto save_fail;
-        }
-        if (buffered_file_writer_write(writer, &rg_albumpeak, 4) < 0) {
-            goto save_fail;
-        }
-        if (buffered_file_writer_write(writer, &rg_trackgain, 4) < 0) {
-            goto save_fail;
-        }
-        if (buffered_file_writer_write(writer, &rg_trackpeak, 4) < 0) {
-            goto save_fail;
-        }
-#endif
-        if (buffered_file_writer_write(writer, &it->_flags, 4) < 0) {
-            goto save_fail;
-        }
-
-        int16_t nm = 0;
-        DB_metaInfo_t *m;
-        for (m = it->meta; m; m = m->next) {
-            if (m->key[0] == '_' || m->key[0] == '!') {
-                continue; // skip reserved names
-            }
-            nm++;
-        }
-        if (buffered_file_writer_write(writer, &nm, 2) < 0) {
-            goto save_fail;
-        }
-        for (m = it->meta; m; m = m->next) {
-            if (m->key[0] == '_' || m->key[0] == '!') {
-                continue; // skip reserved names
-            }
-
-            l = length_to_uint16(strlen (m->key));
-            if (buffered_file_writer_write(writer, &l, 2) < 0) {
-                goto save_fail;
-            }
-            if (l) {
-                if (buffered_file_writer_write(writer, m->key, l) < 0) {
-                    goto save_fail;
-                }
-            }
-            int value_length = max(0, m->valuesize - 1);
-            l = length_to_uint16(value_length);
-            if (buffered_file_writer_write(writer, &l, 2) < 0) {
-                goto save_fail;
-            }
-            if (l) {
-                if (buffered_file_writer_write(writer, m->value, l) < 0) {
-                    goto save_fail;
-                }
-            }
-        }
-    }
-
-    // write playlist metadata
-    int16_t nm = 0;
-    DB_metaInfo_t *m;
-    for (m = plt->meta; m; m = m->next) {
-        nm++;
-    }
-    if (buffered_file_writer_write(writer, &nm, 2) < 0) {
+    if (dbpl4_writer_write (dbpl, writer) < 0) {
         goto save_fail;
     }
-
-    for (m = plt->meta; m; m = m->next) {
-        uint16_t l;
-        l = length_to_uint16(strlen (m->key));
-        if (buffered_file_writer_write(writer, &l, 2) < 0) {
-            goto save_fail;
-        }
-        if (l) {
-            if (buffered_file_writer_write(writer, m->key, l) < 0) {
-                goto save_fail;
-            }
-        }
-        l = length_to_uint16(strlen (m->value));
-        if (buffered_file_writer_write(writer, &l, 2) < 0) {
-            goto save_fail;
-        }
-        if (l) {
-            if (buffered_file_writer_write(writer, m->value, l) < 0) {
-                goto save_fail;
-            }
-        }
-    }
-
     if (buffered_file_writer_flush(writer) < 0) {
         goto save_fail;
     }
     buffered_file_writer_free(writer);
     writer = NULL;
+    dbpl4_writer_free (dbpl);
+    dbpl = NULL;
     if (EOF == fclose (fp)) {
         fp = NULL;
         goto save_fail;
     }
-    UNLOCK;
-    if (rename (tempfile, fname) != 0) {
-        fprintf (stderr, "playlist rename %s -> %s failed: %s\n", tempfile, fname, strerror (errno));
-        return -1;
-    }
     return 0;
 save_fail:
-    UNLOCK;
+    if (dbpl) {
+        dbpl4_writer_free (dbpl);
+    }
     if (writer != NULL) {
         buffered_file_writer_free(writer);
     }
     if (fp != NULL) {
         fclose (fp);
     }
-    unlink (tempfile);
+    unlink (fname);
     return -1;
 }
 
 int
-plt_save_n (int n) {
+plt_save (playlist_t *plt, playItem_t *first, playItem_t *last, const char *fname, int *pabort, int (*cb)(playItem_t *it, void *data), void *user_data) {
+    const char *ext = strrchr (fname, '.');
+    if (ext) {
+        DB_playlist_t **plug = deadbeef->plug_get_playlist_list ();
+        for (int i = 0; plug[i]; i++) {
+            if (plug[i]->extensions && plug[i]->load) {
+                const char **exts = plug[i]->extensions;
+                if (exts && plug[i]->save) {
+                    for (int e = 0; exts[e]; e++) {
+                        if (!strcasecmp (exts[e], ext+1)) {
+                            LOCK;
+                            plt->last_save_modification_idx = plt->modification_idx;
+                            int res = plug[i]->save ((ddb_playlist_t *)plt, fname, (DB_playItem_t *)_current_playlist->head[PL_MAIN], NULL);
+                            UNLOCK;
+                            return res;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    char tempfile[PATH_MAX];
+    snprintf (tempfile, sizeof (tempfile), "%s.tmp", fname);
+    plt_save_snapshot_t snapshot = {0};
+    LOCK;
+    int res = _plt_save_snapshot (plt, &snapshot);
+    UNLOCK;
+    if (_plt_save_snapshot_write (&snapshot, res, tempfile, cb, user_data) < 0) {
+        return -1;
+    }
+    if (rename (tempfile, fname) != 0) {
+        fprintf (stderr, "playlist rename %s -> %s failed: %s\n", tempfile, fname, strerror (errno));
+        return -1;
+    }
+    LOCK;
+    plt->last_save_modification_idx = snapshot.modification_idx;
+    UNLOCK;
+    return 0;
+}
+
+static int
+_make_playlists_folder (void) {
     char path[PATH_MAX];
     if (snprintf (path, sizeof (path), "%s/playlists", dbconfdir) > sizeof (path)) {
         fprintf (stderr, "error: failed to make path string for playlists folder\n");
@@ -2130,13 +2155,101 @@ plt_save_n (int n) {
     }
     // make folder
     mkdir (path, 0755);
+    return 0;
+}
+
+// Runs on the save queue, and saves one of the playlists with a scheduled save.
+// The file index is looked up at the time of rename, under pl_lock,
+// since playlist files are renamed by plt_add, plt_remove and plt_move.
+static void
+_plt_save_scheduled (void) {
+    char tempfile[PATH_MAX];
+    if (snprintf (tempfile, sizeof (tempfile), "%s/playlists/save.tmp", dbconfdir) > sizeof (tempfile)) {
+        fprintf (stderr, "error: failed to make path string for playlist file\n");
+        return;
+    }
 
+    LOCK;
+    playlist_t *plt;
+    for (plt = _playlists_head; plt && !plt->save_scheduled; plt = plt->next);
+    if (!plt) {
+        // already saved synchronously, or deleted
+        UNLOCK;
+        return;
+    }
+    plt->save_scheduled = 0;
+    if (_plt_loading) {
+        // the playlists are being loaded or freed,
+        // the playlist stays modified, and will be saved next time
+        UNLOCK;
+        return;
+    }
+    _plt_saving = plt;
+    plt_save_snapshot_t snapshot = {0};
+    int res = _plt_save_snapshot (plt, &snapshot);
+    UNLOCK;
+
+    if (_plt_save_snapshot_write (&snapshot, res, tempfile, NULL, NULL) < 0) {
+        fprintf (stderr, "error: failed to save playlist\n");
+        LOCK;
+        _plt_saving = NULL;
+        UNLOCK;
+        return;
+    }
+
+    LOCK;
+    int idx = _plt_saving == plt ? plt_get_idx_of (plt) : -1;
+    char path[PATH_MAX];
+    if (idx < 0) {
+        // the playlist has been deleted in the meantime
+        unlink (tempfile);
+    }
+    else if (plt->last_save_modification_idx > snapshot.modification_idx) {
+        // a newer state has been saved synchronously in the meantime
+        unlink (tempfile);
+    }
+    else if (snprintf (path, sizeof (path), "%s/playlists/%d.dbpl", dbconfdir, idx) > sizeof (path)) {
+        fprintf (stderr, "error: failed to make path string for playlist file\n");
+        unlink (tempfile);
+    }
+    else if (rename (tempfile, path) != 0) {
+        fprintf (stderr, "playlist rename %s -> %s failed: %s\n", tempfile, path, strerror (errno));
+    }
+    else {
+        plt->last_save_modification_idx = snapshot.modification_idx;
+    }
+    _plt_saving = NULL;
+    UNLOCK;
+}
+
+// Must be called with pl_lock held.
+// Multiple requests to save the same playlist are coalesced,
+// until the background save takes its snapshot.
+static void
+_plt_schedule_save (playlist_t *plt) {
+    if (plt->save_scheduled || !_save_queue || _plt_loading) {
+        return;
+    }
+    plt->save_scheduled = 1;
+    dispatch_async (_save_queue, ^{
+        _plt_save_scheduled ();
+    });
+}
+
+int
+plt_save_n (int n) {
+    if (_make_playlists_folder () < 0) {
+        return -1;
+    }
+
+    char path[PATH_MAX];
     LOCK;
     int err = 0;
 
     _plt_loading = 1;
     if (snprintf (path, sizeof (path), "%s/playlists/%d.dbpl", dbconfdir, n) > sizeof (path)) {
         fprintf (stderr, "error: failed to make path string for playlist file\n");
+        _plt_loading = 0;
         UNLOCK;
         return -1;
     }
@@ -2144,6 +2257,12 @@ plt_save_n (int n) {
     int i;
     playlist_t *plt;
     for (i = 0, plt = _playlists_head; plt && i < n; i++, plt = plt->next);
+    if (!plt) {
+        _plt_loading = 0;
+        UNLOCK;
+        return -1;
+    }
+    plt->save_scheduled = 0;
     err = plt_save (plt, NULL, NULL, path, NULL, NULL, NULL);
     _plt_loading = 0;
     UNLOCK;
@@ -2157,14 +2276,11 @@ pl_save_current (void) {
 
 int
 pl_save_all (void) {
-    char path[PATH_MAX];
-    if (snprintf (path, sizeof (path), "%s/playlists", dbconfdir) > sizeof (path)) {
-        fprintf (stderr, "error: failed to make path string for playlists folder\n");
+    if (_make_playlists_folder () < 0) {
         return -1;
     }
-    // make folder
-    mkdir (path, 0755);
 
+    char path[PATH_MAX];
     LOCK;
     playlist_t *p = _playlists_head;
     int i;
@@ -2182,6 +2298,7 @@ pl_save_all (void) {
         if (p->last_save_modification_idx == p->modification_idx) {
             continue;
         }
+        p->save_scheduled = 0;
         err = plt_save (p, NULL, NULL, path, NULL, NULL, NULL);
         if (err < 0) {
             break;
@@ -2192,6 +2309,51 @@ pl_save_all (void) {
     return err;
 }
 
+void
+plt_save_n_deferred (int n) {
+    if (_make_playlists_folder () < 0) {
+        return;
+    }
+
+    LOCK;
+    int i;
+    playlist_t *plt;
+    for (i = 0, plt = _playlists_head; plt && i < n; i++, plt = plt->next);
+    if (plt) {
+        _plt_schedule_save (plt);
+    }
+    UNLOCK;
+}
+
+void
+pl_save_current_deferred (void) {
+    plt_save_n_deferred (plt_get_curr_idx ());
+}
+
+void
+pl_save_all_deferred (void) {
+    if (_make_playlists_folder () < 0) {
+        return;
+    }
+
+    LOCK;
+    plt_gen_conf ();
+    for (playlist_t *p = _playlists_head; p; p = p->next) {
+        if (p->last_save_modification_idx == p->modification_idx) {
+            continue;
+        }
+        _plt_schedule_save (p);
+    }
+    UNLOCK;
+}
+
+void
+pl_save_wait (void) {
+    if (_save_queue) {
+        dispatch_sync (_save_queue, ^{});
+    }
+}
+
 static playItem_t *
 plt_load_int (int visibility, playlist_t *plt, playItem_t *after, const char *fname, int *pabort, int (*cb)(playItem_t *it, void *data), void *user_data) {
     playItem_t *it = NULL;
@@ -2273,10 +2435,15 @@ plt_load_int (int visibility, playlist_t *plt, playItem_t *after, const char *fn
     if (fread (&minorver, 1, 1, fp) != 1) {
         goto load_fail;
     }
-    if (minorver < 1) {
+    if (minorver < 1 || minorver > PLAYLIST_MINOR_VER) {
 //        trace ("bad minorver=%d\n", minorver);
         goto load_fail;
     }
+    if (minorver >= 4) {
+        last_added = dbpl4_load (plt, after, fp, pabort, cb, user_data);
+        fclose (fp);
+        return last_added;
+    }
     uint32_t cnt;
     if (fread (&cnt, 1, 4, fp) != 4) {
         goto load_fail;
@@ -2637,7 +2804,7 @@ plt_reshuffle (playlist_t *playlist, playItem_t **ppmin, playItem_t **ppmax) {
         }
         else {
             prev = it;
-            it->shufflerating = rand ();
+            it->shufflerating = pl_shuffle_random ();
             alb = pl_find_meta_raw (it, "album");
             art = pl_find_meta_raw (it, "artist");
             aa = new_aa;
@@ -2650,6 +2817,7 @@ plt_reshuffle (playlist_t *playlist, playItem_t **ppmin, playItem_t **ppmax) {
         }
         it->played = 0;
     }
+    plt_shuffle_rebuild (playlist);
     if (ppmin) {
         *ppmin = pmin;
     }
@@ -3561,7 +3729,7 @@ plt_copy_items (playlist_t *to, int iter, playlist_t *from, playItem_t *before,
     for (int i = 0; i < cnt; i++) {
         if (items[i]) {
             playItem_t *new_it = pl_item_alloc();
-            pl_item_copy (new_it, items[i]);
+            pl_item_copy_shared (new_it, items[i]);
             pl_insert_item (after, new_it);
             pl_item_unref (new_it);
             after = new_it;
@@ -3636,7 +3804,8 @@ plt_search_process2 (playlist_t *playlist, const char *text, int select_results)
     }
     *out = 0;
 
-    int lc_is_valid_u8 = u8_valid (lc, (int)strlen (lc), NULL);
+    size_t lc_len = strlen (lc);
+    int lc_is_valid_u8 = u8_valid (lc, (int)lc_len, NULL);
 
     playlist->search_cmpidx++;
     if (playlist->search_cmpidx > 127) {
@@ -3658,19 +3827,6 @@ plt_search_process2 (playlist_t *playlist, const char *text, int select_results)
                     continue;
                 }
 
-                const char *value = m->value;
-                const char *end = value + m->valuesize;
-
-                if (is_uri) {
-                    value = strrchr (value, '/');
-                    if (value) {
-                        value++;
-                    }
-                    else {
-                        value = m->value;
-                    }
-                }
-
                 char cmp = *(m->value-1);
 
                 if (abs (cmp) == playlist->search_cmpidx) { // string was already compared in this search
@@ -3681,15 +3837,25 @@ plt_search_process2 (playlist_t *playlist, const char *text, int select_results)
                 }
                 else {
                     int match = -playlist->search_cmpidx; // assume no match
-                    do {
-                        int len = (int)strlen(value);
-                        if (lc_is_valid_u8 && u8_valid(value, len, NULL) && utfcasestr_fast (value, lc)) {
+                    if (lc_is_valid_u8) {
+                        // the value parts are zero-separated in the folded copy,
+                        // so searching the whole copy at once can't match across the parts
+                        size_t folded_size;
+                        const char *value = metacache_get_folded_value (m->value, &folded_size);
+                        const char *end = value + folded_size;
+
+                        if (value && is_uri) {
+                            const char *fname = strrchr (value, '/');
+                            if (fname) {
+                                value = fname + 1;
+                            }
+                        }
+
+                        if (value && u8_memmem (value, end - value, lc, lc_len)) {
                             _plsearch_append (playlist, it, select_results);
                             match = playlist->search_cmpidx; // it's a match
-                            break;
                         }
-                        value += len+1;
-                    } while (value < end);
+                    }
                     *((char *)m->value-1) = (int8_t)match;
                     if (match > 0) {
                         break;
@@ -3720,6 +3886,26 @@ send_trackinfochanged (playItem_t *track) {
 void
 pl_items_copy_junk (playItem_t *from, playItem_t *first, playItem_t *last) {
     LOCK;
+    if (first != last && from->meta) {
+        int count = 0;
+        for (playItem_t *i = first; i; i = i->next[PL_MAIN]) {
+            count++;
+            if (i == last) {
+                break;
+            }
+        }
+        playItem_t **items = malloc (sizeof (playItem_t *) * count);
+        playItem_t *i = first;
+        for (int n = 0; n < count; n++, i = i->next[PL_MAIN]) {
+            i->_flags = from->_flags;
+            items[n] = i;
+        }
+        pl_items_share_junk (from, items, count);
+        free (items);
+        UNLOCK;
+        return;
+    }
+
     DB_metaInfo_t *meta = from->meta;
     while (meta) {
         playItem_t *i;
@@ -3735,6 +3921,36 @@ pl_items_copy_junk (playItem_t *from, playItem_t *first, playItem_t *last) {
     UNLOCK;
 }
 
+void
+pl_items_share_junk (playItem_t *from, playItem_t **items, int count) {
+    LOCK;
+    pl_meta_base_t *base = pl_meta_base_alloc ();
+    for (DB_metaInfo_t *meta = from->meta; meta; meta = meta->next) {
+        int i;
+        for (i = 0; i < count; i++) {
+            if (pl_meta_for_key (items[i], meta->key)) {
+                break;
+            }
+        }
+        if (i == count && base) {
+            pl_meta_base_add_copy (base, meta);
+        }
+        else {
+            // some of the items have their own value, or the block couldn't be allocated
+            for (i = 0; i < count; i++) {
+                pl_add_meta_copy (items[i], meta);
+            }
+        }
+    }
+    if (base) {
+        for (int i = 0; i < count; i++) {
+            pl_item_set_meta_base (items[i], base);
+        }
+        pl_meta_base_unref (base);
+    }
+    UNLOCK;
+}
+
 uint32_t
 pl_get_item_flags (playItem_t *it) {
     LOCK;
@@ -4076,7 +4292,7 @@ plt_process_embedded_cue (playlist_t *plt, playItem_t *after, playItem_t *it, in
     const char *cuesheet = pl_find_meta (it, "cuesheet");
     if (cuesheet) {
         const char *fname = pl_find_meta (it, ":URI");
-        cue = plt_load_cuesheet_from_buffer (plt, after, fname, it, totalsamples, samplerate, (const uint8_t *)cuesheet, (int)strlen (cuesheet), NULL, 0, 0);
+        cue = plt_load_cuesheet_from_buffer (plt, after, fname, it, totalsamples, samplerate, (const uint8_t *)cuesheet, (int)strlen (cuesheet), NULL, NULL);
     }
     pl_unlock();
     return cue;
@@ -4162,7 +4378,7 @@ pl_get_played(playItem_t *it) {
 void
 pl_set_played(playItem_t *it, int played) {
     pl_lock();
-    it->played = played;
+    pl_shuffle_set_played (it, played);
     pl_unlock();
 }
 
@@ -4175,8 +4391,13 @@ pl_get_shufflerating (playItem_t *it) {
 }
 
 void
-pl_set_shufflerating (playItem_t *it, int rating) {
+plt_set_item_shufflerating (playlist_t *plt, playItem_t *it, int rating) {
     pl_lock();
+    int in_tree = it->shuffle_count != 0;
+    plt_shuffle_remove (plt, it);
     it->shufflerating = rating;
+    if (in_tree) {
+        plt_shuffle_insert (plt, it, NULL);
+    }
     pl_unlock();
 }
@@ -58,6 +58,14 @@ typedef struct playItem_s {
     struct playItem_s *next[PL_MAX_ITERATORS]; // next item in linked list
     struct playItem_s *prev[PL_MAX_ITERATORS]; // prev item in linked list
     struct DB_metaInfo_s *meta; // linked list storing metainfo
+    struct pl_meta_base_s *meta_base; // shared end of the meta list, see plmeta.h
+    // shuffle order tree, see plshuffle.h
+    struct playItem_s *shuffle_parent;
+    struct playItem_s *shuffle_left;
+    struct playItem_s *shuffle_right;
+    uint32_t shuffle_priority;
+    int32_t shuffle_count; // number of items in the subtree, 0 if the item is not in the tree
+    int32_t shuffle_unplayed; // number of not played items in the subtree
     unsigned selected : 1;
     unsigned played : 1; // mark as played in shuffle mode
     unsigned in_playlist : 1; // 1 if item is in playlist
@@ -78,6 +86,7 @@ typedef struct playlist_s {
     int current_row[PL_MAX_ITERATORS]; // current row (cursor)
     int scroll;
     struct DB_metaInfo_s *meta; // linked list storing metainfo
+    playItem_t *shuffle_root; // items in shuffle order, see plshuffle.h
     int refc;
     int files_add_visibility;
 
@@ -92,6 +101,8 @@ typedef struct playlist_s {
     unsigned loading_cue : 1;
     unsigned ignore_archives : 1;
     unsigned follow_symlinks : 1;
+
+    int save_scheduled; // background save is pending, protected by pl_lock
 } playlist_t;
 
 // global playlist control functions
@@ -241,6 +252,12 @@ pl_item_unref (playItem_t *it);
 void
 pl_item_copy (playItem_t *out, playItem_t *it);
 
+// Like pl_item_copy, but if the output item has no fields yet, it shares them with the original item,
+// and either item gets private copies when it's modified (see plmeta.h).
+// The plugin API keeps using pl_item_copy, which always makes a deep copy.
+void
+pl_item_copy_shared (playItem_t *out, playItem_t *it);
+
 int
 pl_getcount (int iter);
 
@@ -308,6 +325,23 @@ pl_save_current (void);
 int
 pl_save_all (void);
 
+// Same as plt_save_n, pl_save_current and pl_save_all, but the playlists are saved on a background queue,
+// and don't block the caller. Repeated requests to save a playlist are coalesced.
+// The errors are only logged.
+void
+plt_save_n_deferred (int n);
+
+void
+pl_save_current_deferred (void);
+
+void
+pl_save_all_deferred (void);
+
+// Blocks until all scheduled background playlist saves are complete.
+// Must not be called with pl_lock held.
+void
+pl_save_wait (void);
+
 playItem_t *
 plt_load (playlist_t *plt, playItem_t *after, const char *fname, int *pabort, int (*cb)(playItem_t *it, void *data), void *user_data);
 
@@ -425,6 +459,12 @@ plt_sort_random (playlist_t *plt, int iter);
 void
 pl_items_copy_junk (struct playItem_s *from, struct playItem_s *first, struct playItem_s *last);
 
+// Like pl_items_copy_junk, but the fields which none of the items have yet
+// are stored once, in a block shared by all the items (see plmeta.h).
+// The flags are not copied.
+void
+pl_items_share_junk (playItem_t *from, playItem_t **items, int count);
+
 struct DB_metaInfo_s *
 pl_get_metadata_head (playItem_t *it);
 
@@ -560,8 +600,9 @@ pl_set_played (playItem_t *it, int played);
 int
 pl_get_shufflerating (playItem_t *it);
 
+// Changes the rating, and moves the item to the new position in the shuffle order
 void
-pl_set_shufflerating (playItem_t *it, int rating);
+plt_set_item_shufflerating (playlist_t *plt, playItem_t *it, int rating);
 
 #ifdef __cplusplus
 }
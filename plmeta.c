@@ -77,8 +77,82 @@ pl_meta_free_values (DB_metaInfo_t *meta) {
     meta->valuesize = 0;
 }
 
+static int
+_is_property (const char *key) {
+    return key[0] == ':' || key[0] == '_' || key[0] == '!';
+}
+
+// returns 1 if the node is in the shared part of the item's metadata
+static int
+_meta_is_shared (playItem_t *it, DB_metaInfo_t *meta) {
+    if (!it->meta_base || !meta) {
+        return 0;
+    }
+    for (DB_metaInfo_t *m = it->meta; m != it->meta_base->head; m = m->next) {
+        if (m == meta) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static DB_metaInfo_t *
+_meta_copy_node (DB_metaInfo_t *meta) {
+    DB_metaInfo_t *m = calloc (1, sizeof (DB_metaInfo_t));
+    if (!m) {
+        return NULL;
+    }
+    m->key = metacache_add_string (meta->key);
+    if (meta->value) {
+        metacache_ref_value (meta->value);
+        m->value = meta->value;
+        m->valuesize = meta->valuesize;
+    }
+    return m;
+}
+
+// the own regular fields stay before the own properties, and the shared part stays at the end
+static DB_metaInfo_t *
+_add_empty_meta_for_key_shared (playItem_t *it, const char *key) {
+    DB_metaInfo_t *normaltail = NULL;
+    DB_metaInfo_t *tail = NULL;
+    for (DB_metaInfo_t *m = it->meta; m != it->meta_base->head; m = m->next) {
+        if (!_is_property (m->key)) {
+            normaltail = m;
+        }
+        tail = m;
+    }
+
+    DB_metaInfo_t *m = calloc (1, sizeof (DB_metaInfo_t));
+    if (!m) {
+        return NULL;
+    }
+    m->key = metacache_add_string (key);
+
+    DB_metaInfo_t *after = _is_property (key) ? tail : normaltail;
+    if (after) {
+        m->next = after->next;
+        after->next = m;
+    }
+    else {
+        m->next = it->meta;
+        it->meta = m;
+    }
+    return m;
+}
+
 DB_metaInfo_t *
 pl_add_empty_meta_for_key (playItem_t *it, const char *key) {
+    if (it->meta_base) {
+        for (DB_metaInfo_t *m = it->meta; m; m = m->next) {
+            if (!strcasecmp (key, m->key)) {
+                // duplicate key
+                return NULL;
+            }
+        }
+        return _add_empty_meta_for_key_shared (it, key);
+    }
+
     // check if it's already set
     DB_metaInfo_t *normaltail = NULL;
     DB_metaInfo_t *propstart = NULL;
@@ -89,13 +163,12 @@ pl_add_empty_meta_for_key (playItem_t *it, const char *key) {
             // duplicate key
             return NULL;
         }
-        // find end of normal metadata
+        // find end of normal metadata;
+        // the fields which came from a shared block may have regular fields after the properties,
+        // so the whole list is checked for duplicates
         if (!normaltail && (!m->next || m->key[0] == ':' || m->key[0] == '_' || m->key[0] == '!')) {
             normaltail = tail;
             propstart = m;
-            if (key[0] != ':' && key[0] != '_' && key[0] != '!') {
-                break;
-            }
         }
         // find end of properties
         tail = m;
@@ -244,6 +317,13 @@ pl_append_meta_full (playItem_t *it, const char *key, const char *value, int siz
     }
     pl_lock ();
     DB_metaInfo_t *m = pl_meta_for_key (it, key);
+    if (_meta_is_shared (it, m)) {
+        if (pl_item_unshare_meta (it) < 0) {
+            pl_unlock ();
+            return;
+        }
+        m = pl_meta_for_key (it, key);
+    }
     if (!m) {
         m = pl_add_empty_meta_for_key(it, key);
     }
@@ -279,6 +359,13 @@ pl_replace_meta (playItem_t *it, const char *key, const char *value) {
     LOCK;
     // check if it's already set
     DB_metaInfo_t *m = pl_meta_for_key (it, key);
+    if (_meta_is_shared (it, m)) {
+        if (pl_item_unshare_meta (it) < 0) {
+            UNLOCK;
+            return;
+        }
+        m = pl_meta_for_key (it, key);
+    }
 
     if (m) {
         pl_meta_free_values (m);
@@ -318,6 +405,10 @@ pl_set_meta_float (playItem_t *it, const char *key, float value) {
 void
 pl_delete_meta (playItem_t *it, const char *key) {
     pl_lock ();
+    if (_meta_is_shared (it, pl_meta_for_key (it, key)) && pl_item_unshare_meta (it) < 0) {
+        pl_unlock ();
+        return;
+    }
     DB_metaInfo_t *prev = NULL;
     DB_metaInfo_t *m = it->meta;
     while (m) {
@@ -415,30 +506,49 @@ pl_get_metadata_head (playItem_t *it) {
 void
 pl_delete_metadata (playItem_t *it, DB_metaInfo_t *meta) {
     pl_lock ();
+    if (_meta_is_shared (it, meta) && pl_item_unshare_meta (it) < 0) {
+        pl_unlock ();
+        return;
+    }
     DB_metaInfo_t *prev = NULL;
     DB_metaInfo_t *m = it->meta;
-    while (m) {
-        if (m == meta) {
-            if (prev) {
-                prev->next = m->next;
-            }
-            else {
-                it->meta = m->next;
-            }
-            metacache_remove_string (m->key);
-            pl_meta_free_values(m);
-            free (m);
-            break;
-        }
+    while (m && m != meta) {
         prev = m;
         m = m->next;
     }
+    if (!m && meta) {
+        // The node was shared, and the item got a copy of it when it was unshared,
+        // e.g. by deleting an earlier shared node while walking the list.
+        // The shared node is still valid, since the other items keep the block alive.
+        prev = NULL;
+        for (m = it->meta; m; m = m->next) {
+            if (m->key == meta->key && m->value == meta->value) {
+                break;
+            }
+            prev = m;
+        }
+    }
+    if (m) {
+        if (prev) {
+            prev->next = m->next;
+        }
+        else {
+            it->meta = m->next;
+        }
+        metacache_remove_string (m->key);
+        pl_meta_free_values(m);
+        free (m);
+    }
     pl_unlock ();
 }
 
 void
 pl_delete_all_meta (playItem_t *it) {
     LOCK;
+    if (pl_item_unshare_meta (it) < 0) {
+        UNLOCK;
+        return;
+    }
     DB_metaInfo_t *m = it->meta;
     DB_metaInfo_t *prev = NULL;
     while (m) {
@@ -541,3 +651,298 @@ pl_add_meta_copy (playItem_t *it, DB_metaInfo_t *meta) {
     m->value = metacache_add_value (meta->value, meta->valuesize);
     m->valuesize = meta->valuesize;
 }
+
+pl_meta_base_t *
+pl_meta_base_alloc (void) {
+    pl_meta_base_t *base = calloc (1, sizeof (pl_meta_base_t));
+    if (!base) {
+        return NULL;
+    }
+    base->refc = 1;
+    return base;
+}
+
+void
+pl_meta_base_unref (pl_meta_base_t *base) {
+    LOCK;
+    while (base && --base->refc == 0) {
+        pl_meta_base_t *parent = base->parent;
+        DB_metaInfo_t *end = parent ? parent->head : NULL;
+        while (base->head != end) {
+            DB_metaInfo_t *m = base->head;
+            base->head = m->next;
+            pl_meta_free_values (m);
+            free (m);
+        }
+        free (base);
+        base = parent;
+    }
+    UNLOCK;
+}
+
+void
+pl_meta_base_add_copy (pl_meta_base_t *base, DB_metaInfo_t *meta) {
+    DB_metaInfo_t *normaltail = NULL;
+    DB_metaInfo_t *tail = NULL;
+    for (DB_metaInfo_t *m = base->head; m; m = m->next) {
+        if (!strcasecmp (meta->key, m->key)) {
+            return; // dupe
+        }
+        if (!_is_property (m->key)) {
+            normaltail = m;
+        }
+        tail = m;
+    }
+
+    DB_metaInfo_t *m = _meta_copy_node (meta);
+    if (!m) {
+        return;
+    }
+    DB_metaInfo_t *after = _is_property (m->key) ? tail : normaltail;
+    if (after) {
+        m->next = after->next;
+        after->next = m;
+    }
+    else {
+        m->next = base->head;
+        base->head = m;
+    }
+}
+
+void
+pl_item_set_meta_base (playItem_t *it, pl_meta_base_t *base) {
+    LOCK;
+    if (pl_item_unshare_meta (it) < 0) {
+        UNLOCK;
+        return;
+    }
+
+    DB_metaInfo_t *tail = NULL;
+    for (DB_metaInfo_t *m = it->meta; m; m = m->next) {
+        tail = m;
+    }
+
+    int share = 1;
+    for (DB_metaInfo_t *m = it->meta; m && share; m = m->next) {
+        if (pl_meta_base_has_key (base, m->key)) {
+            // the item overrides some of the shared fields
+            share = 0;
+        }
+    }
+
+    if (!share) {
+        for (DB_metaInfo_t *m = base->head; m; m = m->next) {
+            pl_add_meta_copy (it, m);
+        }
+        UNLOCK;
+        return;
+    }
+
+    if (!base->head) {
+        UNLOCK;
+        return;
+    }
+
+    if (tail) {
+        tail->next = base->head;
+    }
+    else {
+        it->meta = base->head;
+    }
+    it->meta_base = base;
+    base->refc++;
+    UNLOCK;
+}
+
+int
+pl_meta_base_has_key (pl_meta_base_t *base, const char *key) {
+    for (DB_metaInfo_t *m = base->head; m; m = m->next) {
+        if (!strcasecmp (key, m->key)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void
+_meta_list_append (DB_metaInfo_t **head, DB_metaInfo_t **tail, DB_metaInfo_t *m) {
+    m->next = NULL;
+    if (*tail) {
+        (*tail)->next = m;
+    }
+    else {
+        *head = m;
+    }
+    *tail = m;
+}
+
+// The nodes keep their order, and the nodes of the blocks which are only used by this item are kept as is,
+// so the pointers obtained from pl_get_metadata_head stay valid where possible.
+int
+pl_item_unshare_meta (playItem_t *it) {
+    LOCK;
+    pl_meta_base_t *base;
+    while ((base = it->meta_base)) {
+        if (base->refc == 1) {
+            // nobody else uses the block, so the item takes over its nodes, and the reference to the parent
+            it->meta_base = base->parent;
+            free (base);
+            continue;
+        }
+
+        DB_metaInfo_t *tail = NULL;
+        for (DB_metaInfo_t *m = it->meta; m != base->head; m = m->next) {
+            tail = m;
+        }
+        DB_metaInfo_t *copy = NULL;
+        DB_metaInfo_t *copytail = NULL;
+        for (DB_metaInfo_t *m = base->head; m; m = m->next) {
+            DB_metaInfo_t *c = _meta_copy_node (m);
+            if (!c) {
+                // the item keeps the shared block
+                while (copy) {
+                    c = copy;
+                    copy = c->next;
+                    metacache_remove_string (c->key);
+                    pl_meta_free_values (c);
+                    free (c);
+                }
+                UNLOCK;
+                return -1;
+            }
+            _meta_list_append (&copy, &copytail, c);
+        }
+        if (tail) {
+            tail->next = copy;
+        }
+        else {
+            it->meta = copy;
+        }
+        it->meta_base = NULL;
+        pl_meta_base_unref (base);
+    }
+    UNLOCK;
+    return 0;
+}
+
+pl_meta_base_t *
+pl_item_freeze_meta (playItem_t *it) {
+    LOCK;
+    pl_meta_base_t *base = it->meta_base;
+    if (it->meta != (base ? base->head : NULL)) {
+        // the own fields become the head of a new block, which continues with the old one
+        base = pl_meta_base_alloc ();
+        if (!base) {
+            UNLOCK;
+            return NULL;
+        }
+        base->head = it->meta;
+        base->parent = it->meta_base;
+        it->meta_base = base;
+    }
+    UNLOCK;
+    return base;
+}
+
+// returns the node of the item with the same key and value, which are compared by pointer,
+// since both come from metacache
+static DB_metaInfo_t *
+_meta_find_same (playItem_t *it, DB_metaInfo_t *meta, DB_metaInfo_t **prev) {
+    *prev = NULL;
+    for (DB_metaInfo_t *m = it->meta; m; m = m->next) {
+        if (m->key == meta->key && m->value == meta->value && m->valuesize == meta->valuesize) {
+            return m;
+        }
+        *prev = m;
+    }
+    return NULL;
+}
+
+static int
+_meta_is_common (playItem_t **items, int count, DB_metaInfo_t *meta) {
+    DB_metaInfo_t *prev;
+    for (int i = 0; i < count; i++) {
+        if (!_meta_find_same (items[i], meta, &prev)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void
+pl_items_share_common_meta (playItem_t **items, int count) {
+    LOCK;
+    for (int i = 0; i < count; i++) {
+        if (items[i]->meta_base) {
+            UNLOCK;
+            return;
+        }
+    }
+
+    // allocated before any nodes are moved, so the items are left alone when it fails
+    pl_meta_base_t *base = pl_meta_base_alloc ();
+    if (!base) {
+        UNLOCK;
+        return;
+    }
+
+    DB_metaInfo_t *normal = NULL;
+    DB_metaInfo_t *normaltail = NULL;
+    DB_metaInfo_t *props = NULL;
+    DB_metaInfo_t *propstail = NULL;
+    DB_metaInfo_t *prev = NULL;
+    DB_metaInfo_t *m = items[0]->meta;
+    while (m) {
+        DB_metaInfo_t *next = m->next;
+        DB_metaInfo_t *same_prev;
+        int i;
+        if (!_meta_is_common (items, count, m)) {
+            prev = m;
+            m = next;
+            continue;
+        }
+
+        // drop the copies of the other items, and move the node of the first one to the shared block
+        for (i = 1; i < count; i++) {
+            DB_metaInfo_t *same = _meta_find_same (items[i], m, &same_prev);
+            if (same_prev) {
+                same_prev->next = same->next;
+            }
+            else {
+                items[i]->meta = same->next;
+            }
+            metacache_remove_string (same->key);
+            pl_meta_free_values (same);
+            free (same);
+        }
+        if (prev) {
+            prev->next = next;
+        }
+        else {
+            items[0]->meta = next;
+        }
+        if (_is_property (m->key)) {
+            _meta_list_append (&props, &propstail, m);
+        }
+        else {
+            _meta_list_append (&normal, &normaltail, m);
+        }
+        m = next;
+    }
+
+    if (!normal && !props) {
+        pl_meta_base_unref (base);
+        UNLOCK;
+        return;
+    }
+    if (normaltail) {
+        normaltail->next = props;
+    }
+
+    base->head = normal ? normal : props;
+    for (int i = 0; i < count; i++) {
+        pl_item_set_meta_base (items[i], base);
+    }
+    pl_meta_base_unref (base);
+    UNLOCK;
+}
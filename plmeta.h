@@ -84,6 +84,57 @@ pl_meta_free_values (DB_metaInfo_t *meta);
 void
 pl_add_meta_copy (playItem_t *it, DB_metaInfo_t *meta);
 
+// A block of metadata fields, which is shared by several items,
+// e.g. the tags of a cue sheet image, which are the same in all of its tracks.
+// The block is linked after the item's own fields, so the readers see a single list.
+// The regular fields come before the properties within the own fields, and within each block,
+// so the list of an item with a shared block can have regular fields after the own properties.
+// The block is never modified after it's attached: changing or deleting a shared field
+// gives the item a private copy of the block first.
+// A block can continue with another one, when it was made from the own fields of an item, which already had one.
+typedef struct pl_meta_base_s {
+    int refc;
+    DB_metaInfo_t *head;
+    struct pl_meta_base_s *parent; // the block following the last node, or NULL
+} pl_meta_base_t;
+
+pl_meta_base_t *
+pl_meta_base_alloc (void);
+
+void
+pl_meta_base_unref (pl_meta_base_t *base);
+
+// Adds a copy of the field, unless the block already has the key.
+// Must only be used before the block is attached to any items.
+void
+pl_meta_base_add_copy (pl_meta_base_t *base, DB_metaInfo_t *meta);
+
+int
+pl_meta_base_has_key (pl_meta_base_t *base, const char *key);
+
+// Links the block after the item's own fields.
+// If the item already has some of the keys, it gets copies of the other fields instead.
+void
+pl_item_set_meta_base (playItem_t *it, pl_meta_base_t *base);
+
+// Replaces the shared fields of the item with private copies, in the same order.
+// The nodes of the blocks which are only used by this item are kept.
+// Returns -1, and leaves the item shared, if the copies can't be allocated.
+int
+pl_item_unshare_meta (playItem_t *it);
+
+// Makes all fields of the item shared, without copying them, and returns the block,
+// which the caller can attach to other items, or NULL if the item has no fields,
+// or the block can't be allocated.
+// The returned block is not referenced.
+pl_meta_base_t *
+pl_item_freeze_meta (playItem_t *it);
+
+// Moves the fields, which are the same in all of the items, to a shared block.
+// Does nothing if any of the items already has a shared block.
+void
+pl_items_share_common_meta (playItem_t **items, int count);
+
 #ifdef __cplusplus
 }
 #endif
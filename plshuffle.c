@@ -0,0 +1,296 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <stdlib.h>
+#include "plshuffle.h"
+
+// splitmix64, separate states for the ratings and for the tree priorities,
+// so that the tree shape doesn't affect the sequence of ratings
+static uint64_t _rating_state = 0x853c49e6748fea9bULL;
+static uint64_t _priority_state = 0xda3e39cb94b95bdbULL;
+
+static uint64_t
+_splitmix64 (uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void
+pl_shuffle_seed (uint64_t seed) {
+    _rating_state = seed;
+}
+
+int32_t
+pl_shuffle_random (void) {
+    pl_lock ();
+    int32_t r = (int32_t)(_splitmix64 (&_rating_state) >> 33);
+    pl_unlock ();
+    return r;
+}
+
+static inline int32_t
+_count (playItem_t *n) {
+    return n ? n->shuffle_count : 0;
+}
+
+// number of items in the subtree with the given played state
+static inline int32_t
+_matching (playItem_t *n, int played) {
+    if (!n) {
+        return 0;
+    }
+    return played ? n->shuffle_count - n->shuffle_unplayed : n->shuffle_unplayed;
+}
+
+static void
+_update (playItem_t *n) {
+    n->shuffle_count = 1 + _count (n->shuffle_left) + _count (n->shuffle_right);
+    n->shuffle_unplayed = !n->played + _matching (n->shuffle_left, 0) + _matching (n->shuffle_right, 0);
+}
+
+static void
+_replace_child (playlist_t *plt, playItem_t *parent, playItem_t *child, playItem_t *with) {
+    if (!parent) {
+        plt->shuffle_root = with;
+    }
+    else if (parent->shuffle_left == child) {
+        parent->shuffle_left = with;
+    }
+    else {
+        parent->shuffle_right = with;
+    }
+    if (with) {
+        with->shuffle_parent = parent;
+    }
+}
+
+// rotates the node above its parent, preserving the order
+static void
+_rotate_up (playlist_t *plt, playItem_t *n) {
+    playItem_t *p = n->shuffle_parent;
+    _replace_child (plt, p->shuffle_parent, p, n);
+    if (p->shuffle_left == n) {
+        p->shuffle_left = n->shuffle_right;
+        if (p->shuffle_left) {
+            p->shuffle_left->shuffle_parent = p;
+        }
+        n->shuffle_right = p;
+    }
+    else {
+        p->shuffle_right = n->shuffle_left;
+        if (p->shuffle_right) {
+            p->shuffle_right->shuffle_parent = p;
+        }
+        n->shuffle_left = p;
+    }
+    p->shuffle_parent = n;
+    _update (p);
+    _update (n);
+}
+
+// attaches the node as a leaf, and restores the heap order of priorities
+static void
+_attach (playlist_t *plt, playItem_t *it, playItem_t *parent, int left) {
+    it->shuffle_left = NULL;
+    it->shuffle_right = NULL;
+    it->shuffle_priority = (uint32_t)_splitmix64 (&_priority_state);
+    it->shuffle_count = 1;
+    it->shuffle_unplayed = !it->played;
+
+    it->shuffle_parent = parent;
+    if (!parent) {
+        plt->shuffle_root = it;
+    }
+    else if (left) {
+        parent->shuffle_left = it;
+    }
+    else {
+        parent->shuffle_right = it;
+    }
+
+    for (playItem_t *n = parent; n; n = n->shuffle_parent) {
+        n->shuffle_count++;
+        n->shuffle_unplayed += !it->played;
+    }
+
+    while (it->shuffle_parent && it->shuffle_parent->shuffle_priority < it->shuffle_priority) {
+        _rotate_up (plt, it);
+    }
+}
+
+void
+plt_shuffle_insert (playlist_t *plt, playItem_t *it, playItem_t *after) {
+    if (after && after->shuffle_count && after->shufflerating == it->shufflerating) {
+        // leftmost position in the right subtree is right after `after`
+        playItem_t *n = after->shuffle_right;
+        if (!n) {
+            _attach (plt, it, after, 0);
+            return;
+        }
+        while (n->shuffle_left) {
+            n = n->shuffle_left;
+        }
+        _attach (plt, it, n, 1);
+        return;
+    }
+
+    playItem_t *parent = NULL;
+    int left = 0;
+    for (playItem_t *n = plt->shuffle_root; n; ) {
+        parent = n;
+        left = it->shufflerating < n->shufflerating;
+        n = left ? n->shuffle_left : n->shuffle_right;
+    }
+    _attach (plt, it, parent, left);
+}
+
+void
+plt_shuffle_remove (playlist_t *plt, playItem_t *it) {
+    if (!it->shuffle_count) {
+        return;
+    }
+
+    // move down until at most one child is left
+    while (it->shuffle_left && it->shuffle_right) {
+        if (it->shuffle_left->shuffle_priority > it->shuffle_right->shuffle_priority) {
+            _rotate_up (plt, it->shuffle_left);
+        }
+        else {
+            _rotate_up (plt, it->shuffle_right);
+        }
+    }
+
+    playItem_t *parent = it->shuffle_parent;
+    _replace_child (plt, parent, it, it->shuffle_left ? it->shuffle_left : it->shuffle_right);
+
+    for (playItem_t *n = parent; n; n = n->shuffle_parent) {
+        n->shuffle_count--;
+        n->shuffle_unplayed -= !it->played;
+    }
+
+    it->shuffle_parent = NULL;
+    it->shuffle_left = NULL;
+    it->shuffle_right = NULL;
+    it->shuffle_count = 0;
+    it->shuffle_unplayed = 0;
+}
+
+void
+plt_shuffle_rebuild (playlist_t *plt) {
+    plt->shuffle_root = NULL;
+    for (playItem_t *it = plt->head[PL_MAIN]; it; it = it->next[PL_MAIN]) {
+        plt_shuffle_insert (plt, it, NULL);
+    }
+}
+
+void
+pl_shuffle_set_played (playItem_t *it, int played) {
+    played = played ? 1 : 0;
+    if (it->played == played) {
+        return;
+    }
+    it->played = played;
+    if (!it->shuffle_count) {
+        return;
+    }
+    int delta = played ? -1 : 1;
+    for (playItem_t *n = it; n; n = n->shuffle_parent) {
+        n->shuffle_unplayed += delta;
+    }
+}
+
+static playItem_t *
+_first_in_subtree (playItem_t *n, int played) {
+    while (n) {
+        if (_matching (n->shuffle_left, played)) {
+            n = n->shuffle_left;
+        }
+        else if (n->played == played) {
+            return n;
+        }
+        else {
+            n = n->shuffle_right;
+        }
+    }
+    return NULL;
+}
+
+static playItem_t *
+_last_in_subtree (playItem_t *n, int played) {
+    while (n) {
+        if (_matching (n->shuffle_right, played)) {
+            n = n->shuffle_right;
+        }
+        else if (n->played == played) {
+            return n;
+        }
+        else {
+            n = n->shuffle_left;
+        }
+    }
+    return NULL;
+}
+
+playItem_t *
+plt_shuffle_first (playlist_t *plt, int32_t rating, int played) {
+    played = played ? 1 : 0;
+    // the deepest node on the search path, which is in range,
+    // and has a match in itself or in its right subtree
+    playItem_t *found = NULL;
+    for (playItem_t *n = plt->shuffle_root; n; ) {
+        if (n->shufflerating < rating) {
+            n = n->shuffle_right;
+            continue;
+        }
+        if (n->played == played || _matching (n->shuffle_right, played)) {
+            found = n;
+        }
+        n = n->shuffle_left;
+    }
+    if (!found || found->played == played) {
+        return found;
+    }
+    return _first_in_subtree (found->shuffle_right, played);
+}
+
+playItem_t *
+plt_shuffle_last (playlist_t *plt, int32_t rating, int played) {
+    played = played ? 1 : 0;
+    playItem_t *found = NULL;
+    for (playItem_t *n = plt->shuffle_root; n; ) {
+        if (n->shufflerating > rating) {
+            n = n->shuffle_left;
+            continue;
+        }
+        if (n->played == played || _matching (n->shuffle_left, played)) {
+            found = n;
+        }
+        n = n->shuffle_right;
+    }
+    if (!found || found->played == played) {
+        return found;
+    }
+    return _last_in_subtree (found->shuffle_left, played);
+}
@@ -0,0 +1,84 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef plshuffle_h
+#define plshuffle_h
+
+#include <stdint.h>
+#include "playlist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Shuffle order of a playlist.
+//
+// The PL_MAIN items of each playlist are kept in a treap ordered by shufflerating.
+// Items with equal rating (tracks of one album in album shuffle mode) follow each other
+// in playlist order.
+// Every node keeps the number of items and of not played items in its subtree,
+// which allows finding the next / previous track in shuffle order in O(log n).
+//
+// The tree functions must be called with pl_lock held.
+
+// Seeds the generator used for shuffle ratings and random playback.
+// Must be called before pl_init.
+void
+pl_shuffle_seed (uint64_t seed);
+
+// Returns a random number in the [0, INT32_MAX] range.
+int32_t
+pl_shuffle_random (void);
+
+// Adds the item to the shuffle order.
+// If `after` is in the tree and has the same rating, the item is placed right after it,
+// otherwise after all items with the same rating.
+void
+plt_shuffle_insert (playlist_t *plt, playItem_t *it, playItem_t *after);
+
+// Removes the item from the shuffle order, does nothing if it's not there.
+void
+plt_shuffle_remove (playlist_t *plt, playItem_t *it);
+
+// Rebuilds the shuffle order from the current ratings,
+// items with equal rating are placed in playlist order.
+void
+plt_shuffle_rebuild (playlist_t *plt);
+
+// Sets the played flag, and updates the counters of the tree.
+void
+pl_shuffle_set_played (playItem_t *it, int played);
+
+// Returns the first item in shuffle order with rating >= `rating` and the given played state, or NULL.
+playItem_t *
+plt_shuffle_first (playlist_t *plt, int32_t rating, int played);
+
+// Returns the last item in shuffle order with rating <= `rating` and the given played state, or NULL.
+playItem_t *
+plt_shuffle_last (playlist_t *plt, int32_t rating, int played);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* plshuffle_h */
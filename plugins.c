@@ -69,6 +69,7 @@
 #include "cocoautil.h"
 #endif
 #include "viz.h"
+#include "decodeinfo.h"
 
 DB_plugin_t main_plugin = {
     .type = DB_PLUGIN_MISC,
@@ -533,6 +534,14 @@ static DB_functions_t deadbeef_api = {
     .plt_insert_dir3 = (ddb_playItem_t *(*) (int visibility, uint32_t flags, ddb_playlist_t *plt, ddb_playItem_t *after, const char *dirname, int *pabort, int (*callback)(ddb_insert_file_result_t result, const char *fname, void *user_data), void *user_data))plt_insert_dir3,
 
     .streamer_get_playing_track_safe = (DB_playItem_t *(*) (void))streamer_get_playing_track,
+
+    // ******* new 1.17 APIs ********
+    .decode_info_get = decode_info_get,
+    .decode_info_set = decode_info_set,
+    .decode_info_free = decode_info_free,
+    .fopen2 = vfs_fopen2,
+    .pl_save_current_deferred = pl_save_current_deferred,
+    .pl_save_all_deferred = pl_save_all_deferred,
 };
 
 DB_functions_t *deadbeef = &deadbeef_api;
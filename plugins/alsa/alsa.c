@@ -20,7 +20,10 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <sys/prctl.h>
+#include <sys/time.h>
 #include <pthread.h>
+#include <poll.h>
+#include <sched.h>
 #include "../../deadbeef.h"
 #ifdef HAVE_CONFIG_H
 #include "../../config.h"
@@ -58,6 +61,18 @@ static snd_pcm_uframes_t req_period_size;
 
 static int conf_alsa_resample = 1;
 static char conf_alsa_soundcard[100] = "default";
+static int conf_alsa_mmap = 0;
+
+// set when the device was opened with mmap access, and the poll-driven thread is used
+static int mmap_active;
+
+#define MAX_POLL_FDS 16
+
+// statistics, protected by mutex
+static int stat_xruns;
+static int stat_callback_us; // duration of the last streamer_read
+static int stat_callback_max_us;
+static int stat_delay_frames; // device latency after the last write
 
 static snd_pcm_format_t dsd_format;
 static snd_pcm_format_t supported_dsd_format[] = {
@@ -145,7 +160,17 @@ palsa_set_hw_params (ddb_waveformat_t *fmt) {
         goto error;
     }
 
-    if ((err = snd_pcm_hw_params_set_access (audio, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+    mmap_active = 0;
+    if (conf_alsa_mmap) {
+        if (snd_pcm_hw_params_set_access (audio, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED) >= 0) {
+            mmap_active = 1;
+        }
+        else {
+            trace ("alsa: mmap access is not supported by the device, falling back to read/write access\n");
+        }
+    }
+
+    if (!mmap_active && (err = snd_pcm_hw_params_set_access (audio, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
         fprintf (stderr, "cannot set access type (%s)\n",
                 snd_strerror (err));
         goto error;
@@ -388,6 +413,7 @@ palsa_open (void) {
 
     // get and cache conf variables
     conf_alsa_resample = deadbeef->conf_get_int ("alsa.resample", 1);
+    conf_alsa_mmap = deadbeef->conf_get_int ("alsa.mmap", 0);
     deadbeef->conf_get_str ("alsa_soundcard", "default", conf_alsa_soundcard, sizeof (conf_alsa_soundcard));
     trace ("alsa_soundcard: %s\n", conf_alsa_soundcard);
 
@@ -470,6 +496,10 @@ palsa_init (void) {
     }
 
     alsa_terminate = 0;
+    stat_xruns = 0;
+    stat_callback_us = 0;
+    stat_callback_max_us = 0;
+    stat_delay_frames = 0;
     alsa_tid = deadbeef->thread_start (palsa_thread, NULL);
 
     return 0;
@@ -680,6 +710,9 @@ alsa_recover (int err) {
     // these errors are auto-fixed by snd_pcm_recover
     if (err == -EINTR || err == -EPIPE || err == -ESTRPIPE) {
         trace ("alsa_recover: %d: %s\n", err, snd_strerror (err));
+        if (err == -EPIPE) {
+            stat_xruns++;
+        }
         err = snd_pcm_recover (audio, err, 1);
         if (err < 0) {
             trace ("snd_pcm_recover: %d: %s\n", err, snd_strerror (err));
@@ -693,11 +726,183 @@ alsa_recover (int err) {
     return err;
 }
 
+// Requests realtime scheduling for the calling thread.
+// This only succeeds if permitted by RLIMIT_RTPRIO or CAP_SYS_NICE, otherwise the thread keeps the normal priority.
+static void
+palsa_set_realtime_priority (void) {
+    struct sched_param param;
+    memset (&param, 0, sizeof (param));
+    param.sched_priority = sched_get_priority_min (SCHED_FIFO) + 10;
+    if (param.sched_priority > sched_get_priority_max (SCHED_FIFO)) {
+        param.sched_priority = sched_get_priority_max (SCHED_FIFO);
+    }
+    int err = pthread_setschedparam (pthread_self (), SCHED_FIFO, &param);
+    if (err != 0) {
+        trace ("alsa: realtime priority is not permitted (%s)\n", strerror (err));
+    }
+    else {
+        trace ("alsa: using realtime priority %d\n", param.sched_priority);
+    }
+}
+
+static int64_t
+_time_us (void) {
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// Fills the device buffer directly, returns the number of written frames, or a negative error.
+// Must be called with the mutex locked.
+static snd_pcm_sframes_t
+palsa_mmap_write (snd_pcm_uframes_t avail) {
+    snd_pcm_sframes_t written = 0;
+    while (avail > 0) {
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t frames = avail;
+        int err = snd_pcm_mmap_begin (audio, &areas, &offset, &frames);
+        if (err < 0) {
+            return err;
+        }
+        if (frames == 0) {
+            break;
+        }
+
+        // interleaved access: all channels share the same area
+        char *ptr = (char *)areas[0].addr + (areas[0].first >> 3) + offset * (areas[0].step >> 3);
+        int sz = (int)snd_pcm_frames_to_bytes (audio, frames);
+
+        int64_t start = _time_us ();
+        palsa_callback (ptr, sz);
+        int us = (int)(_time_us () - start);
+        stat_callback_us = us;
+        if (us > stat_callback_max_us) {
+            stat_callback_max_us = us;
+        }
+
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit (audio, offset, frames);
+        if (committed < 0) {
+            return committed;
+        }
+        if ((snd_pcm_uframes_t)committed != frames) {
+            return -EPIPE;
+        }
+        written += committed;
+        avail -= frames;
+    }
+
+    snd_pcm_sframes_t delay;
+    if (snd_pcm_delay (audio, &delay) >= 0) {
+        stat_delay_frames = (int)delay;
+    }
+    return written;
+}
+
+// Event-driven playback loop:
+// sleeps in poll() until the device can accept at least one period,
+// and renders directly into the mmapped device buffer.
+static void
+palsa_thread_mmap (void) {
+    palsa_set_realtime_priority ();
+
+    struct pollfd fds[MAX_POLL_FDS];
+    for (;;) {
+        if (alsa_terminate) {
+            break;
+        }
+
+        LOCK;
+
+        if (state != DDB_PLAYBACK_STATE_PLAYING) {
+            UNLOCK;
+            usleep (10000);
+            continue;
+        }
+
+        // setformat
+        int res = 0;
+        if (_setformat_requested) {
+            res = _setformat_apply ();
+        }
+
+        if (res != 0) {
+            deadbeef->thread_detach (alsa_tid);
+            alsa_terminate = 1;
+            UNLOCK;
+            break;
+        }
+
+        if (!mmap_active) {
+            // the device was reopened without mmap support
+            UNLOCK;
+            break;
+        }
+
+        snd_pcm_sframes_t avail = snd_pcm_avail_update (audio);
+        if (avail < 0) {
+            int recovered = alsa_recover ((int)avail) == 0;
+            UNLOCK;
+            if (!recovered) {
+                usleep (10000);
+            }
+            continue;
+        }
+
+        if (avail >= period_size) {
+            snd_pcm_sframes_t written = palsa_mmap_write (avail);
+            if (written < 0) {
+                alsa_recover ((int)written);
+                UNLOCK;
+                continue;
+            }
+
+            // start explicitly if the buffer is full, but the start threshold was not reached
+            if (snd_pcm_state (audio) == SND_PCM_STATE_PREPARED) {
+                snd_pcm_start (audio);
+            }
+        }
+
+        int nfds = snd_pcm_poll_descriptors_count (audio);
+        if (nfds > MAX_POLL_FDS) {
+            nfds = MAX_POLL_FDS;
+        }
+        nfds = snd_pcm_poll_descriptors (audio, fds, nfds);
+        snd_pcm_t *pcm = audio;
+
+        // wake up at least every 2 periods, to handle state changes
+        int timeout = (int)(period_size * 2000 / plugin.fmt.samplerate);
+        if (timeout < 10) {
+            timeout = 10;
+        }
+        UNLOCK;
+
+        if (nfds <= 0) {
+            usleep (timeout * 1000);
+            continue;
+        }
+
+        if (poll (fds, nfds, timeout) > 0) {
+            unsigned short revents;
+            LOCK;
+            if (audio == pcm) {
+                snd_pcm_poll_descriptors_revents (audio, fds, nfds, &revents);
+            }
+            UNLOCK;
+        }
+    }
+}
+
 static void
 palsa_thread (void *context) {
     prctl (PR_SET_NAME, "deadbeef-alsa", 0, 0, 0, 0);
     int err = 0;
     int avail;
+
+    if (mmap_active) {
+        palsa_thread_mmap ();
+    }
+
     for (;;) {
         if (alsa_terminate) {
             break;
@@ -741,7 +946,12 @@ palsa_thread (void *context) {
             int sz = avail * (plugin.fmt.bps>>3) * plugin.fmt.channels;
             char buf[sz];
 
+            int64_t start = _time_us ();
             int br = palsa_callback (buf, sz);
+            stat_callback_us = (int)(_time_us () - start);
+            if (stat_callback_us > stat_callback_max_us) {
+                stat_callback_max_us = stat_callback_us;
+            }
 
             int err = 0;
             int frames = snd_pcm_bytes_to_frames(audio, br);
@@ -777,6 +987,7 @@ palsa_thread (void *context) {
     }
 
     LOCK;
+    trace ("alsa: xruns: %d, max callback time: %d us\n", stat_xruns, stat_callback_max_us);
     snd_pcm_close(audio);
     audio = NULL;
     alsa_terminate = 0;
@@ -809,8 +1020,10 @@ alsa_configchanged (void) {
     const char *alsa_soundcard = deadbeef->conf_get_str_fast ("alsa_soundcard", "default");
     int buffer = deadbeef->conf_get_int ("alsa.buffer", DEFAULT_BUFFER_SIZE);
     int period = deadbeef->conf_get_int ("alsa.period", DEFAULT_PERIOD_SIZE);
+    int alsa_mmap = deadbeef->conf_get_int ("alsa.mmap", 0);
     if (audio &&
             (alsa_resample != conf_alsa_resample
+            || alsa_mmap != conf_alsa_mmap
             || strcmp (alsa_soundcard, conf_alsa_soundcard)
             || buffer != req_buffer_size
             || period != req_period_size)) {
@@ -882,6 +1095,34 @@ alsa_stop (void) {
     return 0;
 }
 
+// deadbeef --plugin=alsa stats
+static int
+alsa_exec_cmdline (const char *cmdline, int cmdline_size, ddb_response_t *response) {
+    if (cmdline_size < 1 || strcmp (cmdline, "stats")) {
+        char usage[] = "Usage: --plugin=alsa stats\n";
+        response->append (response, usage, sizeof (usage) - 1);
+        return -1;
+    }
+
+    char out[300];
+    LOCK;
+    int samplerate = plugin.fmt.samplerate > 0 ? plugin.fmt.samplerate : 44100;
+    int len = snprintf (out, sizeof (out),
+                        "mode: %s\n"
+                        "buffer: %d frames, period: %d frames\n"
+                        "xruns: %d\n"
+                        "callback time: %d us (max %d us)\n"
+                        "output latency: %d ms\n",
+                        mmap_active ? "mmap/poll" : "read/write",
+                        (int)buffer_size, (int)period_size,
+                        stat_xruns,
+                        stat_callback_us, stat_callback_max_us,
+                        (int)((int64_t)stat_delay_frames * 1000 / samplerate));
+    UNLOCK;
+    response->append (response, out, len);
+    return 0;
+}
+
 DB_plugin_t *
 alsa_load (DB_functions_t *api) {
     deadbeef = api;
@@ -892,6 +1133,7 @@ static const char settings_dlg[] =
     "property \"Use ALSA resampling\" checkbox alsa.resample 1;\n"
     "property \"Preferred buffer size\" entry alsa.buffer " DEFAULT_BUFFER_SIZE_STR ";\n"
     "property \"Preferred period size\" entry alsa.period " DEFAULT_PERIOD_SIZE_STR ";\n"
+    "property \"Use mmap and poll (lower latency, realtime priority if permitted)\" checkbox alsa.mmap 0;\n"
     "property \"DSD output format:\" select[4] alsa.dsdformat 0 \"U32_BE\" \"U32_LE\" \"U16_BE\" \"U16_LE\";\n"
 ;
 
@@ -899,7 +1141,7 @@ static const char settings_dlg[] =
 static DB_output_t plugin = {
     DDB_PLUGIN_SET_API_VERSION
     .plugin.version_major = 1,
-    .plugin.version_minor = 0,
+    .plugin.version_minor = 1,
     .plugin.type = DB_PLUGIN_OUTPUT,
 //    .plugin.flags = DDB_PLUGIN_FLAG_LOGGING,
     .plugin.id = "alsa",
@@ -927,6 +1169,7 @@ static DB_output_t plugin = {
     .plugin.stop = alsa_stop,
     .plugin.configdialog = settings_dlg,
     .plugin.message = alsa_message,
+    .plugin.exec_cmdline = alsa_exec_cmdline,
     .init = palsa_init,
     .free = palsa_free,
     .setformat = palsa_setformat,
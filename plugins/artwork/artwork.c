@@ -61,6 +61,7 @@
 #include "lastfm.h"
 #include "musicbrainz.h"
 #include "mp4tagutil.h"
+#include "lrucache.h"
 #include "../../strdupa.h"
 #include "wos.h"
 
@@ -117,8 +118,10 @@ static artwork_query_t *query_tail;
 static int64_t last_job_idx;
 static int64_t cancellation_idx;
 
-#define MAX_COVERS_IN_CACHE 20
-static ddb_cover_info_t *cover_cache[MAX_COVERS_IN_CACHE];
+// Capacity of the in-memory cover info cache, in KiB
+#define DEFAULT_COVER_CACHE_SIZE 4096
+static int cover_cache_size = DEFAULT_COVER_CACHE_SIZE;
+static lru_cache_t *cover_cache;
 
 #define DEFAULT_SAVE_TO_MUSIC_FOLDERS_FILENAME "cover.jpg"
 
@@ -1004,77 +1007,65 @@ process_query (ddb_cover_info_t *cover) {
 
 #pragma mark - In memory cache
 
+// All cache functions must be called on sync_queue
+
 static void
-cover_update_cache (ddb_cover_info_t *cover) {
-    // any empty items?
-    time_t minTimestamp = INT64_MAX;
-    int minTimestampIdx = -1;
-    int emptyIdx = -1;
-    for (int i = 0; i < MAX_COVERS_IN_CACHE; i++) {
-        if (!cover_cache[i]) {
-            emptyIdx = i;
-            break;
-        }
+_cover_cache_release_value (void *value) {
+    cover_info_release (value);
+}
 
-        if (cover_cache[i]->priv->timestamp < minTimestamp || emptyIdx == -1) {
-            minTimestamp = cover_cache[i]->priv->timestamp;
-            minTimestampIdx = i;
-        }
+// Approximate memory used by the cover info, including the blob
+static size_t
+_cover_cache_item_size (ddb_cover_info_t *cover) {
+    size_t size = sizeof (ddb_cover_info_t) + sizeof (ddb_cover_info_priv_t);
+    if (cover->image_filename) {
+        size += strlen (cover->image_filename) + 1;
     }
+    if (cover->priv->blob) {
+        size += cover->priv->blob_size;
+    }
+    return size;
+}
 
-    if (emptyIdx < 0) {
-        cover_info_release(cover_cache[minTimestampIdx]);
-        cover_cache[minTimestampIdx] = NULL;
-        emptyIdx = minTimestampIdx;
+static void
+cover_update_cache (ddb_cover_info_t *cover) {
+    if (!cover_cache) {
+        cover_cache = lru_cache_new ((size_t)cover_cache_size * 1024, _cover_cache_release_value);
+    }
+    if (lru_cache_peek (cover_cache, cover->priv->filepath) == cover) {
+        lru_cache_get (cover_cache, cover->priv->filepath);
+        return;
     }
-    cover_cache[emptyIdx] = cover;
-    cover->priv->timestamp = time(NULL);
     cover_info_ref (cover);
+    lru_cache_set (cover_cache, cover->priv->filepath, cover, _cover_cache_item_size (cover));
 }
 
 static void
 cover_cache_free (void) {
-    for (int i = 0; i < MAX_COVERS_IN_CACHE; i++) {
-        if (!cover_cache[i]) {
-            continue;
-        }
-        cover_info_release(cover_cache[i]);
-        cover_cache[i] = NULL;
+    if (!cover_cache) {
+        return;
     }
+    lru_cache_stats_t stats;
+    lru_cache_get_stats (cover_cache, &stats);
+    trace ("artwork: cover cache: %d items, %d KiB, %lld hits, %lld misses, %lld evictions\n", stats.count, (int)(stats.size / 1024), (long long)stats.hits, (long long)stats.misses, (long long)stats.evictions);
+    lru_cache_free (cover_cache);
+    cover_cache = NULL;
 }
 
 static ddb_cover_info_t *
 cover_cache_find (ddb_cover_info_t *cover) {
-    for (int i = 0; i < MAX_COVERS_IN_CACHE; i++) {
-        if (!cover_cache[i]) {
-            continue;
-        }
-
-        ddb_cover_info_t *cached_cover = cover_cache[i];
-
-        if (!strcmp (cover->priv->filepath, cached_cover->priv->filepath)) {
-            return cached_cover;
-        }
+    if (!cover_cache) {
+        return NULL;
     }
-
-    return NULL;
+    return lru_cache_get (cover_cache, cover->priv->filepath);
 }
 
 static void
 cover_cache_remove (ddb_cover_info_t *cover) {
-    for (int i = 0; i < MAX_COVERS_IN_CACHE; i++) {
-        if (!cover_cache[i]) {
-            continue;
-        }
-
-        ddb_cover_info_t *cached_cover = cover_cache[i];
-
-        if (!strcmp (cover->priv->filepath, cached_cover->priv->filepath)) {
-            cover_info_release(cached_cover);
-            cover_cache[i] = NULL;
-            break;
-        }
+    if (!cover_cache) {
+        return;
     }
+    lru_cache_remove (cover_cache, cover->priv->filepath);
 }
 
 #pragma mark - Utility
@@ -1473,7 +1464,6 @@ cover_get (ddb_cover_query_t *query, ddb_cover_callback_t callback) {
             ddb_cover_info_t *cached_cover = cover_cache_find (cover);
             if (cached_cover) {
                 found_in_cache = 1;
-                cached_cover->priv->timestamp = time(NULL);
                 cover_info_release(cover);
                 cover = cached_cover;
             }
@@ -1651,6 +1641,11 @@ _get_fetcher_preferences (void) {
 
     simplified_cache = deadbeef->conf_get_int ("artwork.cache.simplified", 0);
 
+    cover_cache_size = deadbeef->conf_get_int ("artwork.cache.info_memory_size", DEFAULT_COVER_CACHE_SIZE);
+    if (cover_cache_size < 64) {
+        cover_cache_size = 64;
+    }
+
     deadbeef->conf_lock ();
     if (missing_artwork == 0) {
         free(nocover_path);
@@ -1742,6 +1737,9 @@ artwork_configchanged (void) {
             cover_cache_free ();
             need_clear_queue = 1;
         }
+        else if (cover_cache) {
+            lru_cache_set_capacity (cover_cache, (size_t)cover_cache_size * 1024);
+        }
         free (old_artwork_filemask);
         free (old_artwork_folders);
     });
@@ -1773,10 +1771,9 @@ invalidate_playitem_cache (DB_plugin_action_t *action, ddb_action_context_t ctx)
             if (deadbeef->pl_is_selected (it)) {
                 ddb_cover_info_t *cover = sync_cover_info_alloc();
                 _init_cover_metadata(cover, it);
-                ddb_cover_info_t *cached_cover = cover_cache_find (cover);
-                if (cached_cover) {
+                dispatch_sync(sync_queue, ^{
                     cover_cache_remove (cover);
-                }
+                });
 
                 if (cover->priv->album_cache_path[0]) {
                     remove_cache_item (cover->priv->album_cache_path);
@@ -1957,6 +1954,8 @@ static const char settings_dlg[] =
 #endif
     "property \"Simplified cache file names\" checkbox artwork.cache.simplified 0;\n"
     "property \"Image size\" spinbtn[64,2048,1] artwork.image_size 256;\n"
+    "property \"Image memory cache size (MB)\" spinbtn[1,1024,1] artwork.cache.memory_size 32;\n"
+    "property \"Cover info memory cache size (KB)\" spinbtn[64,65536,64] artwork.cache.info_memory_size 4096;\n"
 ;
 
 // define plugin interface
@@ -2007,6 +2006,7 @@ ddb_artwork_plugin_t plugin = {
     .default_image_path = artwork_default_image_path,
     .allocate_source_id = artwork_allocate_source_id,
     .cancel_queries_with_source_id = artwork_cancel_queries_with_source_id,
+    .thumbnail_cache_path = make_thumbnail_cache_path,
 };
 
 DB_plugin_t *
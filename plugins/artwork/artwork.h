@@ -28,7 +28,7 @@
 #include <time.h>
 
 #define DDB_ARTWORK_MAJOR_VERSION 2
-#define DDB_ARTWORK_MINOR_VERSION 0
+#define DDB_ARTWORK_MINOR_VERSION 1
 
 /// The flags below can be used in the `flags` member of the `ddb_cover_query_t` structure,
 /// and can be OR'ed together.
@@ -136,6 +136,22 @@ typedef struct {
     /// Cancel all queries with the specified source_id
     void
     (*cancel_queries_with_source_id) (int64_t source_id);
+
+    // since 2.1
+
+    /// Get the path of a pre-scaled thumbnail in the artwork cache, for an image file.
+    ///
+    /// The thumbnail is identified by the image path, modification time and file size,
+    /// so a modified image gets a new thumbnail.
+    /// The requested size is rounded up to the nearest size bucket (64, 128, 256, ...),
+    /// and the thumbnail is expected to fit into a square of the bucket size.
+    ///
+    /// The thumbnail file may not exist yet: the caller is responsible for generating it,
+    /// the folder for it is created by this function.
+    ///
+    /// @return The bucket size, or -1 on error, e.g. if the image file doesn't exist.
+    int
+    (*thumbnail_cache_path) (const char *image_path, int size, char *path, size_t path_size);
 } ddb_artwork_plugin_t;
 
 #endif /*__ARTWORK_H*/
@@ -36,6 +36,7 @@
 #include "../../deadbeef.h"
 #include "artwork.h"
 #include "artwork_internal.h"
+#include "cache.h"
 
 extern DB_functions_t *deadbeef;
 extern ddb_artwork_plugin_t plugin;
@@ -62,6 +63,70 @@ make_cache_root_path (char *path, const size_t size) {
     return 0;
 }
 
+static int
+make_thumbnail_root_path (char *path, const size_t size) {
+    const char *cache_root_path = deadbeef->get_system_dir(DDB_SYS_DIR_CACHE);
+    size_t res;
+    res = snprintf(path, size, "%s/covers2-thumbs", cache_root_path);
+    if (res >= size) {
+        trace ("artwork: thumbnail root path truncated at %d bytes\n", (int)size);
+        return -1;
+    }
+    return 0;
+}
+
+int
+thumbnail_size_bucket (int size) {
+    int bucket = THUMBNAIL_MIN_SIZE;
+    while (bucket < size && bucket < THUMBNAIL_MAX_SIZE) {
+        bucket *= 2;
+    }
+    return bucket;
+}
+
+// 64-bit FNV-1a
+static uint64_t
+_thumbnail_hash (const char *data, uint64_t h) {
+    for (const uint8_t *p = (const uint8_t *)data; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+int
+make_thumbnail_cache_path (const char *image_path, int size, char *path, const size_t path_size) {
+    struct stat stat_buf;
+    if (stat (image_path, &stat_buf) || !S_ISREG (stat_buf.st_mode)) {
+        return -1;
+    }
+
+    char root_path[PATH_MAX];
+    if (make_thumbnail_root_path (root_path, sizeof (root_path))) {
+        return -1;
+    }
+
+    // The source is identified by its path, modification time and size,
+    // so that the thumbnail is regenerated when the source file changes.
+    char stamp[100];
+    snprintf (stamp, sizeof (stamp), "|%lld|%lld", (long long)stat_buf.st_mtime, (long long)stat_buf.st_size);
+    uint64_t h = _thumbnail_hash (image_path, 14695981039346656037ull);
+    h = _thumbnail_hash (stamp, h);
+
+    int bucket = thumbnail_size_bucket (size);
+    size_t res = snprintf (path, path_size, "%s/%d/%016llx.png", root_path, bucket, (unsigned long long)h);
+    if (res >= path_size) {
+        trace ("artwork: thumbnail path truncated at %d bytes\n", (int)path_size);
+        return -1;
+    }
+
+    if (!ensure_dir (path)) {
+        return -1;
+    }
+
+    return bucket;
+}
+
 void
 remove_cache_item (const char *cache_path) {
     // Unlink the expired file, and the artist directory if it is empty
@@ -83,14 +148,7 @@ should_terminate(void) {
 }
 
 static void
-cache_cleaner_worker (void) {
-    char covers_path[PATH_MAX];
-    if (make_cache_root_path (covers_path, sizeof (covers_path))) {
-        return;
-    }
-
-    const int32_t cache_secs = _file_expiration_time;
-    const time_t cache_expiry = time (NULL) - cache_secs;
+cache_cleaner_clean_dir (const char *covers_path, time_t cache_expiry) {
 
     DIR *covers_dir = opendir (covers_path);
     if (covers_dir == NULL) {
@@ -122,6 +180,29 @@ cache_cleaner_worker (void) {
     }
 }
 
+static void
+cache_cleaner_worker (void) {
+    char covers_path[PATH_MAX];
+    if (make_cache_root_path (covers_path, sizeof (covers_path))) {
+        return;
+    }
+
+    const int32_t cache_secs = _file_expiration_time;
+    const time_t cache_expiry = time (NULL) - cache_secs;
+
+    cache_cleaner_clean_dir (covers_path, cache_expiry);
+
+    // thumbnails are stored in a folder per size
+    if (make_thumbnail_root_path (covers_path, sizeof (covers_path))) {
+        return;
+    }
+    char bucket_path[PATH_MAX];
+    for (int bucket = THUMBNAIL_MIN_SIZE; bucket <= THUMBNAIL_MAX_SIZE && !should_terminate(); bucket *= 2) {
+        snprintf (bucket_path, sizeof (bucket_path), "%s/%d", covers_path, bucket);
+        cache_cleaner_clean_dir (bucket_path, cache_expiry);
+    }
+}
+
 void
 cache_configchanged (void) {
     dispatch_sync(sync_queue, ^{
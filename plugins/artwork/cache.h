@@ -24,10 +24,18 @@
 #ifndef __ARTWORK_CACHE_H
 #define __ARTWORK_CACHE_H
 
+#include <stddef.h>
+
+// Thumbnail sizes are rounded up to a power of 2 in this range
+#define THUMBNAIL_MIN_SIZE 64
+#define THUMBNAIL_MAX_SIZE 2048
+
 int make_cache_root_path(char *path, const size_t size);
+int thumbnail_size_bucket(int size);
+int make_thumbnail_cache_path(const char *image_path, int size, char *path, const size_t path_size);
 void remove_cache_item(const char *entry_path);
 void cache_configchanged(void);
-void start_cache_cleaner(void);
+int start_cache_cleaner(void);
 void stop_cache_cleaner(void);
 
 #endif /*__ARTWORK_CACHE_H*/
@@ -35,11 +35,15 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
 #include <dirent.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <errno.h>
+#include <pthread.h>
 #include "../../deadbeef.h"
 #include "converter.h"
 #include "../../strdupa.h"
@@ -855,31 +859,278 @@ static const unsigned char format_id_pcm[] = {
     0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71
 };
 
-static int64_t
-_write_wav (DB_playItem_t *it, DB_decoder_t *dec, DB_fileinfo_t *fileinfo, ddb_dsp_preset_t *dsp_preset, ddb_encoder_preset_t *encoder_preset, int *abort, int fd, int output_bps, int output_is_float) {
-    int64_t res = -1;
-    char *buffer = NULL;
-    char *dspbuffer = NULL;
+#define RING_BLOCKS 4
+
+typedef struct {
+    char *data;
+    int size;
+    int capacity;
+} ring_block_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t tid;
+    ring_block_t blocks[RING_BLOCKS];
+    int head; // next block to write
+    int count; // number of filled blocks
+    int fd;
+    int eof;
+    int error;
+} write_ring_t;
+
+// buffers reused between the tracks converted on the same thread
+typedef struct {
+    char *input;
+    int input_size;
+    char *dsp;
+    int dsp_size;
+    write_ring_t ring;
+} conv_buffers_t;
+
+// PCM blocks flow from the decoder to the output file descriptor through a small ring,
+// which is written out on a separate thread, so that decoding doesn't wait for the encoder.
+static void *
+_write_ring_thread (void *ctx) {
+    write_ring_t *ring = ctx;
+    pthread_mutex_lock (&ring->mutex);
+    for (;;) {
+        while (!ring->count && !ring->eof) {
+            pthread_cond_wait (&ring->cond, &ring->mutex);
+        }
+        if (!ring->count) {
+            break;
+        }
+        ring_block_t *block = &ring->blocks[ring->head];
+        pthread_mutex_unlock (&ring->mutex);
+
+        // after an error, the remaining blocks are discarded
+        int error = ring->error;
+        if (!error && write (ring->fd, block->data, block->size) != block->size) {
+            error = 1;
+        }
+
+        pthread_mutex_lock (&ring->mutex);
+        ring->error = error;
+        ring->head = (ring->head + 1) % RING_BLOCKS;
+        ring->count--;
+        pthread_cond_signal (&ring->cond);
+    }
+    pthread_mutex_unlock (&ring->mutex);
+    return NULL;
+}
+
+static int
+_write_ring_start (write_ring_t *ring, int fd) {
+    ring->fd = fd;
+    ring->head = 0;
+    ring->count = 0;
+    ring->eof = 0;
+    ring->error = 0;
+    pthread_mutex_init (&ring->mutex, NULL);
+    pthread_cond_init (&ring->cond, NULL);
+    if (pthread_create (&ring->tid, NULL, _write_ring_thread, ring)) {
+        pthread_cond_destroy (&ring->cond);
+        pthread_mutex_destroy (&ring->mutex);
+        return -1;
+    }
+    return 0;
+}
+
+// Waits for a free block, and makes sure it can hold `size` bytes.
+// Returns NULL if out of memory.
+static ring_block_t *
+_write_ring_acquire (write_ring_t *ring, int size) {
+    pthread_mutex_lock (&ring->mutex);
+    while (ring->count == RING_BLOCKS) {
+        pthread_cond_wait (&ring->cond, &ring->mutex);
+    }
+    ring_block_t *block = &ring->blocks[(ring->head + ring->count) % RING_BLOCKS];
+    pthread_mutex_unlock (&ring->mutex);
+
+    if (block->capacity < size) {
+        free (block->data);
+        block->data = malloc (size);
+        if (!block->data) {
+            block->capacity = 0;
+            return NULL;
+        }
+        block->capacity = size;
+    }
+    block->size = 0;
+    return block;
+}
+
+static void
+_write_ring_commit (write_ring_t *ring) {
+    pthread_mutex_lock (&ring->mutex);
+    ring->count++;
+    pthread_cond_signal (&ring->cond);
+    pthread_mutex_unlock (&ring->mutex);
+}
+
+static int
+_write_ring_has_error (write_ring_t *ring) {
+    pthread_mutex_lock (&ring->mutex);
+    int error = ring->error;
+    pthread_mutex_unlock (&ring->mutex);
+    return error;
+}
+
+// Waits until all blocks are written, returns -1 on write error.
+static int
+_write_ring_finish (write_ring_t *ring) {
+    pthread_mutex_lock (&ring->mutex);
+    ring->eof = 1;
+    pthread_cond_signal (&ring->cond);
+    pthread_mutex_unlock (&ring->mutex);
+    pthread_join (ring->tid, NULL);
+    pthread_cond_destroy (&ring->cond);
+    pthread_mutex_destroy (&ring->mutex);
+    return ring->error ? -1 : 0;
+}
+
+static char *
+_ensure_buffer (char **buffer, int *size, int required) {
+    if (*size < required) {
+        free (*buffer);
+        *buffer = malloc (required);
+        *size = *buffer ? required : 0;
+    }
+    return *buffer;
+}
 
-    // write wave header
+static void
+_conv_buffers_free (conv_buffers_t *buffers) {
+    free (buffers->input);
+    free (buffers->dsp);
+    for (int i = 0; i < RING_BLOCKS; i++) {
+        free (buffers->ring.blocks[i].data);
+    }
+    memset (buffers, 0, sizeof (conv_buffers_t));
+}
+
+// Returns the header size
+static int
+_make_wav_header (char *wavehdr, DB_playItem_t *it, DB_fileinfo_t *fileinfo, ddb_encoder_preset_t *encoder_preset, uint32_t outsr, uint16_t outch, int output_bps, int output_is_float, int32_t *wavehdr_size) {
     int exheader = output_bps > 16 && !output_is_float;
 
+    int64_t startsample = deadbeef->pl_item_get_startsample (it);
+    int64_t endsample = deadbeef->pl_item_get_endsample (it);
+    uint64_t size = (int64_t)(endsample-startsample) * outch * output_bps / 8;
+    if (!size) {
+        size = (double)deadbeef->pl_get_item_duration (it) * fileinfo->fmt.samplerate * outch * output_bps / 8;
+
+    }
+
+    if (outsr != fileinfo->fmt.samplerate) {
+        uint64_t temp = size;
+        temp *= outsr;
+        temp /= fileinfo->fmt.samplerate;
+        size  = temp;
+    }
+
+    uint64_t chunksize;
+    chunksize = size + 40;
+
+    // for exheader, add 36 more
+    if (exheader) {
+        chunksize += 36;
+    }
+
+    uint32_t size32 = 0xffffffff;
+    if (chunksize <= 0xffffffff) {
+        size32 = (uint32_t)chunksize;
+    }
+
+    memcpy (wavehdr, "RIFF", 4); // RIFFxxxxWAVEfmt_
+    write_int32_le (wavehdr+4, size32);
+    memcpy (wavehdr+8, "WAVE", 4);
+    memcpy (wavehdr+12, "fmt ", 4);
+    int32_t wavefmtsize = exheader ? 0x28 : 0x10;
+    write_int32_le (wavehdr+16, wavefmtsize); // chunk size; fe ff; num chan ; samples_per_sec; avg_bytes_per_sec
+    int16_t fmt = exheader ? 0xfffe : (output_is_float ? 3 : 1);
+    write_int16_le (wavehdr+20, fmt);
+    write_int16_le (wavehdr+22, outch);
+    write_int32_le (wavehdr+24, outsr);
+    int32_t bytes_per_sec = outsr * output_bps / 8 * outch;
+    write_int32_le (wavehdr+28, bytes_per_sec);
+    uint16_t blockalign = outch * output_bps / 8; // block_align; bits_per_sample; cbSize; validBPS
+    write_int16_le (wavehdr+32, blockalign);
+    write_int16_le (wavehdr+34, output_bps);
+    if (exheader) {
+        int16_t cbSize = 0x16;
+        write_int16_le (wavehdr+36, cbSize); // cbSize (validBPS + channelmask + codec ID = 22 bytes)
+        write_int16_le (wavehdr+38, output_bps); // validBPS
+        int32_t chMask = 3;
+        write_int32_le (wavehdr+40, chMask); // channelMask
+
+        memcpy (wavehdr + 44, output_is_float ? format_id_float32 : format_id_pcm, 16); // 16 bytes format ID
+        memcpy (wavehdr + 60, "data", 4);
+        *wavehdr_size = 64;
+    }
+    else {
+        memcpy (wavehdr + 36, "data", 4);
+        *wavehdr_size = 40;
+    }
+
+    size32 = 0xffffffff;
+    if (size <= 0xffffffff) {
+        size32 = (uint32_t)size;
+    }
+
+    if (encoder_preset->method == DDB_ENCODER_METHOD_PIPE) {
+        size32 = 0;
+    }
+    memcpy (wavehdr + *wavehdr_size, &size32, sizeof (size32));
+    return *wavehdr_size + sizeof (size32);
+}
+
+static int64_t
+_write_wav (DB_playItem_t *it, DB_decoder_t *dec, DB_fileinfo_t *fileinfo, ddb_dsp_preset_t *dsp_preset, ddb_encoder_preset_t *encoder_preset, int *abort, float *progress, conv_buffers_t *buffers, int fd, int output_bps, int output_is_float) {
+    int64_t res = -1;
+
     int32_t wavehdr_size = 0;
-    char wavehdr[0x50];
     int header_written = 0;
     int64_t outsize = 0;
     uint32_t outsr = fileinfo->fmt.samplerate;
     uint16_t outch = fileinfo->fmt.channels;
 
     int samplesize = fileinfo->fmt.channels * fileinfo->fmt.bps / 8;
+    int need_conversion = fileinfo->fmt.bps != output_bps || fileinfo->fmt.is_float != output_is_float;
+
+    // for progress reporting
+    int64_t totalframes = deadbeef->pl_item_get_endsample (it) - deadbeef->pl_item_get_startsample (it);
+    if (totalframes <= 0) {
+        totalframes = (int64_t)((double)deadbeef->pl_get_item_duration (it) * fileinfo->fmt.samplerate);
+    }
+    int64_t decodedframes = 0;
 
     // block size
     int bs = 2000 * samplesize;
-    // expected buffer size after worst-case dsp
+    // expected float buffer size after worst-case dsp,
+    // accounting for up to 7.1 resampled to 48x ratio
     int dspsize = bs/samplesize*sizeof(float)*8*48;
-    buffer = malloc (dspsize);
-    // account for up to float32 7.1 resampled to 48x ratio
-    dspbuffer = malloc (dspsize);
+
+    char *buffer = NULL;
+    char *dspbuffer = NULL;
+    if (dsp_preset || need_conversion) {
+        buffer = _ensure_buffer (&buffers->input, &buffers->input_size, bs);
+        if (!buffer) {
+            return -1;
+        }
+    }
+    if (dsp_preset) {
+        dspbuffer = _ensure_buffer (&buffers->dsp, &buffers->dsp_size, dspsize);
+        if (!dspbuffer) {
+            return -1;
+        }
+    }
+
+    if (_write_ring_start (&buffers->ring, fd) < 0) {
+        return -1;
+    }
+
     int eof = 0;
     for (;;) {
         if (eof) {
@@ -888,22 +1139,24 @@ _write_wav (DB_playItem_t *it, DB_decoder_t *dec, DB_fileinfo_t *fileinfo, ddb_d
         if (abort && *abort) {
             break;
         }
-        int sz = dec->read (fileinfo, buffer, bs);
-
-        if (sz != bs) {
-            eof = 1;
+        if (_write_ring_has_error (&buffers->ring)) {
+            trace ("Write error\n");
+            goto error;
         }
+
+        int sz = 0;
+        int frames = 0;
+        ddb_waveformat_t fmt;
         if (dsp_preset) {
-            ddb_waveformat_t fmt;
-            ddb_waveformat_t outfmt;
+            sz = dec->read (fileinfo, buffer, bs);
+
             memcpy (&fmt, &fileinfo->fmt, sizeof (fmt));
-            memcpy (&outfmt, &fileinfo->fmt, sizeof (fmt));
             fmt.bps = 32;
             fmt.is_float = 1;
             deadbeef->pcm_convert (&fileinfo->fmt, buffer, &fmt, dspbuffer, sz);
 
             ddb_dsp_context_t *dsp = dsp_preset->chain;
-            int frames = sz / samplesize;
+            frames = sz / samplesize;
             while (dsp) {
                 frames = dsp->plugin->process (dsp, (float *)dspbuffer, frames, dspsize / (fmt.channels * 4), &fmt, NULL);
                 if (frames <= 0) {
@@ -918,16 +1171,36 @@ _write_wav (DB_playItem_t *it, DB_decoder_t *dec, DB_fileinfo_t *fileinfo, ddb_d
 
             outsr = fmt.samplerate;
             outch = fmt.channels;
+        }
 
+        if (!header_written) {
+            ring_block_t *block = _write_ring_acquire (&buffers->ring, 0x50);
+            if (!block) {
+                goto error;
+            }
+            block->size = _make_wav_header (block->data, it, fileinfo, encoder_preset, outsr, outch, output_bps, output_is_float, &wavehdr_size);
+            _write_ring_commit (&buffers->ring);
+            header_written = 1;
+        }
+
+        ring_block_t *block;
+        if (dsp_preset) {
+            ddb_waveformat_t outfmt;
+            memcpy (&outfmt, &fileinfo->fmt, sizeof (outfmt));
             outfmt.bps = output_bps;
             outfmt.is_float = output_is_float;
             outfmt.channels = outch;
             outfmt.samplerate = outsr;
 
-            int n = deadbeef->pcm_convert (&fmt, dspbuffer, &outfmt, buffer, frames * sizeof (float) * fmt.channels);
-            sz = n;
+            block = _write_ring_acquire (&buffers->ring, frames * outch * output_bps / 8);
+            if (!block) {
+                goto error;
+            }
+            block->size = deadbeef->pcm_convert (&fmt, dspbuffer, &outfmt, block->data, frames * sizeof (float) * fmt.channels);
         }
-        else if (fileinfo->fmt.bps != output_bps || fileinfo->fmt.is_float != output_is_float) {
+        else if (need_conversion) {
+            sz = dec->read (fileinfo, buffer, bs);
+
             ddb_waveformat_t outfmt;
             memcpy (&outfmt, &fileinfo->fmt, sizeof (outfmt));
             outfmt.bps = output_bps;
@@ -935,105 +1208,46 @@ _write_wav (DB_playItem_t *it, DB_decoder_t *dec, DB_fileinfo_t *fileinfo, ddb_d
             outfmt.channels = outch;
             outfmt.samplerate = outsr;
 
-            int frames = sz / samplesize;
-            int n = deadbeef->pcm_convert (&fileinfo->fmt, buffer, &outfmt, dspbuffer, frames * samplesize);
-            memcpy (buffer, dspbuffer, n);
-            sz = n;
-        }
-        outsize += sz;
-
-        if (!header_written) {
-            int64_t startsample = deadbeef->pl_item_get_startsample (it);
-            int64_t endsample = deadbeef->pl_item_get_endsample (it);
-            uint64_t size = (int64_t)(endsample-startsample) * outch * output_bps / 8;
-            if (!size) {
-                size = (double)deadbeef->pl_get_item_duration (it) * fileinfo->fmt.samplerate * outch * output_bps / 8;
-
-            }
-
-            if (outsr != fileinfo->fmt.samplerate) {
-                uint64_t temp = size;
-                temp *= outsr;
-                temp /= fileinfo->fmt.samplerate;
-                size  = temp;
-            }
-
-            uint64_t chunksize;
-            chunksize = size + 40;
-
-            // for exheader, add 36 more
-            if (exheader) {
-                chunksize += 36;
-            }
-
-            uint32_t size32 = 0xffffffff;
-            if (chunksize <= 0xffffffff) {
-                size32 = (uint32_t)chunksize;
-            }
-
-            memcpy (wavehdr, "RIFF", 4); // RIFFxxxxWAVEfmt_
-            write_int32_le (wavehdr+4, size32);
-            memcpy (wavehdr+8, "WAVE", 4);
-            memcpy (wavehdr+12, "fmt ", 4);
-            int32_t wavefmtsize = exheader ? 0x28 : 0x10;
-            write_int32_le (wavehdr+16, wavefmtsize); // chunk size; fe ff; num chan ; samples_per_sec; avg_bytes_per_sec
-            int16_t fmt = exheader ? 0xfffe : (output_is_float ? 3 : 1);
-            write_int16_le (wavehdr+20, fmt);
-            write_int16_le (wavehdr+22, outch);
-            write_int32_le (wavehdr+24, outsr);
-            int32_t bytes_per_sec = outsr * output_bps / 8 * outch;
-            write_int32_le (wavehdr+28, bytes_per_sec);
-            uint16_t blockalign = outch * output_bps / 8; // block_align; bits_per_sample; cbSize; validBPS
-            write_int16_le (wavehdr+32, blockalign);
-            write_int16_le (wavehdr+34, output_bps);
-            if (exheader) {
-                int16_t cbSize = 0x16;
-                write_int16_le (wavehdr+36, cbSize); // cbSize (validBPS + channelmask + codec ID = 22 bytes)
-                write_int16_le (wavehdr+38, output_bps); // validBPS
-                int32_t chMask = 3;
-                write_int32_le (wavehdr+40, chMask); // channelMask
-
-                memcpy (wavehdr + 44, output_is_float ? format_id_float32 : format_id_pcm, 16); // 16 bytes format ID
-                memcpy (wavehdr + 60, "data", 4);
-                wavehdr_size = 64;
-            }
-            else {
-                memcpy (wavehdr + 36, "data", 4);
-                wavehdr_size = 40;
-            }
-
-            size32 = 0xffffffff;
-            if (size <= 0xffffffff) {
-                size32 = (uint32_t)size;
-            }
-
-            if (wavehdr_size != write (fd, wavehdr, wavehdr_size)) {
-                trace ("Wave header write error\n");
+            frames = sz / samplesize;
+            block = _write_ring_acquire (&buffers->ring, frames * outch * output_bps / 8);
+            if (!block) {
                 goto error;
             }
-            if (encoder_preset->method == DDB_ENCODER_METHOD_PIPE) {
-                size32 = 0;
-            }
-            if (write (fd, &size32, sizeof (size32)) != sizeof (size32)) {
-                trace ("Wave header size write error\n");
+            block->size = deadbeef->pcm_convert (&fileinfo->fmt, buffer, &outfmt, block->data, frames * samplesize);
+        }
+        else {
+            // no conversion, decode straight into the block
+            block = _write_ring_acquire (&buffers->ring, bs);
+            if (!block) {
                 goto error;
             }
-            header_written = 1;
+            sz = dec->read (fileinfo, block->data, bs);
+            block->size = sz;
+        }
+
+        if (sz != bs) {
+            eof = 1;
+        }
+        if (progress && totalframes > 0) {
+            decodedframes += sz / samplesize;
+            *progress = min (1.f, (float)decodedframes / totalframes);
         }
 
         if (output_bps == 8) {
             // convert to unsigned
-            for (char *p = buffer; p < buffer + sz; p++) {
+            for (char *p = block->data; p < block->data + block->size; p++) {
                 uint8_t sample = (uint8_t)(((int)*p) + 128);
                 *((uint8_t *)p) = sample;
             }
         }
 
-        int64_t res = write (fd, buffer, sz);
-        if (sz != res) {
-            trace ("Write error (%"PRId64" bytes written out of %d)\n", res, sz);
-            goto error;
-        }
+        outsize += block->size;
+        _write_ring_commit (&buffers->ring);
+    }
+
+    if (_write_ring_finish (&buffers->ring) < 0) {
+        trace ("Write error\n");
+        return -1;
     }
 
     res = outsize;
@@ -1053,7 +1267,7 @@ _write_wav (DB_playItem_t *it, DB_decoder_t *dec, DB_fileinfo_t *fileinfo, ddb_d
         }
         if (4 != write (fd, &writesize, 4)) {
             trace_err ("converter: riff size write error\n");
-            goto error;
+            return -1;
         }
 
         // data size
@@ -1066,22 +1280,15 @@ _write_wav (DB_playItem_t *it, DB_decoder_t *dec, DB_fileinfo_t *fileinfo, ddb_d
         }
         if (4 != write (fd, &writesize, 4)) {
             trace_err ("converter: data size write error\n");
-            goto error;
+            return -1;
         }
     }
 
-error:
-
-    if (buffer) {
-        free (buffer);
-        buffer = NULL;
-    }
-    if (dspbuffer) {
-        free (dspbuffer);
-        dspbuffer = NULL;
-    }
-
     return res;
+
+error:
+    _write_ring_finish (&buffers->ring);
+    return -1;
 }
 
 static int
@@ -1343,7 +1550,7 @@ ddb_mktemp(char *template, size_t template_size, char *suffix) {
 }
 
 static int
-convert2 (ddb_converter_settings_t *settings, DB_playItem_t *it, const char *out, int *pabort) {
+_convert_track (ddb_converter_settings_t *settings, DB_playItem_t *it, const char *out, int *pabort, float *progress, conv_buffers_t *buffers) {
     int output_bps = settings->output_bps;
     int output_is_float = settings->output_is_float;
     ddb_encoder_preset_t *encoder_preset = settings->encoder_preset;
@@ -1423,6 +1630,12 @@ convert2 (ddb_converter_settings_t *settings, DB_playItem_t *it, const char *out
                 switch (encoder_preset->method) {
                     case DDB_ENCODER_METHOD_FILE:
                     {
+                        if (!encoder_preset->encoder[0]) {
+                            // the internal wave writer outputs directly to the destination file
+                            break;
+                        }
+                        // external encoders of these presets read a named file, and may seek in it,
+                        // so they get a complete temporary wav file; pipe presets stream instead
                         const char *tmp = getenv ("TMPDIR");
                         if (!tmp) {
                             tmp = "/tmp";
@@ -1482,7 +1695,7 @@ convert2 (ddb_converter_settings_t *settings, DB_playItem_t *it, const char *out
                 }
 
                 if (temp_file > 0) {
-                    int64_t outsize = _write_wav (it, dec, fileinfo, dsp_preset, encoder_preset, pabort, temp_file, output_bps, output_is_float);
+                    int64_t outsize = _write_wav (it, dec, fileinfo, dsp_preset, encoder_preset, pabort, progress, buffers, temp_file, output_bps, output_is_float);
 
                     if (outsize < 0) {
                         goto error;
@@ -1546,6 +1759,15 @@ error:
     return err;
 }
 
+static int
+convert2 (ddb_converter_settings_t *settings, DB_playItem_t *it, const char *out, int *pabort) {
+    conv_buffers_t buffers;
+    memset (&buffers, 0, sizeof (buffers));
+    int res = _convert_track (settings, it, out, pabort, NULL, &buffers);
+    _conv_buffers_free (&buffers);
+    return res;
+}
+
 static int
 convert (DB_playItem_t *it, const char *out, int output_bps, int output_is_float, ddb_encoder_preset_t *encoder_preset, ddb_dsp_preset_t *dsp_preset, int *abort) {
     ddb_converter_settings_t settings = {
@@ -1565,6 +1787,417 @@ convert_1_0 (DB_playItem_t *it, const char *outfolder, const char *outfile, int
     return -1;
 }
 
+// batch conversion
+
+#define MAX_BATCH_THREADS 64
+
+typedef struct {
+    dev_t dev;
+    int limit; // 0 means unlimited
+    int running;
+} batch_disk_t;
+
+typedef struct {
+    DB_playItem_t *it;
+    int disk; // index in batch->disks, or -1 for non-local files
+    int state;
+    int abort;
+    float progress;
+} batch_job_t;
+
+typedef struct {
+    ddb_converter_batch_t *batch;
+    // job indexes, the unprocessed part is [head, tail).
+    // the owner takes the jobs from the head, other workers steal from the tail.
+    int *queue;
+    int head;
+    int tail;
+    ddb_dsp_preset_t *dsp_preset;
+    intptr_t tid;
+} batch_worker_t;
+
+struct ddb_converter_batch_s {
+    ddb_converter_settings_t settings;
+    ddb_converter_batch_settings_t batch_settings;
+    uintptr_t mutex;
+    uintptr_t cond; // signalled when a job finishes, so that the workers waiting for a busy disk can continue
+    batch_job_t *jobs;
+    int count;
+    int remaining; // jobs not taken by any worker yet
+    batch_disk_t *disks;
+    int num_disks;
+    batch_worker_t *workers;
+    int num_workers;
+    int num_failed;
+};
+
+static int
+_num_cpus (void) {
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf (_SC_NPROCESSORS_ONLN);
+    if (n > 0) {
+        return (int)n;
+    }
+#endif
+    return 1;
+}
+
+static int
+_disk_is_rotational (dev_t dev) {
+#ifdef __linux__
+    // for partitions, the queue info is in the parent device folder
+    static const char *paths[] = {
+        "/sys/dev/block/%u:%u/queue/rotational",
+        "/sys/dev/block/%u:%u/../queue/rotational",
+        NULL
+    };
+    for (int i = 0; paths[i]; i++) {
+        char path[100];
+        snprintf (path, sizeof (path), paths[i], major (dev), minor (dev));
+        FILE *fp = fopen (path, "rt");
+        if (!fp) {
+            continue;
+        }
+        int rotational = fgetc (fp) == '1';
+        fclose (fp);
+        return rotational;
+    }
+#endif
+    return 0;
+}
+
+// Returns the index of the disk in batch->disks, -1 for non-local files, or -2 on allocation failure
+static int
+_batch_disk_for_path (ddb_converter_batch_t *batch, const char *path) {
+    struct stat st;
+    if (stat (path, &st) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < batch->num_disks; i++) {
+        if (batch->disks[i].dev == st.st_dev) {
+            return i;
+        }
+    }
+    batch_disk_t *disks = realloc (batch->disks, (batch->num_disks + 1) * sizeof (batch_disk_t));
+    if (!disks) {
+        return -2;
+    }
+    batch->disks = disks;
+    batch_disk_t *disk = &batch->disks[batch->num_disks];
+    disk->dev = st.st_dev;
+    disk->running = 0;
+    if (batch->batch_settings.max_jobs_per_disk > 0) {
+        disk->limit = batch->batch_settings.max_jobs_per_disk;
+    }
+    else {
+        disk->limit = _disk_is_rotational (st.st_dev) ? 2 : 0;
+    }
+    return batch->num_disks++;
+}
+
+static int
+_batch_job_can_start (ddb_converter_batch_t *batch, int idx) {
+    batch_job_t *job = &batch->jobs[idx];
+    if (job->abort || job->disk < 0) {
+        return 1;
+    }
+    batch_disk_t *disk = &batch->disks[job->disk];
+    return !disk->limit || disk->running < disk->limit;
+}
+
+// Removes and returns the first job from the queue, which is not blocked by the disk limit,
+// or -1 if there's no such job.
+static int
+_batch_queue_take (ddb_converter_batch_t *batch, batch_worker_t *w, int from_tail) {
+    int count = w->tail - w->head;
+    for (int i = 0; i < count; i++) {
+        int pos = from_tail ? w->tail - 1 - i : w->head + i;
+        int idx = w->queue[pos];
+        if (!_batch_job_can_start (batch, idx)) {
+            continue;
+        }
+        if (from_tail) {
+            w->queue[pos] = w->queue[--w->tail];
+        }
+        else {
+            w->queue[pos] = w->queue[w->head++];
+        }
+        return idx;
+    }
+    return -1;
+}
+
+// Must be called with the batch mutex locked
+static int
+_batch_take_job (ddb_converter_batch_t *batch, batch_worker_t *w) {
+    int idx = _batch_queue_take (batch, w, 0);
+    if (idx >= 0) {
+        return idx;
+    }
+
+    // steal from the worker with the longest queue first
+    batch_worker_t *victim = NULL;
+    for (int i = 0; i < batch->num_workers; i++) {
+        batch_worker_t *v = &batch->workers[i];
+        if (v != w && (!victim || v->tail - v->head > victim->tail - victim->head)) {
+            victim = v;
+        }
+    }
+    if (!victim || victim->tail == victim->head) {
+        return -1;
+    }
+    idx = _batch_queue_take (batch, victim, 1);
+    if (idx >= 0) {
+        return idx;
+    }
+
+    // the longest queue is blocked by the disk limit, try the others
+    for (int i = 0; i < batch->num_workers; i++) {
+        batch_worker_t *v = &batch->workers[i];
+        if (v != w && v != victim) {
+            idx = _batch_queue_take (batch, v, 1);
+            if (idx >= 0) {
+                return idx;
+            }
+        }
+    }
+    return -1;
+}
+
+static void
+_batch_job_finish (ddb_converter_batch_t *batch, int idx, int state) {
+    batch_job_t *job = &batch->jobs[idx];
+    deadbeef->mutex_lock (batch->mutex);
+    if (job->state == DDB_CONVERTER_JOB_RUNNING && job->disk >= 0) {
+        batch->disks[job->disk].running--;
+    }
+    if (state == DDB_CONVERTER_JOB_FAILED) {
+        batch->num_failed++;
+    }
+    if (state == DDB_CONVERTER_JOB_DONE) {
+        job->progress = 1;
+    }
+    job->state = state;
+    deadbeef->cond_broadcast (batch->cond);
+    deadbeef->mutex_unlock (batch->mutex);
+
+    if (batch->batch_settings.job_state_changed) {
+        batch->batch_settings.job_state_changed (batch, idx, state, batch->batch_settings.user_data);
+    }
+}
+
+static void
+_batch_worker (void *ctx) {
+    batch_worker_t *w = ctx;
+    ddb_converter_batch_t *batch = w->batch;
+    ddb_converter_settings_t settings = batch->settings;
+    settings.dsp_preset = w->dsp_preset;
+    conv_buffers_t buffers;
+    memset (&buffers, 0, sizeof (buffers));
+
+    for (;;) {
+        deadbeef->mutex_lock (batch->mutex);
+        if (!batch->remaining) {
+            deadbeef->mutex_unlock (batch->mutex);
+            break;
+        }
+        int idx = _batch_take_job (batch, w);
+        if (idx < 0) {
+            // all remaining jobs are waiting for a busy disk
+            deadbeef->cond_wait (batch->cond, batch->mutex);
+            deadbeef->mutex_unlock (batch->mutex);
+            continue;
+        }
+        batch_job_t *job = &batch->jobs[idx];
+        batch->remaining--;
+        int cancelled = job->abort;
+        if (!cancelled) {
+            job->state = DDB_CONVERTER_JOB_RUNNING;
+            if (job->disk >= 0) {
+                batch->disks[job->disk].running++;
+            }
+        }
+        deadbeef->mutex_unlock (batch->mutex);
+
+        if (cancelled) {
+            _batch_job_finish (batch, idx, DDB_CONVERTER_JOB_CANCELLED);
+            continue;
+        }
+
+        if (batch->batch_settings.job_state_changed) {
+            batch->batch_settings.job_state_changed (batch, idx, DDB_CONVERTER_JOB_RUNNING, batch->batch_settings.user_data);
+        }
+
+        int state;
+        char outpath[PATH_MAX];
+        if (batch->batch_settings.get_output_path (batch, idx, job->it, outpath, sizeof (outpath), batch->batch_settings.user_data) != 0) {
+            state = DDB_CONVERTER_JOB_SKIPPED;
+        }
+        else {
+            int res = _convert_track (&settings, job->it, outpath, &job->abort, &job->progress, &buffers);
+            if (job->abort) {
+                state = DDB_CONVERTER_JOB_CANCELLED;
+            }
+            else {
+                state = res ? DDB_CONVERTER_JOB_FAILED : DDB_CONVERTER_JOB_DONE;
+            }
+        }
+        _batch_job_finish (batch, idx, state);
+    }
+    _conv_buffers_free (&buffers);
+}
+
+// Frees the batch, the worker threads must be finished or not started
+static void
+_batch_free (ddb_converter_batch_t *batch) {
+    if (batch->workers) {
+        for (int i = 0; i < batch->num_workers; i++) {
+            batch_worker_t *w = &batch->workers[i];
+            if (w->dsp_preset) {
+                dsp_preset_free (w->dsp_preset);
+            }
+            free (w->queue);
+        }
+    }
+    if (batch->jobs) {
+        for (int i = 0; i < batch->count; i++) {
+            if (batch->jobs[i].it) {
+                deadbeef->pl_item_unref (batch->jobs[i].it);
+            }
+        }
+    }
+    encoder_preset_free (batch->settings.encoder_preset);
+    deadbeef->cond_free (batch->cond);
+    deadbeef->mutex_free (batch->mutex);
+    free (batch->workers);
+    free (batch->disks);
+    free (batch->jobs);
+    free (batch);
+}
+
+static ddb_converter_batch_t *
+batch_start (ddb_converter_settings_t *settings, ddb_converter_batch_settings_t *batch_settings, DB_playItem_t **items, int count) {
+    if (count <= 0 || !batch_settings->get_output_path || !settings->encoder_preset) {
+        return NULL;
+    }
+
+    ddb_converter_batch_t *batch = calloc (1, sizeof (ddb_converter_batch_t));
+    if (!batch) {
+        return NULL;
+    }
+    batch->settings = *settings;
+    batch->settings.encoder_preset = encoder_preset_alloc ();
+    encoder_preset_copy (batch->settings.encoder_preset, settings->encoder_preset);
+    batch->settings.dsp_preset = NULL;
+    batch->batch_settings = *batch_settings;
+    batch->mutex = deadbeef->mutex_create ();
+    batch->cond = deadbeef->cond_create ();
+    batch->count = count;
+    batch->remaining = count;
+
+    batch->jobs = calloc (count, sizeof (batch_job_t));
+    if (!batch->jobs) {
+        goto error;
+    }
+    for (int i = 0; i < count; i++) {
+        batch_job_t *job = &batch->jobs[i];
+        job->it = items[i];
+        deadbeef->pl_item_ref (job->it);
+        char path[PATH_MAX];
+        deadbeef->pl_get_meta (job->it, ":URI", path, sizeof (path));
+        job->disk = _batch_disk_for_path (batch, path);
+        if (job->disk == -2) {
+            goto error;
+        }
+    }
+
+    int num_workers = batch_settings->num_threads > 0 ? batch_settings->num_threads : _num_cpus ();
+    num_workers = min (num_workers, min (count, MAX_BATCH_THREADS));
+    batch->workers = calloc (num_workers, sizeof (batch_worker_t));
+    if (!batch->workers) {
+        goto error;
+    }
+    batch->num_workers = num_workers;
+
+    // Each worker gets a contiguous range of tracks,
+    // which are usually in the same folder, and the tracks of the same album.
+    for (int i = 0; i < num_workers; i++) {
+        batch_worker_t *w = &batch->workers[i];
+        int first = (int)((int64_t)count * i / num_workers);
+        int last = (int)((int64_t)count * (i + 1) / num_workers);
+        w->batch = batch;
+        w->queue = malloc ((last - first) * sizeof (int));
+        if (!w->queue) {
+            goto error;
+        }
+        for (int n = first; n < last; n++) {
+            w->queue[w->tail++] = n;
+        }
+
+        // DSP plugins are stateful, so each worker needs its own chain
+        if (settings->dsp_preset) {
+            w->dsp_preset = dsp_preset_alloc ();
+            dsp_preset_copy (w->dsp_preset, settings->dsp_preset);
+        }
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        batch->workers[i].tid = deadbeef->thread_start (_batch_worker, &batch->workers[i]);
+    }
+
+    return batch;
+
+error:
+    _batch_free (batch);
+    return NULL;
+}
+
+static void
+batch_cancel (ddb_converter_batch_t *batch) {
+    deadbeef->mutex_lock (batch->mutex);
+    for (int i = 0; i < batch->count; i++) {
+        batch->jobs[i].abort = 1;
+    }
+    deadbeef->mutex_unlock (batch->mutex);
+}
+
+static void
+batch_cancel_job (ddb_converter_batch_t *batch, int idx) {
+    if (idx < 0 || idx >= batch->count) {
+        return;
+    }
+    deadbeef->mutex_lock (batch->mutex);
+    batch->jobs[idx].abort = 1;
+    deadbeef->mutex_unlock (batch->mutex);
+}
+
+static int
+batch_get_job_state (ddb_converter_batch_t *batch, int idx, float *progress) {
+    if (idx < 0 || idx >= batch->count) {
+        return -1;
+    }
+    deadbeef->mutex_lock (batch->mutex);
+    int state = batch->jobs[idx].state;
+    if (progress) {
+        *progress = batch->jobs[idx].progress;
+    }
+    deadbeef->mutex_unlock (batch->mutex);
+    return state;
+}
+
+static int
+batch_wait (ddb_converter_batch_t *batch) {
+    for (int i = 0; i < batch->num_workers; i++) {
+        batch_worker_t *w = &batch->workers[i];
+        if (w->tid) {
+            deadbeef->thread_join (w->tid);
+        }
+    }
+    int num_failed = batch->num_failed;
+    _batch_free (batch);
+    return num_failed;
+}
+
 int
 converter_cmd (int cmd, ...) {
     return -1;
@@ -1590,7 +2223,7 @@ static ddb_converter_t plugin = {
     .misc.plugin.api_vmajor = DB_API_VERSION_MAJOR,
     .misc.plugin.api_vminor = DB_API_VERSION_MINOR,
     .misc.plugin.version_major = 1,
-    .misc.plugin.version_minor = 5,
+    .misc.plugin.version_minor = 6,
     .misc.plugin.flags = DDB_PLUGIN_FLAG_LOGGING,
     .misc.plugin.type = DB_PLUGIN_MISC,
     .misc.plugin.name = "Converter",
@@ -1657,6 +2290,12 @@ static ddb_converter_t plugin = {
     .get_output_path2 = get_output_path2,
     // 1.5 entry points
     .convert2 = convert2,
+    // 1.6 entry points
+    .batch_start = batch_start,
+    .batch_cancel = batch_cancel,
+    .batch_cancel_job = batch_cancel_job,
+    .batch_get_job_state = batch_get_job_state,
+    .batch_wait = batch_wait,
 };
 
 DB_plugin_t *
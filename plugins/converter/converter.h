@@ -25,6 +25,8 @@
 
 #include <stdint.h>
 
+// changes in 1.6:
+//   added batch conversion API, which runs multiple jobs concurrently
 // changes in 1.5:
 //   added mp4 tagging support
 //   added converter option to copy files without conversion, if file format isn't changing
@@ -101,6 +103,41 @@ typedef struct ddb_converter_settings_s {
     int rewrite_tags_after_copy;
 } ddb_converter_settings_t;
 
+// converter job states, since 1.6
+enum {
+    DDB_CONVERTER_JOB_PENDING = 0,
+    DDB_CONVERTER_JOB_RUNNING = 1,
+    DDB_CONVERTER_JOB_DONE = 2,
+    DDB_CONVERTER_JOB_FAILED = 3,
+    DDB_CONVERTER_JOB_SKIPPED = 4,
+    DDB_CONVERTER_JOB_CANCELLED = 5,
+};
+
+// since 1.6
+typedef struct ddb_converter_batch_s ddb_converter_batch_t;
+
+// since 1.6
+typedef struct ddb_converter_batch_settings_s {
+    // number of jobs to run concurrently, 0 means the number of CPU cores
+    int num_threads;
+
+    // max number of concurrent jobs reading from the same disk,
+    // 0 means 2 for rotational disks, and unlimited otherwise
+    int max_jobs_per_disk;
+
+    // passed to the callbacks
+    void *user_data;
+
+    // Required. Called from a worker thread before converting the track `idx`.
+    // Should write the output path to `out`, and return 0,
+    // or return -1 to skip the track.
+    int (*get_output_path) (ddb_converter_batch_t *batch, int idx, DB_playItem_t *it, char *out, int sz, void *user_data);
+
+    // Optional. Called from a worker thread every time a job changes state,
+    // `state` is one of DDB_CONVERTER_JOB_*.
+    void (*job_state_changed) (ddb_converter_batch_t *batch, int idx, int state, void *user_data);
+} ddb_converter_batch_settings_t;
+
 typedef struct {
     DB_misc_t misc;
 
@@ -265,6 +302,34 @@ typedef struct {
          // *pabort will be checked regularly, conversion will be interrupted if it's non-zero
          int *pabort
     );
+
+    /////////////////////////////
+    // new APIs for converter-1.6
+    /////////////////////////////
+
+    // Starts converting `count` tracks in the background, using a pool of worker threads.
+    // The settings are copied, the tracks are referenced by the batch.
+    // Each worker gets its own copy of the dsp preset.
+    // The batch must be released by calling batch_wait.
+    ddb_converter_batch_t *
+    (*batch_start) (ddb_converter_settings_t *settings, ddb_converter_batch_settings_t *batch_settings, DB_playItem_t **items, int count);
+
+    // Cancels all pending and running jobs
+    void
+    (*batch_cancel) (ddb_converter_batch_t *batch);
+
+    // Cancels a single job
+    void
+    (*batch_cancel_job) (ddb_converter_batch_t *batch, int idx);
+
+    // Returns the state of the job, and its progress in the 0..1 range
+    int
+    (*batch_get_job_state) (ddb_converter_batch_t *batch, int idx, float *progress);
+
+    // Waits for all jobs to finish, and frees the batch.
+    // Returns the number of failed jobs.
+    int
+    (*batch_wait) (ddb_converter_batch_t *batch);
 } ddb_converter_t;
 
 #endif
@@ -69,6 +69,8 @@ typedef struct {
     GtkWidget *progress;
     GtkWidget *progress_entry;
     int cancelled;
+    uintptr_t mutex;
+    uintptr_t cond; // signalled when a job finishes, or the conversion is cancelled
 } converter_ctx_t;
 
 converter_ctx_t *current_ctx;
@@ -100,7 +102,10 @@ fill_presets (GtkListStore *mdl, ddb_preset_t *head, int type) {
 void
 on_converter_progress_cancel (GtkDialog *dialog, gint response_id, gpointer user_data) {
     converter_ctx_t *ctx = user_data;
+    deadbeef->mutex_lock (ctx->mutex);
     ctx->cancelled = 1;
+    deadbeef->cond_signal (ctx->cond);
+    deadbeef->mutex_unlock (ctx->mutex);
 }
 
 void
@@ -126,9 +131,15 @@ update_progress_cb (gpointer ctx) {
     return FALSE;
 }
 
+// The context is freed on the main thread, together with the progress dialog,
+// because the cancel button handler uses it.
 static gboolean
 destroy_progress_cb (gpointer ctx) {
-    gtk_widget_destroy (ctx);
+    converter_ctx_t *conv = ctx;
+    gtk_widget_destroy (conv->progress);
+    deadbeef->cond_free (conv->cond);
+    deadbeef->mutex_free (conv->mutex);
+    free (conv);
     return FALSE;
 }
 
@@ -169,17 +180,87 @@ overwrite_prompt (const char *outpath) {
     return ctl.result;
 }
 
+typedef struct {
+    converter_ctx_t *conv;
+    char root[2000];
+    uintptr_t prompt_mutex;
+    int num_finished;
+} converter_batch_ctx_t;
+
+static int
+converter_batch_get_output_path (ddb_converter_batch_t *batch, int idx, DB_playItem_t *it, char *outpath, int sz, void *user_data) {
+    converter_batch_ctx_t *bctx = user_data;
+    converter_ctx_t *conv = bctx->conv;
+
+    converter_plugin->get_output_path2 (it, conv->convert_playlist, conv->outfolder, conv->outfile, conv->encoder_preset, conv->preserve_folder_structure, bctx->root, conv->write_to_source_folder, outpath, sz);
+
+    int skip = 0;
+    char *real_out = realpath(outpath, NULL);
+    if (real_out) {
+        skip = 1;
+        deadbeef->pl_lock();
+        char *real_in = realpath(deadbeef->pl_find_meta(it, ":URI"), NULL);
+        deadbeef->pl_unlock();
+        const int paths_match = real_in && !strcmp(real_in, real_out);
+        free(real_in);
+        free(real_out);
+        if (paths_match) {
+            fprintf (stderr, "converter: destination file is the same as source file, skipping\n");
+        }
+        else if (conv->overwrite_action == 2) {
+            unlink (outpath);
+            skip = 0;
+        }
+        else if (conv->overwrite_action == 1) {
+            // only ask one question at a time
+            deadbeef->mutex_lock (bctx->prompt_mutex);
+            if (!conv->cancelled && overwrite_prompt(outpath)) {
+                unlink (outpath);
+                skip = 0;
+            }
+            deadbeef->mutex_unlock (bctx->prompt_mutex);
+        }
+    }
+    return skip ? -1 : 0;
+}
+
+static void
+converter_batch_job_state_changed (ddb_converter_batch_t *batch, int idx, int state, void *user_data) {
+    converter_batch_ctx_t *bctx = user_data;
+    converter_ctx_t *conv = bctx->conv;
+
+    if (state == DDB_CONVERTER_JOB_RUNNING) {
+        update_progress_info_t *info = malloc (sizeof (update_progress_info_t));
+        info->entry = conv->progress_entry;
+        g_object_ref (info->entry);
+        deadbeef->pl_lock ();
+        info->text = strdup (deadbeef->pl_find_meta (conv->convert_items[idx], ":URI"));
+        deadbeef->pl_unlock ();
+        g_idle_add (update_progress_cb, info);
+    }
+    else if (state != DDB_CONVERTER_JOB_PENDING) {
+        deadbeef->mutex_lock (conv->mutex);
+        bctx->num_finished++;
+        deadbeef->cond_signal (conv->cond);
+        deadbeef->mutex_unlock (conv->mutex);
+    }
+}
+
 static void
 converter_worker (void *ctx) {
     deadbeef->background_job_increment ();
     converter_ctx_t *conv = ctx;
 
-    char root[2000] = "";
+    converter_batch_ctx_t bctx = {
+        .conv = conv,
+        .prompt_mutex = deadbeef->mutex_create (),
+    };
+    char *root = bctx.root;
     int rootlen = 0;
     // prepare for preserving folder struct
     if (conv->preserve_folder_structure && conv->convert_items_count >= 1) {
         // start with the 1st track path
-        deadbeef->pl_get_meta (conv->convert_items[0], ":URI", root, sizeof (root));
+        deadbeef->pl_get_meta (conv->convert_items[0], ":URI", root, sizeof (bctx.root));
         char *sep = strrchr (root, '/');
         if (sep) {
             *sep = 0;
@@ -219,49 +300,32 @@ converter_worker (void *ctx) {
         .rewrite_tags_after_copy = conv->retag_after_copy,
     };
 
-    for (int n = 0; n < conv->convert_items_count; n++) {
-        update_progress_info_t *info = malloc (sizeof (update_progress_info_t));
-        info->entry = conv->progress_entry;
-        g_object_ref (info->entry);
-        deadbeef->pl_lock ();
-        info->text = strdup (deadbeef->pl_find_meta (conv->convert_items[n], ":URI"));
-        deadbeef->pl_unlock ();
-        g_idle_add (update_progress_cb, info);
-
-        char outpath[2000];
-        converter_plugin->get_output_path2 (conv->convert_items[n], conv->convert_playlist, conv->outfolder, conv->outfile, conv->encoder_preset, conv->preserve_folder_structure, root, conv->write_to_source_folder, outpath, sizeof (outpath));
-
-        int skip = 0;
-        char *real_out = realpath(outpath, NULL);
-        if (real_out) {
-            skip = 1;
-            deadbeef->pl_lock();
-            char *real_in = realpath(deadbeef->pl_find_meta(conv->convert_items[n], ":URI"), NULL);
-            deadbeef->pl_unlock();
-            const int paths_match = real_in && !strcmp(real_in, real_out);
-            free(real_in);
-            free(real_out);
-            if (paths_match) {
-                fprintf (stderr, "converter: destination file is the same as source file, skipping\n");
-            }
-            else if (conv->overwrite_action == 2 || (conv->overwrite_action == 1 && overwrite_prompt(outpath))) {
-                unlink (outpath);
-                skip = 0;
-            }
-        }
+    ddb_converter_batch_settings_t batch_settings = {
+        .num_threads = deadbeef->conf_get_int ("converter.threads", 0),
+        .user_data = &bctx,
+        .get_output_path = converter_batch_get_output_path,
+        .job_state_changed = converter_batch_job_state_changed,
+    };
 
-        if (!skip) {
-            converter_plugin->convert2 (&settings, conv->convert_items[n], outpath, &conv->cancelled);
+    ddb_converter_batch_t *batch = converter_plugin->batch_start (&settings, &batch_settings, conv->convert_items, conv->convert_items_count);
+    if (batch) {
+        // wait for the jobs to finish, and forward the cancel button press
+        deadbeef->mutex_lock (conv->mutex);
+        while (bctx.num_finished < conv->convert_items_count && !conv->cancelled) {
+            deadbeef->cond_wait (conv->cond, conv->mutex);
         }
-        if (conv->cancelled) {
-            for (; n < conv->convert_items_count; n++) {
-                deadbeef->pl_item_unref (conv->convert_items[n]);
-            }
-            break;
+        int cancelled = conv->cancelled;
+        deadbeef->mutex_unlock (conv->mutex);
+        if (cancelled) {
+            converter_plugin->batch_cancel (batch);
         }
+        converter_plugin->batch_wait (batch);
+    }
+    deadbeef->mutex_free (bctx.prompt_mutex);
+
+    for (int n = 0; n < conv->convert_items_count; n++) {
         deadbeef->pl_item_unref (conv->convert_items[n]);
     }
-    g_idle_add (destroy_progress_cb, conv->progress);
     if (conv->convert_items) {
         free (conv->convert_items);
     }
@@ -276,7 +340,7 @@ converter_worker (void *ctx) {
     }
     converter_plugin->encoder_preset_free (conv->encoder_preset);
     converter_plugin->dsp_preset_free (conv->dsp_preset);
-    free (conv);
+    g_idle_add (destroy_progress_cb, conv);
     deadbeef->background_job_decrement ();
 }
 
@@ -359,6 +423,8 @@ converter_process (converter_ctx_t *conv)
 
     conv->progress = progress;
     conv->progress_entry = entry;
+    conv->mutex = deadbeef->mutex_create ();
+    conv->cond = deadbeef->cond_create ();
     intptr_t tid = deadbeef->thread_start (converter_worker, conv);
     deadbeef->thread_detach (tid);
     return 0;
@@ -628,6 +694,9 @@ converter_show_cb (void *data) {
     combo = GTK_COMBO_BOX (lookup_widget (conv->converter, "overwrite_action"));
     gtk_combo_box_set_active (combo, deadbeef->conf_get_int ("converter.overwrite_action", 0));
 
+    // 0 means one job per CPU core
+    gtk_spin_button_set_value (GTK_SPIN_BUTTON (lookup_widget (conv->converter, "numthreads")), deadbeef->conf_get_int ("converter.threads", 0));
+
 
     for (;;) {
         int response = gtk_dialog_run (GTK_DIALOG (conv->converter));
@@ -1827,7 +1896,7 @@ convgui_connect (void) {
         fprintf (stderr, "convgui: converter plugin not found\n");
         return -1;
     }
-#define REQ_CONV_VERSION 4
+#define REQ_CONV_VERSION 6
     if (!PLUG_TEST_COMPAT(&converter_plugin->misc.plugin, 1, REQ_CONV_VERSION)) {
         fprintf (stderr, "convgui: need converter>=1.%d, but found %d.%d\n", REQ_CONV_VERSION, converter_plugin->misc.plugin.version_major, converter_plugin->misc.plugin.version_minor);
         return -1;
@@ -295,7 +295,7 @@ cflac_open2 (uint32_t hints, DB_playItem_t *it) {
     deadbeef->pl_lock();
     const char *uri = strdupa (deadbeef->pl_find_meta (it, ":URI"));
     deadbeef->pl_unlock();
-    info->file = deadbeef->fopen(uri);
+    info->file = deadbeef->fopen2 (uri, DDB_VFS_OPEN_SEQUENTIAL);
     if (!info->file) {
         trace("cflac_open2 failed to open file %s\n", uri);
     }
@@ -312,7 +312,7 @@ cflac_init (DB_fileinfo_t *_info, DB_playItem_t *it) {
         deadbeef->pl_lock ();
 	const char *uri = strdupa (deadbeef->pl_find_meta (it, ":URI"));
         deadbeef->pl_unlock ();
-        info->file = deadbeef->fopen (uri);
+        info->file = deadbeef->fopen2 (uri, DDB_VFS_OPEN_SEQUENTIAL);
         if (!info->file) {
             trace ("cflac_init failed to open file %s\n", uri);
             return -1;
@@ -673,7 +673,7 @@ action_sort_custom_handler (DB_plugin_action_t *act, ddb_action_context_t ctx) {
 int
 action_crop_selected_handler (DB_plugin_action_t *act, ddb_action_context_t ctx) {
     deadbeef->pl_crop_selected ();
-    deadbeef->pl_save_current ();
+    deadbeef->pl_save_current_deferred ();
     deadbeef->sendmessage (DB_EV_PLAYLISTCHANGED, 0, DDB_PLAYLIST_CHANGE_CONTENT, 0);
     return 0;
 }
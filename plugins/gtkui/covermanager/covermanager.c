@@ -23,6 +23,8 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
 #include "../../../deadbeef.h"
 #include "../../artwork/artwork.h"
 #include "covermanager.h"
@@ -35,7 +37,8 @@
 
 extern DB_functions_t *deadbeef;
 
-#define CACHE_SIZE 50
+// Default capacity of the image cache, in megabytes
+#define DEFAULT_CACHE_SIZE 32
 
 struct covermanager_s {
     ddb_artwork_plugin_t *plugin;
@@ -102,6 +105,15 @@ _update_default_cover (covermanager_t *impl) {
     }
 }
 
+static size_t
+_cache_capacity (void) {
+    int size = deadbeef->conf_get_int("artwork.cache.memory_size", DEFAULT_CACHE_SIZE);
+    if (size < 1) {
+        size = 1;
+    }
+    return (size_t)size * 1024 * 1024;
+}
+
 static void
 _settings_did_change_for_track(covermanager_t *manager, ddb_playItem_t *track) {
     covermanager_t *impl = manager;
@@ -109,6 +121,7 @@ _settings_did_change_for_track(covermanager_t *manager, ddb_playItem_t *track) {
         impl->image_size = deadbeef->conf_get_int("artwork.image_size", 256);
         _update_default_cover (impl);
         gobj_cache_remove_all(impl->cache);
+        gobj_cache_set_capacity(impl->cache, _cache_capacity ());
     }
     else {
         char *key = _cache_key_for_track(impl, track);
@@ -166,19 +179,87 @@ error:
     return NULL;
 }
 
+static void
+_loader_size_prepared (GdkPixbufLoader *loader, gint width, gint height, gpointer user_data) {
+    const int max_size = GPOINTER_TO_INT(user_data);
+    if (width <= max_size && height <= max_size) {
+        return;
+    }
+
+    // Let the image loader scale while decoding, which is much faster than decoding the full image
+    GtkAllocation size = {
+        .width = width,
+        .height = height,
+    };
+    GtkAllocation new_size = {
+        .width = max_size,
+        .height = max_size,
+    };
+    new_size = covermanager_desired_size_for_image_size(NULL, size, new_size);
+    gdk_pixbuf_loader_set_size (loader, new_size.width > 0 ? new_size.width : 1, new_size.height > 0 ? new_size.height : 1);
+}
+
+static GdkPixbuf *
+_load_image_at_size (const char *fname, int max_size) {
+    GdkPixbuf *img = NULL;
+    long size = 0;
+    char *buf = _buffer_from_file (fname, &size);
+    if (buf != NULL) {
+        GdkPixbufLoader *loader = gdk_pixbuf_loader_new ();
+        g_signal_connect (loader, "size-prepared", G_CALLBACK (_loader_size_prepared), GINT_TO_POINTER(max_size));
+        gdk_pixbuf_loader_write (loader, (const guchar *)buf, size, NULL);
+        gdk_pixbuf_loader_close(loader, NULL);
+        img = gdk_pixbuf_loader_get_pixbuf (loader);
+        if (img != NULL) {
+            gobj_ref (img);
+        }
+        g_object_unref (loader);
+        free (buf);
+    }
+    return img;
+}
+
+static void
+_save_thumbnail (GdkPixbuf *img, const char *thumbnail_path) {
+    char *path = strdup (thumbnail_path);
+    gobj_ref (img);
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        char tmp_path[PATH_MAX];
+        snprintf (tmp_path, sizeof (tmp_path), "%s.part", path);
+        if (gdk_pixbuf_save (img, tmp_path, "png", NULL, "compression", "3", NULL)) {
+            if (rename (tmp_path, path)) {
+                (void)unlink (tmp_path);
+            }
+        }
+        else {
+            (void)unlink (tmp_path);
+        }
+        gobj_unref (img);
+        free (path);
+    });
+}
+
 static GdkPixbuf *
 _load_image_from_cover(covermanager_t *impl, ddb_cover_info_t *cover) {
     GdkPixbuf *img = NULL;
 
-    if (!img && cover && cover->image_filename) {
-        long size = 0;
-        char *buf = _buffer_from_file (cover->image_filename, &size);
-        if (buf != NULL) {
-            GdkPixbufLoader *loader = gdk_pixbuf_loader_new ();
-            gdk_pixbuf_loader_write (loader, (const guchar *)buf, size, NULL);
-            img = gdk_pixbuf_loader_get_pixbuf (loader);
-            gdk_pixbuf_loader_close(loader, NULL);
-            free (buf);
+    if (cover && cover->image_filename) {
+        // Try the pre-scaled thumbnail first, the thumbnails are shared by all sizes in the same bucket
+        char thumbnail_path[PATH_MAX];
+        int bucket = -1;
+        if (impl->plugin->plugin.plugin.version_minor >= 1 && impl->plugin->thumbnail_cache_path != NULL) {
+            bucket = impl->plugin->thumbnail_cache_path (cover->image_filename, impl->image_size, thumbnail_path, sizeof (thumbnail_path));
+        }
+
+        if (bucket > 0) {
+            img = gdk_pixbuf_new_from_file (thumbnail_path, NULL);
+        }
+
+        if (img == NULL) {
+            img = _load_image_at_size (cover->image_filename, bucket > 0 ? bucket : impl->image_size);
+            if (img != NULL && bucket > 0) {
+                _save_thumbnail (img, thumbnail_path);
+            }
         }
     }
 
@@ -280,7 +361,7 @@ _cover_loaded_callback (int error, ddb_cover_query_t *query, ddb_cover_info_t *c
     _dispatch_on_main(^{
         // Prevent spurious loading of the same image. The load is already scheduled, so we should just wait for it.
         char *key = _cache_key_for_track(impl, query->track);
-        gboolean should_wait = gobj_cache_get_should_wait(impl->cache, key) || (gobj_cache_get(impl->cache,key) != NULL);
+        gboolean should_wait = gobj_cache_get_should_wait(impl->cache, key) || gobj_cache_contains(impl->cache, key);
 
         if (should_wait) {
             // append to the end of loader queue
@@ -345,7 +426,7 @@ covermanager_new(void) {
         return impl;
     }
 
-    impl->cache = gobj_cache_new(CACHE_SIZE);
+    impl->cache = gobj_cache_new(_cache_capacity ());
 
     impl->image_size = deadbeef->conf_get_int("artwork.image_size", 256);
 
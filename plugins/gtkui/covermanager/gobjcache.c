@@ -24,21 +24,14 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include "../../../shared/lrucache.h"
 #include "gobjcache.h"
 
 typedef struct {
-    char *key;
-    time_t atime;
     GObject *obj;
     gboolean should_wait;
 } gobj_cache_item_t;
 
-typedef struct {
-    gobj_cache_item_t *items;
-    int count;
-} gobj_cache_impl_t;
-
 /// Using this for getting gobject reference count when debugging
 guint
 gobj_get_refc (gpointer ptr) {
@@ -64,37 +57,39 @@ gobj_unref (gpointer obj) {
 }
 
 static void
-gobj_cache_item_deinit (gobj_cache_item_t * restrict item) {
-    free (item->key);
-    item->key = NULL;
+_gobj_cache_item_free (void *value) {
+    gobj_cache_item_t *item = value;
     if (item->obj) {
         gobj_unref(item->obj);
     }
-    item->obj = NULL;
+    free (item);
+}
+
+// Memory used by the object, pixbufs are accounted by their pixel data size
+static size_t
+_gobj_size (GObject *obj) {
+    size_t size = sizeof (gobj_cache_item_t);
+    if (obj && GDK_IS_PIXBUF(obj)) {
+        GdkPixbuf *pixbuf = GDK_PIXBUF(obj);
+        size += (size_t)gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+    }
+    return size;
 }
 
 gobj_cache_t
-gobj_cache_new (int max_object_count) {
-    assert (max_object_count);
-    gobj_cache_impl_t *impl = calloc (1, sizeof (gobj_cache_impl_t));
-    impl->items = calloc (max_object_count, sizeof (gobj_cache_item_t));
-    impl->count = max_object_count;
-    return impl;
+gobj_cache_new (size_t capacity) {
+    assert (capacity);
+    return lru_cache_new (capacity, _gobj_cache_item_free);
 }
 
 void
 gobj_cache_free (gobj_cache_t restrict cache) {
-    gobj_cache_impl_t *impl = cache;
-
-    for (int i = 0; i < impl->count; i++) {
-        if (impl->items[i].key != NULL) {
-            gobj_cache_item_deinit (&impl->items[i]);
-        }
-    }
-    free (impl->items);
-    impl->items = NULL;
+    lru_cache_free (cache);
+}
 
-    free (impl);
+void
+gobj_cache_set_capacity (gobj_cache_t cache, size_t capacity) {
+    lru_cache_set_capacity (cache, capacity);
 }
 
 static void
@@ -102,53 +97,17 @@ _gobj_cache_set_int (gobj_cache_t restrict cache, const char * restrict key, GOb
     if (key == NULL) {
         return;
     }
-    gobj_cache_impl_t *impl = cache;
 
+    gobj_cache_item_t *item = calloc (1, sizeof (gobj_cache_item_t));
+    if (!item) {
+        return;
+    }
     if (obj) {
         gobj_ref(obj);
     }
-
-    // find item with that key or empty
-    gobj_cache_item_t *reuse = NULL;
-    gobj_cache_item_t *evict = NULL;
-    for (int i = 0; i < impl->count; i++) {
-        gobj_cache_item_t *item = &impl->items[i];
-        if (item->key == NULL) {
-            if (reuse == NULL) {
-                reuse = item;
-            }
-        }
-        else if (!strcmp (item->key, key)) {
-            item->atime = time(NULL);
-            if (item->obj) {
-                gobj_unref(item->obj);
-            }
-            item->obj = obj;
-            item->should_wait = should_wait;
-            return;
-        }
-
-        if (!evict) {
-            evict = item;
-        }
-        else {
-            if (item->atime < evict->atime) {
-                evict = item;
-            }
-        }
-    }
-
-    if (!reuse) {
-        // evict
-        gobj_cache_item_deinit(evict);
-        reuse = evict;
-        evict = NULL;
-    }
-
-    reuse->atime = time(NULL);
-    reuse->key = strdup(key);
-    reuse->obj = obj;
-    reuse->should_wait = should_wait;
+    item->obj = obj;
+    item->should_wait = should_wait;
+    lru_cache_set (cache, key, item, _gobj_size (obj));
 }
 
 void
@@ -161,25 +120,18 @@ _gobj_cache_get_int (gobj_cache_t cache, const char *key) {
     if (key == NULL) {
         return NULL;
     }
-
-    gobj_cache_impl_t *impl = cache;
-
-    for (int i = 0; i < impl->count; i++) {
-        gobj_cache_item_t *item = &impl->items[i];
-        if (item->key != NULL && !strcmp (item->key, key)) {
-            return item;
-        }
-    }
-    return NULL;
+    return lru_cache_peek (cache, key);
 }
 
 GObject *
 gobj_cache_get (gobj_cache_t cache, const char *key) {
-    gobj_cache_item_t *item = _gobj_cache_get_int(cache, key);
+    if (key == NULL) {
+        return NULL;
+    }
+    gobj_cache_item_t *item = lru_cache_get (cache, key);
     if (!item) {
         return NULL;
     }
-    item->atime = time(NULL);
     if (item->obj) {
         gobj_ref(item->obj);
     }
@@ -203,29 +155,32 @@ gobj_cache_get_should_wait (gobj_cache_t cache, const char *key) {
     return item->should_wait;
 }
 
+gboolean
+gobj_cache_contains (gobj_cache_t cache, const char *key) {
+    gobj_cache_item_t *item = _gobj_cache_get_int(cache, key);
+    return item != NULL && item->obj != NULL;
+}
+
 void
 gobj_cache_remove (gobj_cache_t cache, const char *key) {
     if (key == NULL) {
         return;
     }
-
-    gobj_cache_impl_t *impl = cache;
-
-    for (int i = 0; i < impl->count; i++) {
-        gobj_cache_item_t *item = &impl->items[i];
-        if (item->key != NULL && !strcmp (item->key, key)) {
-            gobj_cache_item_deinit(item);
-            break;
-        }
-    }
+    lru_cache_remove (cache, key);
 }
 
 void
 gobj_cache_remove_all (gobj_cache_t cache) {
-    gobj_cache_impl_t *impl = cache;
+    lru_cache_remove_all (cache);
+}
 
-    for (int i = 0; i < impl->count; i++) {
-        gobj_cache_item_t *item = &impl->items[i];
-        gobj_cache_item_deinit(item);
-    }
+void
+gobj_cache_get_stats (gobj_cache_t cache, gobj_cache_stats_t *stats) {
+    lru_cache_stats_t lru_stats;
+    lru_cache_get_stats (cache, &lru_stats);
+    stats->hits = lru_stats.hits;
+    stats->misses = lru_stats.misses;
+    stats->evictions = lru_stats.evictions;
+    stats->size = lru_stats.size;
+    stats->count = lru_stats.count;
 }
@@ -24,6 +24,7 @@
 #ifndef gobjcache_h
 #define gobjcache_h
 
+#include <stdint.h>
 #include <gtk/gtk.h>
 
 typedef void *gobj_cache_t;
@@ -37,12 +38,26 @@ gobj_ref (gpointer obj);
 void
 gobj_unref (gpointer obj);
 
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t size;
+    int count;
+} gobj_cache_stats_t;
+
+/// The capacity is the total size of the cached objects in bytes.
+/// Pixbufs are accounted by the size of their pixel data.
 gobj_cache_t
-gobj_cache_new (int max_object_count);
+gobj_cache_new (size_t capacity);
 
 void
 gobj_cache_free (gobj_cache_t cache);
 
+/// Evicts the least recently used objects, if the cache is over the new capacity.
+void
+gobj_cache_set_capacity (gobj_cache_t cache, size_t capacity);
+
 void
 gobj_cache_set (gobj_cache_t cache, const char *key, GObject *obj);
 
@@ -55,10 +70,17 @@ gobj_cache_set_should_wait (gobj_cache_t cache, const char *key, gboolean should
 gboolean
 gobj_cache_get_should_wait (gobj_cache_t cache, const char *key);
 
+/// Returns TRUE if a non-NULL object is cached for the key, without adding a reference.
+gboolean
+gobj_cache_contains (gobj_cache_t cache, const char *key);
+
 void
 gobj_cache_remove (gobj_cache_t cache, const char *key);
 
 void
 gobj_cache_remove_all (gobj_cache_t cache);
 
+void
+gobj_cache_get_stats (gobj_cache_t cache, gobj_cache_stats_t *stats);
+
 #endif /* gobjcache_h */
@@ -106,7 +106,7 @@ static void
 add_dirs_worker (void *data) {
     GSList *lst = (GSList *)data;
     gtkpl_add_dirs (lst);
-    deadbeef->pl_save_current ();
+    deadbeef->pl_save_current_deferred ();
     deadbeef->conf_save ();
 }
 
@@ -132,7 +132,7 @@ static void
 open_files_worker (void *data) {
     GSList *lst = (GSList *)data;
     gtkpl_add_files (lst);
-    deadbeef->pl_save_current ();
+    deadbeef->pl_save_current_deferred ();
     deadbeef->pl_set_cursor (PL_MAIN, 0);
     deadbeef->conf_save ();
     deadbeef->sendmessage (DB_EV_PLAYLISTCHANGED, 0, DDB_PLAYLIST_CHANGE_CONTENT, 0);
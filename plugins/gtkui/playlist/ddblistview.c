@@ -44,6 +44,7 @@
 #include "../support.h"
 #include "ddblistview.h"
 #include "ddblistviewheader.h"
+#include "listviewregroup.h"
 
 // FIXME: these are owned by plcommon, which we don't want to include
 // Should be owned by something else, like "shared resources"
@@ -71,6 +72,19 @@ enum {
     INFO_TARGET_PLAYITEM_POINTERS,
 };
 
+// top-level group with its position, for binary search by item index or y coordinate
+typedef struct {
+    struct _DdbListviewGroup *grp;
+    int idx; // index of the first item of the group
+    int y; // y coordinate of the group relative to playlist origin
+} DdbListviewGroupOffset;
+
+// item as seen by the last grouping pass
+typedef struct {
+    DdbListviewIter it; // referenced, so that the pointer can't be reused by a new item
+    uint32_t hash; // fingerprint of the metadata the group titles are computed from
+} DdbListviewGroupItem;
+
 struct _DdbListviewPrivate {
     int list_width; // width if the list widget as of the last resize
     int list_height; // heught of the list widget as of the last resize
@@ -118,6 +132,13 @@ struct _DdbListviewPrivate {
     int artwork_subgroup_level;
     int subgroup_title_padding;
     int groups_build_idx; // must be the same as playlist modification idx
+    DdbListviewGroupOffset *group_offsets; // prefix sums over top-level group heights and sizes
+    listview_group_key_t *group_keys; // top-level group titles, same size as group_offsets
+    int group_offsets_count;
+    int group_offsets_size;
+    DdbListviewGroupItem *group_items; // used to find the range to regroup after a modification
+    int group_items_count;
+    char *group_inputs; // lowercase text of the group formats, to tell which metadata fields the group titles depend on
     int grouptitle_height;
     int calculated_grouptitle_height;
 
@@ -166,6 +187,8 @@ static void ddb_listview_destroy(GObject *object);
 #pragma mark - fwd decls
 static void
 ddb_listview_build_groups (DdbListview *listview);
+static void
+ddb_listview_regroup (DdbListview *listview);
 
 static int
 ddb_listview_resize_subgroup (DdbListview *listview, DdbListviewGroup *grp, int group_depth, int min_height, int min_no_artwork_height);
@@ -175,6 +198,10 @@ static void
 ddb_listview_free_group (DdbListview *listview, DdbListviewGroup *group);
 static void
 ddb_listview_free_all_groups (DdbListview *listview);
+static DdbListviewGroupOffset *
+ddb_listview_group_offset_for_idx (DdbListview *listview, int idx);
+static DdbListviewGroupOffset *
+ddb_listview_group_offset_for_y (DdbListview *listview, int y);
 
 static void
 ddb_listview_update_fonts (DdbListview *listview);
@@ -599,6 +626,11 @@ ddb_listview_destroy(GObject *object) {
     DdbListviewPrivate *priv = DDB_LISTVIEW_GET_PRIVATE(listview);
 
     ddb_listview_free_all_groups (listview);
+    free (priv->group_offsets);
+    priv->group_offsets = NULL;
+    free (priv->group_keys);
+    priv->group_keys = NULL;
+    priv->group_offsets_size = 0;
 
     while (priv->columns) {
         DdbListviewColumn *next = priv->columns->next;
@@ -737,7 +769,7 @@ ddb_listview_groupcheck (DdbListview *listview) {
     DdbListviewPrivate *priv = DDB_LISTVIEW_GET_PRIVATE(listview);
     int idx = listview->datasource->modification_idx ();
     if (idx != priv->groups_build_idx) {
-        ddb_listview_build_groups (listview);
+        ddb_listview_regroup (listview);
     }
 }
 
@@ -788,7 +820,11 @@ ddb_listview_get_row_pos (DdbListview *listview, int row_idx, int *accumulated_t
     int accum = 0;
     deadbeef->pl_lock ();
     ddb_listview_groupcheck (listview);
-    int y = ddb_listview_get_row_pos_subgroup (listview, priv->groups, 0, 0, row_idx, &accum);
+    int y = 0;
+    DdbListviewGroupOffset *offset = ddb_listview_group_offset_for_idx (listview, row_idx);
+    if (offset) {
+        y = ddb_listview_get_row_pos_subgroup (listview, offset->grp, offset->y, offset->idx, row_idx, &accum);
+    }
     deadbeef->pl_unlock ();
     if (accumulated_title_height) {
         *accumulated_title_height = accum;
@@ -889,7 +925,11 @@ ddb_listview_list_pickpoint (DdbListview *listview, int x, int y, DdbListviewPic
 
     deadbeef->pl_lock ();
     ddb_listview_groupcheck (listview);
-    int found = ddb_listview_list_pickpoint_subgroup (listview, priv->groups, x, y, 0, 0, 0, 0, pick_ctx);
+    int found = 0;
+    DdbListviewGroupOffset *offset = ddb_listview_group_offset_for_y (listview, y);
+    if (offset) {
+        found = ddb_listview_list_pickpoint_subgroup (listview, offset->grp, x, y, offset->idx, offset->y, 0, 0, pick_ctx);
+    }
     deadbeef->pl_unlock ();
 
     if (!found) {
@@ -1074,7 +1114,11 @@ ddb_listview_list_render (DdbListview *listview, cairo_t *cr, GdkRectangle *clip
     draw_begin (&priv->grpctx, cr);
     fill_list_background(listview, cr, clip->x, clip->y, clip->width, clip->height, clip);
 
-    ddb_listview_list_render_subgroup(listview, cr, clip, priv->groups, 0, -priv->scrollpos, cursor_index, 0, -priv->hscrollpos, subgroup_artwork_offset, subgroup_artwork_width, 0);
+    // start from the top-level group at the top of the clip area
+    DdbListviewGroupOffset *offset = ddb_listview_group_offset_for_y (listview, priv->scrollpos + clip->y - 1);
+    if (offset) {
+        ddb_listview_list_render_subgroup(listview, cr, clip, offset->grp, offset->idx, offset->y - priv->scrollpos, cursor_index, 0, -priv->hscrollpos, subgroup_artwork_offset, subgroup_artwork_width, 0);
+    }
 
     draw_end (&priv->listctx);
     draw_end (&priv->grpctx);
@@ -1256,16 +1300,13 @@ find_subgroup_title_heights (DdbListview *listview, DdbListviewGroup *group, int
 static void
 invalidate_group (DdbListview *listview, int at_y) {
     DdbListviewPrivate *priv = DDB_LISTVIEW_GET_PRIVATE(listview);
-    DdbListviewGroup *group = priv->groups;
-    if (!group) {
+    DdbListviewGroupOffset *offset = ddb_listview_group_offset_for_y (listview, at_y - 1);
+    if (!offset) {
         return;
     }
 
-    int next_group_y = group->height;
-    while (group->next && next_group_y < at_y) {
-        group = group->next;
-        next_group_y += group->height;
-    }
+    DdbListviewGroup *group = offset->grp;
+    int next_group_y = offset->y + group->height;
 
     int group_titles_height = group->group_label_visible ? priv->grouptitle_height : 0;
     if (group->subgroups) {
@@ -2572,7 +2613,10 @@ ddb_listview_update_scroll_ref_point (DdbListview *listview) {
             priv->ref_point_offset = cursor_pos - priv->scrollpos;
         }
         else {
-            ddb_listview_update_scroll_ref_point_subgroup (listview, priv->groups, 0, 0);
+            DdbListviewGroupOffset *offset = ddb_listview_group_offset_for_y (listview, priv->scrollpos - 1);
+            if (offset) {
+                ddb_listview_update_scroll_ref_point_subgroup (listview, offset->grp, offset->idx, offset->y);
+            }
         }
     }
 }
@@ -3038,23 +3082,124 @@ ddb_listview_free_group (DdbListview *listview, DdbListviewGroup *group) {
         if (group->head) {
             listview->datasource->unref (group->head);
         }
+        free (group->title);
 
         free (group);
         group = next;
     }
 }
 
+static void
+ddb_listview_free_group_items (DdbListview *listview, DdbListviewGroupItem *items, int count) {
+    for (int i = 0; i < count; i++) {
+        listview->datasource->unref (items[i].it);
+    }
+    free (items);
+}
+
 static void
 ddb_listview_free_all_groups (DdbListview *listview) {
     DdbListviewPrivate *priv = DDB_LISTVIEW_GET_PRIVATE(listview);
     ddb_listview_free_group(listview, priv->groups);
     priv->groups = NULL;
+    priv->group_offsets_count = 0;
+    ddb_listview_free_group_items (listview, priv->group_items, priv->group_items_count);
+    priv->group_items = NULL;
+    priv->group_items_count = 0;
+    free (priv->group_inputs);
+    priv->group_inputs = NULL;
     if (priv->plt) {
         deadbeef->plt_unref (priv->plt);
         priv->plt = NULL;
     }
 }
 
+// rebuilds the top-level group index, returns the total height of all groups
+static int
+ddb_listview_update_group_offsets (DdbListview *listview) {
+    DdbListviewPrivate *priv = DDB_LISTVIEW_GET_PRIVATE(listview);
+    int count = 0;
+    for (DdbListviewGroup *grp = priv->groups; grp; grp = grp->next) {
+        count++;
+    }
+    if (count > priv->group_offsets_size) {
+        free (priv->group_offsets);
+        free (priv->group_keys);
+        priv->group_offsets = malloc (sizeof (DdbListviewGroupOffset) * count);
+        priv->group_keys = malloc (sizeof (listview_group_key_t) * count);
+        if (!priv->group_offsets || !priv->group_keys) {
+            // nothing can be found by position until the next successful regroup
+            free (priv->group_offsets);
+            free (priv->group_keys);
+            priv->group_offsets = NULL;
+            priv->group_keys = NULL;
+            priv->group_offsets_size = 0;
+            count = 0;
+        }
+        else {
+            priv->group_offsets_size = count;
+        }
+    }
+    int idx = 0;
+    int y = 0;
+    int i = 0;
+    for (DdbListviewGroup *grp = priv->groups; grp; grp = grp->next, i++) {
+        if (i < count) {
+            priv->group_offsets[i].grp = grp;
+            priv->group_offsets[i].idx = idx;
+            priv->group_offsets[i].y = y;
+            priv->group_keys[i].idx = idx;
+            priv->group_keys[i].title = grp->title;
+        }
+        idx += grp->num_items;
+        y += grp->height;
+    }
+    priv->group_offsets_count = count;
+    return y;
+}
+
+// returns the last top-level group starting at or before the item idx, or the first group
+static DdbListviewGroupOffset *
+ddb_listview_group_offset_for_idx (DdbListview *listview, int idx) {
+    DdbListviewPrivate *priv = DDB_LISTVIEW_GET_PRIVATE(listview);
+    if (!priv->group_offsets_count) {
+        return NULL;
+    }
+    int lo = 0;
+    int hi = priv->group_offsets_count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (priv->group_offsets[mid].idx <= idx) {
+            lo = mid;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+    return &priv->group_offsets[lo];
+}
+
+// returns the last top-level group starting at or above the y coordinate, or the first group
+static DdbListviewGroupOffset *
+ddb_listview_group_offset_for_y (DdbListview *listview, int y) {
+    DdbListviewPrivate *priv = DDB_LISTVIEW_GET_PRIVATE(listview);
+    if (!priv->group_offsets_count) {
+        return NULL;
+    }
+    int lo = 0;
+    int hi = priv->group_offsets_count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (priv->group_offsets[mid].y <= y) {
+            lo = mid;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+    return &priv->group_offsets[lo];
+}
+
 static int
 ddb_listview_min_group_height(DdbListviewColumn *columns) {
     int min_height = 0;
@@ -3121,51 +3266,52 @@ calc_group_height(DdbListview *listview, DdbListviewGroup *grp, int min_height,
     return grp->height;
 }
 
-static int
-build_groups (DdbListview *listview) {
-    DdbListviewPrivate *priv = DDB_LISTVIEW_GET_PRIVATE(listview);
-    priv->groups_build_idx = listview->datasource->modification_idx();
-    ddb_listview_free_all_groups(listview);
-    priv->plt = deadbeef->plt_get_curr();
-
-    DdbListviewIter it = listview->datasource->head();
-    if (!it) {
-        return 0;
-    }
-    if (!priv->group_formats->format || !priv->group_formats->format[0]) {
-        priv->grouptitle_height = 0;
-    }
-    else {
-        priv->grouptitle_height = priv->calculated_grouptitle_height;
+// Same as next_playitem, but returns NULL after `*remaining` items were visited
+static DdbListviewIter
+next_playitem_in_range (DdbListview *listview, DdbListviewIter it, int *remaining) {
+    if (--(*remaining) <= 0) {
+        listview->datasource->unref(it);
+        return NULL;
     }
+    return next_playitem(listview, it);
+}
+
+// Groups `count` items starting from `it`, and returns the list of top-level groups.
+// The reference to `it` is consumed.
+// is_first / is_last tell whether the range starts at the head / ends at the tail of the list.
+static DdbListviewGroup *
+build_groups_range (DdbListview *listview, DdbListviewIter it, int count, int is_first, int is_last) {
+    DdbListviewPrivate *priv = DDB_LISTVIEW_GET_PRIVATE(listview);
     int group_depth = 1;
     DdbListviewGroupFormat *fmt = priv->group_formats;
     while (fmt->next) {
         group_depth++;
         fmt = fmt->next;
     }
-    priv->groups = new_group(listview, it, 0);
-    DdbListviewGroup *grps = priv->groups;
+    DdbListviewGroup *groups = new_group(listview, it, 0);
+    DdbListviewGroup *grps = groups;
     for (int i = 1; i < group_depth; i++) {
         grps->subgroups = new_group(listview, it, 0);
         grps = grps->subgroups;
     }
     int min_height = ddb_listview_min_group_height(priv->columns);
     int min_no_artwork_height = ddb_listview_min_no_artwork_group_height(priv->columns);
-    int full_height = 0;
+    int remaining = count;
     // groups
     if (priv->grouptitle_height) {
         DdbListviewGroup *last_group[group_depth];
         char (*group_titles)[1024] = malloc(sizeof(char[1024]) * group_depth);
-        DdbListviewGroup *grp = priv->groups;
+        DdbListviewGroup *grp = groups;
         // populate all subgroups from the first item
         for (int i = 0; i < group_depth; i++) {
             last_group[i] = grp;
             grp = grp->subgroups;
             listview->datasource->get_group_text(listview, it, group_titles[i], sizeof(*group_titles), i);
-            last_group[i]->group_label_visible = group_titles[i][0] != 0;
+            // only the very first top-level group may have its title hidden
+            last_group[i]->group_label_visible = (i == 0 && !is_first) || group_titles[i][0] != 0;
         }
-        while ((it = next_playitem(listview, it))) {
+        groups->title = strdup (group_titles[0]);
+        while ((it = next_playitem_in_range(listview, it, &remaining))) {
             int make_new_group_offset = -1;
             for (int i = 0; i < group_depth; i++) {
                 char next_title[1024];
@@ -3183,21 +3329,18 @@ build_groups (DdbListview *listview) {
                     char next_title[1024];
                     last_group[i]->num_items++;
                     listview->datasource->get_group_text(listview, it, next_title, sizeof(next_title), i);
-                    int height = calc_group_height (listview, last_group[i], i == priv->artwork_subgroup_level ? min_height : min_no_artwork_height, !(it > 0));
+                    calc_group_height (listview, last_group[i], i == priv->artwork_subgroup_level ? min_height : min_no_artwork_height, 0);
+                    // ensure that the top-level groups always have titles
+                    int title_visible = i == 0 || next_title[0] != 0;
+                    DdbListviewGroup *new_grp = new_group(listview, it, title_visible);
                     if (i == 0) {
-                        full_height += height;
-                    }
-                    DdbListviewGroup *new_grp = NULL;
-                    if (it != NULL) {
-                        // ensure that the top-level groups always have titles
-                        int title_visible = i == 0 || next_title[0] != 0;
-                        new_grp = new_group(listview, it, title_visible);
+                        new_grp->title = strdup (next_title);
                     }
                     if (i == make_new_group_offset) {
                         last_group[i]->next = new_grp;
                     }
                     last_group[i] = new_grp;
-                    if (last_group[i] && i < group_depth - 1) {
+                    if (i < group_depth - 1) {
                         last_group[i]->subgroups = last_group[i + 1];
                     }
                     strcpy (group_titles[i], next_title);
@@ -3207,38 +3350,373 @@ build_groups (DdbListview *listview) {
         // calculate final group heights
         for (int i = group_depth - 1; i >= 0; i--) {
             last_group[i]->num_items++;
-            int height = calc_group_height (listview, last_group[i], i == priv->artwork_subgroup_level ? min_height : min_no_artwork_height, 1);
-            if (i == 0) {
-                full_height += height;
-            }
+            calc_group_height (listview, last_group[i], i == priv->artwork_subgroup_level ? min_height : min_no_artwork_height, is_last);
         }
         free(group_titles);
     }
     // no groups fast path
     else {
-        for (DdbListviewGroup *grp = priv->groups; grp; grp = grp->next) {
+        for (DdbListviewGroup *grp = groups; grp; grp = grp->next) {
             do {
                 grp->num_items++;
-                it = next_playitem(listview, it);
+                it = next_playitem_in_range(listview, it, &remaining);
             } while (it && grp->num_items < BLANK_GROUP_SUBDIVISION);
-            full_height += calc_group_height (listview, grp, min_height, !(it > 0));
+            calc_group_height (listview, grp, min_height, !it && is_last);
             if (it) {
                 grp->next = new_group(listview, it, 0);
             }
         }
     }
-    return full_height;
+    return groups;
+}
+
+// Title formatting fields which don't come from the item itself.
+// Group titles using them can change when any other item changes, so they always need a full regroup.
+static const char *group_positional_fields[] = {
+    "list_index", "list_total", "queue_index", "queue_total", "isplaying", "ispaused", "playback_time", "_playlist_name", NULL
+};
+
+// Metadata fields read by title formatting fields of a different name, as { field, metadata key } pairs
+static const char *group_field_aliases[][2] = {
+    { "artist", "album artist" },
+    { "artist", "albumartist" },
+    { "artist", "band" },
+    { "artist", "composer" },
+    { "artist", "performer" },
+    { "album", "venue" },
+    { "date", "year" },
+    { "totaldiscs", "numdiscs" },
+    { NULL, NULL }
+};
+
+// Returns the lowercase text of all group formats, or NULL if the group titles
+// can't be tracked per item, because they use positional fields.
+static char *
+group_inputs_for_formats (DdbListviewGroupFormat *fmt) {
+    size_t len = 0;
+    for (DdbListviewGroupFormat *f = fmt; f; f = f->next) {
+        len += (f->format ? strlen (f->format) : 0) + 1;
+    }
+    char *inputs = malloc (len + 1);
+    if (!inputs) {
+        return NULL;
+    }
+    char *p = inputs;
+    for (DdbListviewGroupFormat *f = fmt; f; f = f->next) {
+        for (const char *c = f->format; c && *c; c++) {
+            *p++ = tolower ((uint8_t)*c);
+        }
+        *p++ = '\n';
+    }
+    *p = 0;
+    for (int i = 0; group_positional_fields[i]; i++) {
+        if (strstr (inputs, group_positional_fields[i])) {
+            free (inputs);
+            return NULL;
+        }
+    }
+    return inputs;
+}
+
+// Returns 1 if the group titles may depend on the metadata field `key`.
+// Properties are always included, since fields like %filename% or %codec% are computed from them.
+static int
+group_input_key (const char *inputs, const char *key) {
+    if (key[0] == ':' || key[0] == '_' || key[0] == '!') {
+        return 1;
+    }
+    char lower[100];
+    size_t len = strlen (key);
+    if (len >= sizeof (lower)) {
+        return 1;
+    }
+    for (size_t i = 0; i <= len; i++) {
+        lower[i] = tolower ((uint8_t)key[i]);
+    }
+    if (strstr (inputs, lower)) {
+        return 1;
+    }
+    for (int i = 0; group_field_aliases[i][0]; i++) {
+        if (!strcmp (lower, group_field_aliases[i][1]) && strstr (inputs, group_field_aliases[i][0])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// FNV-1a over the item fields which group titles can depend on
+static uint32_t
+group_item_hash (const char *inputs, DdbListviewIter it) {
+    uint32_t hash = 2166136261u;
+    for (DB_metaInfo_t *meta = deadbeef->pl_get_metadata_head (it); meta; meta = meta->next) {
+        if (!group_input_key (inputs, meta->key)) {
+            continue;
+        }
+        for (const char *c = meta->key; *c; c++) {
+            hash = (hash ^ (uint8_t)*c) * 16777619u;
+        }
+        for (int i = 0; i < meta->valuesize; i++) {
+            hash = (hash ^ (uint8_t)meta->value[i]) * 16777619u;
+        }
+    }
+    float duration = deadbeef->pl_get_item_duration (it);
+    uint32_t props[2] = { deadbeef->pl_get_item_flags (it), 0 };
+    memcpy (&props[1], &duration, sizeof (duration));
+    for (int i = 0; i < 2; i++) {
+        hash = (hash ^ props[i]) * 16777619u;
+    }
+    return hash;
 }
 
+// Returns the referenced items of the list with their hashes, or NULL if out of memory
+static DdbListviewGroupItem *
+collect_group_items (DdbListview *listview, const char *inputs, int *count) {
+    int size = max (listview->datasource->count (), 1);
+    DdbListviewGroupItem *items = malloc (sizeof (DdbListviewGroupItem) * size);
+    int n = 0;
+    for (DdbListviewIter it = listview->datasource->head (); items && it; it = next_playitem(listview, it)) {
+        if (n == size) {
+            size *= 2;
+            DdbListviewGroupItem *new_items = realloc (items, sizeof (DdbListviewGroupItem) * size);
+            if (!new_items) {
+                listview->datasource->unref (it);
+                ddb_listview_free_group_items (listview, items, n);
+                items = NULL;
+                break;
+            }
+            items = new_items;
+        }
+        listview->datasource->ref (it);
+        items[n].it = it;
+        items[n].hash = group_item_hash (inputs, it);
+        n++;
+    }
+    *count = items ? n : 0;
+    return items;
+}
+
+static int
+build_groups (DdbListview *listview) {
+    DdbListviewPrivate *priv = DDB_LISTVIEW_GET_PRIVATE(listview);
+    priv->groups_build_idx = listview->datasource->modification_idx();
+    ddb_listview_free_all_groups(listview);
+    priv->plt = deadbeef->plt_get_curr();
+
+    DdbListviewIter it = listview->datasource->head();
+    if (!it) {
+        return 0;
+    }
+    if (!priv->group_formats->format || !priv->group_formats->format[0]) {
+        priv->grouptitle_height = 0;
+    }
+    else {
+        priv->grouptitle_height = priv->calculated_grouptitle_height;
+    }
+    priv->groups = build_groups_range (listview, it, listview->datasource->count (), 1, 1);
+    // without group titles, regrouping is cheap enough to always do it for the whole list
+    if (priv->grouptitle_height) {
+        priv->group_inputs = group_inputs_for_formats (priv->group_formats);
+        if (priv->group_inputs) {
+            priv->group_items = collect_group_items (listview, priv->group_inputs, &priv->group_items_count);
+        }
+    }
+    return ddb_listview_update_group_offsets (listview);
+}
+
+// Recalculates the heights of the group and of its last subgroups,
+// which get the spacing after them unless they are at the end of the list
 static void
-ddb_listview_build_groups (DdbListview *listview) {
+ddb_listview_update_last_group_height (DdbListview *listview, DdbListviewGroup *grp, int group_depth, int is_last) {
+    DdbListviewPrivate *priv = DDB_LISTVIEW_GET_PRIVATE(listview);
+    DdbListviewGroup *sub = grp->subgroups;
+    if (sub) {
+        while (sub->next) {
+            sub = sub->next;
+        }
+        ddb_listview_update_last_group_height (listview, sub, group_depth + 1, is_last);
+    }
+    int min_height = group_depth == priv->artwork_subgroup_level ? ddb_listview_min_group_height(priv->columns) : ddb_listview_min_no_artwork_group_height(priv->columns);
+    calc_group_height (listview, grp, min_height, is_last);
+}
+
+static DdbListviewIter
+prev_playitem (DdbListview *listview, DdbListviewIter it) {
+    DdbListviewIter prev = listview->datasource->prev(it);
+    listview->datasource->unref(it);
+    return prev;
+}
+
+// Regroups only the top-level groups containing items which were added, removed, moved or changed since the last grouping.
+// The playlist doesn't tell which items were modified, so the changed range is found by comparing the item sequence
+// with the one seen by the last grouping. When the sequence is the same, the metadata of some of the items has changed,
+// and the fingerprints of all items are compared instead.
+// Only the changed items, and the groups which get regrouped with them, are hashed again.
+// Returns the total height of all groups, or -1 if the whole list has to be regrouped.
+static int
+regroup_changed_range (DdbListview *listview) {
+    DdbListviewPrivate *priv = DDB_LISTVIEW_GET_PRIVATE(listview);
+    if (!priv->groups || !priv->group_items_count || !priv->group_inputs || !priv->group_offsets_count) {
+        return -1;
+    }
+    ddb_playlist_t *plt = deadbeef->plt_get_curr ();
+    int same_plt = plt == priv->plt;
+    if (plt) {
+        deadbeef->plt_unref (plt);
+    }
+    if (!same_plt) {
+        return -1;
+    }
+
+    const int count = listview->datasource->count ();
+    DdbListviewGroupItem *prev_items = priv->group_items;
+    const int prev_count = priv->group_items_count;
+    if (!count) {
+        return -1;
+    }
+
+    // skip unchanged items at the start and at the end of the list, comparing only the pointers
+    const int common = min (count, prev_count);
+    int prefix = 0;
+    DdbListviewIter changed = listview->datasource->head ();
+    while (changed && prefix < common && changed == prev_items[prefix].it) {
+        prefix++;
+        changed = next_playitem (listview, changed);
+    }
+    int suffix = 0;
+    DdbListviewIter it = listview->datasource->tail ();
+    while (it && suffix < common - prefix && it == prev_items[prev_count - 1 - suffix].it) {
+        suffix++;
+        it = prev_playitem (listview, it);
+    }
+    if (it) {
+        listview->datasource->unref (it);
+    }
+
+    DdbListviewGroupItem *items = prev_items;
+    if (prefix == prev_count && prefix == count) {
+        int first_changed = -1;
+        int last_changed = -1;
+        for (int i = 0; i < count; i++) {
+            uint32_t hash = group_item_hash (priv->group_inputs, items[i].it);
+            if (hash != items[i].hash) {
+                if (first_changed < 0) {
+                    first_changed = i;
+                }
+                last_changed = i;
+                items[i].hash = hash;
+            }
+        }
+        if (first_changed < 0) {
+            return priv->fullheight;
+        }
+        prefix = first_changed;
+        suffix = count - 1 - last_changed;
+    }
+    else {
+        items = malloc (sizeof (DdbListviewGroupItem) * count);
+        if (!items) {
+            if (changed) {
+                listview->datasource->unref (changed);
+            }
+            return -1;
+        }
+        // the unchanged items keep their references and hashes
+        memcpy (items, prev_items, sizeof (DdbListviewGroupItem) * prefix);
+        memcpy (items + count - suffix, prev_items + prev_count - suffix, sizeof (DdbListviewGroupItem) * suffix);
+        for (int i = prefix; i < count - suffix; i++) {
+            items[i].it = changed;
+            items[i].hash = group_item_hash (priv->group_inputs, changed);
+            changed = listview->datasource->next (changed);
+        }
+        for (int i = prefix; i < prev_count - suffix; i++) {
+            listview->datasource->unref (prev_items[i].it);
+        }
+        free (prev_items);
+        priv->group_items = items;
+        priv->group_items_count = count;
+    }
+    if (changed) {
+        listview->datasource->unref (changed);
+    }
+
+    char first_title[1024] = "";
+    char last_title[1024] = "";
+    if (prefix < count - suffix) {
+        listview->datasource->get_group_text (listview, items[prefix].it, first_title, sizeof (first_title), 0);
+        listview->datasource->get_group_text (listview, items[count - suffix - 1].it, last_title, sizeof (last_title), 0);
+    }
+    listview_regroup_range_t range;
+    listview_regroup_find_range (priv->group_keys, priv->group_offsets_count, prev_count, count, prefix, suffix, first_title, last_title, &range);
+
+    // the unchanged items regrouped with the changed ones are hashed again,
+    // in case their metadata changed together with the sequence
+    for (int i = range.first_item; i < range.first_item + range.item_count; i++) {
+        if (i < prefix || i >= count - suffix) {
+            items[i].hash = group_item_hash (priv->group_inputs, items[i].it);
+        }
+    }
+
+    DdbListviewGroup *prev_grp = range.first_group > 0 ? priv->group_offsets[range.first_group - 1].grp : NULL;
+    DdbListviewGroup *next_grp = range.last_group + 1 < priv->group_offsets_count ? priv->group_offsets[range.last_group + 1].grp : NULL;
+    DdbListviewGroup *groups = NULL;
+    if (range.item_count > 0) {
+        it = items[range.first_item].it;
+        listview->datasource->ref(it);
+        groups = build_groups_range (listview, it, range.item_count, range.first_item == 0, next_grp == NULL);
+    }
+
+    // replace the old groups
+    if (range.first_group <= range.last_group) {
+        priv->group_offsets[range.last_group].grp->next = NULL;
+        ddb_listview_free_group (listview, priv->group_offsets[range.first_group].grp);
+    }
+    if (groups) {
+        DdbListviewGroup *tail = groups;
+        while (tail->next) {
+            tail = tail->next;
+        }
+        tail->next = next_grp;
+    }
+    else {
+        groups = next_grp;
+    }
+    if (prev_grp) {
+        prev_grp->next = groups;
+        ddb_listview_update_last_group_height (listview, prev_grp, 0, prev_grp->next == NULL);
+    }
+    else {
+        priv->groups = groups;
+    }
+
+    return ddb_listview_update_group_offsets (listview);
+}
+
+static void
+ddb_listview_set_fullheight (DdbListview *listview, int height) {
     DdbListviewPrivate *priv = DDB_LISTVIEW_GET_PRIVATE(listview);
-    deadbeef->pl_lock();
-    int height = build_groups(listview);
     if (height != priv->fullheight) {
         priv->fullheight = height;
         g_idle_add_full(GTK_PRIORITY_RESIZE, ddb_listview_list_setup_vscroll, listview, NULL);
     }
+}
+
+static void
+ddb_listview_build_groups (DdbListview *listview) {
+    deadbeef->pl_lock();
+    ddb_listview_set_fullheight (listview, build_groups(listview));
+    deadbeef->pl_unlock();
+}
+
+static void
+ddb_listview_regroup (DdbListview *listview) {
+    DdbListviewPrivate *priv = DDB_LISTVIEW_GET_PRIVATE(listview);
+    deadbeef->pl_lock();
+    priv->groups_build_idx = listview->datasource->modification_idx();
+    int height = regroup_changed_range (listview);
+    if (height < 0) {
+        height = build_groups (listview);
+    }
+    ddb_listview_set_fullheight (listview, height);
     deadbeef->pl_unlock();
 }
 
@@ -3261,7 +3739,8 @@ ddb_listview_resize_groups (DdbListview *listview) {
     DdbListviewPrivate *priv = DDB_LISTVIEW_GET_PRIVATE(listview);
     int min_height = ddb_listview_min_group_height(priv->columns);
     int min_no_artwork_height = ddb_listview_min_no_artwork_group_height(priv->columns);
-    int full_height = ddb_listview_resize_subgroup (listview, priv->groups, 0, min_height, min_no_artwork_height);
+    ddb_listview_resize_subgroup (listview, priv->groups, 0, min_height, min_no_artwork_height);
+    int full_height = ddb_listview_update_group_offsets (listview);
 
     if (full_height != priv->fullheight) {
         priv->fullheight = full_height;
@@ -3456,6 +3935,11 @@ ddb_listview_set_group_formats (DdbListview *listview, DdbListviewGroupFormat *f
     }
 
     priv->group_formats = formats;
+
+    // the item hashes were computed for the old formats
+    ddb_listview_free_group_items (listview, priv->group_items, priv->group_items_count);
+    priv->group_items = NULL;
+    priv->group_items_count = 0;
 }
 
 drawctx_t * const
@@ -58,6 +58,7 @@ typedef struct _DdbListviewGroup {
     int32_t height;
     int32_t num_items;
     int group_label_visible;
+    char *title; // top-level groups only, used to find the groups which new items can merge with
 
     struct _DdbListviewGroup *next;
 } DdbListviewGroup;
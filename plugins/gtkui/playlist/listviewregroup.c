@@ -0,0 +1,119 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2024 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <string.h>
+#include "listviewregroup.h"
+
+static int
+_same_title (const char *a, const char *b) {
+    return !strcmp (a ? a : "", b ? b : "");
+}
+
+// returns the group containing the old item idx
+static int
+_group_for_idx (const listview_group_key_t *groups, int group_count, int idx) {
+    int lo = 0;
+    int hi = group_count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (groups[mid].idx <= idx) {
+            lo = mid;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+// returns the old index after the last item of the group
+static int
+_group_end (const listview_group_key_t *groups, int group_count, int prev_count, int grp) {
+    return grp + 1 < group_count ? groups[grp + 1].idx : prev_count;
+}
+
+void
+listview_regroup_find_range (const listview_group_key_t *groups, int group_count, int prev_count, int count, int prefix, int suffix, const char *first_title, const char *last_title, listview_regroup_range_t *range) {
+    const int changed_end = prev_count - suffix; // old index after the last changed item
+    const int added = count - suffix - prefix;
+
+    // the groups containing the changed items
+    int first;
+    int last;
+    if (prefix < changed_end) {
+        first = _group_for_idx (groups, group_count, prefix);
+        last = _group_for_idx (groups, group_count, changed_end - 1);
+    }
+    else if (prefix > 0 && prefix < prev_count
+             && _group_for_idx (groups, group_count, prefix - 1) == _group_for_idx (groups, group_count, prefix)) {
+        // inserted in the middle of a group
+        first = last = _group_for_idx (groups, group_count, prefix);
+    }
+    else {
+        // inserted between two groups
+        first = prefix < prev_count ? _group_for_idx (groups, group_count, prefix) : group_count;
+        last = first - 1;
+    }
+
+    int start = first <= last ? groups[first].idx : prefix;
+    int end = first <= last ? _group_end (groups, group_count, prev_count, last) : prefix;
+
+    // The unchanged items of the groups have different titles than the neighbouring groups,
+    // so only the new items, or the ones left after the removed items, can merge with them.
+    if (!added && start == prefix && end == changed_end) {
+        // the groups were removed entirely, so the groups around them can merge
+        if (first > 0 && last + 1 < group_count && _same_title (groups[first - 1].title, groups[last + 1].title)) {
+            first--;
+            last++;
+        }
+    }
+    else {
+        const char *head_title = NULL;
+        const char *tail_title = NULL;
+        if (start == prefix) {
+            head_title = added ? first_title : groups[last].title;
+        }
+        if (end == changed_end) {
+            tail_title = added ? last_title : groups[first].title;
+        }
+        if (head_title && first > 0 && _same_title (head_title, groups[first - 1].title)) {
+            first--;
+        }
+        if (tail_title && last + 1 < group_count && _same_title (tail_title, groups[last + 1].title)) {
+            last++;
+        }
+    }
+
+    start = first <= last ? groups[first].idx : prefix;
+    // the label of the first group is hidden when it has no title,
+    // so the group after the range has to be rebuilt when it may become, or stop being the first one
+    if (start == 0 && last + 1 < group_count && _same_title (groups[last + 1].title, "")) {
+        last++;
+    }
+    end = first <= last ? _group_end (groups, group_count, prev_count, last) : start;
+
+    range->first_group = first;
+    range->last_group = last;
+    range->first_item = start;
+    range->item_count = end - start + count - prev_count;
+}
@@ -0,0 +1,59 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2024 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef listviewregroup_h
+#define listviewregroup_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Top-level group as seen by the last grouping.
+// The top-level groups are separated where the top-level title of the adjacent items differs.
+typedef struct {
+    int idx; // index of the first item of the group
+    const char *title; // top-level title of all items of the group
+} listview_group_key_t;
+
+// The range of the top-level groups to replace, and of the items to group in their place.
+typedef struct {
+    int first_group;
+    int last_group; // first_group - 1 when no groups are replaced, and the new groups are inserted before first_group
+    int first_item; // index in the new list
+    int item_count; // can be 0, when the groups are only removed
+} listview_regroup_range_t;
+
+// Finds the top-level groups which have to be rebuilt, after the old items [prefix, prev_count - suffix)
+// were replaced with the new items [prefix, count - suffix).
+// first_title and last_title are the top-level titles of the first and the last new item,
+// and are only used when there are new items.
+// The neighbouring groups are only included when the new items can merge with them,
+// so their items don't have to be grouped again.
+void
+listview_regroup_find_range (const listview_group_key_t *groups, int group_count, int prev_count, int count, int prefix, int suffix, const char *first_title, const char *last_title, listview_regroup_range_t *range);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* listviewregroup_h */
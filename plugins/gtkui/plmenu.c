@@ -240,20 +240,20 @@ reload_metadata_activate (GtkMenuItem     *menuitem, gpointer         user_data)
 
 static void
 _trkproperties_did_update_tracks (void *user_data) {
-    deadbeef->pl_save_current();
+    deadbeef->pl_save_current_deferred ();
     deadbeef->sendmessage (DB_EV_PLAYLISTCHANGED, 0, DDB_PLAYLIST_CHANGE_CONTENT, 0);
 }
 
 static void
 _trkproperties_did_reload_metadata (void *user_data) {
-    deadbeef->pl_save_current ();
+    deadbeef->pl_save_current_deferred ();
     deadbeef->sendmessage (DB_EV_PLAYLISTCHANGED, 0, DDB_PLAYLIST_CHANGE_CONTENT, 0);
 }
 
 static void
 _trkproperties_did_delete_files (void *user_data, int cancelled) {
     if (!cancelled) {
-        deadbeef->pl_save_all ();
+        deadbeef->pl_save_all_deferred ();
         deadbeef->sendmessage (DB_EV_PLAYLISTCHANGED, 0, DDB_PLAYLIST_CHANGE_CONTENT, 0);
     }
 }
@@ -273,7 +273,7 @@ on_clear1_activate                     (GtkMenuItem     *menuitem,
                                         gpointer         user_data)
 {
     deadbeef->pl_clear ();
-    deadbeef->pl_save_current ();
+    deadbeef->pl_save_current_deferred ();
     deadbeef->sendmessage (DB_EV_PLAYLISTCHANGED, 0, DDB_PLAYLIST_CHANGE_CONTENT, 0);
 }
 
@@ -303,7 +303,7 @@ on_remove2_activate                    (GtkMenuItem     *menuitem,
     for (int i = 0; i < count; i++) {
         deadbeef->plt_remove_item (plt, tracks[i]);
     }
-    deadbeef->pl_save_current();
+    deadbeef->pl_save_current_deferred ();
     deadbeef->sendmessage (DB_EV_PLAYLISTCHANGED, 0, DDB_PLAYLIST_CHANGE_CONTENT, 0);
 }
 
@@ -245,7 +245,7 @@ _update_tags (void *ctx) {
         }
     }
 
-    deadbeef->pl_save_all ();
+    deadbeef->pl_save_all_deferred ();
 
     g_idle_add (_ctl_dismiss_cb, ctl);
 }
@@ -557,7 +557,7 @@ _get_action_track_list (DB_plugin_action_t *action, int ctx, int *pcount, int on
             it = next;
         }
 
-        deadbeef->pl_save_current ();
+        deadbeef->pl_save_current_deferred ();
     }
     else if (ctx == DDB_ACTION_CTX_NOWPLAYING) {
         if (playing_track) {
@@ -668,7 +668,7 @@ _remove_rg_tags (void *ctx) {
         g_idle_add (_setUpdateProgress, dt);
     }
 
-    deadbeef->pl_save_all ();
+    deadbeef->pl_save_all_deferred ();
     deadbeef->background_job_decrement ();
 
     g_idle_add (_ctl_dismiss_cb, ctl);
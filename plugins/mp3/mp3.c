@@ -60,6 +60,121 @@ DB_functions_t *deadbeef;
 static int
 cmp3_seek_sample64 (DB_fileinfo_t *_info, int64_t sample);
 
+#pragma mark - Decode info cache
+
+#define MP3_CACHED_INFO_VERSION 1
+
+// mp3-specific part of the cached decode info
+typedef struct {
+    uint32_t version;
+    uint32_t startoffs;
+    uint32_t endoffs;
+    int32_t ver;
+    int32_t layer;
+    int32_t samples_per_frame;
+    int32_t have_xing_header;
+    int32_t vbr_type;
+    int32_t lamepreset;
+    int32_t reserved;
+    int64_t packet_offs;
+    int64_t avg_bitrate;
+    int64_t datasize;
+    int64_t seektable_interval;
+} mp3_cached_info_t;
+
+// Restores the results of a previous full scan of the file.
+// Returns 0 on success, or -1 if the cache doesn't have a valid entry.
+static int
+_mp3_get_cached_info (const char *fname, int64_t fsize, mp3info_t *mp3info, mp3seektable_t *seektable, uint32_t *startoffs, uint32_t *endoffs) {
+    ddb_decode_info_t *di = deadbeef->decode_info_get (fname, plugin.decoder.plugin.id);
+    if (!di) {
+        return -1;
+    }
+
+    mp3_cached_info_t extra;
+    if (di->extra_size != sizeof (extra)
+        || di->num_seekpoints > MP3_MAX_SEEKPOINTS
+        || di->fmt.samplerate <= 0
+        || di->fmt.channels <= 0) {
+        deadbeef->decode_info_free (di);
+        return -1;
+    }
+    memcpy (&extra, di->extra, sizeof (extra));
+    if (extra.version != MP3_CACHED_INFO_VERSION) {
+        deadbeef->decode_info_free (di);
+        return -1;
+    }
+
+    memset (mp3info, 0, sizeof (mp3info_t));
+    mp3info->fsize = fsize;
+    mp3info->datasize = extra.datasize;
+    mp3info->have_duration = 1;
+    mp3info->totalsamples = di->totalsamples;
+    mp3info->delay = di->delay;
+    mp3info->padding = di->padding;
+    mp3info->packet_offs = extra.packet_offs;
+    mp3info->valid_packets = 1;
+    mp3info->ref_packet.ver = extra.ver;
+    mp3info->ref_packet.layer = extra.layer;
+    mp3info->ref_packet.samples_per_frame = extra.samples_per_frame;
+    mp3info->ref_packet.samplerate = di->fmt.samplerate;
+    mp3info->ref_packet.nchannels = di->fmt.channels;
+    mp3info->have_xing_header = extra.have_xing_header;
+    mp3info->vbr_type = extra.vbr_type;
+    mp3info->lamepreset = (uint16_t)extra.lamepreset;
+    mp3info->avg_bitrate = extra.avg_bitrate;
+
+    memcpy (seektable->points, di->seekpoints, di->num_seekpoints * sizeof (ddb_seekpoint_t));
+    seektable->count = di->num_seekpoints;
+    seektable->interval = extra.seektable_interval;
+
+    *startoffs = extra.startoffs;
+    *endoffs = extra.endoffs;
+
+    deadbeef->decode_info_free (di);
+    return 0;
+}
+
+static void
+_mp3_set_cached_info (const char *fname, const mp3info_t *mp3info, const mp3seektable_t *seektable, uint32_t startoffs, uint32_t endoffs) {
+    mp3_cached_info_t extra = {
+        .version = MP3_CACHED_INFO_VERSION,
+        .startoffs = startoffs,
+        .endoffs = endoffs,
+        .ver = mp3info->ref_packet.ver,
+        .layer = mp3info->ref_packet.layer,
+        .samples_per_frame = mp3info->ref_packet.samples_per_frame,
+        .have_xing_header = mp3info->have_xing_header,
+        .vbr_type = mp3info->vbr_type,
+        .lamepreset = mp3info->lamepreset,
+        .packet_offs = mp3info->packet_offs,
+        .avg_bitrate = mp3info->avg_bitrate,
+        .datasize = mp3info->datasize,
+        .seektable_interval = seektable->interval,
+    };
+
+    int samplerate = mp3info->ref_packet.samplerate;
+    int channels = mp3info->ref_packet.nchannels;
+
+    ddb_decode_info_t di = {
+        .totalsamples = mp3info->totalsamples,
+        .duration = (float)((double)(mp3info->totalsamples - mp3info->delay - mp3info->padding) / samplerate),
+        .delay = mp3info->delay,
+        .padding = mp3info->padding,
+        .fmt = {
+            .channels = channels,
+            .samplerate = samplerate,
+            .channelmask = channels == 1 ? DDB_SPEAKER_FRONT_LEFT : (DDB_SPEAKER_FRONT_LEFT | DDB_SPEAKER_FRONT_RIGHT),
+        },
+        .seekpoints = seektable->points,
+        .num_seekpoints = seektable->count,
+        .extra = &extra,
+        .extra_size = sizeof (extra),
+    };
+
+    deadbeef->decode_info_set (fname, plugin.decoder.plugin.id, &di);
+}
+
 int
 cmp3_seek_stream (DB_fileinfo_t *_info, int64_t sample) {
     mp3_info_t *info = (mp3_info_t *)_info;
@@ -72,7 +187,15 @@ cmp3_seek_stream (DB_fileinfo_t *_info, int64_t sample) {
 #endif
 
     mp3info_t mp3info;
-    int res = mp3_parse_file(&mp3info, info->mp3flags, info->file, deadbeef->fgetlength(info->file), info->startoffs, info->endoffs, sample);
+    int seekpoint_count = info->seektable.count;
+    int64_t seekpoint_interval = info->seektable.interval;
+    int res = mp3_parse_file_with_seektable(&mp3info, info->mp3flags, info->file, deadbeef->fgetlength(info->file), info->startoffs, info->endoffs, sample, &info->seektable);
+
+    if (!res && (info->seektable.count != seekpoint_count || info->seektable.interval != seekpoint_interval)) {
+        // the scan went past the known part of the file,
+        // the cache is updated in cmp3_free, to keep the file system access out of the seek
+        info->seektable_modified = 1;
+    }
 
     if (!res) {
         deadbeef->fseek (info->file, mp3info.packet_offs, SEEK_SET);
@@ -216,8 +339,8 @@ cmp3_set_extra_properties (DB_playItem_t *it, mp3info_t *mp3info, int fake) {
 }
 
 static int
-_mp3_parse_and_validate (mp3info_t *info, uint32_t flags, DB_FILE *fp, int64_t fsize, int startoffs, int endoffs, int64_t seek_to_sample) {
-    int res = mp3_parse_file(info, flags, fp, fsize, startoffs, endoffs, seek_to_sample);
+_mp3_parse_and_validate (mp3info_t *info, uint32_t flags, DB_FILE *fp, int64_t fsize, int startoffs, int endoffs, int64_t seek_to_sample, mp3seektable_t *seektable) {
+    int res = mp3_parse_file_with_seektable(info, flags, fp, fsize, startoffs, endoffs, seek_to_sample, seektable);
     if (res < 0) {
         return res;
     }
@@ -262,7 +385,7 @@ cmp3_init (DB_fileinfo_t *_info, DB_playItem_t *it) {
     deadbeef->pl_lock ();
     const char *uri = strdupa (deadbeef->pl_find_meta (it, ":URI"));
     deadbeef->pl_unlock ();
-    info->file = deadbeef->fopen (uri);
+    info->file = deadbeef->fopen2 (uri, DDB_VFS_OPEN_SEQUENTIAL);
     if (!info->file) {
         return -1;
     }
@@ -272,14 +395,18 @@ cmp3_init (DB_fileinfo_t *_info, DB_playItem_t *it) {
     info->it = it;
     info->info.readpos = 0;
     if (!info->file->vfs->is_streaming () && !(info->mp3flags & MP3_PARSE_ESTIMATE_DURATION)) {
-        deadbeef->junk_get_tag_offsets (info->file, &info->startoffs, &info->endoffs);
-        if (info->startoffs > 0) {
-            trace ("mp3: skipping %d(%xH) bytes of junk\n", info->startoffs, info->endoffs);
-        }
-        int res = _mp3_parse_and_validate(&info->mp3info, info->mp3flags, info->file, deadbeef->fgetlength(info->file), info->startoffs, info->endoffs, -1);
-        if (res < 0) {
-            trace ("mp3: cmp3_init: initial mp3_parse_file failed\n");
-            return -1;
+        int64_t fsize = deadbeef->fgetlength(info->file);
+        if (_mp3_get_cached_info (uri, fsize, &info->mp3info, &info->seektable, &info->startoffs, &info->endoffs) < 0) {
+            deadbeef->junk_get_tag_offsets (info->file, &info->startoffs, &info->endoffs);
+            if (info->startoffs > 0) {
+                trace ("mp3: skipping %d(%xH) bytes of junk\n", info->startoffs, info->endoffs);
+            }
+            int res = _mp3_parse_and_validate(&info->mp3info, info->mp3flags, info->file, fsize, info->startoffs, info->endoffs, -1, &info->seektable);
+            if (res < 0) {
+                trace ("mp3: cmp3_init: initial mp3_parse_file failed\n");
+                return -1;
+            }
+            _mp3_set_cached_info (uri, &info->mp3info, &info->seektable, info->startoffs, info->endoffs);
         }
         info->currentsample = info->mp3info.pcmsample;
 
@@ -304,7 +431,7 @@ cmp3_init (DB_fileinfo_t *_info, DB_playItem_t *it) {
     else {
         info->startoffs = (uint32_t)deadbeef->junk_get_leading_size(info->file);
         deadbeef->pl_add_meta (it, "title", NULL);
-        int res = _mp3_parse_and_validate(&info->mp3info, info->mp3flags, info->file, deadbeef->fgetlength(info->file), info->startoffs, 0, -1);
+        int res = _mp3_parse_and_validate(&info->mp3info, info->mp3flags, info->file, deadbeef->fgetlength(info->file), info->startoffs, 0, -1, NULL);
         if (res < 0) {
             trace ("mp3: cmp3_init: initial mp3_parse_file failed\n");
             return -1;
@@ -427,6 +554,12 @@ static void
 cmp3_free (DB_fileinfo_t *_info) {
     mp3_info_t *info = (mp3_info_t *)_info;
     if (info->it) {
+        if (info->seektable_modified) {
+            deadbeef->pl_lock ();
+            const char *uri = strdupa (deadbeef->pl_find_meta (info->it, ":URI"));
+            deadbeef->pl_unlock ();
+            _mp3_set_cached_info (uri, &info->mp3info, &info->seektable, info->startoffs, info->endoffs);
+        }
         deadbeef->pl_item_unref (info->it);
     }
     if (info->conv_buf) {
@@ -615,9 +748,9 @@ cmp3_insert (ddb_playlist_t *plt, DB_playItem_t *after, const char *fname) {
 
     uint32_t start;
     uint32_t end;
-    deadbeef->junk_get_tag_offsets (fp, &start, &end);
 
     mp3info_t mp3info;
+    mp3seektable_t seektable = { .interval = 0 };
 
     uint64_t fsize = deadbeef->fgetlength(fp);
     uint32_t mp3flags = 0;
@@ -625,12 +758,20 @@ cmp3_insert (ddb_playlist_t *plt, DB_playItem_t *after, const char *fname) {
         mp3flags = MP3_PARSE_ESTIMATE_DURATION;
     }
 
-    int res = _mp3_parse_and_validate(&mp3info, mp3flags, fp, fsize, start, end, -1);
+    if (mp3flags || _mp3_get_cached_info (fname, fsize, &mp3info, &seektable, &start, &end) < 0) {
+        deadbeef->junk_get_tag_offsets (fp, &start, &end);
 
-    if (res < 0) {
-        trace ("mp3: mp3_parse_file returned error\n");
-        deadbeef->fclose (fp);
-        return NULL;
+        int res = _mp3_parse_and_validate(&mp3info, mp3flags, fp, fsize, start, end, -1, &seektable);
+
+        if (res < 0) {
+            trace ("mp3: mp3_parse_file returned error\n");
+            deadbeef->fclose (fp);
+            return NULL;
+        }
+
+        if (!mp3flags) {
+            _mp3_set_cached_info (fname, &mp3info, &seektable, start, end);
+        }
     }
 
     DB_playItem_t *it = deadbeef->pl_item_alloc_init (fname, plugin.decoder.plugin.id);
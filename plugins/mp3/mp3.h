@@ -51,6 +51,8 @@ typedef struct {
 
     mp3info_t mp3info;
     uint32_t mp3flags; // extra flags to pass to mp3parser
+    mp3seektable_t seektable;
+    int seektable_modified; // the seek table was extended, and needs to be saved to the decode info cache on free
 
     int64_t currentsample;
     int64_t skipsamples; // how many samples to skip after seek, usually "seek_sample - mp3info.pcmsample"
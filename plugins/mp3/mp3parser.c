@@ -27,6 +27,11 @@
 #include <stdlib.h>
 #include <math.h>
 #include <sys/time.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 //#define PERFORMANCE_STATS 1
 
@@ -43,6 +48,9 @@ extern DB_functions_t *deadbeef;
 #define MAX_INVALID_BYTES 1000000
 #define MAX_INVALID_BYTES_STREAM 1000
 #define MAX_FREEFORMAT_PACKETS 10
+#define MIN_SCAN_WINDOW 0x4000
+#define MAX_SCAN_WINDOW 0x40000
+#define STREAM_SCAN_WINDOW 0x800 // enough for the header + xing packet
 
 static const int vertbl[] = {3, -1, 2, 1}; // 3 is 2.5
 static const int ltbl[] = { -1, 3, 2, 1 };
@@ -400,8 +408,204 @@ _packet_same_fmt (mp3packet_t *ref_packet, mp3packet_t *packet) {
         && packet->ver == ref_packet->ver;
 }
 
+static void
+_seektable_add (mp3seektable_t *seektable, int64_t sample, int64_t offs) {
+    if (seektable->count == MP3_MAX_SEEKPOINTS) {
+        for (int i = 0; i < MP3_MAX_SEEKPOINTS/2; i++) {
+            seektable->points[i] = seektable->points[i*2];
+        }
+        seektable->count = MP3_MAX_SEEKPOINTS/2;
+        seektable->interval *= 2;
+    }
+    seektable->points[seektable->count].sample = sample;
+    seektable->points[seektable->count].offset = offs;
+    seektable->count++;
+}
+
+static const ddb_seekpoint_t *
+_seektable_find (mp3seektable_t *seektable, int64_t sample) {
+    int lo = 0;
+    int hi = seektable->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (seektable->points[mid].sample <= sample) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo > 0 ? &seektable->points[lo-1] : NULL;
+}
+
+// Reads the file in windows growing from MIN_SCAN_WINDOW to MAX_SCAN_WINDOW bytes,
+// so that the frame headers are parsed from memory, instead of calling seek and read for every frame.
+// With streaming files, only the requested bytes are read, to avoid stalling on network reads.
+typedef struct {
+    DB_FILE *fp;
+    uint8_t *data;
+    int64_t capacity;
+    int64_t offs; // file offset of data[0]
+    int64_t size; // number of valid bytes
+    int64_t read_size; // size of the next read
+    int64_t fileoffs; // current file position
+    int64_t limit; // end of data, or -1 if unknown
+    int exact_reads;
+    uint8_t fallback[STREAM_SCAN_WINDOW]; // used with exact reads, when the window can't be allocated
+} scan_window_t;
+
+// Returns -1 if the window could not be allocated,
+// in which case the window reads each frame separately, like with streaming files.
+static int
+_window_init (scan_window_t *window, DB_FILE *fp, int64_t fileoffs, int64_t limit, int streaming) {
+    memset (window, 0, sizeof (scan_window_t));
+    window->fp = fp;
+    window->exact_reads = streaming;
+    window->capacity = streaming ? STREAM_SCAN_WINDOW : MAX_SCAN_WINDOW;
+    window->data = malloc (window->capacity);
+    window->offs = fileoffs;
+    window->read_size = MIN_SCAN_WINDOW;
+    window->fileoffs = fileoffs;
+    window->limit = limit;
+    if (!window->data) {
+        window->data = window->fallback;
+        window->capacity = STREAM_SCAN_WINDOW;
+        window->exact_reads = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static void
+_window_free (scan_window_t *window) {
+    if (window->data != window->fallback) {
+        free (window->data);
+    }
+    window->data = NULL;
+}
+
+// Returns a pointer to `size` bytes at the file offset `offs`, or NULL if they can't be read.
+static const uint8_t *
+_window_get (scan_window_t *window, mp3info_t *info, int64_t offs, int64_t size) {
+    if (offs >= window->offs && offs + size <= window->offs + window->size) {
+        return window->data + (offs - window->offs);
+    }
+
+    if (size > window->capacity) {
+        return NULL;
+    }
+
+    // keep the remaining part of the window, and read the rest after it
+    int64_t start = offs;
+    int64_t keep = 0;
+    if (offs >= window->offs && offs < window->offs + window->size) {
+        keep = window->offs + window->size - offs;
+        memmove (window->data, window->data + (offs - window->offs), keep);
+    }
+    else if (!window->exact_reads && offs > window->fileoffs && offs + size - window->fileoffs <= window->read_size) {
+        // a packet ends past the window, keep reading sequentially instead of seeking
+        start = window->fileoffs;
+    }
+    window->offs = start;
+    window->size = keep;
+
+    int64_t pos = start + keep;
+    int64_t readsize = offs + size - pos;
+    if (!window->exact_reads) {
+        if (readsize < window->read_size) {
+            readsize = window->read_size;
+        }
+        if (readsize > window->capacity - keep) {
+            readsize = window->capacity - keep;
+        }
+        if (window->limit >= 0 && pos + readsize > window->limit) {
+            readsize = window->limit - pos;
+        }
+        if (window->read_size < MAX_SCAN_WINDOW) {
+            window->read_size *= 2;
+        }
+    }
+
+    if (readsize > 0) {
+        if (window->fileoffs != pos) {
+            deadbeef->fseek (window->fp, pos, SEEK_SET);
+            info->num_seeks++;
+            window->fileoffs = pos;
+        }
+        size_t rb = deadbeef->fread (window->data + keep, 1, readsize, window->fp);
+        info->num_reads++;
+        info->bytes_read += rb;
+        window->fileoffs += rb;
+        window->size += rb;
+    }
+
+    if (window->size < offs + size - start) {
+        return NULL;
+    }
+    return window->data + (offs - start);
+}
+
+// Returns the position of the first possible frame sync (11 set bits) in the buffer,
+// or the position of the trailing 0xff byte, which may start a sync in the next window,
+// or size if there's nothing.
+static int64_t
+_find_sync (const uint8_t *data, int64_t size) {
+    int64_t i = 0;
+#if defined(__SSE2__)
+    const __m128i ff = _mm_set1_epi8 ((char)0xff);
+    const __m128i e0 = _mm_set1_epi8 ((char)0xe0);
+    for (; i + 17 <= size; i += 16) {
+        __m128i b0 = _mm_loadu_si128 ((const __m128i *)(data + i));
+        __m128i b1 = _mm_loadu_si128 ((const __m128i *)(data + i + 1));
+        __m128i m = _mm_and_si128 (_mm_cmpeq_epi8 (b0, ff), _mm_cmpeq_epi8 (_mm_and_si128 (b1, e0), e0));
+        int mask = _mm_movemask_epi8 (m);
+        if (mask) {
+            return i + __builtin_ctz (mask);
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t ff = vdupq_n_u8 (0xff);
+    const uint8x16_t e0 = vdupq_n_u8 (0xe0);
+    for (; i + 17 <= size; i += 16) {
+        uint8x16_t b0 = vld1q_u8 (data + i);
+        uint8x16_t b1 = vld1q_u8 (data + i + 1);
+        uint8x16_t m = vandq_u8 (vceqq_u8 (b0, ff), vceqq_u8 (vandq_u8 (b1, e0), e0));
+        if (vmaxvq_u8 (m)) {
+            break; // the exact position is found below
+        }
+    }
+#endif
+    for (; i + 1 < size; i++) {
+        if (data[i] == 0xff && (data[i+1] & 0xe0) == 0xe0) {
+            return i;
+        }
+    }
+    if (size > 0 && data[size-1] == 0xff) {
+        return size-1;
+    }
+    return size;
+}
+
+static int
+_too_many_invalid_bytes (mp3info_t *info, int64_t offs, int64_t scan_startoffs) {
+    // bail if a valid packet could not be found at the start of stream
+    if (!info->valid_packets && offs - scan_startoffs > MAX_INVALID_BYTES) {
+        return 1;
+    }
+
+    if (info->is_streaming && offs - scan_startoffs > MAX_INVALID_BYTES_STREAM) {
+        return 1;
+    }
+    return 0;
+}
+
 int
 mp3_parse_file (mp3info_t *info, uint32_t flags, DB_FILE *fp, int64_t fsize, int startoffs, int endoffs, int64_t seek_to_sample) {
+    return mp3_parse_file_with_seektable (info, flags, fp, fsize, startoffs, endoffs, seek_to_sample, NULL);
+}
+
+int
+mp3_parse_file_with_seektable (mp3info_t *info, uint32_t flags, DB_FILE *fp, int64_t fsize, int startoffs, int endoffs, int64_t seek_to_sample, mp3seektable_t *seektable) {
 #if PERFORMANCE_STATS
     struct timeval start_tv;
     struct timeval end_tv;
@@ -422,9 +626,32 @@ mp3_parse_file (mp3info_t *info, uint32_t flags, DB_FILE *fp, int64_t fsize, int
 
     int err = -1;
 
-    deadbeef->fseek (fp, startoffs, SEEK_SET);
+    if (seektable && seektable->interval <= 0) {
+        seektable->count = 0;
+        seektable->interval = MP3_SEEKPOINT_INTERVAL;
+    }
+
+    // continue from the nearest known packet, instead of walking all the packets from the start
+    const ddb_seekpoint_t *seekpoint = NULL;
+    if (seektable && seek_to_sample > 0 && fsize > 0) {
+        seekpoint = _seektable_find (seektable, seek_to_sample);
+    }
+
+    int64_t scan_startoffs = seekpoint ? seekpoint->offset : startoffs;
+    int64_t sample_pos = seekpoint ? seekpoint->sample : 0; // position of the current packet
+
+    deadbeef->fseek (fp, scan_startoffs, SEEK_SET);
     info->num_seeks++;
 
+    scan_window_t window;
+    // if the window can't be allocated, the frames are read one by one, which is slower, but still works
+    _window_init (&window, fp, scan_startoffs, fsize > 0 ? fsize - endoffs : -1, fp->vfs->is_streaming ());
+
+    if (seekpoint) {
+        info->pcmsample = seekpoint->sample;
+        info->checked_xing_header = 1;
+    }
+
     int64_t datasize = fsize;
     if (datasize > 0) {
         datasize -= startoffs+endoffs;
@@ -438,8 +665,7 @@ mp3_parse_file (mp3info_t *info, uint32_t flags, DB_FILE *fp, int64_t fsize, int
 
     mp3packet_t packet;
 
-    int64_t offs = startoffs;
-    int64_t fileoffs = startoffs;
+    int64_t offs = scan_startoffs;
 
     int prev_br = -1;
     int prev_length = -1;
@@ -447,30 +673,18 @@ mp3_parse_file (mp3info_t *info, uint32_t flags, DB_FILE *fp, int64_t fsize, int
     int freeformat_packets = 0;
 
     while (fsize > 0 || fsize < 0) {
-        int64_t readsize = 4; // fe ff + frame header
-        if (fsize > 0 && offs + readsize >= fsize - endoffs) {
-            readsize = fsize - endoffs - offs;
-        }
-
-        if (readsize <= 0) {
+        // ff fe + frame header
+        if (fsize > 0 && offs + 4 > fsize - endoffs) {
+            offs = fsize - endoffs;
             break;
         }
 
-        uint8_t fhdr[4];
-
-        if (fileoffs != offs) {
-            deadbeef->fseek (fp, offs, SEEK_SET);
-            info->num_seeks++;
-            fileoffs = offs;
-        }
-        if (deadbeef->fread (fhdr, 1, readsize, fp) != readsize) {
+        const uint8_t *fhdr = _window_get (&window, info, offs, 4);
+        if (!fhdr) {
             goto error;
         }
-        info->num_reads++;
-        info->bytes_read += readsize;
-        fileoffs += readsize;
 
-        int res = _parse_packet (&packet, fhdr);
+        int res = _parse_packet (&packet, (uint8_t *)fhdr);
         if (res < 0 || (info->npackets && !_packet_same_fmt (&info->ref_packet, &packet))) {
             if (res == -2 && info->valid_packets == 0) {
                 freeformat_packets++;
@@ -480,12 +694,7 @@ mp3_parse_file (mp3info_t *info, uint32_t flags, DB_FILE *fp, int64_t fsize, int
                 goto error; // ignore freeformat streams
             }
 
-            // bail if a valid packet could not be found at the start of stream
-            if (!info->valid_packets && offs - startoffs > MAX_INVALID_BYTES) {
-                goto error;
-            }
-
-            if (info->is_streaming && offs - startoffs > MAX_INVALID_BYTES_STREAM) {
+            if (_too_many_invalid_bytes (info, offs, scan_startoffs)) {
                 goto error;
             }
 
@@ -503,6 +712,17 @@ mp3_parse_file (mp3info_t *info, uint32_t flags, DB_FILE *fp, int64_t fsize, int
             }
 
             offs++;
+
+            // skip the bytes which can't start a packet
+            if (offs >= window.offs && offs < window.offs + window.size) {
+                int64_t skip = _find_sync (window.data + (offs - window.offs), window.offs + window.size - offs);
+                if (skip > 0) {
+                    offs += skip;
+                    if (_too_many_invalid_bytes (info, offs - 1, scan_startoffs)) {
+                        goto error;
+                    }
+                }
+            }
             continue;
         }
         else {
@@ -529,15 +749,12 @@ mp3_parse_file (mp3info_t *info, uint32_t flags, DB_FILE *fp, int64_t fsize, int
                 // need whole packet for checking xing!
 
                 info->checked_xing_header = 1;
-                uint8_t xinghdr[packet.packetlength];
-                if (deadbeef->fread (xinghdr, 1, sizeof (xinghdr), fp) != sizeof (xinghdr)) {
-                    return -1;
+                const uint8_t *xinghdr = _window_get (&window, info, offs + 4, packet.packetlength);
+                if (!xinghdr) {
+                    goto error;
                 }
-                info->num_reads++;
-                info->bytes_read += sizeof (xinghdr);
 
-                fileoffs += sizeof (xinghdr);
-                int xingres = _check_xing_header (info, &packet, xinghdr, (int)sizeof (xinghdr));
+                int xingres = _check_xing_header (info, &packet, (uint8_t *)xinghdr, packet.packetlength);
                 if (!xingres) {
                     got_xing = 1;
                     info->have_xing_header = 1;
@@ -568,6 +785,16 @@ mp3_parse_file (mp3info_t *info, uint32_t flags, DB_FILE *fp, int64_t fsize, int
                 if (_process_packet (info, &packet, seek_to_sample) > 0) {
                     goto end;
                 }
+
+                // only use packets following another valid packet, to avoid false sync
+                if (seektable
+                    && fsize > 0
+                    && info->prev_packet.samplerate
+                    && sample_pos >= (seektable->count ? seektable->points[seektable->count-1].sample : 0) + seektable->interval) {
+                    _seektable_add (seektable, sample_pos, offs);
+                }
+                sample_pos += packet.samples_per_frame;
+
                 memcpy (&info->prev_packet, &packet, sizeof (packet));
             }
 
@@ -661,6 +888,7 @@ end_noaverages:
     }
     err = 0;
 error:
+    _window_free (&window);
 #if PERFORMANCE_STATS
     gettimeofday (&end_tv, NULL);
     float elapsed = (end_tv.tv_sec-start_tv.tv_sec) + (end_tv.tv_usec - start_tv.tv_usec) / 1000000.f;
@@ -103,6 +103,18 @@ typedef struct {
     uint64_t bytes_read;
 } mp3info_t;
 
+#define MP3_MAX_SEEKPOINTS 256
+#define MP3_SEEKPOINT_INTERVAL (1152*128) // initial distance between seek points, in samples
+
+// Positions of valid packets, which can be used as starting points for scanning.
+// Sample positions are counted from the first packet after Xing/Info packet, same as mp3info_t.pcmsample.
+// When the table gets full, every other point is dropped, and the interval is doubled.
+typedef struct {
+    ddb_seekpoint_t points[MP3_MAX_SEEKPOINTS];
+    int count;
+    int64_t interval;
+} mp3seektable_t;
+
 // Params:
 // seek_to_sample: -1 means to the end (scan whole file), otherwise a sample to seek to
 // When seeking, the packet offset returned will be the one containing seek_to_sample, not accounting for delay.
@@ -118,6 +130,11 @@ typedef struct {
 int
 mp3_parse_file (mp3info_t *info, uint32_t flags, DB_FILE *fp, int64_t fsize, int startoffs, int endoffs, int64_t seek_to_sample);
 
+// Same as mp3_parse_file, but when seeking, the scan starts from the nearest seek point preceding the target.
+// The packets found past the last point in the table are added to it, so a full scan fills the whole table.
+int
+mp3_parse_file_with_seektable (mp3info_t *info, uint32_t flags, DB_FILE *fp, int64_t fsize, int startoffs, int endoffs, int64_t seek_to_sample, mp3seektable_t *seektable);
+
 #ifdef __cplusplus
 }
 #endif
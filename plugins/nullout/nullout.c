@@ -22,7 +22,10 @@
 */
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
+#include <errno.h>
 #ifdef __linux__
 #include <sys/prctl.h>
 #endif
@@ -33,6 +36,19 @@
 //#define trace(...) { fprintf(stderr, __VA_ARGS__); }
 #define trace(fmt,...)
 
+#define info(...) { deadbeef->log_detailed (&plugin.plugin, DDB_LOG_LAYER_INFO, __VA_ARGS__); }
+
+#define DEFAULT_PERIOD_SIZE 1024
+#define DEFAULT_PERIOD_SIZE_STR "1024"
+#define MAX_PERIOD_SIZE 65536
+
+enum {
+    // consume the data as fast as the pipeline can produce it
+    NULLOUT_MODE_FAST = 0,
+    // consume the data in periods paced by the clock, like a real device
+    NULLOUT_MODE_REALTIME = 1,
+};
+
 static DB_output_t plugin;
 static DB_functions_t *deadbeef;
 
@@ -40,7 +56,25 @@ static intptr_t null_tid;
 static int null_terminate;
 static int state;
 
-static void
+static int conf_mode;
+static int conf_period_size; // in frames
+
+typedef struct {
+    int64_t periods;
+    int64_t bytes;
+    int64_t underruns; // periods which the streamer couldn't fill completely
+    int64_t late_periods; // periods which were filled after their deadline
+    int64_t fill_ns_total; // time spent in streamer_read
+    int64_t fill_ns_max;
+    int64_t wall_start_ns;
+    int64_t cpu_start_ns;
+} nullout_stats_t;
+
+// updated by the output thread, read by the stats command and on stop
+static nullout_stats_t stats;
+static uintptr_t stats_mutex;
+
+static int
 pnull_callback (char *stream, int len);
 
 static void
@@ -67,9 +101,72 @@ pnull_pause (void);
 static int
 pnull_unpause (void);
 
+static int64_t
+_clock_ns (clockid_t clock) {
+    struct timespec ts;
+    clock_gettime (clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+_stats_reset (void) {
+    deadbeef->mutex_lock (stats_mutex);
+    memset (&stats, 0, sizeof (stats));
+    stats.wall_start_ns = _clock_ns (CLOCK_MONOTONIC);
+    stats.cpu_start_ns = _clock_ns (CLOCK_PROCESS_CPUTIME_ID);
+    deadbeef->mutex_unlock (stats_mutex);
+}
+
+static int
+_stats_format (char *out, size_t size) {
+    deadbeef->mutex_lock (stats_mutex);
+    nullout_stats_t snapshot = stats;
+    deadbeef->mutex_unlock (stats_mutex);
+    int64_t wall_ns = _clock_ns (CLOCK_MONOTONIC) - snapshot.wall_start_ns;
+    int64_t cpu_ns = _clock_ns (CLOCK_PROCESS_CPUTIME_ID) - snapshot.cpu_start_ns;
+    int bytes_per_sec = plugin.fmt.samplerate * plugin.fmt.channels * (plugin.fmt.bps / 8);
+    double audio_sec = bytes_per_sec > 0 ? (double)snapshot.bytes / bytes_per_sec : 0;
+    double wall_sec = wall_ns / 1e9;
+
+    return snprintf (out, size,
+                     "nullout: mode: %s, period: %d frames\n"
+                     "nullout: %lld periods, %0.2f sec of audio in %0.2f sec (%0.2fx realtime)\n"
+                     "nullout: fill latency: avg %0.3f ms, max %0.3f ms\n"
+                     "nullout: underruns: %lld, late periods: %lld\n"
+                     "nullout: process CPU time: %0.2f sec (%0.1f%% of wall time)\n",
+                     conf_mode == NULLOUT_MODE_FAST ? "as fast as possible" : "realtime",
+                     conf_period_size,
+                     (long long)snapshot.periods, audio_sec, wall_sec, wall_sec > 0 ? audio_sec / wall_sec : 0,
+                     snapshot.periods > 0 ? snapshot.fill_ns_total / 1e6 / snapshot.periods : 0, snapshot.fill_ns_max / 1e6,
+                     (long long)snapshot.underruns, (long long)snapshot.late_periods,
+                     cpu_ns / 1e9, wall_ns > 0 ? cpu_ns * 100.0 / wall_ns : 0);
+}
+
+static void
+_stats_dump (void) {
+    deadbeef->mutex_lock (stats_mutex);
+    int64_t periods = stats.periods;
+    deadbeef->mutex_unlock (stats_mutex);
+    if (periods == 0) {
+        return;
+    }
+    char out[1000];
+    _stats_format (out, sizeof (out));
+    info ("%s", out);
+}
+
 int
 pnull_init (void) {
     trace ("pnull_init\n");
+    conf_mode = deadbeef->conf_get_int ("nullout.mode", NULLOUT_MODE_FAST);
+    conf_period_size = deadbeef->conf_get_int ("nullout.period", DEFAULT_PERIOD_SIZE);
+    if (conf_period_size < 16) {
+        conf_period_size = 16;
+    }
+    else if (conf_period_size > MAX_PERIOD_SIZE) {
+        conf_period_size = MAX_PERIOD_SIZE;
+    }
+    _stats_reset ();
     state = DDB_PLAYBACK_STATE_STOPPED;
     null_terminate = 0;
     null_tid = deadbeef->thread_start (pnull_thread, NULL);
@@ -93,6 +190,8 @@ pnull_free (void) {
         null_tid = 0;
         state = DDB_PLAYBACK_STATE_STOPPED;
         null_terminate = 0;
+        _stats_dump ();
+        _stats_reset ();
     }
     return 0;
 }
@@ -110,6 +209,8 @@ int
 pnull_stop (void) {
     state = DDB_PLAYBACK_STATE_STOPPED;
     deadbeef->streamer_reset (1);
+    _stats_dump ();
+    _stats_reset ();
     return 0;
 }
 
@@ -132,37 +233,135 @@ pnull_unpause (void) {
     return 0;
 }
 
+static void
+_timespec_add_ns (struct timespec *ts, int64_t ns) {
+    ns += ts->tv_nsec;
+    ts->tv_sec += ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+}
+
 static void
 pnull_thread (void *context) {
 #ifdef __linux__
     prctl (PR_SET_NAME, "deadbeef-null", 0, 0, 0, 0);
 #endif
+    // up to 8 channels of 64 bit samples
+    char fallback_buf[4096];
+    int bufsize = conf_period_size * 8 * 8;
+    char *buf = malloc (bufsize);
+    if (!buf) {
+        // play in shorter periods
+        buf = fallback_buf;
+        bufsize = sizeof (fallback_buf);
+    }
+    struct timespec deadline = {0};
+    int clock_running = 0;
+
     for (;;) {
         if (null_terminate) {
             break;
         }
         if (state != DDB_PLAYBACK_STATE_PLAYING) {
+            clock_running = 0;
             usleep (10000);
             continue;
         }
-        
-        char buf[4096];
-        pnull_callback (buf, 1024);
-        usleep(1);
+
+        int samplesize = plugin.fmt.channels * (plugin.fmt.bps / 8);
+        int samplerate = plugin.fmt.samplerate;
+        if (samplesize <= 0 || samplesize > 64 || samplerate <= 0) {
+            usleep (10000);
+            continue;
+        }
+
+        int period_size = conf_period_size < bufsize / samplesize ? conf_period_size : bufsize / samplesize;
+        int len = period_size * samplesize;
+        int64_t fill_start = _clock_ns (CLOCK_MONOTONIC);
+        int bytesread = pnull_callback (buf, len);
+        int64_t fill_ns = _clock_ns (CLOCK_MONOTONIC) - fill_start;
+
+        deadbeef->mutex_lock (stats_mutex);
+        stats.periods++;
+        stats.bytes += bytesread;
+        stats.fill_ns_total += fill_ns;
+        if (fill_ns > stats.fill_ns_max) {
+            stats.fill_ns_max = fill_ns;
+        }
+        if (bytesread < len) {
+            stats.underruns++;
+        }
+        deadbeef->mutex_unlock (stats_mutex);
+
+        if (conf_mode == NULLOUT_MODE_FAST) {
+            if (bytesread <= 0) {
+                // nothing to read, don't spin
+                usleep (1000);
+            }
+            continue;
+        }
+
+        // sleep until the end of the period, measured from the absolute start time, so that the error doesn't accumulate
+        int64_t period_ns = (int64_t)period_size * 1000000000 / samplerate;
+        if (!clock_running) {
+            clock_gettime (CLOCK_MONOTONIC, &deadline);
+            clock_running = 1;
+        }
+        _timespec_add_ns (&deadline, period_ns);
+
+        struct timespec now;
+        clock_gettime (CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > deadline.tv_sec || (now.tv_sec == deadline.tv_sec && now.tv_nsec > deadline.tv_nsec)) {
+            // the period was filled too late: a real device would have played silence
+            deadbeef->mutex_lock (stats_mutex);
+            stats.late_periods++;
+            deadbeef->mutex_unlock (stats_mutex);
+            deadline = now;
+            continue;
+        }
+#ifdef __linux__
+        while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+#else
+        int64_t remaining = (int64_t)(deadline.tv_sec - now.tv_sec) * 1000000000 + (deadline.tv_nsec - now.tv_nsec);
+        struct timespec ts = { .tv_sec = remaining / 1000000000, .tv_nsec = remaining % 1000000000 };
+        nanosleep (&ts, NULL);
+#endif
+    }
+
+    if (buf != fallback_buf) {
+        free (buf);
     }
 }
 
-static void
+// Returns the number of bytes provided by the streamer
+static int
 pnull_callback (char *stream, int len) {
     if (!deadbeef->streamer_ok_to_read (len)) {
         memset (stream, 0, len);
-        return;
+        return 0;
     }
     int bytesread = deadbeef->streamer_read (stream, len);
 
+    if (bytesread < 0) {
+        bytesread = 0;
+    }
     if (bytesread < len) {
         memset (stream + bytesread, 0, len-bytesread);
     }
+    return bytesread;
+}
+
+// deadbeef --plugin=nullout stats
+static int
+null_exec_cmdline (const char *cmdline, int cmdline_size, ddb_response_t *response) {
+    if (cmdline_size < 1 || strcmp (cmdline, "stats")) {
+        char usage[] = "Usage: --plugin=nullout stats\n";
+        response->append (response, usage, sizeof (usage) - 1);
+        return -1;
+    }
+    char out[1000];
+    int len = _stats_format (out, sizeof (out));
+    response->append (response, out, len);
+    return 0;
 }
 
 ddb_playback_state_t
@@ -172,11 +371,18 @@ pnull_get_state (void) {
 
 int
 null_start (void) {
+    stats_mutex = deadbeef->mutex_create ();
+    _stats_reset ();
     return 0;
 }
 
 int
 null_stop (void) {
+    pnull_free ();
+    if (stats_mutex) {
+        deadbeef->mutex_free (stats_mutex);
+        stats_mutex = 0;
+    }
     return 0;
 }
 
@@ -186,15 +392,20 @@ nullout_load (DB_functions_t *api) {
     return DB_PLUGIN (&plugin);
 }
 
+static const char settings_dlg[] =
+    "property \"Mode\" select[2] nullout.mode 0 \"As fast as possible\" \"Realtime\";\n"
+    "property \"Period size (frames)\" entry nullout.period " DEFAULT_PERIOD_SIZE_STR ";\n"
+;
+
 // define plugin interface
 static DB_output_t plugin = {
     DDB_PLUGIN_SET_API_VERSION
     .plugin.version_major = 1,
-    .plugin.version_minor = 0,
+    .plugin.version_minor = 1,
     .plugin.type = DB_PLUGIN_OUTPUT,
     .plugin.id = "nullout",
     .plugin.name = "Null output plugin",
-    .plugin.descr = "This plugin takes the audio data, and discards it,\nso nothing will play.\nThis is useful for testing.",
+    .plugin.descr = "This plugin takes the audio data, and discards it,\nso nothing will play.\nThis is useful for testing and benchmarking:\nthe timing statistics are logged when playback stops.",
     .plugin.copyright = 
     "Null output plugin for DeaDBeeF Player\n"
     "Copyright (C) 2009-2014 Oleksiy Yakovenko\n"
@@ -220,6 +431,8 @@ static DB_output_t plugin = {
     .plugin.website = "http://deadbeef.sf.net",
     .plugin.start = null_start,
     .plugin.stop = null_stop,
+    .plugin.configdialog = settings_dlg,
+    .plugin.exec_cmdline = null_exec_cmdline,
     .init = pnull_init,
     .free = pnull_free,
     .setformat = pnull_setformat,
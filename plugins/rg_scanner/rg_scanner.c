@@ -31,6 +31,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <stddef.h>
+#include <sys/time.h>
 
 #include "../../deadbeef.h"
 #include "ebur128/ebur128.h"
@@ -47,168 +49,222 @@ static const char *album_signature = "$if2(%album artist% - %album%,%filename%)"
 static ddb_rg_scanner_t plugin;
 static DB_functions_t *deadbeef;
 
+// number of frames decoded at once
+#define RG_BLOCK_FRAMES 16384
+
+// number of blocks per worker, which can be decoded ahead of the analysis
+#define RG_NUM_BLOCKS 3
+
+typedef struct {
+    char *buffer;
+    int buffer_size;
+    float *bufferf;
+    int bufferf_size;
+    // pending analysis of this block
+    dispatch_group_t group;
+} rg_block_t;
+
+typedef struct {
+    int first_track;
+    int num_tracks;
+    int remaining;
+} rg_album_t;
+
 typedef struct {
-    int track_index;
     ddb_rg_scanner_settings_t *settings;
-    ebur128_state **gain_state;
-    ebur128_state **peak_state;
+    int has_stats; // settings has the 1.1 fields
+
+    ebur128_state **states;
+
+    rg_album_t *albums;
+    int num_albums;
+    int *track_album; // album index for each track, or -1
+
+    // all fields below are accessed on sync_queue
     dispatch_queue_t sync_queue;
-} track_state_t;
+    int next_track;
+} rg_scan_ctx_t;
+
+typedef struct {
+    rg_scan_ctx_t *ctx;
+    rg_block_t blocks[RG_NUM_BLOCKS];
+    // decoding on the worker thread is overlapped with the analysis on this serial queue
+    dispatch_queue_t analysis_queue;
+} rg_worker_t;
+
+static int
+_rg_aborted (ddb_rg_scanner_settings_t *settings) {
+    return settings->pabort && *(settings->pabort);
+}
+
+static void *
+_rg_ensure_buffer (void *buffer, int *size, int required) {
+    if (*size < required) {
+        free (buffer);
+        buffer = malloc (required);
+        *size = required;
+    }
+    return buffer;
+}
 
-void
-rg_calc_track(track_state_t *st) {
+static void
+rg_calc_track (rg_worker_t *w, int track_index) {
+    rg_scan_ctx_t *ctx = w->ctx;
+    ddb_rg_scanner_settings_t *settings = ctx->settings;
+    DB_playItem_t *track = settings->tracks[track_index];
     DB_decoder_t *dec = NULL;
     DB_fileinfo_t *fileinfo = NULL;
+    ebur128_state *state = NULL;
 
-    char *buffer = NULL;
-    float *bufferf = NULL;
-
-    if (st->settings->pabort && *(st->settings->pabort)) {
+    if (_rg_aborted (settings)) {
         return;
     }
-    if (deadbeef->pl_get_item_duration (st->settings->tracks[st->track_index]) <= 0) {
-        st->settings->results[st->track_index].scan_result = DDB_RG_SCAN_RESULT_INVALID_FILE;
+    if (deadbeef->pl_get_item_duration (track) <= 0) {
+        settings->results[track_index].scan_result = DDB_RG_SCAN_RESULT_INVALID_FILE;
         return;
     }
 
-
     deadbeef->pl_lock ();
-    dec = (DB_decoder_t *)deadbeef->plug_get_for_id (deadbeef->pl_find_meta (st->settings->tracks[st->track_index], ":DECODER"));
+    dec = (DB_decoder_t *)deadbeef->plug_get_for_id (deadbeef->pl_find_meta (track, ":DECODER"));
     deadbeef->pl_unlock ();
 
-    if (dec) {
-        fileinfo = dec->open (DDB_DECODER_HINT_RAW_SIGNAL);
+    if (!dec) {
+        return;
+    }
 
-        if (!fileinfo || dec->init (fileinfo, DB_PLAYITEM (st->settings->tracks[st->track_index])) != 0) {
-            st->settings->results[st->track_index].scan_result = DDB_RG_SCAN_RESULT_FILE_NOT_FOUND;
-            goto error;
-        }
+    fileinfo = dec->open (DDB_DECODER_HINT_RAW_SIGNAL);
 
-        st->gain_state[st->track_index] = ebur128_init(fileinfo->fmt.channels, fileinfo->fmt.samplerate, EBUR128_MODE_I);
-        st->peak_state[st->track_index] = ebur128_init(fileinfo->fmt.channels, fileinfo->fmt.samplerate, EBUR128_MODE_SAMPLE_PEAK);
-
-        // speaker mask mapping from WAV to EBUR128
-        static const int chmap[18] = {
-            EBUR128_LEFT,
-            EBUR128_RIGHT,
-            EBUR128_CENTER,
-            EBUR128_UNUSED,
-            EBUR128_LEFT_SURROUND,
-            EBUR128_RIGHT_SURROUND,
-            EBUR128_LEFT_SURROUND,
-            EBUR128_RIGHT_SURROUND,
-            EBUR128_CENTER,
-            EBUR128_LEFT_SURROUND,
-            EBUR128_RIGHT_SURROUND,
-            EBUR128_CENTER,
-            EBUR128_LEFT_SURROUND,
-            EBUR128_CENTER,
-            EBUR128_RIGHT_SURROUND,
-            EBUR128_LEFT_SURROUND,
-            EBUR128_CENTER,
-            EBUR128_RIGHT_SURROUND,
-        };
-
-        uint32_t channelmask = fileinfo->fmt.channelmask;
-
-        // first 18 speaker positions are known, the rest will be marked as UNUSED
-        int ch = 0;
-        for (int i = 0; i < 32 && ch < fileinfo->fmt.channels; i++) {
-            if (i < 18) {
-                if (channelmask & (1<<i))
-                {
-                    ebur128_set_channel (st->gain_state[st->track_index], ch, chmap[i]);
-                    ebur128_set_channel (st->peak_state[st->track_index], ch, chmap[i]);
-                    ch++;
-                }
-            }
-            else {
-                ebur128_set_channel (st->gain_state[st->track_index], ch, EBUR128_UNUSED);
-                ebur128_set_channel (st->peak_state[st->track_index], ch, EBUR128_UNUSED);
+    if (!fileinfo || dec->init (fileinfo, DB_PLAYITEM (track)) != 0) {
+        settings->results[track_index].scan_result = DDB_RG_SCAN_RESULT_FILE_NOT_FOUND;
+        goto error;
+    }
+
+    // the same state is used for loudness and peak, so that the data is processed in one pass
+    state = ebur128_init(fileinfo->fmt.channels, fileinfo->fmt.samplerate, EBUR128_MODE_I|EBUR128_MODE_SAMPLE_PEAK);
+    ctx->states[track_index] = state;
+
+    // speaker mask mapping from WAV to EBUR128
+    static const int chmap[18] = {
+        EBUR128_LEFT,
+        EBUR128_RIGHT,
+        EBUR128_CENTER,
+        EBUR128_UNUSED,
+        EBUR128_LEFT_SURROUND,
+        EBUR128_RIGHT_SURROUND,
+        EBUR128_LEFT_SURROUND,
+        EBUR128_RIGHT_SURROUND,
+        EBUR128_CENTER,
+        EBUR128_LEFT_SURROUND,
+        EBUR128_RIGHT_SURROUND,
+        EBUR128_CENTER,
+        EBUR128_LEFT_SURROUND,
+        EBUR128_CENTER,
+        EBUR128_RIGHT_SURROUND,
+        EBUR128_LEFT_SURROUND,
+        EBUR128_CENTER,
+        EBUR128_RIGHT_SURROUND,
+    };
+
+    uint32_t channelmask = fileinfo->fmt.channelmask;
+
+    // first 18 speaker positions are known, the rest will be marked as UNUSED
+    int ch = 0;
+    for (int i = 0; i < 32 && ch < fileinfo->fmt.channels; i++) {
+        if (i < 18) {
+            if (channelmask & (1<<i))
+            {
+                ebur128_set_channel (state, ch, chmap[i]);
                 ch++;
             }
         }
+        else {
+            ebur128_set_channel (state, ch, EBUR128_UNUSED);
+            ch++;
+        }
+    }
 
-        int samplesize = fileinfo->fmt.channels * fileinfo->fmt.bps / 8;
+    int samplesize = fileinfo->fmt.channels * fileinfo->fmt.bps / 8;
+    int bs = RG_BLOCK_FRAMES * samplesize;
+    int is_float = fileinfo->fmt.is_float;
+    ddb_waveformat_t fmt;
+    memcpy (&fmt, &fileinfo->fmt, sizeof (fmt));
+    fmt.bps = 32;
+    fmt.is_float = 1;
+    ddb_waveformat_t *infmt = &fileinfo->fmt;
+
+    int eof = 0;
+    for (int n = 0; !eof; n++) {
+        if (_rg_aborted (settings)) {
+            break;
+        }
 
-        int bs = 2000 * samplesize;
-        ddb_waveformat_t fmt;
+        // wait until the previous analysis of this block is done
+        rg_block_t *block = &w->blocks[n % RG_NUM_BLOCKS];
+        dispatch_group_wait (block->group, DISPATCH_TIME_FOREVER);
 
-        buffer = malloc (bs);
+        block->buffer = _rg_ensure_buffer (block->buffer, &block->buffer_size, bs);
+        if (!is_float) {
+            block->bufferf = _rg_ensure_buffer (block->bufferf, &block->bufferf_size, RG_BLOCK_FRAMES * sizeof (float) * fileinfo->fmt.channels);
+        }
 
-        if (!fileinfo->fmt.is_float) {
-            bufferf = malloc (2000 * sizeof (float) * fileinfo->fmt.channels);
-            memcpy (&fmt, &fileinfo->fmt, sizeof (fmt));
-            fmt.bps = 32;
-            fmt.is_float = 1;
+        int sz = dec->read (fileinfo, block->buffer, bs); // read one block
+        if (sz != bs) {
+            eof = 1;
         }
-        else {
-            bufferf = (float *)buffer;
+        if (sz <= 0) {
+            break;
         }
 
-        int eof = 0;
-        for (;;) {
-            if (eof) {
-                break;
-            }
-            if (st->settings->pabort && *(st->settings->pabort)) {
-                break;
-            }
-
-            int sz = dec->read (fileinfo, buffer, bs); // read one block
-
-            dispatch_sync(st->sync_queue, ^{
-                int samplesize = fileinfo->fmt.channels * (fileinfo->fmt.bps >> 3);
-                int numsamples = sz / samplesize;
-                st->settings->cd_samples_processed += numsamples * 44100 / fileinfo->fmt.samplerate;
-            });
-
-            if (sz != bs) {
-                eof = 1;
+        int frames = sz / samplesize;
+        uint64_t cd_samples = (uint64_t)frames * 44100 / fileinfo->fmt.samplerate;
+        dispatch_async(ctx->sync_queue, ^{
+            settings->cd_samples_processed += cd_samples;
+            if (ctx->has_stats) {
+                settings->bytes_processed += sz;
             }
+        });
 
+        dispatch_group_async(block->group, w->analysis_queue, ^{
             // convert from native output to float,
             // only if the input is not float already
-            if (!fileinfo->fmt.is_float) {
-                deadbeef->pcm_convert (&fileinfo->fmt, buffer, &fmt, (char *)bufferf, sz);
+            float *bufferf = (float *)block->buffer;
+            if (!is_float) {
+                deadbeef->pcm_convert (infmt, block->buffer, &fmt, (char *)block->bufferf, sz);
+                bufferf = block->bufferf;
             }
+            ebur128_add_frames_float (state, bufferf, frames); // collect data
+        });
+    }
 
-            int frames = sz / samplesize;
-
-            ebur128_add_frames_float (st->gain_state[st->track_index], bufferf, frames); // collect data
-            ebur128_add_frames_float (st->peak_state[st->track_index], bufferf, frames); // collect data
-        }
-
-        if (!st->settings->pabort || !(*(st->settings->pabort))) {
-            // calculating track peak
-            // libEBUR128 calculates peak per channel, so we have to pick the highest value
-            double tr_peak = 0;
-            double ch_peak = 0;
-            int res;
-            for (int ch = 0; ch < fileinfo->fmt.channels; ++ch) {
-                res = ebur128_sample_peak (st->peak_state[st->track_index], ch, &ch_peak);
-                //trace ("rg_scanner: peak for ch %d: %f\n", ch, ch_peak);
-                if (ch_peak > tr_peak) {
-                    //trace ("rg_scanner: %f > %f\n", ch_peak, tr_peak);
-                    tr_peak = ch_peak;
-                }
+    // wait for the analysis to finish
+    dispatch_sync(w->analysis_queue, ^{});
+
+    if (!_rg_aborted (settings)) {
+        // calculating track peak
+        // libEBUR128 calculates peak per channel, so we have to pick the highest value
+        double tr_peak = 0;
+        double ch_peak = 0;
+        for (int ch = 0; ch < fileinfo->fmt.channels; ++ch) {
+            ebur128_sample_peak (state, ch, &ch_peak);
+            if (ch_peak > tr_peak) {
+                tr_peak = ch_peak;
             }
+        }
 
-            st->settings->results[st->track_index].track_peak = (float) tr_peak;
-
-            // calculate track loudness
-            double loudness = st->settings->ref_loudness;
-            ebur128_loudness_global (st->gain_state[st->track_index], &loudness);
-            /*
-             * EBUR128 sets the target level to -23 LUFS = 84dB
-             * -> -23 - loudness = track gain to get to 84dB
-             *
-             * The old implementation of RG used 89dB, most people still use that
-             * -> the above + (loudness - 84) = track gain to get to 89dB (or user specified)
-             */
-            if (loudness != -HUGE_VAL) {
-                st->settings->results[st->track_index].track_gain = -23 - loudness + st->settings->ref_loudness - 84;
-            }
+        settings->results[track_index].track_peak = (float) tr_peak;
+
+        // calculate track loudness
+        double loudness = settings->ref_loudness;
+        ebur128_loudness_global (state, &loudness);
+        /*
+         * EBUR128 sets the target level to -23 LUFS = 84dB
+         * -> -23 - loudness = track gain to get to 84dB
+         *
+         * The old implementation of RG used 89dB, most people still use that
+         * -> the above + (loudness - 84) = track gain to get to 89dB (or user specified)
+         */
+        if (loudness != -HUGE_VAL) {
+            settings->results[track_index].track_gain = -23 - loudness + settings->ref_loudness - 84;
         }
     }
 
@@ -217,213 +273,225 @@ error:
     if (fileinfo) {
         dec->free (fileinfo);
     }
-
-    if (buffer && buffer != (char *)bufferf) {
-        free (buffer);
-        buffer = NULL;
-    }
-
-    if (bufferf) {
-        free (bufferf);
-        bufferf = NULL;
-    }
 }
 
-static int
-_update_album_gain (ddb_rg_scanner_settings_t *settings, int i, int album_start, char *current_album, char *album, double loudness, ebur128_state **gain_state) {
-    if (strcmp (album, current_album)) {
-        if (i > 0) {
-            // update current album gain/peak
-            float album_peak = 0;
-
-            for (int n = album_start; n < i; ++n) {
-                if (album_peak < settings->results[n].track_peak) {
-                    album_peak = settings->results[n].track_peak;
-                }
-            }
+// Called on sync_queue, when all tracks of the album have been scanned.
+// Calculates album gain and peak, and releases the loudness states of the album tracks.
+static void
+_rg_finish_album (rg_scan_ctx_t *ctx, rg_album_t *album) {
+    ddb_rg_scanner_settings_t *settings = ctx->settings;
+    float album_peak = 0;
+    int count = 0;
+    ebur128_state **states = malloc (album->num_tracks * sizeof (ebur128_state *));
+
+    for (int n = album->first_track; n < album->first_track + album->num_tracks; ++n) {
+        if (album_peak < settings->results[n].track_peak) {
+            album_peak = settings->results[n].track_peak;
+        }
+        // failed tracks don't have states
+        if (ctx->states[n]) {
+            states[count++] = ctx->states[n];
+            ctx->states[n] = NULL;
+        }
+    }
 
-            // calculate gain of all tracks of the current album
-            ebur128_loudness_global_multiple(&gain_state[album_start], (size_t)i-album_start, &loudness);
+    if (count > 0) {
+        // calculate gain of all tracks of the album
+        double loudness = settings->ref_loudness;
+        ebur128_loudness_global_multiple(states, (size_t)count, &loudness);
 
-            float album_gain = -23 - (float)loudness + settings->ref_loudness - 84;
+        float album_gain = -23 - (float)loudness + settings->ref_loudness - 84;
 
-            for (int n = album_start; n < i; ++n) {
-                settings->results[n].album_gain = album_gain;
-                settings->results[n].album_peak = album_peak;
-            }
+        for (int n = album->first_track; n < album->first_track + album->num_tracks; ++n) {
+            settings->results[n].album_gain = album_gain;
+            settings->results[n].album_peak = album_peak;
         }
-
-        // proceed to next album
-        strcpy (current_album, album);
-
-        //trace ("next album found %d -> %d\n", album_start, i);
-        return i;
     }
-    return album_start;
-}
 
-int
-rg_scan (ddb_rg_scanner_settings_t *settings) {
-    if (settings->_size != sizeof (ddb_rg_scanner_settings_t)) {
-        return -1;
+    for (int n = 0; n < count; n++) {
+        ebur128_destroy (&states[n]);
     }
+    free (states);
+}
 
-    if (settings->num_threads <= 0) {
-        settings->num_threads = 4;
+// Called on sync_queue
+static void
+_rg_track_finished (rg_scan_ctx_t *ctx, int track_index) {
+    ddb_rg_scanner_settings_t *settings = ctx->settings;
+    if (ctx->has_stats) {
+        settings->tracks_processed++;
     }
 
-    char *album_signature_tf = NULL;
-    if (settings->mode == DDB_RG_SCAN_MODE_ALBUMS_FROM_TAGS) {
-        album_signature_tf = deadbeef->tf_compile (album_signature);
-        deadbeef->sort_track_array (NULL, settings->tracks, settings->num_tracks, album_signature, DDB_SORT_ASCENDING);
+    int a = ctx->track_album[track_index];
+    if (a < 0) {
+        if (ctx->states[track_index]) {
+            ebur128_destroy (&ctx->states[track_index]);
+        }
+        return;
     }
 
-    //trace ("rg_scanner: using %d thread(s)\n", settings->num_threads);
-
-    ebur128_state **gain_state = NULL;
-    ebur128_state **peak_state = NULL;
-
-    if (settings->ref_loudness == 0) {
-        settings->ref_loudness = DDB_RG_SCAN_DEFAULT_LOUDNESS;
+    rg_album_t *album = &ctx->albums[a];
+    album->remaining--;
+    if (!album->remaining && !_rg_aborted (settings)) {
+        _rg_finish_album (ctx, album);
     }
+}
 
-    double loudness = settings->ref_loudness;
-
-    // allocate status array
-    gain_state = calloc (settings->num_tracks, sizeof (ebur128_state *));
-    peak_state = calloc (settings->num_tracks, sizeof (ebur128_state *));
-
-    track_state_t *track_states = calloc (settings->num_tracks, sizeof (track_state_t));
-
-    dispatch_semaphore_t semaphore = dispatch_semaphore_create(settings->num_threads);
-    dispatch_queue_t queue = dispatch_queue_create("rg_scanner", DISPATCH_QUEUE_CONCURRENT);
-    dispatch_queue_t sync_queue = dispatch_queue_create("rg_scanner_sync", 0);
-
-    // calculate gain for each track and album
-    for (int i = 0; i < settings->num_tracks; ++i) {
-        if (settings->progress_callback) {
-            settings->progress_callback (i, settings->progress_cb_user_data);
-        }
-
-        if (settings->pabort && *(settings->pabort)) {
-            // wait for remaining jobs / close semaphore
-            for (int i = 0; i < settings->num_threads; i++) {
-                dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+static void
+_rg_worker (rg_worker_t *w) {
+    rg_scan_ctx_t *ctx = w->ctx;
+    ddb_rg_scanner_settings_t *settings = ctx->settings;
+
+    for (;;) {
+        __block int track_index = -1;
+        dispatch_sync(ctx->sync_queue, ^{
+            if (ctx->next_track < settings->num_tracks && !_rg_aborted (settings)) {
+                track_index = ctx->next_track++;
             }
-            goto cleanup;
+        });
+        if (track_index < 0) {
+            break;
         }
 
-        // close semaphore before starting the next job
-        dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
-
-        // initialize arguments
-        track_states[i].track_index = i;
-        track_states[i].settings = settings;
-        track_states[i].gain_state = gain_state;
-        track_states[i].peak_state = peak_state;
-        track_states[i].sync_queue = sync_queue;
+        if (settings->progress_callback) {
+            settings->progress_callback (track_index, settings->progress_cb_user_data);
+        }
 
-        dispatch_async(queue, ^{
-            rg_calc_track(&track_states[i]);
+        rg_calc_track (w, track_index);
 
-            // open semaphore when the job is done
-            dispatch_semaphore_signal(semaphore);
+        dispatch_sync(ctx->sync_queue, ^{
+            _rg_track_finished (ctx, track_index);
         });
     }
+}
 
-    // wait for remaining jobs / close semaphore
-    for (int i = 0; i < settings->num_threads; i++) {
-        dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+// Splits the tracks into albums, according to the scan mode.
+static void
+_rg_init_albums (rg_scan_ctx_t *ctx) {
+    ddb_rg_scanner_settings_t *settings = ctx->settings;
+    ctx->track_album = malloc (settings->num_tracks * sizeof (int));
+    ctx->albums = calloc (settings->num_tracks, sizeof (rg_album_t));
+
+    if (settings->mode == DDB_RG_SCAN_MODE_SINGLE_ALBUM) {
+        ctx->num_albums = 1;
+        ctx->albums[0].num_tracks = settings->num_tracks;
+        ctx->albums[0].remaining = settings->num_tracks;
+        for (int i = 0; i < settings->num_tracks; i++) {
+            ctx->track_album[i] = 0;
+        }
     }
-
-    if (settings->mode == DDB_RG_SCAN_MODE_ALBUMS_FROM_TAGS) {
-        int album_start = -1;
+    else if (settings->mode == DDB_RG_SCAN_MODE_ALBUMS_FROM_TAGS) {
+        // the tracks are sorted by album
+        char *album_signature_tf = deadbeef->tf_compile (album_signature);
         char current_album[1000] = "";
         char album[1000];
 
-        ddb_tf_context_t ctx;
-        memset (&ctx, 0, sizeof (ctx));
-
-        ctx._size = sizeof (ctx);
-        ctx.plt = NULL;
-        ctx.idx = -1;
-        ctx.id = -1;
-
-        for (int i = 0; i <= settings->num_tracks; i++) {
-            // set album gain when the album change is detected
-            if (i < settings->num_tracks) {
-                ctx.it = settings->tracks[i];
-                deadbeef->tf_eval(&ctx, album_signature_tf, album, sizeof (album));
-            }
-            else {
-                *album = 0;
+        ddb_tf_context_t tf_ctx;
+        memset (&tf_ctx, 0, sizeof (tf_ctx));
+
+        tf_ctx._size = sizeof (tf_ctx);
+        tf_ctx.plt = NULL;
+        tf_ctx.idx = -1;
+        tf_ctx.id = -1;
+
+        for (int i = 0; i < settings->num_tracks; i++) {
+            tf_ctx.it = settings->tracks[i];
+            deadbeef->tf_eval (&tf_ctx, album_signature_tf, album, sizeof (album));
+            if (i == 0 || strcmp (album, current_album)) {
+                strcpy (current_album, album);
+                ctx->albums[ctx->num_albums].first_track = i;
+                ctx->num_albums++;
             }
-            album_start = _update_album_gain (settings, i, album_start, current_album, album, loudness, gain_state);
+            rg_album_t *a = &ctx->albums[ctx->num_albums-1];
+            a->num_tracks++;
+            a->remaining++;
+            ctx->track_album[i] = ctx->num_albums-1;
         }
+        deadbeef->tf_free (album_signature_tf);
     }
-
-    if (settings->mode == DDB_RG_SOURCE_MODE_ALBUM) {
-        float album_peak = 0;
-
-        for (int i = 0; i < settings->num_tracks; ++i) {
-            if (album_peak < settings->results[i].track_peak) {
-                album_peak = settings->results[i].track_peak;
-            }
+    else {
+        for (int i = 0; i < settings->num_tracks; i++) {
+            ctx->track_album[i] = -1;
         }
+    }
+}
 
-        // calculate gain of all tracks combined
-        ebur128_loudness_global_multiple(gain_state, (size_t)settings->num_tracks, &loudness);
+int
+rg_scan (ddb_rg_scanner_settings_t *settings) {
+    if (settings->_size != sizeof (ddb_rg_scanner_settings_t) && settings->_size != offsetof (ddb_rg_scanner_settings_t, bytes_processed)) {
+        return -1;
+    }
 
-        float album_gain = -23 - (float)loudness + settings->ref_loudness - 84;
+    if (settings->num_threads <= 0) {
+        settings->num_threads = 4;
+    }
 
-        for (int i = 0; i < settings->num_tracks; ++i) {
-            settings->results[i].album_gain = album_gain;
-            settings->results[i].album_peak = album_peak;
-        }
+    if (settings->mode == DDB_RG_SCAN_MODE_ALBUMS_FROM_TAGS) {
+        deadbeef->sort_track_array (NULL, settings->tracks, settings->num_tracks, album_signature, DDB_SORT_ASCENDING);
     }
 
-cleanup:
-    // It is assumed that semaphore is closed at this point,
-    // need to open before calling release.
-    for (int i = 0; i < settings->num_threads; i++) {
-        dispatch_semaphore_signal (semaphore);
+    if (settings->ref_loudness == 0) {
+        settings->ref_loudness = DDB_RG_SCAN_DEFAULT_LOUDNESS;
     }
-    dispatch_release(semaphore);
-    semaphore = NULL;
-    dispatch_release(queue);
-    queue = NULL;
-    dispatch_release(sync_queue);
-    sync_queue = NULL;
 
-    if (track_states) {
-        free (track_states);
-        track_states = NULL;
+    rg_scan_ctx_t ctx;
+    memset (&ctx, 0, sizeof (ctx));
+    ctx.settings = settings;
+    ctx.has_stats = settings->_size == sizeof (ddb_rg_scanner_settings_t);
+    if (ctx.has_stats) {
+        settings->bytes_processed = 0;
+        settings->tracks_processed = 0;
     }
+    ctx.states = calloc (settings->num_tracks, sizeof (ebur128_state *));
+    ctx.sync_queue = dispatch_queue_create("rg_scanner_sync", NULL);
+    _rg_init_albums (&ctx);
 
-    if (gain_state) {
-        for (int i = 0; i < settings->num_tracks; ++i) {
-            if (gain_state[i]) {
-                ebur128_destroy (&gain_state[i]);
-            }
+    int num_workers = settings->num_threads;
+    if (num_workers > settings->num_tracks) {
+        num_workers = settings->num_tracks;
+    }
+
+    rg_worker_t *workers = calloc (num_workers, sizeof (rg_worker_t));
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_queue_t queue = dispatch_queue_create("rg_scanner", DISPATCH_QUEUE_CONCURRENT);
+
+    for (int i = 0; i < num_workers; i++) {
+        rg_worker_t *w = &workers[i];
+        w->ctx = &ctx;
+        w->analysis_queue = dispatch_queue_create("rg_scanner_analysis", NULL);
+        for (int n = 0; n < RG_NUM_BLOCKS; n++) {
+            w->blocks[n].group = dispatch_group_create();
         }
-        free (gain_state);
-        gain_state = NULL;
+        dispatch_group_async(group, queue, ^{
+            _rg_worker (w);
+        });
     }
 
-    if (peak_state) {
-        for (int i = 0; i < settings->num_tracks; ++i) {
-            if (peak_state[i]) {
-                ebur128_destroy (&peak_state[i]);
-            }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+    for (int i = 0; i < num_workers; i++) {
+        rg_worker_t *w = &workers[i];
+        for (int n = 0; n < RG_NUM_BLOCKS; n++) {
+            dispatch_release(w->blocks[n].group);
+            free (w->blocks[n].buffer);
+            free (w->blocks[n].bufferf);
         }
-        free (peak_state);
-        peak_state = NULL;
+        dispatch_release(w->analysis_queue);
     }
+    free (workers);
+    dispatch_release(group);
+    dispatch_release(queue);
+    dispatch_release(ctx.sync_queue);
 
-    if (album_signature_tf) {
-        deadbeef->tf_free (album_signature_tf);
-        album_signature_tf = NULL;
+    // states of the unfinished albums are left after abort
+    for (int i = 0; i < settings->num_tracks; ++i) {
+        if (ctx.states[i]) {
+            ebur128_destroy (&ctx.states[i]);
+        }
     }
+    free (ctx.states);
+    free (ctx.albums);
+    free (ctx.track_album);
 
     return 0;
 }
@@ -518,12 +586,163 @@ rg_remove (DB_playItem_t *track) {
     return _rg_write_meta (track);
 }
 
+int
+rg_scan_playlist (ddb_playlist_t *plt, int mode, uint32_t flags, int num_threads, int *pabort) {
+    ddb_rg_scanner_settings_t settings;
+    memset (&settings, 0, sizeof (settings));
+    settings._size = sizeof (settings);
+    settings.mode = mode;
+    settings.num_threads = num_threads;
+    settings.pabort = pabort;
+    settings.ref_loudness = deadbeef->conf_get_float ("rg_scanner.target_db", DDB_RG_SCAN_DEFAULT_LOUDNESS);
+
+    if (!flags) {
+        flags = (1<<DDB_REPLAYGAIN_TRACKGAIN)|(1<<DDB_REPLAYGAIN_TRACKPEAK);
+        if (mode != DDB_RG_SCAN_MODE_TRACK) {
+            flags |= (1<<DDB_REPLAYGAIN_ALBUMGAIN)|(1<<DDB_REPLAYGAIN_ALBUMPEAK);
+        }
+    }
+
+    deadbeef->pl_lock ();
+    int count = deadbeef->plt_get_item_count (plt, PL_MAIN);
+    if (count <= 0) {
+        deadbeef->pl_unlock ();
+        return 0;
+    }
+    settings.tracks = calloc (count, sizeof (DB_playItem_t *));
+    DB_playItem_t *it = deadbeef->plt_get_first (plt, PL_MAIN);
+    while (it && settings.num_tracks < count) {
+        settings.tracks[settings.num_tracks++] = it;
+        it = deadbeef->pl_get_next (it, PL_MAIN);
+    }
+    if (it) {
+        deadbeef->pl_item_unref (it);
+    }
+    deadbeef->pl_unlock ();
+
+    settings.results = calloc (settings.num_tracks, sizeof (ddb_rg_scanner_result_t));
+
+    struct timeval start_tv, end_tv;
+    gettimeofday (&start_tv, NULL);
+
+    int res = rg_scan (&settings);
+
+    gettimeofday (&end_tv, NULL);
+    float elapsed = (end_tv.tv_sec - start_tv.tv_sec) + (end_tv.tv_usec - start_tv.tv_usec) / 1000000.f;
+
+    int failed = 0;
+    if (res == 0 && !(pabort && *pabort)) {
+        if (elapsed > 0) {
+            trace ("rg_scanner: scanned %d tracks in %0.2f sec: %0.2f tracks/sec, %0.2f MB/sec\n", settings.tracks_processed, elapsed, settings.tracks_processed / elapsed, settings.bytes_processed / elapsed / (1024 * 1024));
+        }
+        for (int i = 0; i < settings.num_tracks; i++) {
+            if (settings.results[i].scan_result != DDB_RG_SCAN_RESULT_SUCCESS) {
+                failed++;
+                continue;
+            }
+            if (rg_apply (settings.tracks[i], flags, settings.results[i].track_gain, settings.results[i].track_peak, settings.results[i].album_gain, settings.results[i].album_peak)) {
+                failed++;
+            }
+        }
+        deadbeef->plt_modified (plt);
+    }
+    else if (res != 0) {
+        failed = -1;
+    }
+
+    for (int i = 0; i < settings.num_tracks; i++) {
+        deadbeef->pl_item_unref (settings.tracks[i]);
+    }
+    free (settings.tracks);
+    free (settings.results);
+
+    return failed;
+}
+
+typedef struct {
+    ddb_playlist_t *plt;
+    int mode;
+    int num_threads;
+} rg_cmdline_job_t;
+
+static void
+_rg_cmdline_job (void *ctx) {
+    rg_cmdline_job_t *job = ctx;
+    int failed = rg_scan_playlist (job->plt, job->mode, 0, job->num_threads, NULL);
+    if (failed > 0) {
+        trace ("rg_scanner: %d tracks failed\n", failed);
+    }
+    deadbeef->pl_save_all ();
+    deadbeef->plt_unref (job->plt);
+    free (job);
+    deadbeef->background_job_decrement ();
+}
+
+// deadbeef --plugin=rg_scanner scan [track|album|albums] [--threads N]
+// Starts scanning the current playlist in background, and writes the tags.
+static int
+rg_exec_cmdline (const char *cmdline, int cmdline_size, ddb_response_t *response) {
+    const char *end = cmdline + cmdline_size;
+    int mode = DDB_RG_SCAN_MODE_ALBUMS_FROM_TAGS;
+    int num_threads = 0;
+    int have_command = 0;
+
+    for (const char *arg = cmdline; arg < end && *arg; arg += strlen (arg) + 1) {
+        if (!strcmp (arg, "scan")) {
+            have_command = 1;
+        }
+        else if (!strcmp (arg, "track")) {
+            mode = DDB_RG_SCAN_MODE_TRACK;
+        }
+        else if (!strcmp (arg, "album")) {
+            mode = DDB_RG_SCAN_MODE_SINGLE_ALBUM;
+        }
+        else if (!strcmp (arg, "albums")) {
+            mode = DDB_RG_SCAN_MODE_ALBUMS_FROM_TAGS;
+        }
+        else if (!strcmp (arg, "--threads") && arg + strlen (arg) + 1 < end) {
+            arg += strlen (arg) + 1;
+            num_threads = atoi (arg);
+        }
+        else {
+            have_command = 0;
+            break;
+        }
+    }
+
+    if (!have_command) {
+        char usage[] = "Usage: --plugin=rg_scanner scan [track|album|albums] [--threads N]\n";
+        response->append (response, usage, sizeof (usage) - 1);
+        return -1;
+    }
+
+    ddb_playlist_t *plt = deadbeef->plt_get_curr ();
+    if (!plt) {
+        char msg[] = "No current playlist\n";
+        response->append (response, msg, sizeof (msg) - 1);
+        return -1;
+    }
+
+    rg_cmdline_job_t *job = calloc (1, sizeof (rg_cmdline_job_t));
+    job->plt = plt;
+    job->mode = mode;
+    job->num_threads = num_threads;
+
+    deadbeef->background_job_increment ();
+    intptr_t tid = deadbeef->thread_start (_rg_cmdline_job, job);
+    deadbeef->thread_detach (tid);
+
+    char msg[] = "ReplayGain scan started\n";
+    response->append (response, msg, sizeof (msg) - 1);
+    return 0;
+}
+
 // plugin structure and info
 static ddb_rg_scanner_t plugin = {
     .misc.plugin.api_vmajor = DB_API_VERSION_MAJOR,
     .misc.plugin.api_vminor = DB_API_VERSION_MINOR,
     .misc.plugin.version_major = 1,
-    .misc.plugin.version_minor = 0,
+    .misc.plugin.version_minor = 1,
     .misc.plugin.flags = DDB_PLUGIN_FLAG_LOGGING,
     .misc.plugin.type = DB_PLUGIN_MISC,
     .misc.plugin.name = "ReplayGain Scanner",
@@ -558,9 +777,11 @@ static ddb_rg_scanner_t plugin = {
         "OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN\n"
         "THE SOFTWARE.\n",
     .misc.plugin.website = "http://deadbeef.sf.net",
+    .misc.plugin.exec_cmdline = rg_exec_cmdline,
     .scan = rg_scan,
     .apply = rg_apply,
-    .remove = rg_remove
+    .remove = rg_remove,
+    .scan_playlist = rg_scan_playlist,
 };
 
 DB_plugin_t *
@@ -83,6 +83,16 @@ typedef struct {
     // How many 44.1kHz samples of PCM data have been processed.
     // Set by the scanner, can be used in the progress callback, to calculate scanning speed.
     uint64_t cd_samples_processed;
+
+    // The fields below are available since rg_scanner 1.1.
+    // Older callers can set _size to offsetof (ddb_rg_scanner_settings_t, bytes_processed).
+
+    // How many bytes of decoded PCM data have been processed.
+    uint64_t bytes_processed;
+
+    // How many tracks have been completely processed.
+    // Unlike the index passed to the progress callback, this is only incremented after the track is done.
+    int tracks_processed;
 } ddb_rg_scanner_settings_t;
 
 typedef struct {
@@ -96,6 +106,14 @@ typedef struct {
     int (*apply) (DB_playItem_t *track, uint32_t flags, float track_gain, float track_peak, float album_gain, float album_peak);
 
     int (*remove) (DB_playItem_t *track);
+
+    // since rg_scanner 1.1
+
+    // Scans all tracks of the playlist, and writes the tags, without any UI.
+    // mode is one of DDB_RG_SCAN_MODE_*, flags are the same as in the apply function,
+    // num_threads can be 0 to use the default.
+    // Returns the number of tracks which failed to scan or write, or -1 on error.
+    int (*scan_playlist) (ddb_playlist_t *plt, int mode, uint32_t flags, int num_threads, int *pabort);
 } ddb_rg_scanner_t;
 
 #endif //__RG_SCANNER_H
@@ -32,13 +32,21 @@ typedef struct {
     REAL *w;
 } FFTCTX;
 
-typedef struct {
-    REAL *lires,*lires1,*lires2;
-    REAL *irest;
+struct SuperEqState_s;
+
+// Filter in the frequency domain, designed by equ_makeKernel.
+typedef struct SuperEqKernel_s {
+    REAL *ires; // tabsize values, or partitions spectra of 2*partsize values in the partitioned mode
+    float fs;
+    struct SuperEqState_s *state; // new buffers to use with this filter, if not NULL
+    struct SuperEqKernel_s *next;
+} SuperEqKernel;
+
+typedef struct SuperEqState_s {
     REAL *fsamples;
+    REAL *fsamples2; // the block filtered with next_kernel, for crossfading
     REAL *ditherbuf;
     int ditherptr;
-    volatile int chg_ires,cur_ires;
     int winlen,winlenbit,tabsize,nbufsamples;
     REAL *finbuf;
     REAL *outbuf;
@@ -48,15 +56,41 @@ typedef struct {
     int fft_bits;
     FFTCTX fftctx;
     float hm1, hm2;
+
+    // uniformly partitioned convolution, used if partsize is not 0:
+    // the input is processed in blocks of partsize samples,
+    // the filter is split into partitions of the same size
+    int partsize;
+    int partitions;
+    REAL *fdl; // spectra of the last `partitions` input blocks of each channel
+    int fdlpos;
+
+    SuperEqKernel *kernel;
+    SuperEqKernel *next_kernel; // crossfaded in over the next block, or the next two blocks in the overlap-add mode
+    int crossfading; // the first of the two overlap-add crossfade blocks was processed
+    SuperEqKernel *retired; // replaced kernel, to be freed by the caller
 } SuperEqState;
 
 void *paramlist_alloc (void);
 void paramlist_free (void *);
-void equ_makeTable(SuperEqState *state, float *lbc,void *param,float fs);
+
+// Designs the filter for the 18 band gains and the samplerate,
+// for states initialized with the same wb and partbits.
+// Doesn't use any state, and can be called from any thread.
+SuperEqKernel *equ_makeKernel (int wb, int partbits, float *lbc, void *param, float fs);
+void equ_freeKernel (SuperEqKernel *kernel);
+
+// Sets the filter to crossfade to at the next block, or the current filter if there's none.
+// Returns the kernel which was replaced without being used, or NULL.
+SuperEqKernel *equ_setKernel (SuperEqState *state, SuperEqKernel *kernel);
+
 int equ_modifySamples(SuperEqState *state, char *buf,int nsamples,int nch,int bps);
 int equ_modifySamples_float (SuperEqState *state, char *buf,int nsamples,int nch);
 void equ_clearbuf(SuperEqState *state);
-void equ_init(SuperEqState *state, int wb, int channels);
+
+// partbits is 0 for overlap-add over the whole window,
+// otherwise the partitioned mode is used with the partition size of 1<<partbits
+void equ_init(SuperEqState *state, int wb, int channels, int partbits);
 void equ_quit(SuperEqState *state);
 
 #ifdef __cplusplus
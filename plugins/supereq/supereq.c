@@ -26,40 +26,116 @@
 static DB_functions_t *deadbeef;
 static DB_dsp_t plugin;
 
+#define SUPEREQ_WB 10
+#define SUPEREQ_PARTBITS 7 // 128 samples per block in the low latency mode
+
 typedef struct {
     ddb_dsp_context_t ctx;
     float last_srate;
     int last_nch;
     float bands[18];
     float preamp;
-    void *paramsroot;
-    int params_changed;
+    int low_latency;
     uintptr_t mutex;
-    SuperEqState state;
+    uintptr_t cond;
+    intptr_t tid;
+    int quit;
+    int design_requested;
+    SuperEqKernel *ready; // designed filter, to be picked up by supereq_process
+    SuperEqKernel *retired; // filters replaced by supereq_process, to be freed by the worker
+    SuperEqState *state;
     int enabled;
 } ddb_supereq_ctx_t;
 
 void supereq_reset (ddb_dsp_context_t *ctx);
 
-void
-recalc_table (ddb_supereq_ctx_t *eq) {
-    void *params = paramlist_alloc ();
+// must be called with the mutex locked
+static void
+request_design (ddb_supereq_ctx_t *eq) {
+    eq->design_requested = 1;
+    deadbeef->cond_signal (eq->cond);
+}
 
-    deadbeef->mutex_lock (eq->mutex);
-    float bands_copy[18];
-    float srate = eq->last_srate;
-    memcpy (bands_copy, eq->bands, sizeof (eq->bands));
-    for (int i = 0; i < 18; i++) {
-        bands_copy[i] *= eq->preamp;
+static void
+retire_kernel (ddb_supereq_ctx_t *eq, SuperEqKernel *kernel) {
+    kernel->next = __atomic_load_n (&eq->retired, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n (&eq->retired, &kernel->next, kernel, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static void
+free_retired_kernels (ddb_supereq_ctx_t *eq) {
+    SuperEqKernel *kernel = __atomic_exchange_n (&eq->retired, NULL, __ATOMIC_ACQUIRE);
+    while (kernel) {
+        SuperEqKernel *next = kernel->next;
+        equ_freeKernel (kernel);
+        kernel = next;
     }
-    deadbeef->mutex_unlock (eq->mutex);
+}
 
-    equ_makeTable (&eq->state, bands_copy, params, srate);
+// Designs the filters off the streamer thread, the filter design takes much longer than processing a block.
+// When the channel count or the mode changes, the new buffers are prepared here too,
+// and passed to supereq_process together with the filter.
+static void
+supereq_worker (void *ctx) {
+    ddb_supereq_ctx_t *eq = ctx;
+    void *params = paramlist_alloc ();
 
     deadbeef->mutex_lock (eq->mutex);
-    paramlist_free (eq->paramsroot);
-    eq->paramsroot = params;
+    int nch = eq->last_nch;
+    int low_latency = eq->low_latency;
+    for (;;) {
+        while (!eq->quit && !eq->design_requested) {
+            deadbeef->cond_wait (eq->cond, eq->mutex);
+        }
+        if (eq->quit) {
+            break;
+        }
+        eq->design_requested = 0;
+
+        float bands_copy[18];
+        for (int i = 0; i < 18; i++) {
+            bands_copy[i] = eq->bands[i] * eq->preamp;
+        }
+        float srate = eq->last_srate;
+        int new_nch = eq->last_nch;
+        int new_low_latency = eq->low_latency;
+        deadbeef->mutex_unlock (eq->mutex);
+
+        free_retired_kernels (eq);
+
+        int partbits = new_low_latency ? SUPEREQ_PARTBITS : 0;
+        SuperEqKernel *kernel = equ_makeKernel (SUPEREQ_WB, partbits, bands_copy, params, srate);
+        if (kernel && (new_nch != nch || new_low_latency != low_latency)) {
+            kernel->state = calloc (1, sizeof (SuperEqState));
+            if (kernel->state) {
+                equ_init (kernel->state, SUPEREQ_WB, new_nch, partbits);
+                nch = new_nch;
+                low_latency = new_low_latency;
+            }
+            else {
+                // keep the current filter and buffers, the next design request tries again
+                equ_freeKernel (kernel);
+                kernel = NULL;
+            }
+        }
+        if (kernel) {
+            // replace the filter which wasn't picked up yet, keeping the new buffers if it had them
+            SuperEqKernel *prev = __atomic_exchange_n (&eq->ready, NULL, __ATOMIC_ACQ_REL);
+            if (prev) {
+                if (prev->state && !kernel->state) {
+                    kernel->state = prev->state;
+                    prev->state = NULL;
+                }
+                equ_freeKernel (prev);
+            }
+            __atomic_store_n (&eq->ready, kernel, __ATOMIC_RELEASE);
+        }
+
+        deadbeef->mutex_lock (eq->mutex);
+    }
     deadbeef->mutex_unlock (eq->mutex);
+
+    paramlist_free (params);
 }
 
 int
@@ -72,6 +148,44 @@ supereq_plugin_stop (void) {
     return 0;
 }
 
+// picks up the filter designed by the worker
+static void
+update_kernel (ddb_supereq_ctx_t *supereq) {
+    SuperEqKernel *kernel = __atomic_exchange_n (&supereq->ready, NULL, __ATOMIC_ACQ_REL);
+    if (!kernel) {
+        return;
+    }
+
+    if (!kernel->state) {
+        SuperEqKernel *skipped = equ_setKernel (supereq->state, kernel);
+        if (skipped) {
+            retire_kernel (supereq, skipped);
+        }
+        return;
+    }
+
+    // switch to the new buffers, the old ones are freed by the worker together with their filter
+    SuperEqState *state = kernel->state;
+    kernel->state = NULL;
+    equ_setKernel (state, kernel);
+
+    deadbeef->mutex_lock (supereq->mutex);
+    SuperEqState *old = supereq->state;
+    supereq->state = state;
+    deadbeef->mutex_unlock (supereq->mutex);
+
+    SuperEqKernel *carrier = old->kernel;
+    old->kernel = NULL;
+    if (carrier) {
+        carrier->state = old;
+        retire_kernel (supereq, carrier);
+    }
+    else {
+        equ_quit (old);
+        free (old);
+    }
+}
+
 int
 supereq_process (ddb_dsp_context_t *ctx, float *samples, int frames, int maxframes, ddb_waveformat_t *fmt, float *r) {
     ddb_supereq_ctx_t *supereq = (ddb_supereq_ctx_t *)ctx;
@@ -80,21 +194,29 @@ supereq_process (ddb_dsp_context_t *ctx, float *samples, int frames, int maxfram
             supereq_reset (ctx);
         }
         supereq->enabled = ctx->enabled;
-    }
-    if (supereq->params_changed) {
-        recalc_table (supereq);
-        supereq->params_changed = 0;
     }
 	if (supereq->last_srate != fmt->samplerate || supereq->last_nch != fmt->channels) {
         deadbeef->mutex_lock (supereq->mutex);
 		supereq->last_srate = fmt->samplerate;
 		supereq->last_nch = fmt->channels;
-        equ_init (&supereq->state, 10, fmt->channels);
-        recalc_table (supereq);
-		equ_clearbuf(&supereq->state);
+        request_design (supereq);
         deadbeef->mutex_unlock (supereq->mutex);
     }
-	equ_modifySamples_float(&supereq->state, (char *)samples,frames,fmt->channels);
+
+    update_kernel (supereq);
+
+    SuperEqState *state = supereq->state;
+    if (state->channels != fmt->channels || !state->kernel) {
+        // the buffers for the new channel count are not ready yet
+        return frames;
+    }
+
+	equ_modifySamples_float(state, (char *)samples,frames,fmt->channels);
+
+    if (state->retired) {
+        retire_kernel (supereq, state->retired);
+        state->retired = NULL;
+    }
 	return frames;
 }
 
@@ -109,8 +231,8 @@ supereq_set_band (ddb_dsp_context_t *ctx, int band, float value) {
     ddb_supereq_ctx_t *supereq = (ddb_supereq_ctx_t *)ctx;
     deadbeef->mutex_lock (supereq->mutex);
     supereq->bands[band] = value;
+    request_design (supereq);
     deadbeef->mutex_unlock (supereq->mutex);
-    supereq->params_changed = 1;
 }
 
 float
@@ -124,21 +246,32 @@ supereq_set_preamp (ddb_dsp_context_t *ctx, float value) {
     ddb_supereq_ctx_t *supereq = (ddb_supereq_ctx_t *)ctx;
     deadbeef->mutex_lock (supereq->mutex);
     supereq->preamp = value;
+    request_design (supereq);
+    deadbeef->mutex_unlock (supereq->mutex);
+}
+
+static void
+supereq_set_low_latency (ddb_dsp_context_t *ctx, int value) {
+    ddb_supereq_ctx_t *supereq = (ddb_supereq_ctx_t *)ctx;
+    deadbeef->mutex_lock (supereq->mutex);
+    if (supereq->low_latency != value) {
+        supereq->low_latency = value;
+        request_design (supereq);
+    }
     deadbeef->mutex_unlock (supereq->mutex);
-    supereq->params_changed = 1;
 }
 
 void
 supereq_reset (ddb_dsp_context_t *ctx) {
     ddb_supereq_ctx_t *supereq = (ddb_supereq_ctx_t *)ctx;
     deadbeef->mutex_lock (supereq->mutex);
-    equ_clearbuf(&supereq->state);
+    equ_clearbuf(supereq->state);
     deadbeef->mutex_unlock (supereq->mutex);
 }
 
 int
 supereq_num_params (void) {
-    return 19;
+    return 20;
 }
 
 static const char *bandnames[] = {
@@ -160,7 +293,8 @@ static const char *bandnames[] = {
     "7 kHz",
     "10 kHz",
     "14 kHz",
-    "20 kHz"
+    "20 kHz",
+    "Low latency"
 };
 
 const char *
@@ -189,6 +323,9 @@ supereq_set_param (ddb_dsp_context_t *ctx, int p, const char *val) {
     case 1 ... 18:
         supereq_set_band (ctx, p-1, db_to_amp (atof (val)));
         break;
+    case 19:
+        supereq_set_low_latency (ctx, atoi (val) ? 1 : 0);
+        break;
     default:
         fprintf (stderr, "supereq_set_param: invalid param index (%d)\n", p);
     }
@@ -203,6 +340,9 @@ supereq_get_param (ddb_dsp_context_t *ctx, int p, char *v, int sz) {
     case 1 ... 18:
         snprintf (v, sz, "%f", amp_to_db (supereq_get_band (ctx, p-1)));
         break;
+    case 19:
+        snprintf (v, sz, "%d", ((ddb_supereq_ctx_t *)ctx)->low_latency);
+        break;
     default:
         fprintf (stderr, "supereq_get_param: invalid param index (%d)\n", p);
     }
@@ -214,17 +354,23 @@ supereq_open (void) {
     ddb_supereq_ctx_t *supereq = malloc (sizeof (ddb_supereq_ctx_t));
     DDB_INIT_DSP_CONTEXT (supereq,ddb_supereq_ctx_t,&plugin);
 
-    equ_init (&supereq->state, 10, 2);
-    supereq->paramsroot = paramlist_alloc ();
+    supereq->state = calloc (1, sizeof (SuperEqState));
+    equ_init (supereq->state, SUPEREQ_WB, 2, 0);
     supereq->last_srate = 44100;
     supereq->last_nch = 2;
     supereq->mutex = deadbeef->mutex_create ();
+    supereq->cond = deadbeef->cond_create ();
     supereq->preamp = 1;
     for (int i = 0; i < 18; i++) {
         supereq->bands[i] = 1;
     }
-    recalc_table (supereq);
-    equ_clearbuf (&supereq->state);
+
+    // flat filter until the worker designs the real one
+    void *params = paramlist_alloc ();
+    equ_setKernel (supereq->state, equ_makeKernel (SUPEREQ_WB, 0, supereq->bands, params, supereq->last_srate));
+    paramlist_free (params);
+
+    supereq->tid = deadbeef->thread_start (supereq_worker, supereq);
 
     return (ddb_dsp_context_t*)supereq;
 }
@@ -232,16 +378,34 @@ supereq_open (void) {
 void
 supereq_close (ddb_dsp_context_t *ctx) {
     ddb_supereq_ctx_t *supereq = (ddb_supereq_ctx_t *)ctx;
+    if (supereq->tid) {
+        deadbeef->mutex_lock (supereq->mutex);
+        supereq->quit = 1;
+        deadbeef->cond_signal (supereq->cond);
+        deadbeef->mutex_unlock (supereq->mutex);
+        deadbeef->thread_join (supereq->tid);
+        supereq->tid = 0;
+    }
+    if (supereq->ready) {
+        equ_freeKernel (supereq->ready);
+        supereq->ready = NULL;
+    }
+    free_retired_kernels (supereq);
+    if (supereq->cond) {
+        deadbeef->cond_free (supereq->cond);
+        supereq->cond = 0;
+    }
     if (supereq->mutex) {
         deadbeef->mutex_free (supereq->mutex);
         supereq->mutex = 0;
     }
-    equ_quit (&supereq->state);
-    paramlist_free (supereq->paramsroot);
+    equ_quit (supereq->state);
+    free (supereq->state);
     free (ctx);
 }
 
 static const char settings_dlg[] =
+    "property \"\" vbox[2] fill expand border=0 spacing=8 height=-1;\n"
     "property \"\" hbox[19] hmg fill expand border=0 spacing=8 height=200 noclip itemwidth=30;\n"
         "property \"Preamp\" vscale[20,-20,0.5] vert 0 0;\n"
         "property \"55\" vscale[20,-20,0.5] vert 1 0;\n"
@@ -262,6 +426,7 @@ static const char settings_dlg[] =
         "property \"10K\" vscale[20,-20,0.5] vert 16 0;\n"
         "property \"14K\" vscale[20,-20,0.5] vert 17 0;\n"
         "property \"20K\" vscale[20,-20,0.5] vert 18 0;\n"
+    "property \"Low latency\" checkbox 19 0;\n"
 ;
 
 static DB_dsp_t plugin = {
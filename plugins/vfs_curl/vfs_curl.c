@@ -24,11 +24,17 @@
 #include <curl/curl.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <unistd.h>
 #include <errno.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <curl/curlver.h>
 #include <sys/time.h>
+#include <sys/stat.h>
 #include "vfs_curl.h"
 
 #define trace(...) { deadbeef->log_detailed (&plugin.plugin, 0, __VA_ARGS__); }
@@ -63,47 +69,446 @@ http_cancel_abort (uint64_t identifier);
 static void
 vfs_curl_abort_with_identifier (uint64_t identifier);
 
+// how long the waiting reader and writer sleep before re-checking the abort / timeout conditions
+#define WAIT_INTERVAL_MS 100
+
+// Must be called with fp->mutex held
+static void
+http_wait (HTTP_FILE *fp, int ms) {
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    struct timespec ts;
+    ts.tv_sec = tv.tv_sec + ms / 1000;
+    ts.tv_nsec = tv.tv_usec * 1000 + (ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait (&fp->cond, &fp->mutex, &ts);
+}
+
+// Must be called with fp->mutex held
+static void
+http_set_status (HTTP_FILE *fp, uint8_t status) {
+    fp->status = status;
+    pthread_cond_broadcast (&fp->cond);
+}
+
+#pragma mark - Disk cache
+
+// The disk cache keeps the seekable (non-ICY) resources of known length
+// in $CACHE/vfs_curl/<url hash>/, as an "info" file with the length, content type and validators
+// (ETag and Last-Modified), and the data split into CACHE_SEGMENT_SIZE segments, stored once complete.
+// The mtime of the info file is used for evicting the least recently used entries.
+// The resource is always requested from the server, and the cached segments are only used
+// after the response matched the stored length and validators.
+// Responses without any validators are not cached.
+
+static uint64_t
+http_cache_hash (const char *s) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (const uint8_t *p = (const uint8_t *)s; *p; p++) {
+        h ^= *p;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static int
+http_cache_root (char *path, size_t size) {
+    const char *root = deadbeef->get_system_dir (DDB_SYS_DIR_CACHE);
+    if (!root || !*root) {
+        return -1;
+    }
+    snprintf (path, size, "%s/vfs_curl", root);
+    return 0;
+}
+
+static char *
+http_cache_path_for_url (const char *url) {
+    if (!deadbeef->conf_get_int ("vfs_curl.cache", 0) || deadbeef->conf_get_int ("vfs_curl.cache_size", 256) <= 0) {
+        return NULL;
+    }
+    char root[PATH_MAX];
+    if (http_cache_root (root, sizeof (root))) {
+        return NULL;
+    }
+    char path[PATH_MAX];
+    snprintf (path, sizeof (path), "%s/%016" PRIx64, root, http_cache_hash (url));
+    return strdup (path);
+}
+
+static void
+http_cache_read_line (FILE *f, char *out, size_t size) {
+    *out = 0;
+    if (fgets (out, (int)size, f)) {
+        out[strcspn (out, "\r\n")] = 0;
+    }
+}
+
+// returns the cached length, or -1;
+// the content type and the validators are returned in the buffers of CACHE_INFO_LINE_SIZE, which can be NULL
+static int64_t
+http_cache_read_info (const char *cache_path, char *content_type, char *etag, char *last_modified) {
+    char path[PATH_MAX];
+    snprintf (path, sizeof (path), "%s/info", cache_path);
+    FILE *f = fopen (path, "rt");
+    if (!f) {
+        return -1;
+    }
+    char line[CACHE_INFO_LINE_SIZE];
+    http_cache_read_line (f, line, sizeof (line));
+    int64_t length = atoll (line);
+    http_cache_read_line (f, content_type ? content_type : line, sizeof (line));
+    http_cache_read_line (f, etag ? etag : line, sizeof (line));
+    http_cache_read_line (f, last_modified ? last_modified : line, sizeof (line));
+    fclose (f);
+    return length > 0 ? length : -1;
+}
+
+static int
+http_cache_write_info (const char *cache_path, HTTP_FILE *fp) {
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    snprintf (path, sizeof (path), "%s/info", cache_path);
+    snprintf (tmp, sizeof (tmp), "%s.%" PRIu64 ".part", path, fp->identifier);
+    FILE *f = fopen (tmp, "wt");
+    if (!f) {
+        return -1;
+    }
+    fprintf (f, "%" PRId64 "\n%s\n%s\n%s\n", fp->length,
+             fp->content_type ? fp->content_type : "",
+             fp->etag ? fp->etag : "",
+             fp->last_modified ? fp->last_modified : "");
+    if (fclose (f) || rename (tmp, path)) {
+        unlink (tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// removes all files in the entry folder; returns the number of bytes freed
+static int64_t
+http_cache_clear_dir (const char *cache_path, int remove_dir) {
+    int64_t freed = 0;
+    DIR *dir = opendir (cache_path);
+    if (!dir) {
+        return 0;
+    }
+    struct dirent *entry;
+    while ((entry = readdir (dir))) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char path[PATH_MAX];
+        snprintf (path, sizeof (path), "%s/%s", cache_path, entry->d_name);
+        struct stat st;
+        if (!stat (path, &st)) {
+            freed += st.st_size;
+        }
+        (void)unlink (path);
+    }
+    closedir (dir);
+    if (remove_dir) {
+        (void)rmdir (cache_path);
+    }
+    return freed;
+}
+
+typedef struct {
+    char path[PATH_MAX];
+    time_t mtime;
+    int64_t size;
+} http_cache_entry_t;
+
+static int
+http_cache_entry_cmp (const void *a, const void *b) {
+    const http_cache_entry_t *ea = a;
+    const http_cache_entry_t *eb = b;
+    return ea->mtime < eb->mtime ? -1 : ea->mtime > eb->mtime ? 1 : 0;
+}
+
+static int64_t
+http_cache_dir_size (const char *cache_path) {
+    int64_t size = 0;
+    DIR *dir = opendir (cache_path);
+    if (!dir) {
+        return 0;
+    }
+    struct dirent *entry;
+    while ((entry = readdir (dir))) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char path[PATH_MAX];
+        snprintf (path, sizeof (path), "%s/%s", cache_path, entry->d_name);
+        struct stat st;
+        if (!stat (path, &st)) {
+            size += st.st_size;
+        }
+    }
+    closedir (dir);
+    return size;
+}
+
+// evicts the least recently used entries, until the cache fits into vfs_curl.cache_size
+static void
+http_cache_trim (const char *keep_path) {
+    int64_t limit = (int64_t)deadbeef->conf_get_int ("vfs_curl.cache_size", 256) * 1024 * 1024;
+    char root[PATH_MAX];
+    if (http_cache_root (root, sizeof (root))) {
+        return;
+    }
+    DIR *dir = opendir (root);
+    if (!dir) {
+        return;
+    }
+
+    http_cache_entry_t *entries = NULL;
+    int count = 0;
+    int reserved = 0;
+    int64_t total = 0;
+    struct dirent *d;
+    while ((d = readdir (dir))) {
+        if (d->d_name[0] == '.') {
+            continue;
+        }
+        if (count == reserved) {
+            reserved = reserved ? reserved * 2 : 32;
+            http_cache_entry_t *newentries = realloc (entries, reserved * sizeof (http_cache_entry_t));
+            if (!newentries) {
+                break;
+            }
+            entries = newentries;
+        }
+        http_cache_entry_t *e = &entries[count];
+        snprintf (e->path, sizeof (e->path), "%s/%s", root, d->d_name);
+        char info[PATH_MAX];
+        snprintf (info, sizeof (info), "%s/info", e->path);
+        struct stat st;
+        e->mtime = stat (info, &st) ? 0 : st.st_mtime;
+        e->size = http_cache_dir_size (e->path);
+        total += e->size;
+        count++;
+    }
+    closedir (dir);
+
+    if (total > limit) {
+        qsort (entries, count, sizeof (http_cache_entry_t), http_cache_entry_cmp);
+        for (int i = 0; i < count && total > limit; i++) {
+            if (keep_path && !strcmp (entries[i].path, keep_path)) {
+                continue;
+            }
+            trace ("vfs_curl: evicting cache entry %s (%" PRId64 " bytes)\n", entries[i].path, entries[i].size);
+            total -= http_cache_clear_dir (entries[i].path, 1);
+        }
+    }
+    free (entries);
+}
+
+// Returns 1 if the cached entry was made from the same version of the resource as the current response
+static int
+http_cache_is_current (HTTP_FILE *fp) {
+    char etag[CACHE_INFO_LINE_SIZE];
+    char last_modified[CACHE_INFO_LINE_SIZE];
+    int64_t length = http_cache_read_info (fp->cache_path, NULL, etag, last_modified);
+    if (length != fp->length) {
+        return 0;
+    }
+    if (!*etag && !*last_modified) {
+        return 0;
+    }
+    if (*etag && (!fp->etag || strcmp (etag, fp->etag))) {
+        return 0;
+    }
+    if (*last_modified && (!fp->last_modified || strcmp (last_modified, fp->last_modified))) {
+        return 0;
+    }
+    return 1;
+}
+
+// Called from the streamer thread when the body of a response starts
+static void
+http_cache_begin (HTTP_FILE *fp) {
+    pthread_mutex_lock (&fp->mutex);
+    fp->cache_started = 0;
+    fp->cache_valid = 0;
+    pthread_mutex_unlock (&fp->mutex);
+    fp->segment_index = -1;
+    fp->segment_fill = 0;
+    if (!fp->cache_path || fp->length <= 0 || fp->icyheader || fp->icy_metaint > 0) {
+        return;
+    }
+    if (!fp->etag && !fp->last_modified) {
+        // can't tell whether it changed next time
+        return;
+    }
+
+    if (!http_cache_is_current (fp)) {
+        // new or changed resource
+        char root[PATH_MAX];
+        if (http_cache_root (root, sizeof (root))) {
+            return;
+        }
+        (void)mkdir (root, 0755);
+        (void)mkdir (fp->cache_path, 0755);
+        http_cache_clear_dir (fp->cache_path, 0);
+        if (http_cache_write_info (fp->cache_path, fp)) {
+            trace ("vfs_curl: failed to create cache entry %s\n", fp->cache_path);
+            return;
+        }
+        http_cache_trim (fp->cache_path);
+    }
+    else {
+        trace ("vfs_curl: %s is in the disk cache, length %" PRId64 "\n", fp->url, fp->length);
+        // mark as recently used
+        char path[PATH_MAX];
+        snprintf (path, sizeof (path), "%s/info", fp->cache_path);
+        (void)utimes (path, NULL);
+    }
+    if (!fp->segment) {
+        fp->segment = malloc (CACHE_SEGMENT_SIZE);
+        if (!fp->segment) {
+            return;
+        }
+    }
+    pthread_mutex_lock (&fp->mutex);
+    fp->cache_started = 1;
+    fp->cache_valid = 1;
+    pthread_cond_broadcast (&fp->cond);
+    pthread_mutex_unlock (&fp->mutex);
+}
+
+static void
+http_cache_flush_segment (HTTP_FILE *fp) {
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    snprintf (path, sizeof (path), "%s/%" PRId64 ".seg", fp->cache_path, fp->segment_index);
+    snprintf (tmp, sizeof (tmp), "%s.%" PRIu64 ".part", path, fp->identifier);
+    FILE *f = fopen (tmp, "wb");
+    if (!f) {
+        trace ("vfs_curl: failed to write cache segment %s\n", tmp);
+        return;
+    }
+    size_t res = fwrite (fp->segment, 1, fp->segment_fill, f);
+    int err = fclose (f);
+    if (res != fp->segment_fill || err || rename (tmp, path)) {
+        (void)unlink (tmp);
+        return;
+    }
+    if (++fp->nflushed % 64 == 0) {
+        http_cache_trim (fp->cache_path);
+    }
+}
+
+// Collects the network data into segments, and writes each complete segment to disk.
+// Segments which were not received from the start are skipped.
+// Called from the streamer thread, without holding fp->mutex.
+static void
+http_cache_store (HTTP_FILE *fp, int64_t offset, const uint8_t *ptr, size_t size) {
+    while (size > 0) {
+        int64_t index = offset / CACHE_SEGMENT_SIZE;
+        size_t segoffs = (size_t)(offset - index * CACHE_SEGMENT_SIZE);
+        size_t chunk = min (size, CACHE_SEGMENT_SIZE - segoffs);
+
+        if (index != fp->segment_index || fp->segment_fill != segoffs) {
+            fp->segment_index = index;
+            fp->segment_fill = 0;
+        }
+        if (fp->segment_fill == segoffs) {
+            memcpy (fp->segment + segoffs, ptr, chunk);
+            fp->segment_fill += chunk;
+            int64_t segsize = min (CACHE_SEGMENT_SIZE, fp->length - index * CACHE_SEGMENT_SIZE);
+            if ((int64_t)fp->segment_fill >= segsize) {
+                http_cache_flush_segment (fp);
+                fp->segment_index = -1;
+                fp->segment_fill = 0;
+            }
+        }
+        offset += chunk;
+        ptr += chunk;
+        size -= chunk;
+    }
+}
+
+// Reads up to the end of the segment containing the offset,
+// returns 0 if the segment is not cached.
+static size_t
+http_cache_read (HTTP_FILE *fp, int64_t offset, uint8_t *ptr, size_t size) {
+    int64_t index = offset / CACHE_SEGMENT_SIZE;
+    if (index != fp->cache_fd_index) {
+        if (fp->cache_fd >= 0) {
+            close (fp->cache_fd);
+        }
+        char path[PATH_MAX];
+        snprintf (path, sizeof (path), "%s/%" PRId64 ".seg", fp->cache_path, index);
+        fp->cache_fd = open (path, O_RDONLY);
+        fp->cache_fd_index = index;
+    }
+    if (fp->cache_fd < 0) {
+        return 0;
+    }
+    off_t segoffs = (off_t)(offset - index * CACHE_SEGMENT_SIZE);
+    size = min (size, CACHE_SEGMENT_SIZE - (size_t)segoffs);
+    if (lseek (fp->cache_fd, segoffs, SEEK_SET) != segoffs) {
+        return 0;
+    }
+    ssize_t res = read (fp->cache_fd, ptr, size);
+    return res > 0 ? (size_t)res : 0;
+}
+
+#pragma mark -
+
 static size_t
 http_curl_write_wrapper (HTTP_FILE *fp, void *ptr, size_t size) {
     size_t avail = size;
+    pthread_mutex_lock (&fp->mutex);
     while (avail > 0) {
-        deadbeef->mutex_lock (fp->mutex);
         if (fp->status == STATUS_SEEK) {
             trace ("vfs_curl seek request, aborting current request\n");
-            deadbeef->mutex_unlock (fp->mutex);
+            pthread_mutex_unlock (&fp->mutex);
             return 0;
         }
         if (http_need_abort (fp->identifier)) {
-            fp->status = STATUS_ABORTED;
+            http_set_status (fp, STATUS_ABORTED);
             trace ("vfs_curl STATUS_ABORTED in the middle of packet\n");
-            deadbeef->mutex_unlock (fp->mutex);
             break;
         }
         int sz = BUFFER_SIZE/2 - fp->remaining; // number of bytes free in buffer
                                                 // don't allow to fill more than half -- used for seeking backwards
 
-        if (sz > 5000) { // wait until there are at least 5k bytes free
-            size_t cp = min (avail, sz);
-            int writepos = (fp->pos + fp->remaining) & BUFFER_MASK;
-            // copy 1st portion (before end of buffer
-            size_t part1 = BUFFER_SIZE - writepos;
-            // may not be more than total
-            part1 = min (part1, cp);
-            memcpy (fp->buffer+writepos, ptr, part1);
-            ptr += part1;
-            avail -= part1;
-            fp->remaining += part1;
-            cp -= part1;
-            if (cp > 0) {
-                memcpy (fp->buffer, ptr, cp);
-                ptr += cp;
-                avail -= cp;
-                fp->remaining += cp;
-            }
+        if (sz <= 5000) { // wait until there are at least 5k bytes free
+            http_wait (fp, WAIT_INTERVAL_MS);
+            continue;
+        }
+        size_t cp = min (avail, sz);
+        int64_t offset = fp->pos + fp->remaining;
+        uint8_t *data = ptr;
+        int writepos = offset & BUFFER_MASK;
+        // copy 1st portion (before end of buffer
+        size_t part1 = BUFFER_SIZE - writepos;
+        // may not be more than total
+        part1 = min (part1, cp);
+        memcpy (fp->buffer+writepos, ptr, part1);
+        ptr += part1;
+        avail -= part1;
+        fp->remaining += part1;
+        size_t part2 = cp - part1;
+        if (part2 > 0) {
+            memcpy (fp->buffer, ptr, part2);
+            ptr += part2;
+            avail -= part2;
+            fp->remaining += part2;
+        }
+        pthread_cond_broadcast (&fp->cond);
+
+        if (fp->cache_started) {
+            pthread_mutex_unlock (&fp->mutex);
+            http_cache_store (fp, offset, data, cp);
+            pthread_mutex_lock (&fp->mutex);
         }
-        deadbeef->mutex_unlock (fp->mutex);
-        usleep (3000);
     }
+    pthread_mutex_unlock (&fp->mutex);
     return size - avail;
 }
 
@@ -244,6 +649,8 @@ http_stream_reset (HTTP_FILE *fp) {
     fp->gotheader = 0;
     fp->icyheader = 0;
     fp->gotsomeheader = 0;
+    // keep the read position: the restarted request continues from it
+    fp->pos += fp->skipbytes;
     fp->remaining = 0;
     fp->metadata_size = 0;
     fp->metadata_have_size = 0;
@@ -343,7 +750,29 @@ http_content_header_handler_int (const void *ptr, size_t size, void *stream, int
             fp->content_type = strdup ((char *)value);
         }
         else if (!strcasecmp ((char *)key, "Content-Length")) {
-            fp->length = atoi ((char *)value);
+            int64_t length = atoll ((char *)value);
+            // partial content length is counted from the requested offset
+            fp->length = fp->http_code == 206 ? fp->range_start + length : length;
+        }
+        else if (!strcasecmp ((char *)key, "Content-Range")) {
+            // bytes <first>-<last>/<total>
+            const char *total = strchr ((char *)value, '/');
+            if (total && total[1] != '*') {
+                fp->length = atoll (total + 1);
+            }
+        }
+        else if (!strcasecmp ((char *)key, "ETag")) {
+            free (fp->etag);
+            fp->etag = strdup ((char *)value);
+        }
+        else if (!strcasecmp ((char *)key, "Last-Modified")) {
+            free (fp->last_modified);
+            fp->last_modified = strdup ((char *)value);
+        }
+        else if (!strcasecmp ((char *)key, "Accept-Ranges")) {
+            if (!strcasecmp ((char *)value, "none")) {
+                fp->no_ranges = 1;
+            }
         }
         else if (!strcasecmp ((char *)key, "icy-name")) {
             if (fp->track) {
@@ -527,7 +956,9 @@ http_curl_write (void *_ptr, size_t size, size_t nmemb, void *stream) {
 //    trace ("http_curl_write %d bytes, wait_meta=%d\n", size * nmemb, fp->wait_meta);
     gettimeofday (&fp->last_read_time, NULL);
     if (http_need_abort (fp->identifier)) {
-        fp->status = STATUS_ABORTED;
+        pthread_mutex_lock (&fp->mutex);
+        http_set_status (fp, STATUS_ABORTED);
+        pthread_mutex_unlock (&fp->mutex);
         trace ("vfs_curl STATUS_ABORTED at start of packet\n");
         return 0;
     }
@@ -542,11 +973,28 @@ http_curl_write (void *_ptr, size_t size, size_t nmemb, void *stream) {
         }
     }
 
-    deadbeef->mutex_lock (fp->mutex);
+    int body_started = 0;
+    pthread_mutex_lock (&fp->mutex);
     if (fp->status == STATUS_INITIAL && fp->gotheader) {
-        fp->status = STATUS_READING;
+        http_set_status (fp, STATUS_READING);
+        body_started = 1;
+    }
+    pthread_mutex_unlock (&fp->mutex);
+
+    if (body_started) {
+        http_cache_begin (fp);
+    }
+
+    // the server ignored the range request, and sends the resource from the beginning
+    if (fp->discard > 0) {
+        size_t n = (size_t)min ((int64_t)avail, fp->discard);
+        fp->discard -= n;
+        avail -= n;
+        ptr += n;
+        if (!avail) {
+            return nmemb*size;
+        }
     }
-    deadbeef->mutex_unlock (fp->mutex);
 
     int error = 0;
     size_t consumed = _handle_icy_metadata (avail, fp, ptr, &error);
@@ -566,16 +1014,43 @@ http_curl_write (void *_ptr, size_t size, size_t nmemb, void *stream) {
     return nmemb * size - avail;
 }
 
+static void
+http_handle_status_line (HTTP_FILE *fp, const char *ptr, size_t size) {
+    // HTTP/<version> <code> <reason>
+    char line[100];
+    size = min (size, sizeof (line) - 1);
+    memcpy (line, ptr, size);
+    line[size] = 0;
+    const char *code = strchr (line, ' ');
+    fp->http_code = code ? atol (code + 1) : 0;
+    fp->discard = 0;
+    free (fp->etag);
+    fp->etag = NULL;
+    free (fp->last_modified);
+    fp->last_modified = NULL;
+    if (fp->http_code == 200 && fp->range_start > 0) {
+        trace ("vfs_curl: server ignored the range request, skipping %" PRId64 " bytes\n", fp->range_start);
+        fp->discard = fp->range_start;
+        fp->no_ranges = 1;
+    }
+}
+
 static size_t
 http_content_header_handler (void *ptr, size_t size, size_t nmemb, void *stream) {
+    size_t avail = size * nmemb;
+    if (avail > 5 && !memcmp (ptr, "HTTP/", 5)) {
+        // every response (including redirects) starts with a status line
+        http_handle_status_line (stream, ptr, avail);
+        return avail;
+    }
     int end = 0;
-    return http_content_header_handler_int (ptr, size*nmemb, stream, &end);
+    return http_content_header_handler_int (ptr, avail, stream, &end);
 }
 
 static int
 http_curl_control (void *stream, double dltotal, double dlnow, double ultotal, double ulnow) {
     HTTP_FILE *fp = (HTTP_FILE *)stream;
-    deadbeef->mutex_lock (fp->mutex);
+    pthread_mutex_lock (&fp->mutex);
 
     struct timeval tm;
     gettimeofday (&tm, NULL);
@@ -587,20 +1062,20 @@ http_curl_control (void *stream, double dltotal, double dlnow, double ultotal, d
         trace ("http_curl_control: timed out, restarting read\n");
         memcpy (&fp->last_read_time, &tm, sizeof (struct timeval));
         http_stream_reset (fp);
-        fp->status = STATUS_SEEK;
+        http_set_status (fp, STATUS_SEEK);
     }
     else if (fp->status == STATUS_SEEK) {
         trace ("vfs_curl STATUS_SEEK in progress callback\n");
-        deadbeef->mutex_unlock (fp->mutex);
+        pthread_mutex_unlock (&fp->mutex);
         return -1;
     }
     if (http_need_abort (fp->identifier)) {
-        fp->status = STATUS_ABORTED;
+        http_set_status (fp, STATUS_ABORTED);
         trace ("vfs_curl STATUS_ABORTED in progress callback\n");
-        deadbeef->mutex_unlock (fp->mutex);
+        pthread_mutex_unlock (&fp->mutex);
         return -1;
     }
-    deadbeef->mutex_unlock (fp->mutex);
+    pthread_mutex_unlock (&fp->mutex);
     return 0;
 }
 
@@ -615,8 +1090,18 @@ vfs_curl_free_file (HTTP_FILE *fp) {
     if (fp->url) {
         free (fp->url);
     }
-    if (fp->mutex) {
-        deadbeef->mutex_free (fp->mutex);
+    if (fp->cache_path) {
+        if (fp->cache_fd >= 0) {
+            close (fp->cache_fd);
+        }
+        free (fp->cache_path);
+    }
+    free (fp->segment);
+    free (fp->etag);
+    free (fp->last_modified);
+    if (fp->sync_initialized) {
+        pthread_cond_destroy (&fp->cond);
+        pthread_mutex_destroy (&fp->mutex);
     }
     free (fp);
 }
@@ -626,8 +1111,10 @@ http_thread_func (void *ctx) {
     HTTP_FILE *fp = (HTTP_FILE *)ctx;
     CURL *curl;
     curl = curl_easy_init ();
-    fp->length = -1;
-    fp->status = STATUS_INITIAL;
+    if (fp->length == 0) {
+        // not known yet (a restarted streamer keeps the length of the previous request)
+        fp->length = -1;
+    }
     fp->curl = curl;
 
     int status;
@@ -666,9 +1153,22 @@ http_thread_func (void *ctx) {
 #ifdef __MINGW32__
         curl_easy_setopt (curl,CURLOPT_CAINFO, getenv("CURL_CA_BUNDLE"));
 #endif
+        pthread_mutex_lock (&fp->mutex);
+        fp->range_start = 0;
+        fp->discard = 0;
+        fp->http_code = 0;
+        char range[30];
         if (fp->pos > 0 && fp->length >= 0) {
-            curl_easy_setopt (curl, CURLOPT_RESUME_FROM, (long)fp->pos);
+            // ask for the remaining bytes only;
+            // unlike CURLOPT_RESUME_FROM this doesn't fail when the server ignores the range
+            fp->range_start = fp->pos;
+            if (!fp->no_ranges) {
+                snprintf (range, sizeof (range), "%" PRId64 "-", fp->pos);
+                curl_easy_setopt (curl, CURLOPT_RANGE, range);
+            }
+            // otherwise the response starts from the beginning, and the bytes up to range_start are discarded
         }
+        pthread_mutex_unlock (&fp->mutex);
         if (deadbeef->conf_get_int ("network.proxy", 0)) {
             deadbeef->conf_lock ();
             curl_easy_setopt (curl, CURLOPT_PROXY, deadbeef->conf_get_str_fast ("network.proxy.address", ""));
@@ -723,16 +1223,22 @@ http_thread_func (void *ctx) {
         if (status != 0) {
             trace ("curl error:\n%s\n", fp->http_err);
         }
-        deadbeef->mutex_lock (fp->mutex);
+        curl_slist_free_all (headers);
+        curl_slist_free_all (ok_aliases);
+        pthread_mutex_lock (&fp->mutex);
+        fp->cache_started = 0;
         if (fp->status != STATUS_SEEK) {
             trace ("vfs_curl: break loop\n");
-            deadbeef->mutex_unlock (fp->mutex);
+            pthread_mutex_unlock (&fp->mutex);
             break;
         }
         else {
             trace ("vfs_curl: restart loop\n");
+            // the reader may have moved on using the disk cache
+            fp->pos += fp->skipbytes;
             fp->skipbytes = 0;
-            fp->status = STATUS_INITIAL;
+            fp->remaining = 0;
+            http_set_status (fp, STATUS_INITIAL);
             trace ("seeking to %lld\n", fp->pos);
             if (fp->length < 0) {
                 // icy -- need full restart
@@ -749,14 +1255,12 @@ http_thread_func (void *ctx) {
                 fp->icy_metaint = 0;
             }
         }
-        deadbeef->mutex_unlock (fp->mutex);
-        curl_slist_free_all (headers);
-        curl_slist_free_all (ok_aliases);
+        pthread_mutex_unlock (&fp->mutex);
     }
     fp->curl = NULL;
     curl_easy_cleanup (curl);
 
-    deadbeef->mutex_lock (fp->mutex);
+    pthread_mutex_lock (&fp->mutex);
 
     if (fp->status == STATUS_ABORTED) {
         trace ("vfs_curl: thread ended due to abort signal\n");
@@ -765,12 +1269,16 @@ http_thread_func (void *ctx) {
         trace ("vfs_curl: thread ended normally\n");
         fp->status = STATUS_FINISHED;
     }
-    deadbeef->mutex_unlock (fp->mutex);
+    pthread_cond_broadcast (&fp->cond);
+    pthread_mutex_unlock (&fp->mutex);
 }
 
+// Must be called with fp->mutex held
 static void
 http_start_streamer (HTTP_FILE *fp) {
-    fp->mutex = deadbeef->mutex_create ();
+    // start downloading from the current read position
+    http_stream_reset (fp);
+    fp->status = STATUS_INITIAL;
     fp->tid = deadbeef->thread_start (http_thread_func, fp);
 //    deadbeef->thread_detach (fp->tid);
 }
@@ -793,6 +1301,14 @@ http_open (const char *fname) {
     fp->identifier = ++_curr_identifier;
     fp->vfs = &plugin;
     fp->url = strdup (fname);
+    pthread_mutex_init (&fp->mutex, NULL);
+    pthread_cond_init (&fp->cond, NULL);
+    fp->sync_initialized = 1;
+
+    fp->cache_fd = -1;
+    fp->cache_fd_index = -1;
+    fp->segment_index = -1;
+    fp->cache_path = http_cache_path_for_url (fname);
     return (DB_FILE*)fp;
 }
 
@@ -814,6 +1330,10 @@ http_close (DB_FILE *stream) {
     uint64_t identifier = fp->identifier;
     vfs_curl_abort_with_identifier (identifier);
     if (fp->tid) {
+        // wake up the streamer if it waits for buffer space
+        pthread_mutex_lock (&fp->mutex);
+        pthread_cond_broadcast (&fp->cond);
+        pthread_mutex_unlock (&fp->mutex);
         deadbeef->thread_join (fp->tid);
     }
     http_cancel_abort (identifier);
@@ -821,6 +1341,37 @@ http_close (DB_FILE *stream) {
     trace ("http_close done\n");
 }
 
+// Moves the read position over the skipped bytes which are already in the buffer.
+// Must be called with fp->mutex held.
+static void
+http_skip_buffered (HTTP_FILE *fp) {
+    int64_t skip = min (fp->remaining, fp->skipbytes);
+    if (skip > 0) {
+        fp->pos += skip;
+        fp->remaining -= skip;
+        fp->skipbytes -= skip;
+        pthread_cond_broadcast (&fp->cond);
+    }
+}
+
+// Makes the network request start over from the read position.
+// Must be called with fp->mutex held.
+static void
+http_restart_request (HTTP_FILE *fp) {
+    http_stream_reset (fp);
+    if (fp->status == STATUS_FINISHED) {
+        // the streamer thread has exited, the next read starts a new one
+        intptr_t tid = fp->tid;
+        fp->tid = 0;
+        pthread_mutex_unlock (&fp->mutex);
+        deadbeef->thread_join (tid);
+        pthread_mutex_lock (&fp->mutex);
+    }
+    else if (fp->status != STATUS_ABORTED) {
+        http_set_status (fp, STATUS_SEEK);
+    }
+}
+
 static size_t
 http_read (void *ptr, size_t size, size_t nmemb, DB_FILE *stream) {
     assert (stream);
@@ -828,21 +1379,50 @@ http_read (void *ptr, size_t size, size_t nmemb, DB_FILE *stream) {
     HTTP_FILE *fp = (HTTP_FILE *)stream;
 //    trace ("http_read %d (status=%d)\n", size*nmemb, fp->status);
     fp->seektoend = 0;
-    if (fp->status == STATUS_ABORTED || (fp->status == STATUS_FINISHED && fp->remaining == 0)) {
+    if (fp->status == STATUS_ABORTED) {
         errno = ECONNABORTED;
         return 0;
     }
-    if (!fp->tid) {
-        http_start_streamer (fp);
-    }
 
+    uint8_t *out = ptr;
     size_t sz = size * nmemb;
-    while ((fp->remaining > 0 || (fp->status != STATUS_FINISHED && fp->status != STATUS_ABORTED)) && sz > 0)
-    {
-        // wait until data is available
-        while ((fp->remaining == 0 || fp->skipbytes > 0) && fp->status != STATUS_FINISHED && fp->status != STATUS_ABORTED) {
-//            trace ("vfs_curl: readwait, status: %d..\n", fp->status);
-            deadbeef->mutex_lock (fp->mutex);
+    pthread_mutex_lock (&fp->mutex);
+    while (sz > 0 && fp->status != STATUS_ABORTED) {
+        int64_t offset = fp->pos + fp->skipbytes;
+        if (fp->length > 0 && offset >= fp->length) {
+            break;
+        }
+
+        if (fp->cache_valid) {
+            pthread_mutex_unlock (&fp->mutex);
+            size_t n = http_cache_read (fp, offset, out, sz);
+            pthread_mutex_lock (&fp->mutex);
+            if (n > 0 && offset == fp->pos + fp->skipbytes) {
+                // the same bytes are skipped in the network stream
+                fp->skipbytes += n;
+                http_skip_buffered (fp);
+                out += n;
+                sz -= n;
+                continue;
+            }
+            if (fp->tid && fp->skipbytes > fp->remaining
+                && (fp->skipbytes > BUFFER_SIZE/2 || fp->status == STATUS_FINISHED)) {
+                // cache miss far ahead of the network stream: request the data from the read position
+                trace ("vfs_curl: cache miss at %" PRId64 ", restarting request\n", offset);
+                http_restart_request (fp);
+            }
+        }
+
+        if (!fp->tid) {
+            http_start_streamer (fp);
+        }
+
+        http_skip_buffered (fp);
+        if (fp->remaining == 0 || fp->skipbytes > 0) {
+            // wait until data is available
+            if (fp->status == STATUS_FINISHED) {
+                break;
+            }
             if (fp->status == STATUS_READING) {
                 struct timeval tm;
                 gettimeofday (&tm, NULL);
@@ -851,50 +1431,46 @@ http_read (void *ptr, size_t size, size_t nmemb, DB_FILE *stream) {
                     trace ("http_read: timed out, restarting read\n");
                     memcpy (&fp->last_read_time, &tm, sizeof (struct timeval));
                     http_stream_reset (fp);
-                    fp->status = STATUS_SEEK;
-                    deadbeef->mutex_unlock (fp->mutex);
+                    http_set_status (fp, STATUS_SEEK);
+                    pthread_mutex_unlock (&fp->mutex);
                     if (fp->track) { // don't touch streamer if the stream is not assosiated with a track
                         deadbeef->streamer_reset (1);
+                        pthread_mutex_lock (&fp->mutex);
                         continue;
                     }
                     errno = ETIMEDOUT;
                     return 0;
                 }
             }
-            int64_t skip = min (fp->remaining, fp->skipbytes);
-            if (skip > 0) {
-//                trace ("skipping %d bytes\n");
-                fp->pos += skip;
-                fp->remaining -= skip;
-                fp->skipbytes -= skip;
-            }
-            deadbeef->mutex_unlock (fp->mutex);
-            usleep (3000);
+            http_wait (fp, WAIT_INTERVAL_MS);
+            continue;
         }
-    //    trace ("buffer remaining: %d\n", fp->remaining);
-        deadbeef->mutex_lock (fp->mutex);
+
         //trace ("http_read %lld/%lld/%d\n", fp->pos, fp->length, fp->remaining);
         size_t cp = min (sz, fp->remaining);
         int64_t readpos = fp->pos & BUFFER_MASK;
         size_t part1 = BUFFER_SIZE-readpos;
         part1 = min (part1, cp);
 //        trace ("readpos=%d, remaining=%d, req=%d, cp=%d, part1=%d, part2=%d\n", readpos, fp->remaining, sz, cp, part1, cp-part1);
-        memcpy (ptr, fp->buffer+readpos, part1);
+        memcpy (out, fp->buffer+readpos, part1);
         fp->remaining -= part1;
         fp->pos += part1;
         sz -= part1;
-        ptr += part1;
+        out += part1;
         cp -= part1;
         if (cp > 0) {
-            memcpy (ptr, fp->buffer, cp);
+            memcpy (out, fp->buffer, cp);
             fp->remaining -= cp;
             fp->pos += cp;
             sz -= cp;
-            ptr += cp;
+            out += cp;
         }
-        deadbeef->mutex_unlock (fp->mutex);
+        // wake up the writer waiting for free space
+        pthread_cond_broadcast (&fp->cond);
     }
-    if (fp->status == STATUS_ABORTED) {
+    int aborted = fp->status == STATUS_ABORTED;
+    pthread_mutex_unlock (&fp->mutex);
+    if (aborted) {
         errno = ECONNABORTED;
         return 0;
     }
@@ -918,45 +1494,49 @@ http_seek (DB_FILE *stream, int64_t offset, int whence) {
         trace ("vfs_curl: can't seek in curl stream relative to EOF\n");
         return -1;
     }
+    pthread_mutex_lock (&fp->mutex);
+    if (whence == SEEK_CUR) {
+        whence = SEEK_SET;
+        offset = fp->pos + fp->skipbytes + offset;
+    }
     if (!fp->tid) {
-        if (offset == 0 && (whence == SEEK_SET || whence == SEEK_CUR)) {
+        if (offset == fp->pos + fp->skipbytes) {
+            fp->pos = offset;
+            fp->skipbytes = 0;
+            pthread_mutex_unlock (&fp->mutex);
             return 0;
         }
-        else {
-            trace ("vfs_curl: cannot do seek(%lld,%d)\n", offset, whence);
-            return -1;
-        }
-    }
-    deadbeef->mutex_lock (fp->mutex);
-    if (whence == SEEK_CUR) {
-        whence = SEEK_SET;
-        offset = fp->pos + offset;
+        pthread_mutex_unlock (&fp->mutex);
+        trace ("vfs_curl: cannot do seek(%lld,%d)\n", offset, whence);
+        return -1;
     }
     if (whence == SEEK_SET) {
         if (fp->pos == offset) {
             fp->skipbytes = 0;
-            deadbeef->mutex_unlock (fp->mutex);
+            pthread_mutex_unlock (&fp->mutex);
             return 0;
         }
-        else if (fp->pos < offset && fp->pos + BUFFER_SIZE > offset) {
+        else if (fp->pos < offset && (fp->pos + BUFFER_SIZE > offset || fp->cache_valid || fp->no_ranges)) {
+            // with the disk cache, the reader decides whether the network request needs to restart;
+            // without range support, a new request would start from the beginning, so keep reading the current one
             fp->skipbytes = offset - fp->pos;
-            deadbeef->mutex_unlock (fp->mutex);
+            pthread_mutex_unlock (&fp->mutex);
             return 0;
         }
         else if (fp->pos-offset >= 0 && fp->pos-offset <= BUFFER_SIZE-fp->remaining) {
             fp->skipbytes = 0;
             fp->remaining += fp->pos - offset;
             fp->pos = offset;
-            deadbeef->mutex_unlock (fp->mutex);
+            pthread_mutex_unlock (&fp->mutex);
             return 0;
         }
     }
     // reset stream, and start over
-    http_stream_reset (fp);
+    http_restart_request (fp);
     fp->pos = offset;
-    fp->status = STATUS_SEEK;
+    fp->skipbytes = 0;
 
-    deadbeef->mutex_unlock (fp->mutex);
+    pthread_mutex_unlock (&fp->mutex);
     return 0;
 }
 
@@ -975,13 +1555,13 @@ http_rewind (DB_FILE *stream) {
     trace ("http_rewind\n");
     assert (stream);
     HTTP_FILE *fp = (HTTP_FILE *)stream;
+    pthread_mutex_lock (&fp->mutex);
     if (fp->tid) {
-        deadbeef->mutex_lock (fp->mutex);
-        fp->status = STATUS_SEEK;
-        http_stream_reset (fp);
-        fp->pos = 0;
-        deadbeef->mutex_unlock (fp->mutex);
+        http_restart_request (fp);
     }
+    fp->pos = 0;
+    fp->skipbytes = 0;
+    pthread_mutex_unlock (&fp->mutex);
 }
 
 static int64_t
@@ -993,12 +1573,14 @@ http_getlength (DB_FILE *stream) {
         trace ("length: -1\n");
         return -1;
     }
+    pthread_mutex_lock (&fp->mutex);
     if (!fp->tid) {
         http_start_streamer (fp);
     }
     while (fp->status == STATUS_INITIAL) {
-        usleep (3000);
+        http_wait (fp, WAIT_INTERVAL_MS);
     }
+    pthread_mutex_unlock (&fp->mutex);
     trace ("length: %lld\n", fp->length);
     return fp->length;
 }
@@ -1014,13 +1596,15 @@ http_get_content_type (DB_FILE *stream) {
     if (fp->gotheader) {
         return fp->content_type;
     }
+    pthread_mutex_lock (&fp->mutex);
     if (!fp->tid) {
         http_start_streamer (fp);
     }
     trace ("http_get_content_type waiting for response...\n");
     while (fp->status != STATUS_FINISHED && fp->status != STATUS_ABORTED && !fp->gotheader) {
-        usleep (3000);
+        http_wait (fp, WAIT_INTERVAL_MS);
     }
+    pthread_mutex_unlock (&fp->mutex);
 
     if (!fp->content_type && fp->icyheader) {
         // assume mp3
@@ -1030,7 +1614,6 @@ http_get_content_type (DB_FILE *stream) {
     return fp->content_type;
 }
 
-
 static int
 http_need_abort (uint64_t identifier) {
     deadbeef->mutex_lock (biglock);
@@ -1125,6 +1708,8 @@ vfs_curl_abort_with_identifier (uint64_t identifier) {
 
 
 static const char settings_dlg[] =
+    "property \"Cache downloaded files on disk\" checkbox vfs_curl.cache 0;\n"
+    "property \"Disk cache size (MB)\" entry vfs_curl.cache_size 256;\n"
     "property \"Enable logging\" checkbox vfs_curl.trace 0;\n"
 ;
 
@@ -1132,7 +1717,7 @@ static const char settings_dlg[] =
 static DB_vfs_t plugin = {
     DDB_PLUGIN_SET_API_VERSION
     .plugin.version_major = 1,
-    .plugin.version_minor = 0,
+    .plugin.version_minor = 1,
     .plugin.type = DB_PLUGIN_VFS,
 //    .plugin.flags = DDB_PLUGIN_FLAG_LOGGING,
     .plugin.id = "vfs_curl",
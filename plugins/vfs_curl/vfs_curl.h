@@ -10,6 +10,7 @@
 #define vfs_curl_h
 
 #include <curl/curl.h>
+#include <pthread.h>
 #include "../../deadbeef.h"
 
 #ifdef __cplusplus
@@ -23,6 +24,9 @@ extern "C" {
 
 #define TIMEOUT 10 // in seconds
 
+#define CACHE_SEGMENT_SIZE (256*1024) // disk cache granularity
+#define CACHE_INFO_LINE_SIZE 256
+
 enum {
     STATUS_INITIAL  = 0,
     STATUS_READING  = 1,
@@ -43,7 +47,8 @@ typedef struct {
     int32_t remaining; // remaining bytes in buffer read from stream
     int64_t skipbytes;
     intptr_t tid; // thread id which does http requests
-    intptr_t mutex;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond; // signalled on any change of buffer state or status
     uint8_t nheaderpackets;
     char *content_type;
     CURL *curl;
@@ -63,11 +68,31 @@ typedef struct {
 
     uint64_t identifier;
 
+    // range requests
+    int64_t range_start; // offset requested from the server by the current transfer
+    int64_t discard; // body bytes to drop, when the server ignored the range request
+    long http_code;
+    char *etag; // validators of the current response
+    char *last_modified;
+
+    // disk cache
+    char *cache_path; // directory with the cached segments of this url, NULL if caching is off
+    uint8_t *segment; // segment being assembled from the network data
+    int64_t segment_index;
+    size_t segment_fill;
+    int nflushed;
+    int cache_fd; // open segment file for reading, -1 if the segment is not cached
+    int64_t cache_fd_index;
+    int cache_valid; // the cached segments match the current response, protected by mutex
+    int cache_started; // the current transfer is being written to the disk cache, protected by mutex
+
     // flags (bitfields to save some space)
     unsigned seektoend : 1; // indicates that next tell must return length
     unsigned gotheader : 1; // tells that all headers (including ICY) were processed (to start reading body)
     unsigned icyheader : 1; // tells that we're currently reading ICY headers
     unsigned gotsomeheader : 1; // tells that we got some headers before body started
+    unsigned no_ranges : 1; // the server sent "Accept-Ranges: none", or ignored a range request
+    unsigned sync_initialized : 1; // mutex and cond are valid
 } HTTP_FILE;
 
 size_t
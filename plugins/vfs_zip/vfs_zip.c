@@ -23,23 +23,49 @@
 
 #include <string.h>
 #include <zip.h>
+#include <zlib.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <sys/stat.h>
 #include "../../deadbeef.h"
 
 //#define trace(...) { fprintf(stderr, __VA_ARGS__); }
 #define trace(fmt,...)
 
-#define ENABLE_CACHE 1
-
 #define min(x,y) ((x)<(y)?(x):(y))
 
+#if defined(LIBZIP_VERSION_MAJOR) && (LIBZIP_VERSION_MAJOR > 1 || (LIBZIP_VERSION_MAJOR == 1 && LIBZIP_VERSION_MINOR >= 2))
+#define HAVE_ZIP_FSEEK 1
+#endif
+
 static DB_functions_t *deadbeef;
 static DB_vfs_t plugin;
 
-#if ENABLE_CACHE
-#define ZIP_BUFFER_SIZE 8192
-#endif
+// Decompressed data is kept in a circular window of the last 32K bytes,
+// which is also the deflate dictionary size.
+#define ZIP_WINDOW_SIZE 32768
+#define ZIP_INPUT_SIZE 16384
+
+// Distance between the inflate checkpoints, in decompressed bytes
+#define ZIP_CHECKPOINT_SPAN (1024*1024)
+
+// Number of idle archives kept open for reuse
+#define ZIP_ARCHIVE_CACHE_SIZE 4
+
+enum {
+    ZIP_MODE_GENERIC, // sequential reading through libzip, restarting on backwards seeks
+    ZIP_MODE_STORED, // raw member data, seeking directly
+    ZIP_MODE_DEFLATE, // raw deflate data, inflated here, seeking via checkpoints
+};
+
+// Inflate state at a deflate block boundary, see zran.c in the zlib distribution
+typedef struct {
+    int64_t out; // decompressed offset
+    int64_t in; // compressed offset of the first byte after the boundary
+    int bits; // number of bits of the boundary byte which belong to the next block
+    int window_size;
+    uint8_t window[ZIP_WINDOW_SIZE];
+} zip_checkpoint_t;
 
 typedef struct {
     DB_FILE file;
@@ -48,14 +74,42 @@ typedef struct {
     int64_t offset;
     zip_uint64_t index;
     int64_t size;
+    int64_t comp_size;
+    int mode;
 
-#if ENABLE_CACHE
-    uint8_t buffer[ZIP_BUFFER_SIZE];
-    zip_int64_t buffer_remaining;
-    int buffer_pos;
-#endif
+    // decompressed bytes [max(valid_from, out - ZIP_WINDOW_SIZE), out) are in the window
+    uint8_t window[ZIP_WINDOW_SIZE];
+    int64_t out;
+    int64_t valid_from;
+
+    // compressed offset of the next byte read from zf, for the stored and deflate modes
+    int64_t in;
+
+    z_stream strm;
+    int strm_initialized;
+    int strm_end;
+    uint8_t input[ZIP_INPUT_SIZE];
+
+    zip_checkpoint_t **checkpoints;
+    int num_checkpoints;
+    int checkpoints_reserved;
 } ddb_zip_file_t;
 
+typedef struct {
+    char *path;
+    struct zip *z;
+    time_t mtime;
+    off_t size;
+    int in_use;
+    uint64_t last_used;
+} zip_archive_t;
+
+static uintptr_t archives_mutex;
+static zip_archive_t archives[ZIP_ARCHIVE_CACHE_SIZE];
+static uint64_t archives_counter;
+static int archives_acquired; // handed out and not released yet, cached or not
+static int archives_stopped; // the plugin was stopped while some archives were still in use
+
 static const char *scheme_names[] = { "zip://", NULL };
 
 const char **
@@ -68,6 +122,311 @@ vfs_zip_is_streaming (void) {
     return 0;
 }
 
+#pragma mark - Archive cache
+
+static void
+_archive_free (zip_archive_t *a) {
+    zip_close (a->z);
+    free (a->path);
+    memset (a, 0, sizeof (zip_archive_t));
+}
+
+// Opens the archive, or reuses an idle one opened earlier, e.g. when importing the members of an archive one by one.
+// An archive is handed out to one user at a time, since libzip archives are not thread safe.
+static struct zip *
+_archive_acquire (const char *path, int *error) {
+    struct stat st;
+    if (stat (path, &st)) {
+        return NULL;
+    }
+
+    deadbeef->mutex_lock (archives_mutex);
+    for (int i = 0; i < ZIP_ARCHIVE_CACHE_SIZE; i++) {
+        zip_archive_t *a = &archives[i];
+        if (!a->z || a->in_use || strcmp (a->path, path)) {
+            continue;
+        }
+        if (a->mtime != st.st_mtime || a->size != st.st_size) {
+            // modified on disk
+            _archive_free (a);
+            continue;
+        }
+        a->in_use = 1;
+        archives_acquired++;
+        deadbeef->mutex_unlock (archives_mutex);
+        return a->z;
+    }
+    deadbeef->mutex_unlock (archives_mutex);
+
+    struct zip *z = zip_open (path, 0, error);
+    if (!z) {
+        return NULL;
+    }
+
+    deadbeef->mutex_lock (archives_mutex);
+    zip_archive_t *slot = NULL;
+    for (int i = 0; i < ZIP_ARCHIVE_CACHE_SIZE; i++) {
+        zip_archive_t *a = &archives[i];
+        if (!a->z) {
+            slot = a;
+            break;
+        }
+        if (!a->in_use && (!slot || a->last_used < slot->last_used)) {
+            slot = a;
+        }
+    }
+    if (slot) {
+        if (slot->z) {
+            _archive_free (slot);
+        }
+        slot->path = strdup (path);
+        slot->z = z;
+        slot->mtime = st.st_mtime;
+        slot->size = st.st_size;
+        slot->in_use = 1;
+    }
+    // otherwise all cached archives are in use, and this one is closed on release
+    archives_acquired++;
+    deadbeef->mutex_unlock (archives_mutex);
+    return z;
+}
+
+static void
+_archive_release (struct zip *z) {
+    deadbeef->mutex_lock (archives_mutex);
+    archives_acquired--;
+    for (int i = 0; i < ZIP_ARCHIVE_CACHE_SIZE; i++) {
+        if (archives[i].z == z) {
+            archives[i].in_use = 0;
+            archives[i].last_used = ++archives_counter;
+            deadbeef->mutex_unlock (archives_mutex);
+            return;
+        }
+    }
+    int last = archives_stopped && !archives_acquired;
+    deadbeef->mutex_unlock (archives_mutex);
+    zip_close (z);
+    if (last) {
+        // the last file which was open when the plugin was stopped
+        deadbeef->mutex_free (archives_mutex);
+        archives_mutex = 0;
+        archives_stopped = 0;
+    }
+}
+
+#pragma mark - Member data
+
+static int
+_open_member (ddb_zip_file_t *f) {
+    if (f->zf) {
+        zip_fclose (f->zf);
+    }
+    f->zf = zip_fopen_index (f->z, f->index, f->mode == ZIP_MODE_GENERIC ? 0 : ZIP_FL_COMPRESSED);
+    f->in = 0;
+    return f->zf ? 0 : -1;
+}
+
+// Positions the compressed data stream, for the stored and deflate modes
+static int
+_seek_input (ddb_zip_file_t *f, int64_t in) {
+    if (in == f->in) {
+        return 0;
+    }
+#if HAVE_ZIP_FSEEK
+    if (!zip_fseek (f->zf, in, SEEK_SET)) {
+        f->in = in;
+        return 0;
+    }
+#endif
+    if (in < f->in && _open_member (f) < 0) {
+        return -1;
+    }
+    // skipping compressed data is still much cheaper than inflating it
+    while (f->in < in) {
+        zip_int64_t rb = zip_fread (f->zf, f->input, min (in - f->in, ZIP_INPUT_SIZE));
+        if (rb <= 0) {
+            return -1;
+        }
+        f->in += rb;
+    }
+    return 0;
+}
+
+static void
+_add_checkpoint (ddb_zip_file_t *f) {
+    if (f->num_checkpoints == f->checkpoints_reserved) {
+        int reserved = f->checkpoints_reserved ? f->checkpoints_reserved * 2 : 16;
+        zip_checkpoint_t **checkpoints = realloc (f->checkpoints, reserved * sizeof (zip_checkpoint_t *));
+        if (!checkpoints) {
+            return;
+        }
+        f->checkpoints = checkpoints;
+        f->checkpoints_reserved = reserved;
+    }
+    zip_checkpoint_t *cp = malloc (sizeof (zip_checkpoint_t));
+    if (!cp) {
+        return;
+    }
+    cp->out = f->out;
+    cp->in = f->in - f->strm.avail_in;
+    cp->bits = f->strm.data_type & 7;
+
+    // linearize the window
+    int64_t size = min (f->out - f->valid_from, ZIP_WINDOW_SIZE);
+    int pos = (int)(f->out % ZIP_WINDOW_SIZE);
+    if (size == ZIP_WINDOW_SIZE) {
+        memcpy (cp->window, f->window + pos, ZIP_WINDOW_SIZE - pos);
+        memcpy (cp->window + ZIP_WINDOW_SIZE - pos, f->window, pos);
+    }
+    else {
+        // can only happen at the start, where the window doesn't wrap
+        assert (pos >= size);
+        memcpy (cp->window, f->window + pos - size, size);
+    }
+    cp->window_size = (int)size;
+    f->checkpoints[f->num_checkpoints++] = cp;
+    trace ("vfs_zip: checkpoint %d at %lld (in: %lld, bits: %d)\n", f->num_checkpoints, cp->out, cp->in, cp->bits);
+}
+
+// Restarts decompression at the closest possible position before the offset
+static int
+_restore (ddb_zip_file_t *f, int64_t offset) {
+    switch (f->mode) {
+    case ZIP_MODE_STORED:
+        if (_seek_input (f, offset) < 0) {
+            return -1;
+        }
+        f->out = f->valid_from = offset;
+        return 0;
+    case ZIP_MODE_DEFLATE: {
+        zip_checkpoint_t *cp = NULL;
+        int l = 0, r = f->num_checkpoints - 1;
+        while (l <= r) {
+            int m = (l + r) / 2;
+            if (f->checkpoints[m]->out <= offset) {
+                cp = f->checkpoints[m];
+                l = m + 1;
+            }
+            else {
+                r = m - 1;
+            }
+        }
+        inflateReset (&f->strm);
+        f->strm.avail_in = 0;
+        f->strm_end = 0;
+        if (!cp) {
+            if (_seek_input (f, 0) < 0) {
+                return -1;
+            }
+            f->out = f->valid_from = 0;
+            return 0;
+        }
+        if (_seek_input (f, cp->bits ? cp->in - 1 : cp->in) < 0) {
+            return -1;
+        }
+        if (cp->bits) {
+            uint8_t byte;
+            if (zip_fread (f->zf, &byte, 1) != 1) {
+                return -1;
+            }
+            f->in++;
+            inflatePrime (&f->strm, cp->bits, byte >> (8 - cp->bits));
+        }
+        if (cp->window_size > 0) {
+            inflateSetDictionary (&f->strm, cp->window, cp->window_size);
+        }
+        f->out = f->valid_from = cp->out;
+        return 0;
+    }
+    default:
+        if (_open_member (f) < 0) {
+            return -1;
+        }
+        f->out = f->valid_from = 0;
+        return 0;
+    }
+}
+
+// Decompresses the next chunk into the window, returns the number of bytes produced, or -1 on error
+static int
+_fill (ddb_zip_file_t *f) {
+    int pos = (int)(f->out % ZIP_WINDOW_SIZE);
+    size_t space = min (ZIP_WINDOW_SIZE - pos, f->size - f->out);
+    if (space == 0) {
+        return 0;
+    }
+
+    if (f->mode != ZIP_MODE_DEFLATE) {
+        zip_int64_t rb = zip_fread (f->zf, f->window + pos, space);
+        if (rb <= 0) {
+            return (int)rb;
+        }
+        f->in += rb;
+        f->out += rb;
+        return (int)rb;
+    }
+
+    int produced = 0;
+    while (!produced && !f->strm_end) {
+        if (f->strm.avail_in == 0) {
+            zip_int64_t rb = zip_fread (f->zf, f->input, min (ZIP_INPUT_SIZE, f->comp_size - f->in));
+            if (rb <= 0) {
+                return -1;
+            }
+            f->in += rb;
+            f->strm.next_in = f->input;
+            f->strm.avail_in = (uInt)rb;
+        }
+        f->strm.next_out = f->window + pos;
+        f->strm.avail_out = (uInt)space;
+        // stop at the block boundaries, to be able to record checkpoints
+        int ret = inflate (&f->strm, Z_BLOCK);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            trace ("vfs_zip: inflate error %d\n", ret);
+            return -1;
+        }
+        produced = (int)(space - f->strm.avail_out);
+        f->out += produced;
+        if (ret == Z_STREAM_END) {
+            f->strm_end = 1;
+        }
+        else if ((f->strm.data_type & 128) && !(f->strm.data_type & 64)) {
+            int64_t last = f->num_checkpoints ? f->checkpoints[f->num_checkpoints-1]->out : 0;
+            if (f->out - last >= ZIP_CHECKPOINT_SPAN) {
+                _add_checkpoint (f);
+            }
+        }
+    }
+    return produced;
+}
+
+// Returns whether seeking to the offset is faster by restoring a checkpoint than by decompressing forward
+static int
+_need_restore (ddb_zip_file_t *f, int64_t offset) {
+    if (offset < f->valid_from || offset < f->out - ZIP_WINDOW_SIZE) {
+        return 1;
+    }
+    switch (f->mode) {
+    case ZIP_MODE_STORED:
+        return offset > f->out + ZIP_WINDOW_SIZE;
+    case ZIP_MODE_DEFLATE:
+        if (f->num_checkpoints && offset > f->out) {
+            // a known checkpoint between the current position and the offset
+            int64_t last = f->checkpoints[f->num_checkpoints-1]->out;
+            if (last > f->out) {
+                for (int i = f->num_checkpoints - 1; i >= 0 && f->checkpoints[i]->out > f->out; i--) {
+                    if (f->checkpoints[i]->out <= offset) {
+                        return 1;
+                    }
+                }
+            }
+        }
+        return 0;
+    default:
+        return 0;
+    }
+}
+
 // fname must have form of zip://full_filepath.zip:full_filepath_in_zip
 DB_FILE*
 vfs_zip_open (const char *fname) {
@@ -95,7 +454,7 @@ vfs_zip_open (const char *fname) {
 
         colon = colon+1;
 
-        z = zip_open (zipname, 0, NULL);
+        z = _archive_acquire (zipname, NULL);
         if (!z) {
             continue;
         }
@@ -106,7 +465,7 @@ vfs_zip_open (const char *fname) {
         }
         int res = zip_stat(z, colon, 0, &st);
         if (res != 0) {
-            zip_close (z);
+            _archive_release (z);
             return NULL;
         }
 
@@ -117,20 +476,38 @@ vfs_zip_open (const char *fname) {
         return NULL;
     }
 
-    struct zip_file *zf = zip_fopen_index (z, st.index, 0);
-    if (!zf) {
-        zip_close (z);
+    ddb_zip_file_t *f = calloc (1, sizeof (ddb_zip_file_t));
+    if (!f) {
+        _archive_release (z);
         return NULL;
     }
-
-    ddb_zip_file_t *f = malloc (sizeof (ddb_zip_file_t));
-    memset (f, 0, sizeof (ddb_zip_file_t));
     f->file.vfs = &plugin;
     f->z = z;
-    f->zf = zf;
     f->index = st.index;
     f->size = st.size;
-    trace ("vfs_zip: end open %s\n", fname);
+    f->comp_size = st.comp_size;
+
+    f->mode = ZIP_MODE_GENERIC;
+    int plain = (st.valid & ZIP_STAT_ENCRYPTION_METHOD) && st.encryption_method == ZIP_EM_NONE;
+    if (plain && (st.valid & ZIP_STAT_COMP_METHOD) && (st.valid & ZIP_STAT_COMP_SIZE)) {
+        if (st.comp_method == ZIP_CM_STORE && st.comp_size == st.size) {
+            f->mode = ZIP_MODE_STORED;
+        }
+        else if (st.comp_method == ZIP_CM_DEFLATE && inflateInit2 (&f->strm, -MAX_WBITS) == Z_OK) {
+            f->strm_initialized = 1;
+            f->mode = ZIP_MODE_DEFLATE;
+        }
+    }
+
+    if (_open_member (f) < 0) {
+        if (f->strm_initialized) {
+            inflateEnd (&f->strm);
+        }
+        _archive_release (z);
+        free (f);
+        return NULL;
+    }
+    trace ("vfs_zip: end open %s (mode %d)\n", fname, f->mode);
     return (DB_FILE*)f;
 }
 
@@ -142,8 +519,15 @@ vfs_zip_close (DB_FILE *f) {
         zip_fclose (zf->zf);
     }
     if (zf->z) {
-        zip_close (zf->z);
+        _archive_release (zf->z);
+    }
+    if (zf->strm_initialized) {
+        inflateEnd (&zf->strm);
     }
+    for (int i = 0; i < zf->num_checkpoints; i++) {
+        free (zf->checkpoints[i]);
+    }
+    free (zf->checkpoints);
     free (zf);
 }
 
@@ -153,29 +537,27 @@ vfs_zip_read (void *ptr, size_t size, size_t nmemb, DB_FILE *f) {
 //    printf ("read: %d\n", size*nmemb);
 
     size_t sz = size * nmemb;
-#if ENABLE_CACHE
-    while (sz) {
-        if (zf->buffer_remaining == 0) {
-            zf->buffer_pos = 0;
-            zip_int64_t rb = zip_fread (zf->zf, zf->buffer, ZIP_BUFFER_SIZE);
-            if (rb <= 0) {
+    while (sz > 0 && zf->offset < zf->size) {
+        if (_need_restore (zf, zf->offset)) {
+            if (_restore (zf, zf->offset) < 0) {
                 break;
             }
-            zf->buffer_remaining = rb;
-        }
-        size_t from_buf = min (sz, zf->buffer_remaining);
-        memcpy (ptr, zf->buffer+zf->buffer_pos, from_buf);
-        zf->buffer_remaining -= from_buf;
-        zf->buffer_pos += from_buf;
-        zf->offset += from_buf;
-        sz -= from_buf;
-        ptr += from_buf;
-    }
-#else
-    rb = zip_fread (zf->zf, ptr, sz);
-    sz -= rb;
-    zf->offset += rb;
-#endif
+        }
+        if (zf->offset >= zf->out) {
+            // decompress up to the read position, the skipped data is discarded as the window wraps
+            if (_fill (zf) <= 0) {
+                break;
+            }
+            continue;
+        }
+        int pos = (int)(zf->offset % ZIP_WINDOW_SIZE);
+        size_t n = min (sz, zf->out - zf->offset);
+        n = min (n, ZIP_WINDOW_SIZE - pos);
+        memcpy (ptr, zf->window + pos, n);
+        zf->offset += n;
+        sz -= n;
+        ptr += n;
+    }
 
     return (size * nmemb - sz) / size;
 }
@@ -192,66 +574,12 @@ vfs_zip_seek (DB_FILE *f, int64_t offset, int whence) {
         offset = zf->size + offset;
     }
 
-#if ENABLE_CACHE
-    int64_t offs = offset - zf->offset;
-    if ((offs < 0 && -offs <= zf->buffer_pos) || (offs >= 0 && offs < zf->buffer_remaining)) {
-        if (offs != 0) {
-            //printf ("cache success\n");
-
-            //printf ("[before] absoffs: %lld, offs: %lld, rem: %d, pos: %d\n", offset, offs, zf->buffer_remaining, zf->buffer_pos);
-
-            // test cases:
-            // fail: offs = -3, pos = 0, rem = 100
-            // fail: offs = 10, pos = 95, rem = 5
-            // succ: offs = -3, pos = 3, rem = 97 ----> pos = 0, rem=100
-            // succ: offs = 10, pos = 0, rem = 100 ---> pos = 10, rem = 90
-
-            zf->buffer_pos += offs;
-            zf->buffer_remaining -= offs;
-            //printf ("[after] offs: %lld, rem: %d, pos: %d\n", offs, zf->buffer_remaining, zf->buffer_pos);
-            zf->offset = offset;
-            assert (zf->buffer_pos < ZIP_BUFFER_SIZE);
-            return 0;
-        }
-        else {
-//            printf ("cache double success\n");
-            return 0;
-        }
-    }
-//    else {
-//        printf ("cache miss: abs_offs: %lld, offs: %lld, rem: %d, pos: %d\n", offset, offs, zf->buffer_remaining, zf->buffer_pos);
-//    }
-
-    zf->offset += zf->buffer_remaining;
-#endif
-    if (offset < zf->offset) {
-        // reopen
-        zip_fclose (zf->zf);
-        zf->zf = zip_fopen_index (zf->z, zf->index, 0);
-        if (!zf->zf) {
-            return -1;
-        }
-        zf->offset = 0;
-    }
-#if ENABLE_CACHE
-    zf->buffer_pos = 0;
-    zf->buffer_remaining = 0;
-#endif
-    char buf[4096];
-    int64_t n = offset - zf->offset;
-    while (n > 0) {
-        int64_t sz = min (n, sizeof (buf));
-        ssize_t rb = zip_fread (zf->zf, buf, sz);
-        n -= rb;
-        assert (n >= 0);
-        zf->offset += rb;
-        if (rb != sz) {
-            break;
-        }
-    }
-    if (n > 0) {
+    if (offset < 0 || offset > zf->size) {
         return -1;
     }
+
+    // the data is decompressed on the next read
+    zf->offset = offset;
     return 0;
 }
 
@@ -264,13 +592,7 @@ vfs_zip_tell (DB_FILE *f) {
 void
 vfs_zip_rewind (DB_FILE *f) {
     ddb_zip_file_t *zf = (ddb_zip_file_t *)f;
-    zip_fclose (zf->zf);
-    zf->zf = zip_fopen_index (zf->z, zf->index, 0);
-    assert (zf->zf); // FIXME: better error handling?
     zf->offset = 0;
-#if ENABLE_CACHE
-    zf->buffer_remaining = 0;
-#endif
 }
 
 int64_t
@@ -282,8 +604,8 @@ vfs_zip_getlength (DB_FILE *f) {
 int
 vfs_zip_scandir (const char *dir, struct dirent ***namelist, int (*selector) (const struct dirent *), int (*cmp) (const struct dirent **, const struct dirent **)) {
     trace ("vfs_zip_scandir: %s\n", dir);
-    int error;
-    struct zip *z = zip_open (dir, 0, &error);
+    int error = 0;
+    struct zip *z = _archive_acquire (dir, &error);
     if (!z) {
         trace ("zip_open failed (code: %d)\n", error);
         return -1;
@@ -305,7 +627,8 @@ vfs_zip_scandir (const char *dir, struct dirent ***namelist, int (*selector) (co
         }
     }
 
-    zip_close (z);
+    // keep the archive open for the members which are opened next
+    _archive_release (z);
     trace ("vfs_zip: scandir done\n");
     return num_files;
 }
@@ -323,10 +646,50 @@ vfs_zip_get_scheme_for_name (const char *fname) {
     return scheme_names[0];
 }
 
+static int
+vfs_zip_start (void) {
+    if (!archives_mutex) {
+        archives_mutex = deadbeef->mutex_create ();
+    }
+    // files left open from before a restart keep using the same mutex
+    archives_stopped = 0;
+    return 0;
+}
+
+static int
+vfs_zip_stop (void) {
+    if (!archives_mutex) {
+        return 0;
+    }
+    deadbeef->mutex_lock (archives_mutex);
+    for (int i = 0; i < ZIP_ARCHIVE_CACHE_SIZE; i++) {
+        zip_archive_t *a = &archives[i];
+        if (!a->z) {
+            continue;
+        }
+        if (a->in_use) {
+            // still used by an open file: remove it from the cache, and let the release close it
+            free (a->path);
+            memset (a, 0, sizeof (zip_archive_t));
+        }
+        else {
+            _archive_free (a);
+        }
+    }
+    int in_use = archives_acquired > 0;
+    archives_stopped = in_use;
+    deadbeef->mutex_unlock (archives_mutex);
+    if (!in_use) {
+        deadbeef->mutex_free (archives_mutex);
+        archives_mutex = 0;
+    }
+    return 0;
+}
+
 static DB_vfs_t plugin = {
     DDB_PLUGIN_SET_API_VERSION
     .plugin.version_major = 1,
-    .plugin.version_minor = 0,
+    .plugin.version_minor = 1,
     .plugin.type = DB_PLUGIN_VFS,
     .plugin.id = "vfs_zip",
     .plugin.name = "ZIP vfs",
@@ -354,6 +717,8 @@ static DB_vfs_t plugin = {
         "3. This notice may not be removed or altered from any source distribution.\n"
     ,
     .plugin.website = "http://deadbeef.sf.net",
+    .plugin.start = vfs_zip_start,
+    .plugin.stop = vfs_zip_stop,
     .open = vfs_zip_open,
     .close = vfs_zip_close,
     .read = vfs_zip_read,
@@ -137,7 +137,7 @@ wv_init (DB_fileinfo_t *_info, DB_playItem_t *it) {
     deadbeef->pl_lock ();
     const char *uri = strdupa (deadbeef->pl_find_meta (it, ":URI"));
     deadbeef->pl_unlock ();
-    info->file = deadbeef->fopen (uri);
+    info->file = deadbeef->fopen2 (uri, DDB_VFS_OPEN_SEQUENTIAL);
     if (!info->file) {
         return -1;
     }
@@ -812,6 +812,7 @@ project "ddb_gui_GTK2"
     "plugins/gtkui/covermanager/*.c",
     "plugins/gtkui/playlist/*.c",
     "shared/eqpreset.c",
+    "shared/lrucache.c",
     "shared/pluginsettings.c",
     "shared/trkproperties_shared.c",
     "analyzer/analyzer.c",
@@ -842,6 +843,7 @@ project "ddb_gui_GTK3"
     "plugins/gtkui/covermanager/*.c",
     "plugins/gtkui/playlist/*.c",
     "shared/eqpreset.c",
+    "shared/lrucache.c",
     "shared/pluginsettings.c",
     "shared/trkproperties_shared.c",
     "analyzer/analyzer.c",
@@ -1114,6 +1116,7 @@ project "artwork_plugin"
   targetname "artwork"
   files {
     "plugins/artwork/*.c",
+    "shared/lrucache.c",
     "shared/mp4tagutil.c"
   }
   includedirs {"../libmp4ff", "./shared"}
@@ -26,6 +26,11 @@
 */
 #include <string.h>
 #include <stdlib.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 #include "streamer.h"
 #include "volume.h"
 #include "replaygain.h"
@@ -179,6 +184,60 @@ get_int_volume (ddb_replaygain_settings_t *settings) {
     return vol == 1000 ? -1 : vol;
 }
 
+// The integer gain is applied as `sample * vol / 1000`, clipped to the sample range.
+// The vectorized versions compute it in double precision, which is exact for the products of int32 samples
+// and the volumes in use, and truncate the quotient the same way as the integer division,
+// so the result is bit-exact with the scalar code.
+
+// Apply gain to the int32 samples in place, and clip the result to [min, max].
+static void
+_scale_int32 (int32_t *s, int count, int64_t vol, int32_t min, int32_t max) {
+    int j = 0;
+#if defined(__SSE2__)
+    const __m128d vvol = _mm_set1_pd ((double)vol);
+    const __m128d vdiv = _mm_set1_pd (1000.0);
+    const __m128d vmin = _mm_set1_pd ((double)min);
+    const __m128d vmax = _mm_set1_pd ((double)max);
+    for (; j + 4 <= count; j += 4) {
+        __m128i v = _mm_loadu_si128 ((const __m128i *)(s + j));
+        __m128d lo = _mm_cvtepi32_pd (v);
+        __m128d hi = _mm_cvtepi32_pd (_mm_shuffle_epi32 (v, _MM_SHUFFLE (1, 0, 3, 2)));
+        lo = _mm_div_pd (_mm_mul_pd (lo, vvol), vdiv);
+        hi = _mm_div_pd (_mm_mul_pd (hi, vvol), vdiv);
+        lo = _mm_max_pd (_mm_min_pd (lo, vmax), vmin);
+        hi = _mm_max_pd (_mm_min_pd (hi, vmax), vmin);
+        v = _mm_unpacklo_epi64 (_mm_cvttpd_epi32 (lo), _mm_cvttpd_epi32 (hi));
+        _mm_storeu_si128 ((__m128i *)(s + j), v);
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const float64x2_t vvol = vdupq_n_f64 ((double)vol);
+    const float64x2_t vdiv = vdupq_n_f64 (1000.0);
+    const float64x2_t vmin = vdupq_n_f64 ((double)min);
+    const float64x2_t vmax = vdupq_n_f64 ((double)max);
+    for (; j + 4 <= count; j += 4) {
+        int32x4_t v = vld1q_s32 (s + j);
+        float64x2_t lo = vcvtq_f64_s64 (vmovl_s32 (vget_low_s32 (v)));
+        float64x2_t hi = vcvtq_f64_s64 (vmovl_s32 (vget_high_s32 (v)));
+        lo = vdivq_f64 (vmulq_f64 (lo, vvol), vdiv);
+        hi = vdivq_f64 (vmulq_f64 (hi, vvol), vdiv);
+        lo = vmaxq_f64 (vminq_f64 (lo, vmax), vmin);
+        hi = vmaxq_f64 (vminq_f64 (hi, vmax), vmin);
+        v = vcombine_s32 (vmovn_s64 (vcvtq_s64_f64 (lo)), vmovn_s64 (vcvtq_s64_f64 (hi)));
+        vst1q_s32 (s + j, v);
+    }
+#endif
+    for (; j < count; j++) {
+        int64_t sample = s[j] * vol / 1000;
+        if (sample > max) {
+            sample = max;
+        }
+        else if (sample < min) {
+            sample = min;
+        }
+        s[j] = (int32_t)sample;
+    }
+}
+
 void
 apply_replay_gain_int8 (ddb_replaygain_settings_t *settings, char *bytes, int size) {
     int vol = get_int_volume (settings);
@@ -206,16 +265,57 @@ apply_replay_gain_int16 (ddb_replaygain_settings_t *settings, char *bytes, int s
         return;
     }
     int16_t *s = (int16_t*)bytes;
-    for (int j = 0; j < size/2; j++) {
-        int32_t sample = ((int32_t)(*s)) * vol / 1000;
+    int count = size/2;
+    int j = 0;
+#if defined(__SSE2__)
+    const __m128d vvol = _mm_set1_pd ((double)vol);
+    const __m128d vdiv = _mm_set1_pd (1000.0);
+    const __m128d vmin = _mm_set1_pd (-0x8000);
+    const __m128d vmax = _mm_set1_pd (0x7fff);
+    for (; j + 8 <= count; j += 8) {
+        __m128i v = _mm_loadu_si128 ((const __m128i *)(s + j));
+        // sign-extend to int32, then to double, 2 samples per register
+        __m128i v32[2] = {
+            _mm_srai_epi32 (_mm_unpacklo_epi16 (v, v), 16),
+            _mm_srai_epi32 (_mm_unpackhi_epi16 (v, v), 16)
+        };
+        for (int k = 0; k < 2; k++) {
+            __m128d lo = _mm_cvtepi32_pd (v32[k]);
+            __m128d hi = _mm_cvtepi32_pd (_mm_shuffle_epi32 (v32[k], _MM_SHUFFLE (1, 0, 3, 2)));
+            lo = _mm_div_pd (_mm_mul_pd (lo, vvol), vdiv);
+            hi = _mm_div_pd (_mm_mul_pd (hi, vvol), vdiv);
+            lo = _mm_max_pd (_mm_min_pd (lo, vmax), vmin);
+            hi = _mm_max_pd (_mm_min_pd (hi, vmax), vmin);
+            v32[k] = _mm_unpacklo_epi64 (_mm_cvttpd_epi32 (lo), _mm_cvttpd_epi32 (hi));
+        }
+        _mm_storeu_si128 ((__m128i *)(s + j), _mm_packs_epi32 (v32[0], v32[1]));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const float64x2_t vvol = vdupq_n_f64 ((double)vol);
+    const float64x2_t vdiv = vdupq_n_f64 (1000.0);
+    for (; j + 8 <= count; j += 8) {
+        int16x8_t v = vld1q_s16 (s + j);
+        int32x4_t v32[2] = { vmovl_s16 (vget_low_s16 (v)), vmovl_s16 (vget_high_s16 (v)) };
+        for (int k = 0; k < 2; k++) {
+            float64x2_t lo = vcvtq_f64_s64 (vmovl_s32 (vget_low_s32 (v32[k])));
+            float64x2_t hi = vcvtq_f64_s64 (vmovl_s32 (vget_high_s32 (v32[k])));
+            lo = vdivq_f64 (vmulq_f64 (lo, vvol), vdiv);
+            hi = vdivq_f64 (vmulq_f64 (hi, vvol), vdiv);
+            // saturating narrowing does the clipping
+            v32[k] = vcombine_s32 (vqmovn_s64 (vcvtq_s64_f64 (lo)), vqmovn_s64 (vcvtq_s64_f64 (hi)));
+        }
+        vst1q_s16 (s + j, vcombine_s16 (vqmovn_s32 (v32[0]), vqmovn_s32 (v32[1])));
+    }
+#endif
+    for (; j < count; j++) {
+        int32_t sample = ((int32_t)s[j]) * vol / 1000;
         if (sample > 0x7fff) {
             sample = 0x7fff;
         }
         else if (sample < -0x8000) {
             sample = -0x8000;
         }
-        *s = (int16_t)sample;
-        s++;
+        s[j] = (int16_t)sample;
     }
 }
 
@@ -225,20 +325,24 @@ apply_replay_gain_int24 (ddb_replaygain_settings_t *settings, char *bytes, int s
     if (vol < 0) {
         return;
     }
+    // unpack into int32 in chunks, to process them with _scale_int32
+    int32_t samples[256];
     char *s = (char*)bytes;
-    for (int j = 0; j < size/3; j++) {
-        int32_t sample = ((unsigned char)s[0]) | ((unsigned char)s[1]<<8) | ((signed char)s[2]<<16);
-        sample = (int32_t)(sample * vol / 1000);
-        if (sample > 0x7fffff) {
-            sample = 0x7fffff;
+    int count = size/3;
+    while (count > 0) {
+        int n = count < 256 ? count : 256;
+        for (int j = 0; j < n; j++) {
+            samples[j] = ((unsigned char)s[j*3]) | ((unsigned char)s[j*3+1]<<8) | ((signed char)s[j*3+2]<<16);
         }
-        else if (sample < -0x800000) {
-            sample = -0x800000;
+        _scale_int32 (samples, n, vol, -0x800000, 0x7fffff);
+        for (int j = 0; j < n; j++) {
+            int32_t sample = samples[j];
+            s[j*3] = (sample&0x0000ff);
+            s[j*3+1] = (sample&0x00ff00)>>8;
+            s[j*3+2] = (sample&0xff0000)>>16;
         }
-        s[0] = (sample&0x0000ff);
-        s[1] = (sample&0x00ff00)>>8;
-        s[2] = (sample&0xff0000)>>16;
-        s += 3;
+        s += n * 3;
+        count -= n;
     }
 }
 
@@ -248,12 +352,7 @@ apply_replay_gain_int32 (ddb_replaygain_settings_t *settings, char *bytes, int s
     if (vol < 0) {
         return;
     }
-    int32_t *s = (int32_t*)bytes;
-    for (int j = 0; j < size/4; j++) {
-        int64_t sample = ((int32_t)(*s)) * vol / 1000;
-        *s = (int32_t)sample;
-        s++;
-    }
+    _scale_int32 ((int32_t*)bytes, size/4, vol, INT32_MIN, INT32_MAX);
 }
 
 void
@@ -294,15 +393,35 @@ apply_replay_gain_float32 (ddb_replaygain_settings_t *settings, char *bytes, int
     }
 
     float *s = (float*)bytes;
-    for (int j = 0; j < size/4; j++) {
-        float sample = ((float)*s) * vol;
+    int count = size/4;
+    int j = 0;
+#if defined(__SSE2__)
+    const __m128 vvol = _mm_set1_ps (vol);
+    const __m128 vmin = _mm_set1_ps (-1.f);
+    const __m128 vmax = _mm_set1_ps (1.f);
+    for (; j + 4 <= count; j += 4) {
+        __m128 v = _mm_mul_ps (_mm_loadu_ps (s + j), vvol);
+        // limit goes first, so that NaN passes through, as in the scalar code
+        v = _mm_max_ps (vmin, _mm_min_ps (vmax, v));
+        _mm_storeu_ps (s + j, v);
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const float32x4_t vvol = vdupq_n_f32 (vol);
+    const float32x4_t vmin = vdupq_n_f32 (-1.f);
+    const float32x4_t vmax = vdupq_n_f32 (1.f);
+    for (; j + 4 <= count; j += 4) {
+        float32x4_t v = vmulq_f32 (vld1q_f32 (s + j), vvol);
+        vst1q_f32 (s + j, vmaxq_f32 (vminq_f32 (v, vmax), vmin));
+    }
+#endif
+    for (; j < count; j++) {
+        float sample = s[j] * vol;
         if (sample > 1.f) {
             sample = 1.f;
         }
         else if (sample < -1.f) {
             sample = -1.f;
         }
-        *s = sample;
-        s++;
+        s[j] = sample;
     }
 }
@@ -28,6 +28,11 @@
 #define __REPLAYGAIN_H
 
 #include "deadbeef.h"
+#include "playlist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 void
 replaygain_init_settings (ddb_replaygain_settings_t *settings, playItem_t *it);
@@ -56,4 +61,8 @@ apply_replay_gain_int32 (ddb_replaygain_settings_t *settings, char *bytes, int s
 void
 apply_replay_gain_float32 (ddb_replaygain_settings_t *settings, char *bytes, int size);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
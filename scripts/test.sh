@@ -4,7 +4,7 @@ set -e
 shopt -s extglob
 
 BUILD=testbuild
-TEST_C_SOURCES="*.c shared/*.c scriptable/*.c plugins/libparser/*.c plugins/nullout/*.c ConvertUTF/*.c metadata/*.c plugins/m3u/*.c plugins/vfs_curl/*.c plugins/shellexec/*.c external/mp4p/src/*.c external/wcwidth/*.c md5/*.c plugins/mp3/*.c Tests/*.c"
+TEST_C_SOURCES="*.c shared/*.c scriptable/*.c plugins/libparser/*.c plugins/nullout/*.c ConvertUTF/*.c metadata/*.c plugins/m3u/*.c plugins/vfs_curl/*.c plugins/shellexec/*.c plugins/converter/converter.c external/mp4p/src/*.c external/wcwidth/*.c md5/*.c plugins/mp3/*.c Tests/*.c"
 TEST_CPP_SOURCES="Tests/*.cpp"
 GOOGLE_TEST_SOURCES="external/googletest/googletest/src/gtest-all.cc"
 ORIGIN=$PWD
@@ -0,0 +1,289 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "lrucache.h"
+
+#define MIN_BUCKETS 64
+
+typedef struct lru_cache_entry_s {
+    // hash chain
+    struct lru_cache_entry_s *next;
+    // recency list, prev is more recent
+    struct lru_cache_entry_s *lru_prev;
+    struct lru_cache_entry_s *lru_next;
+    uint32_t hash;
+    size_t size;
+    void *value;
+    char key[1];
+} lru_cache_entry_t;
+
+struct lru_cache_s {
+    lru_cache_entry_t **buckets;
+    uint32_t num_buckets; // power of 2
+    int count;
+    size_t size;
+    size_t capacity;
+    lru_cache_entry_t *head; // most recently used
+    lru_cache_entry_t *tail; // least recently used
+    lru_cache_free_value_t free_value;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+// FNV-1a
+static uint32_t
+_hash (const char *key) {
+    uint32_t h = 2166136261u;
+    for (const uint8_t *p = (const uint8_t *)key; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+lru_cache_t *
+lru_cache_new (size_t capacity, lru_cache_free_value_t free_value) {
+    lru_cache_t *cache = calloc (1, sizeof (lru_cache_t));
+    if (!cache) {
+        return NULL;
+    }
+    cache->num_buckets = MIN_BUCKETS;
+    cache->buckets = calloc (cache->num_buckets, sizeof (lru_cache_entry_t *));
+    if (!cache->buckets) {
+        free (cache);
+        return NULL;
+    }
+    cache->capacity = capacity;
+    cache->free_value = free_value;
+    return cache;
+}
+
+void
+lru_cache_free (lru_cache_t *cache) {
+    lru_cache_remove_all (cache);
+    free (cache->buckets);
+    free (cache);
+}
+
+static lru_cache_entry_t **
+_find (lru_cache_t *cache, const char *key, uint32_t hash) {
+    lru_cache_entry_t **pe = &cache->buckets[hash & (cache->num_buckets-1)];
+    while (*pe) {
+        if ((*pe)->hash == hash && !strcmp ((*pe)->key, key)) {
+            break;
+        }
+        pe = &(*pe)->next;
+    }
+    return pe;
+}
+
+static void
+_lru_unlink (lru_cache_t *cache, lru_cache_entry_t *e) {
+    if (e->lru_prev) {
+        e->lru_prev->lru_next = e->lru_next;
+    }
+    else {
+        cache->head = e->lru_next;
+    }
+    if (e->lru_next) {
+        e->lru_next->lru_prev = e->lru_prev;
+    }
+    else {
+        cache->tail = e->lru_prev;
+    }
+    e->lru_prev = e->lru_next = NULL;
+}
+
+static void
+_lru_push_front (lru_cache_t *cache, lru_cache_entry_t *e) {
+    e->lru_prev = NULL;
+    e->lru_next = cache->head;
+    if (cache->head) {
+        cache->head->lru_prev = e;
+    }
+    cache->head = e;
+    if (!cache->tail) {
+        cache->tail = e;
+    }
+}
+
+static void
+_free_value (lru_cache_t *cache, lru_cache_entry_t *e) {
+    if (e->value && cache->free_value) {
+        cache->free_value (e->value);
+    }
+    e->value = NULL;
+}
+
+// removes the entry pointed by pe from its hash chain and the recency list, and frees it
+static void
+_remove_entry (lru_cache_t *cache, lru_cache_entry_t **pe) {
+    lru_cache_entry_t *e = *pe;
+    *pe = e->next;
+    _lru_unlink (cache, e);
+    cache->size -= e->size;
+    cache->count--;
+    _free_value (cache, e);
+    free (e);
+}
+
+static void
+_evict (lru_cache_t *cache, lru_cache_entry_t *keep) {
+    while (cache->size > cache->capacity && cache->tail && cache->tail != keep) {
+        lru_cache_entry_t *e = cache->tail;
+        _remove_entry (cache, _find (cache, e->key, e->hash));
+        cache->evictions++;
+    }
+}
+
+static void
+_grow (lru_cache_t *cache) {
+    uint32_t num_buckets = cache->num_buckets * 2;
+    lru_cache_entry_t **buckets = calloc (num_buckets, sizeof (lru_cache_entry_t *));
+    if (!buckets) {
+        // keep using the current buckets, with longer chains
+        return;
+    }
+    for (uint32_t i = 0; i < cache->num_buckets; i++) {
+        lru_cache_entry_t *e = cache->buckets[i];
+        while (e) {
+            lru_cache_entry_t *next = e->next;
+            uint32_t b = e->hash & (num_buckets-1);
+            e->next = buckets[b];
+            buckets[b] = e;
+            e = next;
+        }
+    }
+    free (cache->buckets);
+    cache->buckets = buckets;
+    cache->num_buckets = num_buckets;
+}
+
+void
+lru_cache_set_capacity (lru_cache_t *cache, size_t capacity) {
+    cache->capacity = capacity;
+    _evict (cache, NULL);
+}
+
+void
+lru_cache_set (lru_cache_t *cache, const char *key, void *value, size_t size) {
+    uint32_t hash = _hash (key);
+    lru_cache_entry_t **pe = _find (cache, key, hash);
+    lru_cache_entry_t *e = *pe;
+
+    if (e) {
+        if (e->value != value) {
+            _free_value (cache, e);
+        }
+        cache->size -= e->size;
+        _lru_unlink (cache, e);
+    }
+    else {
+        size_t len = strlen (key);
+        e = calloc (1, sizeof (lru_cache_entry_t) + len);
+        if (!e) {
+            // the value is owned by the cache, even if it couldn't be added
+            if (value && cache->free_value) {
+                cache->free_value (value);
+            }
+            return;
+        }
+        memcpy (e->key, key, len + 1);
+        e->hash = hash;
+        *pe = e;
+        cache->count++;
+    }
+
+    e->value = value;
+    e->size = size;
+    cache->size += size;
+    _lru_push_front (cache, e);
+
+    _evict (cache, e);
+
+    if ((uint32_t)cache->count > cache->num_buckets) {
+        _grow (cache);
+    }
+}
+
+void *
+lru_cache_get (lru_cache_t *cache, const char *key) {
+    lru_cache_entry_t *e = *_find (cache, key, _hash (key));
+    if (!e) {
+        cache->misses++;
+        return NULL;
+    }
+    cache->hits++;
+    if (e != cache->head) {
+        _lru_unlink (cache, e);
+        _lru_push_front (cache, e);
+    }
+    return e->value;
+}
+
+void *
+lru_cache_peek (lru_cache_t *cache, const char *key) {
+    lru_cache_entry_t *e = *_find (cache, key, _hash (key));
+    return e ? e->value : NULL;
+}
+
+int
+lru_cache_contains (lru_cache_t *cache, const char *key) {
+    return *_find (cache, key, _hash (key)) != NULL;
+}
+
+void
+lru_cache_remove (lru_cache_t *cache, const char *key) {
+    lru_cache_entry_t **pe = _find (cache, key, _hash (key));
+    if (*pe) {
+        _remove_entry (cache, pe);
+    }
+}
+
+void
+lru_cache_remove_all (lru_cache_t *cache) {
+    lru_cache_entry_t *e = cache->head;
+    while (e) {
+        lru_cache_entry_t *next = e->lru_next;
+        _free_value (cache, e);
+        free (e);
+        e = next;
+    }
+    memset (cache->buckets, 0, cache->num_buckets * sizeof (lru_cache_entry_t *));
+    cache->head = cache->tail = NULL;
+    cache->count = 0;
+    cache->size = 0;
+}
+
+void
+lru_cache_get_stats (lru_cache_t *cache, lru_cache_stats_t *stats) {
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->size = cache->size;
+    stats->capacity = cache->capacity;
+    stats->count = cache->count;
+}
@@ -0,0 +1,95 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef lrucache_h
+#define lrucache_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A hash table of string keys, with least-recently-used eviction.
+// The capacity is specified in bytes, each value is added with its own size,
+// so that e.g. large images are accounted for correctly.
+// The cache is not thread-safe: the caller must serialize access.
+
+typedef struct lru_cache_s lru_cache_t;
+
+// Called when a value is evicted, replaced or removed.
+typedef void (*lru_cache_free_value_t) (void *value);
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t size; // total size of the values in the cache
+    size_t capacity;
+    int count;
+} lru_cache_stats_t;
+
+lru_cache_t *
+lru_cache_new (size_t capacity, lru_cache_free_value_t free_value);
+
+void
+lru_cache_free (lru_cache_t *cache);
+
+// Evicts the least recently used values, if the new capacity is smaller than the current size.
+void
+lru_cache_set_capacity (lru_cache_t *cache, size_t capacity);
+
+// Adds or replaces the value, the cache takes the ownership of the value.
+// If the entry can't be allocated, the value is released immediately.
+// The most recently added value is never evicted, even if it is larger than the capacity.
+void
+lru_cache_set (lru_cache_t *cache, const char *key, void *value, size_t size);
+
+// Returns the value and marks it as the most recently used, or NULL if not found.
+// The value is owned by the cache.
+void *
+lru_cache_get (lru_cache_t *cache, const char *key);
+
+// Same as lru_cache_get, without updating the recency and the counters.
+void *
+lru_cache_peek (lru_cache_t *cache, const char *key);
+
+// Returns 1 if the key was found.
+int
+lru_cache_contains (lru_cache_t *cache, const char *key);
+
+void
+lru_cache_remove (lru_cache_t *cache, const char *key);
+
+void
+lru_cache_remove_all (lru_cache_t *cache);
+
+void
+lru_cache_get_stats (lru_cache_t *cache, lru_cache_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* lrucache_h */
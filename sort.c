@@ -30,6 +30,7 @@
 #include "tf.h"
 #include "pltmeta.h"
 #include "plmeta.h"
+#include "plshuffle.h"
 #include "messagepump.h"
 
 //#define trace(...) { fprintf(stderr, __VA_ARGS__); }
@@ -58,8 +59,9 @@ static const char *pl_sort_format;
 static char *pl_sort_tf_bytecode;
 static ddb_tf_context_t pl_sort_tf_ctx;
 
+// cmp is used for the non-numeric parts
 static int
-strcasecmp_numeric (const char *a, const char *b) {
+cmp_numeric (const char *a, const char *b, int (*cmp) (const char *, const char *)) {
     if (isdigit (*a) && isdigit (*b)) {
         int anum = *a-'0';
         const char *ae = a+1;
@@ -76,11 +78,11 @@ strcasecmp_numeric (const char *a, const char *b) {
             be++;
         }
         if (anum == bnum) {
-            return u8_strcasecmp (ae, be);
+            return cmp (ae, be);
         }
         return anum - bnum;
     }
-    return u8_strcasecmp (a,b);
+    return cmp (a,b);
 }
 
 static int
@@ -111,6 +113,7 @@ pl_sort_compare_str (playItem_t *a, playItem_t *b) {
         return !pl_sort_ascending ? t2 - t1 : t1 - t2;
     }
     else {
+        // slow path, formats both items on each comparison
         char tmp1[1024];
         char tmp2[1024];
         if (pl_sort_version == 0) {
@@ -124,7 +127,7 @@ pl_sort_compare_str (playItem_t *a, playItem_t *b) {
             pl_sort_tf_ctx.it = (ddb_playItem_t *)b;
             tf_eval(&pl_sort_tf_ctx, pl_sort_tf_bytecode, tmp2, sizeof(tmp2));
         }
-        int res = strcasecmp_numeric (tmp1, tmp2);
+        int res = cmp_numeric (tmp1, tmp2, u8_strcasecmp);
         if (!pl_sort_ascending) {
             res = -res;
         }
@@ -139,6 +142,74 @@ qsort_cmp_func (const void *a, const void *b) {
     return pl_sort_compare_str (aa, bb);
 }
 
+typedef struct {
+    playItem_t *it;
+    char *key; // formatted and case-folded
+} pl_sort_key_t;
+
+static int
+qsort_key_cmp_func (const void *a, const void *b) {
+    const pl_sort_key_t *ka = a;
+    const pl_sort_key_t *kb = b;
+    // the keys which could not be allocated sort as empty strings
+    int res = cmp_numeric (ka->key ? ka->key : "", kb->key ? kb->key : "", strcmp);
+    return !pl_sort_ascending ? -res : res;
+}
+
+static char *
+pl_sort_make_key (playItem_t *it) {
+    char tmp[1024];
+    if (pl_sort_version == 0) {
+        pl_format_title (it, -1, tmp, sizeof (tmp), pl_sort_id, pl_sort_format);
+    }
+    else {
+        pl_sort_tf_ctx.id = pl_sort_id;
+        pl_sort_tf_ctx.it = (ddb_playItem_t *)it;
+        tf_eval(&pl_sort_tf_ctx, pl_sort_tf_bytecode, tmp, sizeof(tmp));
+    }
+    int len = (int)strlen (tmp);
+    char *key = malloc (U8_CASEFOLD_MAX_LEN (len) + 1);
+    if (!key) {
+        return NULL;
+    }
+    len = u8_casefold (tmp, len, key);
+    key[len] = 0;
+    return key;
+}
+
+static void
+pl_sort_items (playItem_t **items, int count) {
+    // format and fold the sort strings once per item, instead of on each comparison
+    pl_sort_key_t *keys = NULL;
+    if (!pl_sort_is_duration && !pl_sort_is_track) {
+        keys = malloc (count * sizeof (pl_sort_key_t));
+    }
+    if (!keys) {
+#if HAVE_MERGESORT
+        mergesort (items, count, sizeof (playItem_t *), qsort_cmp_func);
+#else
+        qsort (items, count, sizeof (playItem_t *), qsort_cmp_func);
+#endif
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        keys[i].it = items[i];
+        keys[i].key = pl_sort_make_key (items[i]);
+    }
+
+#if HAVE_MERGESORT
+    mergesort (keys, count, sizeof (pl_sort_key_t), qsort_key_cmp_func);
+#else
+    qsort (keys, count, sizeof (pl_sort_key_t), qsort_key_cmp_func);
+#endif
+
+    for (int i = 0; i < count; i++) {
+        items[i] = keys[i].it;
+        free (keys[i].key);
+    }
+    free (keys);
+}
+
 void
 plt_sort_random (playlist_t *playlist, int iter) {
     plt_replace_meta (playlist, "autosort_mode", "random");
@@ -186,6 +257,10 @@ plt_sort_random (playlist_t *playlist, int iter) {
 
     free (array);
 
+    if (iter == PL_MAIN) {
+        plt_shuffle_rebuild (playlist);
+    }
+
     plt_modified (playlist);
 
     pl_unlock ();
@@ -261,11 +336,7 @@ plt_sort_internal (playlist_t *playlist, int iter, int id, const char *format, i
         array[idx] = it;
     }
 
-#if HAVE_MERGESORT
-    mergesort (array, playlist->count[iter], sizeof (playItem_t *), qsort_cmp_func);
-#else
-    qsort (array, playlist->count[iter], sizeof (playItem_t *), qsort_cmp_func);
-#endif
+    pl_sort_items (array, playlist->count[iter]);
     playItem_t *prev = NULL;
     playlist->head[iter] = 0;
     for (idx = 0; idx < playlist->count[iter]; idx++) {
@@ -285,6 +356,10 @@ plt_sort_internal (playlist_t *playlist, int iter, int id, const char *format, i
 
     free (array);
 
+    if (iter == PL_MAIN) {
+        plt_shuffle_rebuild (playlist);
+    }
+
     if (track_under_cursor) {
         cursor = plt_get_item_idx (playlist, track_under_cursor, PL_MAIN);
         plt_set_cursor (playlist, PL_MAIN, cursor);
@@ -346,11 +421,7 @@ sort_track_array (playlist_t *playlist, playItem_t **tracks, int num_tracks, con
         pl_sort_is_track = 0;
     }
 
-#if HAVE_MERGESORT
-    mergesort (tracks, num_tracks, sizeof (playItem_t *), qsort_cmp_func);
-#else
-    qsort (tracks, num_tracks, sizeof (playItem_t *), qsort_cmp_func);
-#endif
+    pl_sort_items (tracks, num_tracks);
 
     tf_free (pl_sort_tf_bytecode);
     pl_sort_tf_bytecode = NULL;
@@ -36,6 +36,7 @@
 #include <errno.h>
 #include "threading.h"
 #include "playlist.h"
+#include "plshuffle.h"
 #include "plmeta.h"
 #include "common.h"
 #include "shared/ctmap.h"
@@ -53,6 +54,7 @@
 #include "strdupa.h"
 #include "playqueue.h"
 #include "streamreader.h"
+#include "pcmcache.h"
 #include "decodedblock.h"
 #include "dsp.h"
 #include "playmodes.h"
@@ -91,6 +93,7 @@ static int conf_streamer_samplerate_mult_48 = 48000;
 static int conf_streamer_samplerate_mult_44 = 44100;
 static float conf_format_silence = -1.f;
 static float conf_playback_buffer_size = 0.3f;
+static float conf_prefetch_time = 5.f;
 
 static int trace_bufferfill = 0;
 
@@ -123,6 +126,7 @@ static playItem_t *last_played; // this is the last track that was played, shoul
 
 static ddb_waveformat_t prev_output_format; // last format that was sent to output via streamer_set_output_format
 static ddb_waveformat_t last_block_fmt; // input file format corresponding to the current output
+static unsigned stream_generation; // incremented when the queued blocks are dropped
 
 static DB_fileinfo_t *fileinfo_curr;
 static uint64_t fileinfo_file_identifier;
@@ -144,6 +148,7 @@ static DB_vfs_t *streamer_file_vfs;
 static char *_int_output_buffer;
 static ringbuf_t _output_ringbuf;
 
+static resizable_buffer_t _dsp_input_buffer;
 static resizable_buffer_t _dsp_process_buffer;
 static resizable_buffer_t _viz_read_buffer;
 
@@ -198,6 +203,15 @@ _handle_playback_stopped (void);
 static void
 _streamer_mark_album_played_up_to (playItem_t *item);
 
+static void
+_dsp_stage_init (void);
+
+static void
+_dsp_stage_free (void);
+
+static void
+_dsp_stage_wake (void);
+
 static void
 streamer_abort_files (void) {
     streamer_lock ();
@@ -541,7 +555,7 @@ get_random_track (void) {
         return NULL;
     }
     int curr = str_get_idx_of (streaming_track);
-    int r = (int)(rand () / (double)RAND_MAX * cnt);
+    int r = (int)(pl_shuffle_random () / ((double)INT32_MAX + 1) * cnt);
     if (r == curr) {
         r++;
         if (r >= cnt) {
@@ -597,16 +611,7 @@ get_next_track (playItem_t *curr, ddb_shuffle_t shuffle, ddb_repeat_t repeat) {
         playItem_t *it = NULL;
         if (!curr || shuffle == DDB_SHUFFLE_TRACKS) {
             // find minimal notplayed
-            playItem_t *pmin = NULL; // notplayed minimum
-            for (playItem_t *i = plt->head[PL_MAIN]; i; i = i->next[PL_MAIN]) {
-                if (pl_get_played (i)) {
-                    continue;
-                }
-                if (!pmin || pl_get_shufflerating(i) < pl_get_shufflerating(pmin)) {
-                    pmin = i;
-                }
-            }
-            it = pmin;
+            it = plt_shuffle_first (plt, INT32_MIN, 0);
             if (!it) {
                 // all songs played, reshuffle and try again
                 if (repeat == DDB_REPEAT_ALL) { // loop
@@ -620,17 +625,7 @@ get_next_track (playItem_t *curr, ddb_shuffle_t shuffle, ddb_repeat_t repeat) {
         }
         else {
             // find minimal notplayed above current
-            int rating = pl_get_shufflerating(curr);
-            playItem_t *pmin = NULL; // notplayed minimum
-            for (playItem_t *i = plt->head[PL_MAIN]; i; i = i->next[PL_MAIN]) {
-                if (pl_get_played(i) || pl_get_shufflerating (i) < rating) {
-                    continue;
-                }
-                if (!pmin || pl_get_shufflerating (i) < pl_get_shufflerating (pmin)) {
-                    pmin = i;
-                }
-            }
-            it = pmin;
+            it = plt_shuffle_first (plt, curr->shufflerating, 0);
             if (!it) {
                 // all songs played, reshuffle and try again
                 if (repeat == DDB_REPEAT_ALL) { // loop
@@ -694,6 +689,93 @@ get_next_track (playItem_t *curr, ddb_shuffle_t shuffle, ddb_repeat_t repeat) {
     return NULL;
 }
 
+// The playlist based prediction of peek_next_track, which is requested for every streamed block,
+// and is only recomputed when the track, the playlist or the playback order changes.
+// A stale prediction only makes the prefetch miss.
+static playItem_t *peek_curr;
+static playItem_t *peek_next;
+static playlist_t *peek_plt; // not referenced, only compared
+static int peek_modification_idx;
+static ddb_shuffle_t peek_shuffle;
+static ddb_repeat_t peek_repeat;
+
+// must be called with pl_lock held
+static void
+peek_reset (void) {
+    if (peek_curr) {
+        pl_item_unref (peek_curr);
+        peek_curr = NULL;
+    }
+    if (peek_next) {
+        pl_item_unref (peek_next);
+        peek_next = NULL;
+    }
+    peek_plt = NULL;
+}
+
+static playItem_t *
+peek_next_in_playlist (playlist_t *plt, playItem_t *curr, ddb_shuffle_t shuffle, ddb_repeat_t repeat) {
+    playItem_t *it = NULL;
+    if (!plt->head[PL_MAIN] || plt_get_item_idx (plt, curr, PL_MAIN) == -1) {
+        it = NULL;
+    }
+    else if (shuffle == DDB_SHUFFLE_TRACKS || shuffle == DDB_SHUFFLE_ALBUMS) {
+        it = plt_shuffle_first (plt, shuffle == DDB_SHUFFLE_TRACKS ? INT32_MIN : curr->shufflerating, 0);
+        if (it == curr) {
+            it = NULL;
+        }
+    }
+    else if (shuffle == DDB_SHUFFLE_OFF) {
+        it = curr->next[PL_MAIN];
+        if (!it && repeat == DDB_REPEAT_ALL) {
+            it = plt->head[PL_MAIN];
+        }
+    }
+    return it;
+}
+
+// Same as get_next_track, but without side effects (no playqueue changes, no reshuffling),
+// returns NULL if the next track can't be predicted.
+static playItem_t *
+peek_next_track (playItem_t *curr, ddb_shuffle_t shuffle, ddb_repeat_t repeat) {
+    pl_lock ();
+
+    playItem_t *it = NULL;
+    playlist_t *plt = streamer_playlist;
+
+    if (next_track_to_play != NULL) {
+        it = next_track_to_play;
+    }
+    else if (playqueue_getcount ()) {
+        it = playqueue_getnext ();
+        pl_unlock ();
+        return it;
+    }
+    else if (plt && curr) {
+        if (peek_curr != curr || peek_plt != plt || peek_modification_idx != plt->modification_idx
+            || peek_shuffle != shuffle || peek_repeat != repeat) {
+            peek_reset ();
+            peek_curr = curr;
+            pl_item_ref (peek_curr);
+            peek_next = peek_next_in_playlist (plt, curr, shuffle, repeat);
+            if (peek_next) {
+                pl_item_ref (peek_next);
+            }
+            peek_plt = plt;
+            peek_modification_idx = plt->modification_idx;
+            peek_shuffle = shuffle;
+            peek_repeat = repeat;
+        }
+        it = peek_next;
+    }
+
+    if (it) {
+        pl_item_ref (it);
+    }
+    pl_unlock ();
+    return it;
+}
+
 static playItem_t *
 get_prev_track (playItem_t *curr, ddb_shuffle_t shuffle, ddb_repeat_t repeat) {
     pl_lock ();
@@ -730,21 +812,15 @@ get_prev_track (playItem_t *curr, ddb_shuffle_t shuffle, ddb_repeat_t repeat) {
         }
         else {
             pl_set_played(curr, 0);
-            // find already played song with maximum shuffle rating below prev song
-            int rating = pl_get_shufflerating(curr);
-            playItem_t *pmax = NULL; // played maximum
-            playItem_t *amax = NULL; // absolute maximum
-            for (playItem_t *i = plt->head[PL_MAIN]; i; i = i->next[PL_MAIN]) {
-                int played = pl_get_played(i);
-                if (i != curr && played && (!amax || pl_get_shufflerating (i) > pl_get_shufflerating (amax))) {
-                    amax = i;
-                }
-                if (i == curr || pl_get_shufflerating (i) > rating || !played) {
-                    continue;
-                }
-                if (!pmax || pl_get_shufflerating (i) > pl_get_shufflerating (pmax)) {
-                    pmax = i;
-                }
+            // find already played song with maximum shuffle rating below prev song,
+            // the first one of the tracks with equal rating
+            playItem_t *pmax = plt_shuffle_last (plt, curr->shufflerating, 1); // played maximum
+            if (pmax) {
+                pmax = plt_shuffle_first (plt, pmax->shufflerating, 1);
+            }
+            playItem_t *amax = plt_shuffle_last (plt, INT32_MAX, 1); // absolute maximum
+            if (amax) {
+                amax = plt_shuffle_first (plt, amax->shufflerating, 1);
             }
 
             if (pmax && shuffle == DDB_SHUFFLE_ALBUMS) {
@@ -974,8 +1050,240 @@ fileinfo_free (DB_fileinfo_t *fileinfo) {
     }
 }
 
+// Next track prefetch.
+// When the streaming track gets close to its end, the decoder of the next track is opened on a separate thread,
+// and, if the PCM cache is enabled, the first blocks are decoded into it.
+// Remote tracks are not prefetched, since opening them can block for the network timeout,
+// which would also block stream_track and the shutdown waiting for the prefetch.
+// stream_track picks up the prepared fileinfo, and waits for it if it's still being opened.
+// The prefetch is re-evaluated on every block, so that a stale one gets cancelled
+// when the playlist or the playback order changes.
+
+#define PREFETCH_DECODE_SIZE (16384 * 8)
+
+typedef enum {
+    PREFETCH_IDLE,
+    PREFETCH_PENDING,
+    PREFETCH_RUNNING,
+    PREFETCH_DONE,
+} prefetch_state_t;
+
+static uintptr_t prefetch_mutex;
+static uintptr_t prefetch_cond;
+static intptr_t prefetch_tid;
+static int prefetch_terminate;
+static prefetch_state_t prefetch_state;
+static int prefetch_cancelled;
+static playItem_t *prefetch_track;
+static DB_decoder_t *prefetch_decoder;
+static DB_fileinfo_t *prefetch_fileinfo;
+
+// must be called with prefetch_mutex locked
+static void
+prefetch_reset (void) {
+    if (prefetch_fileinfo) {
+        fileinfo_free (prefetch_fileinfo);
+        prefetch_fileinfo = NULL;
+    }
+    if (prefetch_track) {
+        pl_item_unref (prefetch_track);
+        prefetch_track = NULL;
+    }
+    prefetch_decoder = NULL;
+    prefetch_cancelled = 0;
+    prefetch_state = PREFETCH_IDLE;
+}
+
+static DB_fileinfo_t *
+prefetch_open (DB_decoder_t *dec, playItem_t *it) {
+    DB_fileinfo_t *fileinfo = pcmcache_open_cached (dec, STREAMER_HINTS, it);
+    if (fileinfo) {
+        return fileinfo;
+    }
+
+    fileinfo = dec_open (dec, STREAMER_HINTS, it);
+    if (!fileinfo) {
+        return NULL;
+    }
+    if (dec->init (fileinfo, DB_PLAYITEM (it)) != 0) {
+        dec->free (fileinfo);
+        return NULL;
+    }
+
+    DB_fileinfo_t *cached = pcmcache_wrap (dec, STREAMER_HINTS, it, fileinfo);
+    if (cached != fileinfo) {
+        // decode the beginning into the cache, and rewind:
+        // the cached part is served first, then the decoder continues from where it stopped
+        char *buffer = malloc (PREFETCH_DECODE_SIZE);
+        if (buffer) {
+            cached->plugin->read (cached, buffer, PREFETCH_DECODE_SIZE);
+            free (buffer);
+        }
+        cached->plugin->seek_sample (cached, 0);
+    }
+    return cached;
+}
+
+static void
+prefetch_thread (void *unused) {
+#if defined(__linux__) && !defined(ANDROID)
+    prctl (PR_SET_NAME, "deadbeef-prefetch", 0, 0, 0, 0);
+#endif
+    mutex_lock (prefetch_mutex);
+    for (;;) {
+        while (!prefetch_terminate && prefetch_state != PREFETCH_PENDING) {
+            cond_wait (prefetch_cond, prefetch_mutex);
+        }
+        if (prefetch_terminate) {
+            break;
+        }
+        prefetch_state = PREFETCH_RUNNING;
+        playItem_t *it = prefetch_track;
+        DB_decoder_t *dec = prefetch_decoder;
+        mutex_unlock (prefetch_mutex);
+
+        trace ("prefetching %s\n", pl_find_meta (it, ":URI"));
+        DB_fileinfo_t *fileinfo = prefetch_open (dec, it);
+
+        mutex_lock (prefetch_mutex);
+        prefetch_fileinfo = fileinfo;
+        prefetch_state = PREFETCH_DONE;
+        if (prefetch_cancelled) {
+            prefetch_reset ();
+        }
+        cond_broadcast (prefetch_cond);
+    }
+    mutex_unlock (prefetch_mutex);
+}
+
+static void
+prefetch_cancel (void) {
+    mutex_lock (prefetch_mutex);
+    if (prefetch_state == PREFETCH_RUNNING) {
+        // the thread will release the result
+        prefetch_cancelled = 1;
+    }
+    else {
+        prefetch_reset ();
+    }
+    mutex_unlock (prefetch_mutex);
+}
+
+// Returns the prepared fileinfo, if the prefetch was done for the track and decoder,
+// otherwise cancels the prefetch and returns NULL.
+static DB_fileinfo_t *
+prefetch_take (playItem_t *it, DB_decoder_t *dec) {
+    DB_fileinfo_t *fileinfo = NULL;
+    mutex_lock (prefetch_mutex);
+    if (prefetch_track == it && prefetch_decoder == dec && !prefetch_cancelled) {
+        while (prefetch_state == PREFETCH_RUNNING) {
+            cond_wait (prefetch_cond, prefetch_mutex);
+        }
+        if (prefetch_track == it && prefetch_state == PREFETCH_DONE) {
+            fileinfo = prefetch_fileinfo;
+            prefetch_fileinfo = NULL;
+        }
+    }
+    mutex_unlock (prefetch_mutex);
+    prefetch_cancel ();
+    return fileinfo;
+}
+
+// Starts the prefetch of the track which follows the streaming track,
+// when the end of the streaming track is close enough.
+static void
+prefetch_update (ddb_shuffle_t shuffle, ddb_repeat_t repeat) {
+    if (conf_prefetch_time <= 0 || !streaming_track || !fileinfo_curr || stop_after_current) {
+        return;
+    }
+    float dur = pl_get_item_duration (streaming_track);
+    if (dur <= 0 || dur - fileinfo_curr->readpos > conf_prefetch_time) {
+        return;
+    }
+
+    playItem_t *next;
+    if (repeat == DDB_REPEAT_SINGLE) {
+        next = streaming_track;
+        pl_item_ref (next);
+    }
+    else {
+        next = peek_next_track (streaming_track, shuffle, repeat);
+    }
+
+    mutex_lock (prefetch_mutex);
+    int same = prefetch_state != PREFETCH_IDLE && prefetch_track == next && !prefetch_cancelled;
+    mutex_unlock (prefetch_mutex);
+
+    if (same) {
+        pl_item_unref (next);
+        return;
+    }
+
+    prefetch_cancel ();
+
+    if (!next) {
+        return;
+    }
+
+    DB_decoder_t *dec = NULL;
+    if (pl_get_item_duration (next) > 0 && !is_remote_stream (next) && !stop_after_album_check (streaming_track, next)) {
+        pl_lock ();
+        const char *dec_id = pl_find_meta (next, ":DECODER");
+        if (dec_id) {
+            dec = plug_get_decoder_for_id (dec_id);
+        }
+        pl_unlock ();
+    }
+
+    mutex_lock (prefetch_mutex);
+    if (dec && prefetch_state == PREFETCH_IDLE) {
+        prefetch_track = next;
+        pl_item_ref (next);
+        prefetch_decoder = dec;
+        prefetch_state = PREFETCH_PENDING;
+        cond_broadcast (prefetch_cond);
+    }
+    mutex_unlock (prefetch_mutex);
+
+    pl_item_unref (next);
+}
+
+static void
+prefetch_init (void) {
+    prefetch_mutex = mutex_create ();
+    prefetch_cond = cond_create ();
+    prefetch_terminate = 0;
+    prefetch_tid = thread_start (prefetch_thread, NULL);
+}
+
+static void
+prefetch_free (void) {
+    mutex_lock (prefetch_mutex);
+    prefetch_terminate = 1;
+    cond_broadcast (prefetch_cond);
+    mutex_unlock (prefetch_mutex);
+    thread_join (prefetch_tid);
+    prefetch_tid = 0;
+
+    prefetch_reset ();
+    pl_lock ();
+    peek_reset ();
+    pl_unlock ();
+    cond_free (prefetch_cond);
+    prefetch_cond = 0;
+    mutex_free (prefetch_mutex);
+    prefetch_mutex = 0;
+}
+
 static int
 stream_track (playItem_t *it, int startpaused) {
+    mutex_lock (prefetch_mutex);
+    int prefetched = it && prefetch_track == it;
+    mutex_unlock (prefetch_mutex);
+    if (!prefetched) {
+        prefetch_cancel ();
+    }
+
     streamer_lock();
     if (fileinfo_curr) {
         fileinfo_free (fileinfo_curr);
@@ -1316,6 +1624,28 @@ m3u_error:
             goto error;
         }
 
+        // opened by the prefetch, or the beginning of the track is cached
+        DB_fileinfo_t *ready_fileinfo = prefetch_take (it, dec);
+        if (!ready_fileinfo) {
+            ready_fileinfo = pcmcache_open_cached (dec, STREAMER_HINTS, it);
+        }
+        if (ready_fileinfo) {
+            trace ("\033[0;33mdecoder for %s is ready\033[37;0m\n", pl_find_meta (it, ":URI"));
+            streamer_lock();
+            new_fileinfo = ready_fileinfo;
+            if (new_fileinfo->file) {
+                new_fileinfo_file_vfs = new_fileinfo->file->vfs;
+                new_fileinfo_file_identifier = vfs_get_identifier (new_fileinfo->file);
+            }
+            else {
+                new_fileinfo_file_vfs = NULL;
+                new_fileinfo_file_identifier = 0;
+            }
+            streamer_set_streaming_track (it);
+            streamer_unlock();
+            break;
+        }
+
         trace ("\033[0;33minit decoder for %s (%s)\033[37;0m\n", pl_find_meta (it, ":URI"), dec->plugin.id);
         streamer_lock();
         new_fileinfo = dec_open (dec, STREAMER_HINTS, it);
@@ -1347,6 +1677,7 @@ m3u_error:
         }
         else {
             streamer_lock();
+            new_fileinfo = pcmcache_wrap (dec, STREAMER_HINTS, it, new_fileinfo);
             if (new_fileinfo->file) {
                 new_fileinfo_file_vfs = new_fileinfo->file->vfs;
                 new_fileinfo_file_identifier = vfs_get_identifier (new_fileinfo->file);
@@ -1623,11 +1954,13 @@ streamer_set_output_format (ddb_waveformat_t *fmt) {
 
 static void
 _streamer_requeue_after_current (ddb_repeat_t repeat, ddb_shuffle_t shuffle) {
+    prefetch_cancel ();
     if (!playing_track) {
         return;
     }
     streamer_lock ();
     streamreader_flush_after (playing_track);
+    stream_generation++;
 
     if (playing_track == streaming_track) {
         streamer_unlock ();
@@ -1797,6 +2130,11 @@ streamer_thread (void *unused) {
             streamreader_enqueue_block (block);
             last = block->last;
             streamer_unlock ();
+            _dsp_stage_wake ();
+        }
+
+        if (res >= 0 && !last) {
+            prefetch_update (shuffle, repeat);
         }
 
         if (res < 0 || last) {
@@ -1867,8 +2205,11 @@ streamer_init (void) {
 
     streamreader_init ();
     decoded_blocks_init ();
+    pcmcache_init ();
+    prefetch_init ();
 
     streamer_dsp_init ();
+    _dsp_stage_init ();
 
     ctmap_init_mutex ();
     conf_get_str ("network.ctmapping", DDB_DEFAULT_CTMAPPING, conf_network_ctmapping, sizeof (conf_network_ctmapping));
@@ -1889,9 +2230,12 @@ streamer_free (void) {
     streamer_abort_files ();
     streaming_terminate = 1;
     thread_join (streamer_tid);
+    prefetch_free ();
+    _dsp_stage_free ();
 
     streamreader_free ();
     decoded_blocks_free ();
+    pcmcache_free ();
 
     if (first_failed_track) {
         pl_item_unref (first_failed_track);
@@ -1930,6 +2274,7 @@ streamer_free (void) {
     free (_int_output_buffer);
     _int_output_buffer = NULL;
 
+    resizable_buffer_deinit(&_dsp_input_buffer);
     resizable_buffer_deinit(&_dsp_process_buffer);
     resizable_buffer_deinit(&_viz_read_buffer);
 }
@@ -1943,6 +2288,7 @@ streamer_reset (int full) { // must be called when current song changes by exter
 
     streamer_lock();
     streamreader_reset ();
+    stream_generation++;
     decoded_blocks_reset();
     dsp_reset ();
     ringbuf_flush(&_output_ringbuf);
@@ -1950,65 +2296,74 @@ streamer_reset (int full) { // must be called when current song changes by exter
     viz_reset ();
 }
 
-static int
-process_output_block (streamblock_t *block, char *bytes, int bytes_available_size) {
-    DB_output_t *output = plug_get_output ();
-
-    if (block->pos < 0) {
-        return 0;
-    }
-
-    // A block with 0 size is a valid block, and needs to be processed as usual (code above this line).
-    // But here we do early exit, because there's no data to process in it.
-    if (!block->size) {
-        decoded_block_t *decoded_block = decoded_blocks_append();
-        if (decoded_block != NULL) {
-            decoded_block->track = block->track;
-            if (decoded_block->track != NULL) {
-                pl_item_ref (decoded_block->track);
-            }
-            decoded_block->last = block->last;
-            decoded_block->first = block->first;
-        }
+// @return latency buffer size
+static size_t
+_output_ringbuf_setup(const ddb_waveformat_t *fmt) {
+    // Need to be able to upsample from 8000 mono to the current format.
+    // Add some padding to allow multiple blocks to be decoded.
+    // FIXME: this could be improved by walking the current dsp chain, and calculating the real ratio.
+    size_t size = (size_t)(16384 * 1.5 * MAX_DSP_RATIO);
+    size_t latency = 0;
+#ifdef __APPLE__
+    // add 3 seconds of history for airplay latency / visualization compensation
+    latency = 3 * fmt->channels * fmt->samplerate * fmt->bps / 8;
+#endif
+    size += latency;
 
-        streamreader_next_block ();
-        _update_buffering_state ();
-        return 0;
+    if (size != _output_ringbuf.size) {
+        free (_int_output_buffer);
+        _int_output_buffer = malloc (size);
+        ringbuf_init(&_output_ringbuf, _int_output_buffer, size);
     }
 
-    decoded_block_t *decoded_block = decoded_blocks_append();
-    if (decoded_block == NULL) {
-        return 0; // queue is full!
-    }
+    return latency;
+}
 
-    assert (block->size > block->pos);
-    int sz = block->size - block->pos;
+// DSP stage.
+// The decoded blocks are passed through the DSP chain, and converted to the output format on a separate thread,
+// which writes the result to the output ring buffer.
+// This way the decoder, the DSP chain and the output can run in parallel,
+// while the amount of the processed data is still limited by the playback buffer size.
+// The block data is copied out, and processed without holding the streamer lock,
+// the result is dropped if the blocks were flushed, or the output format has changed in the meantime.
+// streamer_read processes the blocks by itself only when the ring buffer is running out of data.
+
+static uintptr_t _dsp_fill_mutex; // serializes the block processing
+static uintptr_t _dsp_stage_mutex;
+static uintptr_t _dsp_stage_cond;
+static intptr_t _dsp_stage_tid;
+static int _dsp_stage_signalled;
+static int _dsp_stage_terminate;
+
+// Apply DSP and convert the data to the output format, into _dsp_process_buffer.
+// Must be called with dsp_lock held.
+// @return the size of the output data
+static int
+_process_block_data (ddb_waveformat_t *fmt, char *input, int sz, const ddb_waveformat_t *outfmt, float *dspratio) {
+    char *bytes = _dsp_process_buffer.buffer;
 
     ddb_waveformat_t datafmt; // comes either from dsp, or from input plugin
-    memcpy (&datafmt, &block->fmt, sizeof (ddb_waveformat_t));
+    memcpy (&datafmt, fmt, sizeof (ddb_waveformat_t));
 
     char *dspbytes = NULL;
     int dspsize = 0;
-    float dspratio = 1;
-
 
 #if defined(ANDROID) || defined(HAVE_XGUI)
     // android EQ and resampling require 16 bit, so convert here if needed
-    int tempsize = sz * 16 / block->fmt.bps;
+    int tempsize = sz * 16 / fmt->bps;
     int16_t *temp_audio_data = NULL;
-    char *input = block->buf + block->pos;
-    if (block->fmt.bps != 16) {
+    if (fmt->bps != 16) {
         temp_audio_data = alloca (tempsize);
         ddb_waveformat_t out_fmt = {
             .bps = 16,
-            .channels = block->fmt.channels,
-            .samplerate = block->fmt.samplerate,
-            .channelmask = block->fmt.channelmask,
+            .channels = fmt->channels,
+            .samplerate = fmt->samplerate,
+            .channelmask = fmt->channelmask,
             .is_float = 0,
             .is_bigendian = 0
         };
 
-        pcm_convert (&block->fmt, (char *)input, &out_fmt, (char *)temp_audio_data, sz);
+        pcm_convert (fmt, (char *)input, &out_fmt, (char *)temp_audio_data, sz);
         input = (char *)temp_audio_data;
         memcpy (&datafmt, &out_fmt, sizeof (ddb_waveformat_t));
         sz = tempsize;
@@ -2017,26 +2372,26 @@ process_output_block (streamblock_t *block, char *bytes, int bytes_available_siz
     extern void android_eq_apply (char *dspbytes, int dspsize);
     android_eq_apply (input, sz);
 
-    dsp_apply_simple_downsampler(datafmt.samplerate, datafmt.channels, input, sz, output->fmt.samplerate, &dspbytes, &dspsize);
-    datafmt.samplerate = output->fmt.samplerate;
+    dsp_apply_simple_downsampler(datafmt.samplerate, datafmt.channels, input, sz, outfmt->samplerate, &dspbytes, &dspsize);
+    datafmt.samplerate = outfmt->samplerate;
     sz = dspsize;
 #else
-    int dsp_res = dsp_apply (&block->fmt, block->buf + block->pos, sz,
-                             &datafmt, &dspbytes, &dspsize, &dspratio);
+    int dsp_res = dsp_apply (fmt, input, sz,
+                             &datafmt, &dspbytes, &dspsize, dspratio);
     if (dsp_res) {
         sz = dspsize;
     }
     else {
-        memcpy (&datafmt, &block->fmt, sizeof (ddb_waveformat_t));
-        dspbytes = block->buf+block->pos;
+        memcpy (&datafmt, fmt, sizeof (ddb_waveformat_t));
+        dspbytes = input;
     }
 #endif
 
-    int need_convert = memcmp (&output->fmt, &datafmt, sizeof (ddb_waveformat_t));
+    int need_convert = memcmp (outfmt, &datafmt, sizeof (ddb_waveformat_t));
     int required_size = 0;
     if (need_convert) {
         int input_ss = datafmt.channels * datafmt.bps/8;
-        int output_ss = output->fmt.channels * output->fmt.bps/8;
+        int output_ss = outfmt->channels * outfmt->bps/8;
         required_size = sz / input_ss * output_ss;
     }
     else {
@@ -2044,35 +2399,198 @@ process_output_block (streamblock_t *block, char *bytes, int bytes_available_siz
     }
 
     // Crash here to catch the buffer issues early, instead of corrupting sound.
-    assert(bytes_available_size >= required_size);
+    assert(_dsp_process_buffer.size >= required_size);
 
     if (need_convert) {
-        sz = pcm_convert (&datafmt, dspbytes, &output->fmt, bytes, sz);
+        sz = pcm_convert (&datafmt, dspbytes, outfmt, bytes, sz);
     }
     else {
         memcpy (bytes, dspbytes, sz);
     }
 
-    streamer_lock();
-    decoded_block->track = block->track;
-    if (decoded_block->track != NULL) {
-        pl_item_ref (decoded_block->track);
-    }
-    decoded_block->last = block->last;
-    decoded_block->first = block->first;
-    decoded_block->total_bytes = decoded_block->remaining_bytes = sz;
-    decoded_block->is_silent_header = block->is_silent_header;
-    decoded_block->playback_time = (float)sz/output->fmt.samplerate/((output->fmt.bps>>3)*output->fmt.channels) * dspratio;
-
-    block->pos = block->size;
-    streamreader_next_block ();
-    streamer_unlock();
+    return sz;
+}
+
+static void
+_update_avg_bitrate (int block_bitrate) {
+    if (avg_bitrate == -1) {
+        avg_bitrate = block_bitrate;
+    }
+    else {
+        if (avg_bitrate < block_bitrate) {
+            avg_bitrate += 5;
+            if (avg_bitrate > block_bitrate) {
+                avg_bitrate = block_bitrate;
+            }
+        }
+        else if (avg_bitrate > block_bitrate) {
+            avg_bitrate -= 5;
+            if (avg_bitrate < block_bitrate) {
+                avg_bitrate = block_bitrate;
+            }
+        }
+    }
+    //        printf ("apx bitrate: %d (last %d)\n", avg_bitrate, last_bitrate);
+}
 
-    _update_buffering_state ();
+// Process the queued blocks into the output ring buffer, until the buffer is full, or until the next format change.
+static void
+_streamer_process_blocks (void) {
+    DB_output_t *output = plug_get_output ();
+    if (!output) {
+        return;
+    }
+    int block_bitrate = -1;
 
-    return sz;
+    mutex_lock (_dsp_fill_mutex);
+    for (;;) {
+        streamer_lock ();
+        streamblock_t *block = streamreader_get_curr_block();
+        size_t latency = _output_ringbuf_setup(&output->fmt);
+
+        if (block == NULL
+            || block->pos < 0
+            || !decoded_blocks_have_free()
+            || decoded_blocks_playback_time_total() >= conf_playback_buffer_size
+            || (_output_ringbuf.size - _output_ringbuf.remaining - latency) < block->size * MAX_DSP_RATIO
+            || memcmp (&block->fmt, &last_block_fmt, sizeof (ddb_waveformat_t))) {
+            break;
+        }
+
+        // A block with 0 size is a valid block, and needs to be passed to the output as usual,
+        // but there's no data to process in it.
+        if (!block->size) {
+            decoded_block_t *decoded_block = decoded_blocks_append();
+            decoded_block->track = block->track;
+            if (decoded_block->track != NULL) {
+                pl_item_ref (decoded_block->track);
+            }
+            decoded_block->last = block->last;
+            decoded_block->first = block->first;
+
+            streamreader_next_block ();
+            streamer_unlock ();
+            _update_buffering_state ();
+            continue;
+        }
+
+        unsigned generation = stream_generation;
+        ddb_waveformat_t fmt, outfmt;
+        memcpy (&fmt, &block->fmt, sizeof (ddb_waveformat_t));
+        memcpy (&outfmt, &output->fmt, sizeof (ddb_waveformat_t));
+
+        assert (block->size > block->pos);
+        int sz = block->size - block->pos;
+        resizable_buffer_ensure_size(&_dsp_input_buffer, sz);
+        memcpy (_dsp_input_buffer.buffer, block->buf + block->pos, sz);
+        resizable_buffer_ensure_size(&_dsp_process_buffer, block->size * MAX_DSP_RATIO);
+
+        dsp_lock ();
+        streamer_unlock ();
+
+        float dspratio = 1;
+        sz = _process_block_data (&fmt, _dsp_input_buffer.buffer, sz, &outfmt, &dspratio);
+
+        dsp_unlock ();
+        streamer_lock ();
+
+        if (generation != stream_generation
+            || block != streamreader_get_curr_block()
+            || memcmp (&fmt, &last_block_fmt, sizeof (ddb_waveformat_t))
+            || memcmp (&outfmt, &output->fmt, sizeof (ddb_waveformat_t))) {
+            // flushed or reconfigured while processing
+            streamer_unlock ();
+            continue;
+        }
+
+        decoded_block_t *decoded_block = decoded_blocks_append();
+        decoded_block->track = block->track;
+        if (decoded_block->track != NULL) {
+            pl_item_ref (decoded_block->track);
+        }
+        decoded_block->last = block->last;
+        decoded_block->first = block->first;
+        decoded_block->total_bytes = decoded_block->remaining_bytes = sz;
+        decoded_block->is_silent_header = block->is_silent_header;
+        decoded_block->playback_time = (float)sz/outfmt.samplerate/((outfmt.bps>>3)*outfmt.channels) * dspratio;
+
+        if (sz > 0) {
+            ringbuf_write(&_output_ringbuf, _dsp_process_buffer.buffer, sz);
+        }
+
+        block_bitrate = block->bitrate;
+        block->pos = block->size;
+        streamreader_next_block ();
+        streamer_unlock ();
+
+        _update_buffering_state ();
+    }
+
+    // approximate bitrate
+    if (block_bitrate != -1) {
+        _update_avg_bitrate (block_bitrate);
+    }
+    streamer_unlock ();
+    mutex_unlock (_dsp_fill_mutex);
 }
 
+static void
+_dsp_stage_thread (void *unused) {
+#if defined(__linux__) && !defined(ANDROID)
+    prctl (PR_SET_NAME, "deadbeef-dsp", 0, 0, 0, 0);
+#endif
+    mutex_lock (_dsp_stage_mutex);
+    for (;;) {
+        while (!_dsp_stage_terminate && !_dsp_stage_signalled) {
+            cond_wait (_dsp_stage_cond, _dsp_stage_mutex);
+        }
+        if (_dsp_stage_terminate) {
+            break;
+        }
+        _dsp_stage_signalled = 0;
+        mutex_unlock (_dsp_stage_mutex);
+
+        _streamer_process_blocks ();
+
+        mutex_lock (_dsp_stage_mutex);
+    }
+    mutex_unlock (_dsp_stage_mutex);
+}
+
+static void
+_dsp_stage_wake (void) {
+    mutex_lock (_dsp_stage_mutex);
+    _dsp_stage_signalled = 1;
+    cond_signal (_dsp_stage_cond);
+    mutex_unlock (_dsp_stage_mutex);
+}
+
+static void
+_dsp_stage_init (void) {
+    _dsp_fill_mutex = mutex_create_nonrecursive ();
+    _dsp_stage_mutex = mutex_create_nonrecursive ();
+    _dsp_stage_cond = cond_create ();
+    _dsp_stage_signalled = 0;
+    _dsp_stage_terminate = 0;
+    _dsp_stage_tid = thread_start (_dsp_stage_thread, NULL);
+}
+
+static void
+_dsp_stage_free (void) {
+    mutex_lock (_dsp_stage_mutex);
+    _dsp_stage_terminate = 1;
+    cond_signal (_dsp_stage_cond);
+    mutex_unlock (_dsp_stage_mutex);
+    thread_join (_dsp_stage_tid);
+    _dsp_stage_tid = 0;
+
+    cond_free (_dsp_stage_cond);
+    _dsp_stage_cond = 0;
+    mutex_free (_dsp_stage_mutex);
+    _dsp_stage_mutex = 0;
+    mutex_free (_dsp_fill_mutex);
+    _dsp_fill_mutex = 0;
+}
 
 static float (*streamer_volume_modifier) (float delta_time);
 
@@ -2229,32 +2747,10 @@ _streamer_get_bytes (char *bytes, int size) {
     return sz;
 }
 
-// @return latency buffer size
-static size_t
-_output_ringbuf_setup(const ddb_waveformat_t *fmt) {
-    // Need to be able to upsample from 8000 mono to the current format.
-    // Add some padding to allow multiple blocks to be decoded.
-    // FIXME: this could be improved by walking the current dsp chain, and calculating the real ratio.
-    size_t size = (size_t)(16384 * 1.5 * MAX_DSP_RATIO);
-    size_t latency = 0;
-#ifdef __APPLE__
-    // add 3 seconds of history for airplay latency / visualization compensation
-    latency = 3 * fmt->channels * fmt->samplerate * fmt->bps / 8;
-#endif
-    size += latency;
-
-    if (size != _output_ringbuf.size) {
-        free (_int_output_buffer);
-        _int_output_buffer = malloc (size);
-        ringbuf_init(&_output_ringbuf, _int_output_buffer, size);
-    }
-
-    return latency;
-}
-
-// Decode enough blocks to fill the _output_buffer, and update avg_bitrate
+// Handle the stop and the output format changes, and get the DSP stage to fill the output ring buffer.
+// The blocks are processed right away if there's not enough data for the current read.
 static void
-_streamer_fill_playback_buffer(void) {
+_streamer_fill_playback_buffer(int size) {
     streamer_lock ();
     streamblock_t *block = streamreader_get_curr_block();
     if (!block) {
@@ -2284,60 +2780,25 @@ _streamer_fill_playback_buffer(void) {
 
     _audio_stall_count = 0;
 
-    int block_bitrate = -1;
-
-    // only decode until the next format change
-    // decode enough blocks to fill the output buffer
-    resizable_buffer_ensure_size(&_dsp_process_buffer, block->size * MAX_DSP_RATIO);
-
-    size_t latency = _output_ringbuf_setup(&plug_get_output ()->fmt);
-
-    while (block != NULL
-           && decoded_blocks_have_free()
-           && decoded_blocks_playback_time_total() < conf_playback_buffer_size
-           && (_output_ringbuf.size - _output_ringbuf.remaining - latency) >= block->size * MAX_DSP_RATIO
-           && !memcmp (&block->fmt, &last_block_fmt, sizeof (ddb_waveformat_t))) {
-        int rb = process_output_block (block, _dsp_process_buffer.buffer, block->size * MAX_DSP_RATIO);
-        if (rb <= 0) {
-            break;
-        }
-        ringbuf_write(&_output_ringbuf, _dsp_process_buffer.buffer, rb);
-
-        block_bitrate = block->bitrate;
-        block = streamreader_get_curr_block();
-    }
     // empty buffer and the next block format differs? request format change!
-
-    if (_output_ringbuf.remaining == 0 && block && memcmp (&block->fmt, &last_block_fmt, sizeof (ddb_waveformat_t))) {
+    if (_output_ringbuf.remaining == 0 && memcmp (&block->fmt, &last_block_fmt, sizeof (ddb_waveformat_t))) {
         streamer_set_output_format (&block->fmt);
         memcpy (&last_block_fmt, &block->fmt, sizeof (ddb_waveformat_t));
 
         streamer_unlock();
+        _dsp_stage_wake ();
         return;
     }
 
-    // approximate bitrate
-    if (block_bitrate != -1) {
-        if (avg_bitrate == -1) {
-            avg_bitrate = block_bitrate;
-        }
-        else {
-            if (avg_bitrate < block_bitrate) {
-                avg_bitrate += 5;
-                if (avg_bitrate > block_bitrate) {
-                    avg_bitrate = block_bitrate;
-                }
-            }
-            else if (avg_bitrate > block_bitrate) {
-                avg_bitrate -= 5;
-                if (avg_bitrate < block_bitrate) {
-                    avg_bitrate = block_bitrate;
-                }
-            }
-        }
-        //        printf ("apx bitrate: %d (last %d)\n", avg_bitrate, last_bitrate);
-    }
+    int starving = _output_ringbuf.remaining < size;
     streamer_unlock ();
+
+    if (starving) {
+        _streamer_process_blocks ();
+    }
+    else {
+        _dsp_stage_wake ();
+    }
 }
 
 int
@@ -2349,7 +2810,7 @@ streamer_read (char *bytes, int size) {
     int max_bytes = output->fmt.samplerate * ss;
 
     // Read into the output buffer
-    _streamer_fill_playback_buffer();
+    _streamer_fill_playback_buffer(size);
 
     // Process
 #ifndef ANDROID
@@ -2464,7 +2925,10 @@ streamer_configchanged (void) {
     }
     conf_playback_buffer_size = playback_buffer_size / 1000.f;
 
+    conf_prefetch_time = conf_get_float ("streamer.prefetch_time", 5.f);
+
     streamreader_configchanged ();
+    pcmcache_configchanged ();
 
     streamer_unlock ();
 }
@@ -2482,6 +2946,7 @@ _handle_playback_stopped (void) {
         pl_item_unref (trk);
     }
     streamer_play_failed (NULL);
+    prefetch_cancel ();
 }
 
 static void
@@ -2543,8 +3008,8 @@ _rebuild_shuffle_albums_after_manual_trigger(playlist_t *plt, playItem_t *it) {
     }
     else {
         // This ensures that the manually triggered item becomes first in shuffle queue.
-        // It works because shufflerating is generated using rand(), which gives only numbers in the [0..RAND_MAX] range.
-        pl_set_shufflerating (it, -1);
+        // It works because shufflerating is generated using pl_shuffle_random(), which gives only numbers in the [0..INT32_MAX] range.
+        plt_set_item_shufflerating (plt, it, -1);
     }
 }
 
@@ -136,6 +136,14 @@ streamreader_read_block (streamblock_t *block, playItem_t *track, DB_fileinfo_t
         rb = -1;
     }
 
+    // apply replaygain before taking the lock, the settings are only changed by this thread
+    if (rb > 0) {
+        int input_does_rg = fileinfo->plugin->plugin.flags & DDB_PLUGIN_FLAG_REPLAYGAIN;
+        if (!input_does_rg) {
+            replaygain_apply (&fileinfo->fmt, block->buf, rb);
+        }
+    }
+
     mutex_lock (mutex);
 
     block->bitrate = curr_block_bitrate;
@@ -155,13 +163,6 @@ streamreader_read_block (streamblock_t *block, playItem_t *track, DB_fileinfo_t
         pl_item_ref(block->track);
     }
 
-    if (size > 0) {
-        int input_does_rg = fileinfo->plugin->plugin.flags & DDB_PLUGIN_FLAG_REPLAYGAIN;
-        if (!input_does_rg) {
-            replaygain_apply (&fileinfo->fmt, block->buf, block->size);
-        }
-    }
-
     if (_firstblock) {
         block->first = 1;
         _firstblock = 0;
@@ -40,7 +40,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdint.h>
 //#include <alloca.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 #include "ctype.h"
 #include "utf8.h"
 #include "u8_lc_map.h"
@@ -786,40 +792,149 @@ utfcasestr (const char *s1, const char *s2) {
     return NULL;
 }
 
-#define min(x,y) ((x)<(y)?(x):(y))
-// s2 must be lowercase
+// Lowercases one character at p, returns the number of consumed bytes.
+// The output can be one byte longer than the input character, see U8_CASEFOLD_MAX_LEN.
+static int
+_u8_casefold_char (const char *p, const char *end, char *out, int *outlen) {
+    if ((uint8_t)*p < 0x80) {
+        *out = (*p >= 'A' && *p <= 'Z') ? *p + 0x20 : *p;
+        *outlen = 1;
+        return 1;
+    }
+    int32_t i = 0;
+    u8_nextchar (p, &i);
+    if (i > end - p) {
+        i = (int32_t)(end - p);
+    }
+    char lw[10];
+    int l = i < (int)sizeof (lw) ? u8_tolower_slow (p, i, lw) : 0;
+    if (l > 0) {
+        memcpy (out, lw, l);
+        *outlen = l;
+    }
+    else {
+        memcpy (out, p, i);
+        *outlen = i;
+    }
+    return i;
+}
+
+int
+u8_casefold (const char *in, int inlen, char *out) {
+    const char *p = in;
+    const char *end = in + inlen;
+    char *o = out;
+    while (p < end) {
+        // plain ascii runs are the common case
+        while (p < end && (uint8_t)*p < 0x80) {
+            *o++ = (*p >= 'A' && *p <= 'Z') ? *p + 0x20 : *p;
+            p++;
+        }
+        if (p < end) {
+            int l;
+            p += _u8_casefold_char (p, end, o, &l);
+            o += l;
+        }
+    }
+    return (int)(o - out);
+}
+
 const char *
-utfcasestr_fast (const char *s1, const char *s2) {
-    while (*s1) {
-        const char *p1 = s1;
-        const char *p2 = s2;
-        while (*p2 && *p1) {
-            int32_t i1 = 0;
-            int32_t i2 = 0;
-            char lw1[10];
-            u8_nextchar (p1, &i1);
-            u8_nextchar (p2, &i2);
-            int l1 = u8_tolower ((const signed char *)p1, i1, lw1);
-            if (memcmp (lw1, p2, min(i2,l1))) {
-                break;
+u8_memmem (const char *haystack, size_t hsize, const char *needle, size_t nsize) {
+    if (nsize == 0) {
+        return haystack;
+    }
+    if (nsize > hsize) {
+        return NULL;
+    }
+    const uint8_t *h = (const uint8_t *)haystack;
+    const uint8_t first = (uint8_t)needle[0];
+    const uint8_t last = (uint8_t)needle[nsize-1];
+    const size_t npos = hsize - nsize + 1; // number of possible match positions
+    size_t i = 0;
+    // compare the first and the last byte of the needle at 16 positions at once,
+    // and only check the full needle at the positions where both match
+#if defined(__SSE2__)
+    const __m128i vfirst = _mm_set1_epi8 ((char)first);
+    const __m128i vlast = _mm_set1_epi8 ((char)last);
+    for (; i + 16 <= npos; i += 16) {
+        __m128i bf = _mm_loadu_si128 ((const __m128i *)(h + i));
+        __m128i bl = _mm_loadu_si128 ((const __m128i *)(h + i + nsize - 1));
+        int mask = _mm_movemask_epi8 (_mm_and_si128 (_mm_cmpeq_epi8 (bf, vfirst), _mm_cmpeq_epi8 (bl, vlast)));
+        while (mask) {
+            int bit = __builtin_ctz (mask);
+            if (!memcmp (h + i + bit, needle, nsize)) {
+                return haystack + i + bit;
             }
-            p1 += i1;
-            p2 += i2;
+            mask &= mask - 1;
         }
-        if (*p2 == 0) {
-            return p1;
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t vfirst = vdupq_n_u8 (first);
+    const uint8x16_t vlast = vdupq_n_u8 (last);
+    for (; i + 16 <= npos; i += 16) {
+        uint8x16_t bf = vld1q_u8 (h + i);
+        uint8x16_t bl = vld1q_u8 (h + i + nsize - 1);
+        if (vmaxvq_u8 (vandq_u8 (vceqq_u8 (bf, vfirst), vceqq_u8 (bl, vlast)))) {
+            break; // the exact position is checked below
+        }
+    }
+#endif
+    for (; i < npos; i++) {
+        if (h[i] == first && h[i + nsize - 1] == last && !memcmp (h + i, needle, nsize)) {
+            return haystack + i;
         }
-        int32_t i = 0;
-        u8_nextchar (s1, &i);
-        s1 += i;
     }
     return NULL;
 }
 
+// s2 must be lowercase
+const char *
+utfcasestr_fast (const char *s1, const char *s2) {
+    int len = (int)strlen (s1);
+    char buf[1024];
+    char *folded = U8_CASEFOLD_MAX_LEN (len) <= (int)sizeof (buf) ? buf : malloc (U8_CASEFOLD_MAX_LEN (len));
+    if (!folded) {
+        return utfcasestr (s1, s2);
+    }
+    int folded_len = u8_casefold (s1, len, folded);
+
+    const char *res = NULL;
+    const char *match = u8_memmem (folded, folded_len, s2, strlen (s2));
+    if (match) {
+        // find the corresponding position in s1
+        const char *p = s1;
+        const char *end = s1 + len;
+        int pos = 0;
+        while (pos < match - folded && p < end) {
+            char lw[10];
+            int l;
+            p += _u8_casefold_char (p, end, lw, &l);
+            pos += l;
+        }
+        res = p;
+    }
+
+    if (folded != buf) {
+        free (folded);
+    }
+    return res;
+}
+
 int
 u8_strcasecmp (const char *a, const char *b) {
     const char *p1 = a, *p2 = b;
     while (*p1 && *p2) {
+        if ((uint8_t)*p1 < 0x80 && (uint8_t)*p2 < 0x80) {
+            int c1 = (*p1 >= 'A' && *p1 <= 'Z') ? *p1 + 0x20 : *p1;
+            int c2 = (*p2 >= 'A' && *p2 <= 'Z') ? *p2 + 0x20 : *p2;
+            if (c1 != c2) {
+                return c1 - c2;
+            }
+            p1++;
+            p2++;
+            continue;
+        }
         int32_t i1 = 0;
         int32_t i2 = 0;
         char s1[10], s2[10];
@@ -136,7 +136,23 @@ const char *
 utfcasestr (const char *s1, const char *s2);
 
 // s2 must be lowercase
+// returns the position of the match in s1, or NULL
 const char *
 utfcasestr_fast (const char *s1, const char *s2);
 
+// Converts inlen bytes of UTF-8 to lowercase, for case-insensitive search and comparison.
+// Zero bytes are copied as is, so that multi-value strings keep their parts.
+// The output needs up to U8_CASEFOLD_MAX_LEN(inlen) bytes, and is not NULL-terminated.
+// Returns the number of bytes written.
+int
+u8_casefold (const char *in, int inlen, char *out);
+
+// A few 2-byte characters (U+023A, U+023E) have a 3-byte lowercase form
+#define U8_CASEFOLD_MAX_LEN(len) ((len) + (len) / 2)
+
+// Finds the first occurrence of the needle in the haystack, both being case-folded.
+// Returns NULL if not found.
+const char *
+u8_memmem (const char *haystack, size_t hsize, const char *needle, size_t nsize);
+
 #endif
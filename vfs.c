@@ -66,6 +66,19 @@ can_use_file (DB_FILE *fp) {
 
 DB_FILE *
 vfs_fopen (const char *fname) {
+    return vfs_fopen2 (fname, 0);
+}
+
+static DB_FILE *
+_vfs_open (DB_vfs_t *p, const char *fname, uint32_t flags) {
+    if (flags && p->plugin.api_vminor >= 17 && p->open2) {
+        return p->open2 (fname, flags);
+    }
+    return p->open (fname);
+}
+
+DB_FILE *
+vfs_fopen2 (const char *fname, uint32_t flags) {
     trace ("vfs_open %s\n", fname);
 
     if (!can_use_filename (fname)) {
@@ -86,12 +99,12 @@ vfs_fopen (const char *fname) {
         for (n = 0; scheme_names[n]; n++) {
             size_t l = strlen (scheme_names[n]);
             if (!strncasecmp (scheme_names[n], fname, l)) {
-                return p->open (fname);
+                return _vfs_open (p, fname, flags);
             }
         }
     }
     if (fallback) {
-        return fallback->open (fname);
+        return _vfs_open (fallback, fname, flags);
     }
     return NULL;
 }
@@ -35,6 +35,7 @@ extern "C" {
 #endif
 
 DB_FILE* vfs_fopen (const char *fname);
+DB_FILE* vfs_fopen2 (const char *fname, uint32_t flags);
 void vfs_set_track (DB_FILE *stream, DB_playItem_t *it);
 void vfs_fclose (DB_FILE *f);
 size_t vfs_fread (void *ptr, size_t size, size_t nmemb, DB_FILE *stream);
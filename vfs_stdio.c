@@ -33,6 +33,11 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#ifndef __MINGW32__
+#include <sys/mman.h>
+#define USE_MMAP
+#endif
+#include "vfs_stdio.h"
 
 #ifndef __linux__
 #define off64_t off_t
@@ -44,7 +49,12 @@
 #define USE_BUFFERING
 
 #ifndef USE_STDIO
-#define BUFSIZE 1024
+// The buffer grows while the file is read sequentially, and shrinks back after a seek.
+// Files which are not opened for sequential playback (e.g. by tag readers) start small,
+// and stay within BUFSIZE_MIN.
+#define BUFSIZE_SMALL 0x1000
+#define BUFSIZE_MIN 0x10000
+#define BUFSIZE_MAX 0x100000
 #endif
 
 static DB_functions_t *deadbeef;
@@ -55,20 +65,61 @@ typedef struct {
 #else
     int stream;
     int64_t offs;
+    uint32_t flags;
 #ifdef USE_BUFFERING
-    uint8_t buffer[BUFSIZE];
-    uint8_t *bufptr;
-    int bufremaining;
+    uint8_t *buffer;
+    size_t buffer_capacity;
+    int64_t bufoffs; // file offset of buffer[0]
+    size_t buflen; // number of valid bytes in the buffer
+    size_t fillsize; // size of the next read
+    int64_t fdoffs; // file descriptor position
+#endif
+#ifdef USE_MMAP
+    const uint8_t *map;
 #endif
     int have_size;
     size_t size;
+    vfs_stdio_stats_t stats;
 #endif
 } STDIO_FILE;
 
 static DB_vfs_t plugin;
 
+#ifndef USE_STDIO
+static void
+_hint_sequential (STDIO_FILE *fp) {
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise (fp->stream, 0, 0, POSIX_FADV_SEQUENTIAL);
+    fp->stats.num_hints++;
+#elif defined(F_RDAHEAD)
+    fcntl (fp->stream, F_RDAHEAD, 1);
+    fp->stats.num_hints++;
+#endif
+}
+
+#ifdef USE_MMAP
+static void
+_try_map (STDIO_FILE *fp) {
+    struct stat st;
+    if (fstat (fp->stream, &st) != 0 || !S_ISREG (st.st_mode) || st.st_size <= 0 || (uint64_t)st.st_size > SIZE_MAX) {
+        return;
+    }
+    void *map = mmap (NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fp->stream, 0);
+    if (map == MAP_FAILED) {
+        return;
+    }
+    if (fp->flags & DDB_VFS_OPEN_SEQUENTIAL) {
+        madvise (map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    }
+    fp->map = map;
+    fp->size = (size_t)st.st_size;
+    fp->have_size = 1;
+}
+#endif
+#endif
+
 static DB_FILE *
-stdio_open (const char *fname) {
+stdio_open2 (const char *fname, uint32_t flags) {
     if (!memcmp (fname, "file://", 7)) {
         fname += 7;
     }
@@ -87,34 +138,117 @@ stdio_open (const char *fname) {
     memset (fp, 0, sizeof (STDIO_FILE));
     fp->vfs = &plugin;
     fp->stream = file;
+#ifndef USE_STDIO
+    fp->flags = flags;
+#ifdef USE_BUFFERING
+    fp->fillsize = (flags & DDB_VFS_OPEN_SEQUENTIAL) ? BUFSIZE_MIN : BUFSIZE_SMALL;
+#endif
+#ifdef USE_MMAP
+    if (flags & DDB_VFS_OPEN_MMAP) {
+        _try_map (fp);
+    }
+    if (!fp->map && (flags & DDB_VFS_OPEN_SEQUENTIAL)) {
+        _hint_sequential (fp);
+    }
+#else
+    if (flags & DDB_VFS_OPEN_SEQUENTIAL) {
+        _hint_sequential (fp);
+    }
+#endif
+#endif
     return (DB_FILE*)fp;
 }
 
+static DB_FILE *
+stdio_open (const char *fname) {
+    return stdio_open2 (fname, 0);
+}
+
 static void
 stdio_close (DB_FILE *stream) {
     assert (stream);
 #ifdef USE_STDIO
     fclose (((STDIO_FILE *)stream)->stream);
 #else
-    close (((STDIO_FILE *)stream)->stream);
+    STDIO_FILE *f = (STDIO_FILE *)stream;
+#ifdef USE_MMAP
+    if (f->map) {
+        munmap ((void *)f->map, f->size);
+    }
+#endif
+#ifdef USE_BUFFERING
+    free (f->buffer);
+#endif
+    close (f->stream);
 #endif
     free (stream);
 }
 
 #ifndef USE_STDIO
+static ssize_t
+_read_at (STDIO_FILE *f, void *ptr, size_t size, int64_t offs) {
+    if (f->fdoffs != offs) {
+        if (lseek64 (f->stream, offs, SEEK_SET) == -1) {
+            return -1;
+        }
+        f->stats.num_seeks++;
+        f->fdoffs = offs;
+    }
+    ssize_t rb = read (f->stream, ptr, size);
+    f->stats.num_reads++;
+    if (rb > 0) {
+        f->fdoffs += rb;
+        f->stats.bytes_read += rb;
+    }
+    return rb;
+}
+
 #ifdef USE_BUFFERING
-static int
+static ssize_t
 fillbuffer (STDIO_FILE *f) {
-    assert (f->bufremaining >= 0);
-    if (f->bufremaining == 0) {
-        f->bufremaining = (int)read (f->stream, f->buffer, BUFSIZE);
-        if (f->bufremaining < 0) {
-            f->bufremaining = 0;
+    int sequential = f->flags & DDB_VFS_OPEN_SEQUENTIAL;
+    if (f->buflen > 0 && f->offs == f->bufoffs + (int64_t)f->buflen) {
+        // sequential access, read more at once
+        if (f->fillsize < (sequential ? BUFSIZE_MAX : BUFSIZE_MIN)) {
+            f->fillsize *= 2;
+        }
+    }
+    else {
+        f->fillsize = sequential ? BUFSIZE_MIN : BUFSIZE_SMALL;
+    }
+
+    if (f->buffer_capacity < f->fillsize) {
+        uint8_t *buffer = malloc (f->fillsize);
+        if (buffer) {
+            free (f->buffer);
+            f->buffer = buffer;
+            f->buffer_capacity = f->fillsize;
+        }
+        else if (f->buffer) {
+            // keep reading with the existing buffer
+            f->fillsize = f->buffer_capacity;
+        }
+        else {
             return -1;
         }
-        f->bufptr = f->buffer;
     }
-    return f->bufremaining;
+
+    f->bufoffs = f->offs;
+    f->buflen = 0;
+    ssize_t rb = _read_at (f, f->buffer, f->fillsize, f->offs);
+    if (rb <= 0) {
+        return rb;
+    }
+    f->buflen = rb;
+
+#if defined(POSIX_FADV_WILLNEED)
+    // start reading the next part in the background
+    if ((f->flags & DDB_VFS_OPEN_SEQUENTIAL) && rb == (ssize_t)f->fillsize) {
+        posix_fadvise (f->stream, f->fdoffs, f->fillsize < BUFSIZE_MAX ? f->fillsize * 2 : f->fillsize, POSIX_FADV_WILLNEED);
+        f->stats.num_hints++;
+    }
+#endif
+    return rb;
 }
 #endif
 #endif
@@ -129,25 +263,53 @@ stdio_read (void *ptr, size_t size, size_t nmemb, DB_FILE *stream) {
     STDIO_FILE *f = (STDIO_FILE*)stream;
 
     size_t nb = size * nmemb;
+#ifdef USE_MMAP
+    if (f->map) {
+        if (f->offs >= (int64_t)f->size) {
+            return 0;
+        }
+        if (nb > f->size - f->offs) {
+            nb = f->size - f->offs;
+        }
+        memcpy (ptr, f->map + f->offs, nb);
+        f->offs += nb;
+        return nb / size;
+    }
+#endif
 #ifdef USE_BUFFERING
+    uint8_t *dst = ptr;
     while (nb > 0) {
+        if (f->offs >= f->bufoffs && f->offs < f->bufoffs + (int64_t)f->buflen) {
+            size_t r = f->bufoffs + f->buflen - f->offs;
+            if (r > nb) {
+                r = nb;
+            }
+            memcpy (dst, f->buffer + (f->offs - f->bufoffs), r);
+            dst += r;
+            f->offs += r;
+            nb -= r;
+            continue;
+        }
+
+        // large reads don't need to go through the buffer
+        if (nb >= BUFSIZE_MAX) {
+            ssize_t rb = _read_at (f, dst, nb, f->offs);
+            if (rb <= 0) {
+                break;
+            }
+            dst += rb;
+            f->offs += rb;
+            nb -= rb;
+            continue;
+        }
+
         if (fillbuffer (f) <= 0) {
             break;
         }
-        int r = f->bufremaining;
-        if (r > nb) {
-            r = (int)nb;
-        }
-        memcpy (ptr, f->bufptr, r);
-        f->bufremaining -= r;
-        f->bufptr += r;
-        ptr += r;
-        f->offs += r;
-        nb -= r;
     }
     size_t ret = ((size * nmemb) - nb) / size;
 #else
-    ssize_t ret = read (f->stream, ptr, nb);
+    ssize_t ret = _read_at (f, ptr, nb, f->offs);
     if (ret < 0) {
         return -1;
     }
@@ -158,26 +320,28 @@ stdio_read (void *ptr, size_t size, size_t nmemb, DB_FILE *stream) {
 #endif
 }
 
+static int64_t
+stdio_getlength (DB_FILE *stream);
+
 static int
 stdio_seek (DB_FILE *stream, int64_t offset, int whence) {
     assert (stream);
 #ifdef USE_STDIO
     return fseek (((STDIO_FILE *)stream)->stream, offset, whence);
 #else
+    STDIO_FILE *f = (STDIO_FILE *)stream;
     // convert offset to absolute
     if (whence == SEEK_CUR) {
-        whence = SEEK_SET;
-        offset = ((STDIO_FILE*)stream)->offs + offset;
+        offset = f->offs + offset;
     }
-    off64_t res = lseek64 (((STDIO_FILE *)stream)->stream, offset, whence);
-    if (res == -1) {
+    else if (whence == SEEK_END) {
+        offset = stdio_getlength (stream) + offset;
+    }
+    if (offset < 0) {
         return -1;
     }
-//    printf ("lseek res: %lld (%lld, %d, prev=%lld)\n", res, offset, whence,  ((STDIO_FILE*)stream)->offs);
-    ((STDIO_FILE*)stream)->offs = res;
-#ifdef USE_BUFFERING
-    ((STDIO_FILE*)stream)->bufremaining = 0;
-#endif
+    // the actual seek is done on the next read, if the position is not buffered
+    f->offs = offset;
 #endif
     return 0;
 }
@@ -214,18 +378,41 @@ stdio_getlength (DB_FILE *stream) {
     return l;
 #else
     if (!f->have_size) {
-        int64_t size = lseek64 (f->stream, 0, SEEK_END);
-        lseek64 (f->stream, f->offs, SEEK_SET);
-#ifdef USE_BUFFERING
-        f->bufremaining = 0;
-#endif
+        struct stat st;
+        if (fstat (f->stream, &st) != 0) {
+            return -1;
+        }
+        if (!S_ISREG (st.st_mode)) {
+            // st_size is meaningless for devices and pipes, ask the file descriptor
+            off64_t l = lseek64 (f->stream, 0, SEEK_END);
+            if (l == -1) {
+                return -1;
+            }
+            f->stats.num_seeks++;
+            // the position is restored by the next read
+            f->fdoffs = l;
+            return l;
+        }
         f->have_size = 1;
-        f->size = size;
+        f->size = st.st_size;
     }
     return f->size;
 #endif
 }
 
+int
+vfs_stdio_get_stats (DB_FILE *stream, vfs_stdio_stats_t *stats) {
+    if (stream->vfs != &plugin) {
+        return -1;
+    }
+#ifdef USE_STDIO
+    memset (stats, 0, sizeof (vfs_stdio_stats_t));
+#else
+    *stats = ((STDIO_FILE *)stream)->stats;
+#endif
+    return 0;
+}
+
 const char *
 stdio_get_content_type (DB_FILE *stream) {
     return NULL;
@@ -270,6 +457,7 @@ static DB_vfs_t plugin = {
     ,
     .plugin.website = "http://deadbeef.sf.net",
     .open = stdio_open,
+    .open2 = stdio_open2,
     .close = stdio_close,
     .read = stdio_read,
     .seek = stdio_seek,
@@ -0,0 +1,48 @@
+/*
+    DeaDBeeF -- the music player
+    Copyright (C) 2009-2023 Oleksiy Yakovenko and other contributors
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef vfs_stdio_h
+#define vfs_stdio_h
+
+#include "deadbeef.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint64_t num_reads; // read calls
+    uint64_t num_seeks; // lseek calls
+    uint64_t num_hints; // fadvise calls
+    uint64_t bytes_read;
+} vfs_stdio_stats_t;
+
+// Returns I/O statistics of a file opened by the stdio vfs, or -1 if the file was opened by another plugin.
+int
+vfs_stdio_get_stats (DB_FILE *stream, vfs_stdio_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* vfs_stdio_h */